@@ -325,27 +325,6 @@ uint32_t ADF4351_status( uint8_t mode)
 }
 
 
-/**
- *  \brief Return the GCD of two unsigned 32bit numbers
- * @param  u: first number 
- * @param  v: second number 
- * @return GCD of u and v
- */
-MEMSPACE
-uint32_t ADF4351_GCD32(uint32_t u, uint32_t v)
-{
-    if (u == 0)
-        return v;
-    if (v == 0)
-        return u;
-
-    if (u > v)
-        return ADF4351_GCD32(u % v, v);
-    else
-        return ADF4351_GCD32(u, v % u);
-}
-
-
 /**
  *  \brief Compute PFD
  * @param  REFin: Reference in frequency
@@ -416,330 +395,60 @@ void ADF4351_display_error(int error)
 
 /**
  *  \brief Calculate register values for ADF4351
+ *  ADF4351_Plan() finds the exact setting, or the closest one
  * @param  RFout: 	Required output frequency in Hz
  * @param  REFin:	Reference clock in Hz
- * @param  Spacing:	Output channel spacing in Hz
+ * @param  Spacing:	Output channel spacing in Hz, MOD no longer depends on it
  * @paramOut  RFoutCalc: Calculated actual output frequency in Hz
- * @retval 0=OK, or Error code 
+ * @retval 0=OK, ADF4351_RFout_MISMATCH when not exact, or Error code 
  *
  */
 MEMSPACE
 int ADF4351_Config(double RFout, double REFin, double ChannelSpacing, double *RFoutCalc )
 {
-
-	uint32_t	div_gcd;
-    uint32_t 	r0_INT;
-    uint32_t 	r0_FRAC;
-    uint32_t 	r1_MOD;
-	uint32_t    r1_Prescaler;
-	uint32_t	r2_R;
-    uint32_t 	r4_RFDivSel;
-	uint32_t 	r4_BandClkDiv;
-    uint32_t    RFoutDIV;	
-	double 		N;
-	uint32_t    N_min;
-
-	double 		PFD;
-    double 		BandSelectClockFrequency;
-	double      Fres;
-
-	double 		dscale;
-	uint32_t 	temp;
+	adf4351_plan_t plan;
+	int status;
 
 	*RFoutCalc = 0.0;
 
-/**
- * RFoutVCO = [r0_INT + (r0_FRAC/r1_MOD)] × (PFD)
- * RFout = [r0_INT + (r0_FRAC/r1_MOD)] × (PFD /RFoutDIV)
- *   RFout is the RF frequency output.
- *   r0_INT is the integer division factor.
- *   r0_FRAC is the numerator of the fractional division (0 to MOD − 1).
- *   r1_MOD is the preset fractional modulus (2 to 4095).
- *   RFoutDIV is the VCO output divider.
- * PFD = REFin × [(1 + REFinMUL2)/(R × (1 + REFinDIV2))]
- *   REFin is the reference frequency input.
- *   REFinMUL2 is the REFin doubler bit (0 or 1).
- *   r2_R is REFin division factor (1 to 1023).
- *   REFinDIV2 is the reference divide-by-2 bit (0 or 1).
- * Fres = ChannelSpacing * RFoutDIV
- * r1_MOD=REFin / Fres
-*/
-
 	// ==========================
-    if (RFout > ADF4351_RFOUT_MAX)
-	{
-#if ADF4351_DEBUG & 1
-		printf("RFout > %.2f\n", (double) ADF4351_RFOUT_MAX);
-#endif
-		return(ADF4351_RFout_RANGE);
-	}
-
-    if (RFout < ADF4351_RFOUT_MIN)
+	// Range check before converting to integer Hz
+    if (RFout > ADF4351_RFOUT_MAX || RFout < ADF4351_RFOUT_MIN)
 	{
 #if ADF4351_DEBUG & 1
-		printf("RFout < %.2f\n", (double) ADF4351_RFOUT_MIN);
+		printf("RFout %.2f not in %.2f .. %.2f\n", 
+			(double) RFout, (double) ADF4351_RFOUT_MIN, (double) ADF4351_RFOUT_MAX);
 #endif
 		return(ADF4351_RFout_RANGE);
 	}
 
-    if (REFin > ADF4351_REFIN_MAX)
+    if (REFin > ADF4351_REFIN_MAX || REFin < 1.0)
 	{
 #if ADF4351_DEBUG & 1
-		printf("REFin > %.2f\n", (double) ADF4351_REFIN_MAX);
+		printf("REFin %.2f not in 1 .. %.2f\n", (double) REFin, (double) ADF4351_REFIN_MAX);
 #endif
 		return(ADF4351_REFin_RANGE);
 	}
 
-	// ==========================
-    // Compute RFout divider and R4 register value
-	r4_RFDivSel = 0;
-	RFoutDIV = 1;
-	while(((RFout * RFoutDIV) < ADF4351_VCO_MIN)  && RFoutDIV < 64)
-	{
-		RFoutDIV <<= 1;
-		r4_RFDivSel++;
-	}
-
-	// Compute r1_prescale selector based on RFout
-	if(RFout > ADF4351_MAX_FREQ_45PRE)
-	{
-		r1_Prescaler = 1;
-		N_min = 75;
-	}
-	else
-	{
-		r1_Prescaler = 0;
-		N_min = 23;
-	}
-
-
-	// ==========================
-	// PFD = REFin × [(1 + REFinMUL2)/(R × (1 + REFinDIV2))]
-	//  REFin is the reference frequency input.
-	//  REFinMUL2 is the REFin doubler bit (0 or 1).
-	//  r2_R is REFin division factor (1 to 1023).
-	//  REFinDIV2 is the reference divide-by-2 bit (0 or 1).
-	r2_R = 1;
-	while(r2_R < 4096 )
-	{
-		PFD = ADF4351_PFD(REFin, r2_R);
-		if(PFD < ADF4351_PFD_MAX)
-			break;
-		r2_R++;
-	}
-
-	if(r2_R == 4096)
-	{
-#if ADF4351_DEBUG & 1
-        printf("r2_R == 4096\n");
-#endif
-        return(ADF4351_R_RANGE);
-	}
-
-	// ==========================
-	// Compute N based on R4 feedback path select
-    if (regs.r4.FeedbackVCO)
-        N = ((double)RFout * (double)RFoutDIV) / (double) PFD;
-    else
-        N = ((double)RFout / (double) PFD);
-
-	if(N < N_min || N > 65535U )
-	{
-#if ADF4351_DEBUG & 1
-		printf("N %.2f out of range\n", (double) N);
-#endif
-		return(ADF4351_N_RANGE);
-	}
-
-	// ==========================
-	// Integer
-	r0_INT = (uint32_t) N;
-
-	// r0_INt range check
-    if (r0_INT > 65535U)
-    {
-#if ADF4351_DEBUG & 1
-        printf("INT: %lu\n", (unsigned long) r0_INT);
-#endif
-		return(ADF4351_INT_RANGE);
-    }
-
-	// ==========================
-	// Modulus
-	// FIXME the AD windows driver Main_Form.cs disagrees with their own datasheet
-	// Specifically the RF output divider is not included in the calculation
-	// Datasheet:
-	// Fres is the VCO Channel Spacing
- 	//   r1_MOD=REFin/Fres
- 	//   Fres = ChannelSpacing/RFoutDIV
-	//   r1_MOD=(uint32_t) round((double) REFin / (double) Fres);
-
-	// The tested working solution found in the AD driver Main_Form.cs
-	r1_MOD=(uint32_t) round((double) PFD / (double) ChannelSpacing );
-
-	// ==========================
-	// Fractional
-	r0_FRAC = (uint32_t)round( ((double)N-(double)r0_INT)*(double) r1_MOD);
-
-	// ==========================
-	// Reduce r1_MOD and r0_FRAC by greatest common divisor
-
-	div_gcd = ADF4351_GCD32(r1_MOD, r0_FRAC);
-	r1_MOD /= div_gcd;
-	r0_FRAC /= div_gcd;
-
-	// FIXME - why is this needed ?
-	if (r1_MOD == 1)
-		r1_MOD = 2;
-
-	// ==========================
-	// r1_MOD Range check
-	if(r1_MOD == 0 || r1_MOD > 4095U) 
-	{
-#if ADF4351_DEBUG & 1
-		if(r1_MOD == 0)
-			printf("*MOD == 0\n");
-		if(r1_MOD > 4095U)
-			printf("*MOD > 4095\n");
-        printf("*MOD: %lu, INT: %lu, FRAC: %lu\n", (unsigned long) r1_MOD, (unsigned long) r0_INT, (unsigned long) r0_FRAC);
-#endif
-		return(ADF4351_MOD_RANGE);
-	}
-	
-	// ==========================
-	// r0_FRAC range check
-    if (r0_FRAC > 4095U)
-    {
-#if ADF4351_DEBUG & 1
-		if(r0_FRAC > 4095U)
-			printf("*FRAC > 4095\n");
-        printf("MOD: %lu, INT: %lu, *FRAC: %lu\n", (unsigned long) r1_MOD, (unsigned long) r0_INT, (unsigned long) r0_FRAC);
-#endif
-		return(ADF4351_FRAC_RANGE);
-    }
-
-	// ==========================
-	// Check for PFD range errors
-	if (regs.r3.BandClkMode == 0)
-    {
-		if( PFD > ADF4351_PFD_MAX )
-		{
-#if ADF4351_DEBUG & 1
-			printf("PFD: %.2f > %lu && BandClkMode == 0\n", 
-				(double) PFD, (unsigned long) ADF4351_PFD_MAX);
-#endif
-			return(ADF4351_PFD_RANGE);
-		}
-    }
-    else 
-    {
-		if( PFD > ADF4351_PFD_MAX && r0_FRAC != 0)
-		{
-#if ADF4351_DEBUG & 1
-			printf("PFD: %.2f > %lu && BandClkMode == 0\n", 
-				(double) PFD, (unsigned long) ADF4351_PFD_MAX);
-#endif
-			return(ADF4351_PFD_RANGE);
-		}
-		if (PFD > 90 && r0_FRAC != 0)
-		{
-#if ADF4351_DEBUG & 1
-			printf("PFD: %.2f > 90 Band Clock Mode && r0_FRAC != 0\n", 	
-				(double) PFD);
-#endif
-			return(ADF4351_PFD_RANGE);
-		}
-	}
-
-	// ==========================
-	// Band Clock Divider 
-	// FIXME Add user override to pick value
-    // FIXME perhaps we could consider setting regs.r3.BandClkMode based on PFD ?
-	if (regs.r3.BandClkMode == 0)
-		dscale = 8;
-	else
-		dscale = 2;
-	temp = (uint32_t)round(dscale * PFD);
-	if ((dscale * PFD - temp) > 0)
-		temp++;
-
-	temp = (temp > 255) ? 255 : temp;
-	r4_BandClkDiv = temp;
-
-	// ==========================
-	// Band Clock Frequency
-	// FYI temp will always be > 0
-	BandSelectClockFrequency = (PFD / (double)r4_BandClkDiv);
-
-	// ==========================
-	// Band Clock Range Check 
-	if (BandSelectClockFrequency > 500000.0)
-    {
-#if ADF4351_DEBUG & 1
-        printf("Band Select Clock Frequency %.2f > 500000\n", 
-			(double) BandSelectClockFrequency);
-#endif
-		return(ADF4351_BandSelectClockFrequency_RANGE);
-    }
-
-    if ((BandSelectClockFrequency > 125000.0) & (regs.r3.BandClkMode))
-    {
-#if ADF4351_DEBUG & 1
-        printf("Band Select Clock Frequency %.2f > 125000 && regs.r3.BandClkMode\n", 
-			(double) BandSelectClockFrequency);
-#endif
-		return(ADF4351_BandSelectClockFrequency_RANGE);
-    }
-
-	// ==========================
-	// Noise Spur Mode
-    if ((regs.r2.NoiseSpurMode == ADF4351_LOW_SPUR_MODE) && (r1_MOD < 50))
-    {
-#if ADF4351_DEBUG & 1
-        printf("regs.r2.NoiseSpurMode == ADF4351_LOW_SPUR_MODE) && (r1_MOD(%lu) < 50\n",
-		(unsigned long) r1_MOD);
-#endif
-		return(ADF4351_MOD_RANGE);
-    }
+	status = ADF4351_Plan((uint64_t) (RFout + 0.5), (uint32_t) (REFin + 0.5), 0,
+		ADF4351_PLAN_ERROR, &plan);
+	if(status)
+		return(status);
 
 	// ==========================
 	// Write Registers
-	regs.r0.INT = r0_INT;
-    regs.r0.FRAC = r0_FRAC;
-	regs.r1.MOD = r1_MOD;
-	regs.r1.Prescaler = r1_Prescaler;
+	ADF4351_Apply(&plan);
 
-	regs.r2.R = r2_R;
-
-	regs.r4.BandClkDiv = r4_BandClkDiv;
-	regs.r4.RFDivSel = r4_RFDivSel;
-
-	// ==========================
-	// Compute actual RFout
-
-    *RFoutCalc = (double) 
-		( (double) r0_INT + ((double)r0_FRAC / (double)r1_MOD) ) 
-		* ( (double)PFD / (double)(RFoutDIV) );
+	*RFoutCalc = (double) plan.RFout_mHz / 1000.0;
 
 #if ADF4351_DEBUG & 2
-    printf("RFout:     %.2f Hz\n", RFout);
-    printf("RFoutCalc: %.2f Hz\n", *RFoutCalc);
-    printf("RFin:      %.2f Hz\n", (double) REFin);
-    printf("PFD:       %.2f Hz\n", (double) PFD);
-	printf("RFoutDIV:  %d\n", (int) RFoutDIV);
-    printf("  Channel Spacing: %.2f Hz\n", (double) ChannelSpacing);
-    printf("  BandSelectClockFrequency: %.2f Hz\n", (double) BandSelectClockFrequency);
-    printf("  VCO FeedbackVCO %s\n", regs.r4.FeedbackVCO ? "VCO" : "Divided" );
-    printf("  N: %.2f Hz\n", (double) N);
-	printf("  r0_INT: %lu, r0_FRAC: %lu, r1_MOD: %lu\n",
-		(unsigned long) r0_INT, (unsigned long)r0_FRAC, (unsigned long) r1_MOD);
-	printf("  r2_R:%lu\n", (unsigned long) r2_R);
-	printf("  r1_Prescaler: %s\n", r1_Prescaler ? "8/9" : "4/5");
-	printf("  r4_BandClkDiv %lu\n", (unsigned long) r4_BandClkDiv);
+	printf("RFout:     %.2f Hz\n", RFout);
+	printf("  Channel Spacing: %.2f Hz\n", (double) ChannelSpacing);
+	ADF4351_display_plan(&plan);
 #endif
 
 	// VCO frequency error ?
-	if (*RFoutCalc != RFout)
+	if (!plan.exact || (double) plan.RFout != RFout)
     {
         return(ADF4351_RFout_MISMATCH);
     }
@@ -747,4 +456,3 @@ int ADF4351_Config(double RFout, double REFin, double ChannelSpacing, double *RF
     return (0);
 }
 
-
@@ -452,6 +452,43 @@ enum
     ADF4351_AUXOUT_FROM_VCO          /*!< RFout direct from VCO */
 };
 
+/** \brief ADF4351_Plan() optimization
+ */
+enum
+{
+    ADF4351_PLAN_ERROR,	/*!< smallest error, then highest PFD */
+    ADF4351_PLAN_SPUR	/*!< smallest MOD within the tolerance */
+};
+
+/// @brief Divisors of REFin kept as R candidates by ADF4351_Plan()
+#ifndef ADF4351_PLAN_DIVISORS
+#define ADF4351_PLAN_DIVISORS 128
+#endif
+/// @brief R values after the highest PFD ADF4351_Plan() tries when nothing is exact
+#ifndef ADF4351_PLAN_SCAN
+#define ADF4351_PLAN_SCAN 16
+#endif
+
+/** \brief ADF4351 frequency plan
+ * RFout = REFin * (INT + FRAC/MOD) / (R * RFoutDIV)
+ */
+typedef struct
+{
+	uint32_t INT;
+	uint32_t FRAC;
+	uint32_t MOD;
+	uint32_t R;
+	uint32_t Prescaler;
+	uint32_t RFDivSel;
+	uint32_t BandClkDiv;
+	uint32_t PFD;		/*!< PFD in Hz, rounded down */
+	uint64_t RFout;		/*!< requested output in Hz */
+	uint64_t RFout_mHz;	/*!< achieved output in mHz, rounded down */
+	int64_t error_mHz;	/*!< achieved minus requested in mHz, rounded toward zero */
+	int exact;			/*!< achieved output is exactly RFout */
+} adf4351_plan_t;
+
+extern adf4351_regs_t regs;
 
 #endif
 
@@ -461,11 +498,16 @@ MEMSPACE int ADF4351_CHARGE_PUMP_uA ( int32_t x );
 MEMSPACE void ADF4351_Init ( void );
 MEMSPACE void ADF_dump_registers ( void );
 MEMSPACE uint32_t ADF4351_status ( uint8_t mode );
-MEMSPACE uint32_t ADF4351_GCD ( uint32_t u , uint32_t v );
 MEMSPACE double ADF4351_PFD ( double REFin , int R );
 MEMSPACE void ADF4351_display_error ( int error );
 MEMSPACE int ADF4351_Config( double RFout , double REFin , double ChannelSpacing , double *RFoutCalc );
 
+/* adf4351_plan.c */
+MEMSPACE uint32_t ADF4351_GCD32 ( uint32_t u , uint32_t v );
+MEMSPACE int ADF4351_Plan ( uint64_t RFout , uint32_t REFin , uint32_t tolerance , int mode , adf4351_plan_t *plan );
+MEMSPACE void ADF4351_Apply ( adf4351_plan_t *plan );
+MEMSPACE void ADF4351_display_plan ( adf4351_plan_t *plan );
+
 
 
 /* adf4351_cmd.c */
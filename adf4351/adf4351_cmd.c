@@ -34,6 +34,11 @@
 
 #include "mathio.h"
 
+#ifdef WEBSERVER
+#include "web/web.h"
+#include "web/websocket.h"
+#endif
+
 /* define ADF4351 global data */
 typedef struct {
 	double low;
@@ -52,6 +57,10 @@ void ADF4351_update(double freq)
 {
     printf("%4.3f\n", freq/1000000.0);
     ADF4351_sync(1);
+#ifdef WEBSERVER
+    // Live status for WebSocket clients, see html/live.htm
+    ws_printf("{\"adf4351\":%4.3f}", freq/1000000.0);
+#endif
 }
 
 // update every 50 mS
@@ -90,6 +99,7 @@ void adf4351_help()
     printf(
 	"adf4351 help\n"
     "adf4351 frequency [spacing]\n"
+    "adf4351 plan frequency [spur [tolerance]]\n"
     "adf4351 scan low hi spacing\n"
     "adf4351 set frequency spacing\n"
     "adf4351 start\n"
@@ -112,6 +122,9 @@ int adf4351_cmd(int argc,char *argv[])
     double result;
 	char tmp[80];
 	int ind;
+	adf4351_plan_t plan;
+	int mode;
+	uint32_t tolerance;
 
     if(argc < 2)
         return(0);
@@ -161,6 +174,34 @@ int adf4351_cmd(int argc,char *argv[])
         frequency.scan = 1;
         return(1);
     }
+	if(MATCHARGS(ptr, "plan", (ind+1) ,argc))
+    {
+		/* stop scanning - manual mode */
+		frequency.scan = 0;
+
+		frequency.val = atof(argv[ind++]);
+
+		// Smallest error, or smallest MOD within tolerance Hz
+		mode = ADF4351_PLAN_ERROR;
+		tolerance = 0;
+		if(ind < argc && MATCH(argv[ind], "spur"))
+		{
+			++ind;
+			mode = ADF4351_PLAN_SPUR;
+			tolerance = (ind < argc) ? atoi(argv[ind++]) : 1000;
+		}
+
+		status = ADF4351_Plan((uint64_t) (frequency.val + 0.5), 25000000UL, tolerance, mode, &plan);
+		if(status)
+		{
+			ADF4351_display_error ( status );
+			return(1);
+		}
+		ADF4351_display_plan(&plan);
+		ADF4351_Apply(&plan);
+		ADF4351_sync(1);
+		return(1);
+	}
 	if(MATCHARGS(ptr, "set", (ind+1) ,argc))
     {
 		/* stop scanning - manual mode */
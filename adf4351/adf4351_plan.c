@@ -0,0 +1,501 @@
+/**
+ @file     adf4351_plan.c
+ @brief    ADF4351 integer frequency planner
+ * Finds R, INT, FRAC and MOD for an output frequency in Hz using
+ * only integer arithmetic, and reports the exact frequency and error.
+ *
+ *   RFout = REFin * (INT + FRAC/MOD) / (R * RFoutDIV)
+ *
+ * With everything in Hz the fractional part of N for a given R is the
+ * rational (fb * R mod REFin) / REFin, so an exact setting exists when
+ * that reduces to a denominator of 4095 or less. Otherwise the closest
+ * fraction is found from its continued fraction.
+
+ @par Copyright &copy; 2016 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef USER_CONFIG
+#include "user_config.h"
+#else
+// Host test build
+#include <stdio.h>
+#define MEMSPACE
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include "adf4351/adf4351.h"
+
+/// @brief Largest R counter value, 10 bits
+#define ADF4351_R_MAX 1023U
+/// @brief Largest MOD and FRAC values, 12 bits
+#define ADF4351_MOD_MAX 4095U
+/// @brief Smallest MOD that works with dither in low spur mode
+#define ADF4351_MOD_MIN_LOW_SPUR 50U
+
+/// @brief Register MOD for ranking plans, integer-N counts as 1
+#define PLAN_MOD(p) ((p)->FRAC ? (p)->MOD : 1U)
+/// @brief Unsigned distance between two values
+#define ADF4351_DIFF(a,b) ((a) > (b) ? (a) - (b) : (b) - (a))
+
+/// @brief Fixed inputs for ADF4351_plan_try()
+typedef struct
+{
+	uint64_t fb;		/*!< frequency at the N counter in Hz */
+	uint32_t ref;		/*!< REFin after the doubler in Hz */
+	uint32_t refdiv;	/*!< reference divide by 2, 1 or 2 */
+	uint32_t outdiv;	/*!< RF divider when it is inside the loop, else 1 */
+	uint32_t RFDivSel;
+	uint32_t Prescaler;
+	uint32_t N_min;
+	uint32_t tolerance;	/*!< ADF4351_PLAN_SPUR tolerance in Hz */
+	int mode;
+} adf4351_job_t;
+
+/// @brief Divisors of the reference used as R candidates, see ADF4351_divisors()
+static uint16_t plan_div[ADF4351_PLAN_DIVISORS];
+static int plan_divs = 0;
+static uint32_t plan_ref = 0;
+
+/**
+ *  \brief Cache the divisors of the reference that an R counter can hold
+ *  Only recomputed when the reference changes
+ * @param  ref: reference frequency in Hz
+ */
+MEMSPACE
+static void ADF4351_divisors(uint32_t ref)
+{
+	uint32_t d;
+
+	if(ref == plan_ref)
+		return;
+	plan_divs = 0;
+	for(d = 2; d <= ADF4351_R_MAX * 2 && plan_divs < ADF4351_PLAN_DIVISORS; ++d)
+	{
+		if((ref % d) == 0)
+			plan_div[plan_divs++] = d;
+	}
+	plan_ref = ref;
+}
+
+/**
+ *  \brief Closest fraction to p/q with a denominator no larger than maxden
+ *  Uses the continued fraction convergents and the last semiconvergent,
+ *  the result is exact, and in lowest terms, when p/q reduces to maxden or less
+ * @param  p: numerator, less than q
+ * @param  q: denominator
+ * @param  maxden: largest denominator
+ * @param  *F: numerator result, may equal *M when p/q rounds up to 1
+ * @param  *M: denominator result
+ */
+MEMSPACE
+static void ADF4351_best_frac(uint32_t p, uint32_t q, uint32_t maxden, uint32_t *F, uint32_t *M)
+{
+	uint64_t h0 = 0, k0 = 1, h1 = 1, k1 = 0, h2, k2, a;
+	uint32_t n = p, d = q, t;
+
+	while(d)
+	{
+		a = n / d;
+		k2 = a * k1 + k0;
+		if(k2 > maxden)
+		{
+			// Largest semiconvergent that fits, keep it if it is closer
+			a = (maxden - k0) / k1;
+			h2 = a * h1 + h0;
+			k2 = a * k1 + k0;
+			if(a && ADF4351_DIFF(p * k2, q * h2) * k1 < ADF4351_DIFF(p * k1, q * h1) * k2)
+			{
+				h1 = h2;
+				k1 = k2;
+			}
+			break;
+		}
+		h2 = a * h1 + h0;
+		h0 = h1;
+		k0 = k1;
+		h1 = h2;
+		k1 = k2;
+		t = n - (uint32_t) a * d;
+		n = d;
+		d = t;
+	}
+	*F = (uint32_t) h1;
+	*M = (uint32_t) k1;
+}
+
+/**
+ *  \brief Fraction with the smallest denominator in [lo/q, hi/q]
+ * @param  lo: low end numerator, 0 <= lo <= hi
+ * @param  hi: high end numerator, hi <= q
+ * @param  q: denominator
+ * @param  maxden: largest denominator
+ * @param  *F: numerator result
+ * @param  *M: denominator result, 0 if it would be larger than maxden
+ */
+MEMSPACE
+static void ADF4351_simple_frac(uint64_t lo, uint64_t hi, uint64_t q, uint32_t maxden, uint32_t *F, uint32_t *M)
+{
+	uint64_t h0 = 0, k0 = 1, h1 = 1, k1 = 0, h2, k2, a;
+	uint64_t ln = lo, ld = q, hn = hi, hd = q, nln, nld;
+	int last = 0;
+
+	while(!last)
+	{
+		a = ln / ld;
+		if(a * ld == ln)
+			last = 1;
+		else if((a + 1) * hd <= hn)
+		{
+			++a;
+			last = 1;
+		}
+		h2 = a * h1 + h0;
+		k2 = a * k1 + k0;
+		if(k2 > maxden)
+		{
+			*F = 0;
+			*M = 0;
+			return;
+		}
+		h0 = h1;
+		k0 = k1;
+		h1 = h2;
+		k1 = k2;
+		if(!last)
+		{
+			// Continue with [1/(hi - a), 1/(lo - a)]
+			nln = hd;
+			nld = hn - a * hd;
+			hn = ld;
+			hd = ln - a * ld;
+			ln = nln;
+			ld = nld;
+		}
+	}
+	*F = (uint32_t) h1;
+	*M = (uint32_t) k1;
+}
+
+/**
+ *  \brief Return the GCD of two unsigned 32bit numbers
+ * @param  u: first number 
+ * @param  v: second number 
+ * @return GCD of u and v
+ */
+MEMSPACE
+uint32_t ADF4351_GCD32(uint32_t u, uint32_t v)
+{
+	uint32_t t;
+
+	while(v)
+	{
+		t = u % v;
+		u = v;
+		v = t;
+	}
+	return(u);
+}
+
+/**
+ *  \brief Work out INT, FRAC and MOD for one R value
+ * @param  *job: planner inputs
+ * @param  R: reference divider
+ * @param  *p: plan result
+ * @retval 0=OK, or Error code 
+ */
+MEMSPACE
+static int ADF4351_plan_try(adf4351_job_t *job, uint32_t R, adf4351_plan_t *p)
+{
+	uint64_t prod, T, lo, hi, num, target, den, diff, err;
+	uint32_t Rt, INT, rem, F, M, k, dscale, BandClkDiv;
+
+	// N = fb * Rt / ref, rem / ref is the fractional part
+	Rt = R * job->refdiv;
+	prod = job->fb * Rt;
+	INT = (uint32_t) (prod / job->ref);
+	rem = (uint32_t) (prod - (uint64_t) INT * job->ref);
+
+	M = 0;
+	if(job->mode == ADF4351_PLAN_SPUR)
+	{
+		// Output tolerance in the same units as rem
+		T = (uint64_t) job->tolerance * job->outdiv * Rt;
+		lo = rem > T ? rem - T : 0;
+		hi = rem + T < job->ref ? rem + T : job->ref;
+		ADF4351_simple_frac(lo, hi, job->ref, ADF4351_MOD_MAX, &F, &M);
+	}
+	if(!M)
+		ADF4351_best_frac(rem, job->ref, ADF4351_MOD_MAX, &F, &M);
+	if(F == M)
+	{
+		++INT;
+		F = 0;
+	}
+	if(F == 0)
+		M = 1;
+
+	if(INT < job->N_min || INT > 65535U)
+		return(ADF4351_N_RANGE);
+
+	// ==========================
+	// Band Clock Divider, as ADF4351_Config() always did
+	dscale = regs.r3.BandClkMode ? 2 : 8;
+	BandClkDiv = (uint32_t) (((uint64_t) dscale * job->ref + Rt - 1) / Rt);
+	if(BandClkDiv > 255)
+		BandClkDiv = 255;
+	if((uint64_t) job->ref > 500000ULL * Rt * BandClkDiv)
+		return(ADF4351_BandSelectClockFrequency_RANGE);
+	if(regs.r3.BandClkMode && (uint64_t) job->ref > 125000ULL * Rt * BandClkDiv)
+		return(ADF4351_BandSelectClockFrequency_RANGE);
+
+	// ==========================
+	// MOD is at least 2, and at least 50 for dither in low spur mode
+	k = (M < 2) ? 2 : 1;
+	if(regs.r2.NoiseSpurMode == ADF4351_LOW_SPUR_MODE && M < ADF4351_MOD_MIN_LOW_SPUR)
+		k = (ADF4351_MOD_MIN_LOW_SPUR + M - 1) / M;
+
+	p->INT = INT;
+	p->FRAC = F * k;
+	p->MOD = M * k;
+	p->R = R;
+	p->Prescaler = job->Prescaler;
+	p->RFDivSel = job->RFDivSel;
+	p->BandClkDiv = BandClkDiv;
+	p->PFD = job->ref / Rt;
+	p->RFout = job->fb / job->outdiv;
+
+	// ==========================
+	// RFout = ref * (INT * M + F) / (Rt * M * outdiv), exactly
+	num = (uint64_t) job->ref * ((uint64_t) INT * M + F);
+	target = job->fb * Rt * M;
+	den = (uint64_t) Rt * M * job->outdiv;
+
+	p->RFout_mHz = (num / den) * 1000ULL + ((num % den) * 1000ULL) / den;
+	diff = ADF4351_DIFF(num, target);
+	err = (diff / den) * 1000ULL + ((diff % den) * 1000ULL) / den;
+	p->error_mHz = (num >= target) ? (int64_t) err : -(int64_t) err;
+	p->exact = (num == target);
+	return(0);
+}
+
+/**
+ *  \brief Compare two plans
+ * @param  *job: planner inputs
+ * @param  *a: first plan
+ * @param  *b: second plan
+ * @return 1 if a is better than b
+ */
+MEMSPACE
+static int ADF4351_plan_better(adf4351_job_t *job, adf4351_plan_t *a, adf4351_plan_t *b)
+{
+	uint64_t ea = a->error_mHz < 0 ? -a->error_mHz : a->error_mHz;
+	uint64_t eb = b->error_mHz < 0 ? -b->error_mHz : b->error_mHz;
+	int ta, tb;
+
+	if(job->mode == ADF4351_PLAN_SPUR)
+	{
+		ta = (ea <= job->tolerance * 1000ULL);
+		tb = (eb <= job->tolerance * 1000ULL);
+		if(ta != tb)
+			return(ta);
+		if(PLAN_MOD(a) != PLAN_MOD(b))
+			return(PLAN_MOD(a) < PLAN_MOD(b));
+	}
+	if(a->exact != b->exact)
+		return(a->exact);
+	if(ea != eb)
+		return(ea < eb);
+	// Higher PFD, less phase noise
+	if(a->R != b->R)
+		return(a->R < b->R);
+	return(PLAN_MOD(a) < PLAN_MOD(b));
+}
+
+/**
+ *  \brief Plan ADF4351 register values with integer arithmetic
+ *  Tries the highest PFD and the R values that share a factor with the
+ *  reference, only those can give an exact result with a smaller MOD.
+ *  When there is no exact result ADF4351_PLAN_ERROR also tries the next
+ *  ADF4351_PLAN_SCAN R values.
+ *  The reference doubler and divider, band select clock mode, noise mode
+ *  and feedback select come from the current register settings.
+ * @param  RFout: 	Required output frequency in Hz
+ * @param  REFin:	Reference clock in Hz
+ * @param  tolerance: Largest error in Hz for ADF4351_PLAN_SPUR
+ * @param  mode:	ADF4351_PLAN_ERROR for the smallest error, then highest PFD
+ *                  ADF4351_PLAN_SPUR for the smallest MOD within tolerance
+ * @paramOut  plan: R, INT, FRAC, MOD, exact frequency and error
+ * @retval 0=OK, or Error code 
+ */
+MEMSPACE
+int ADF4351_Plan(uint64_t RFout, uint32_t REFin, uint32_t tolerance, int mode, adf4351_plan_t *plan)
+{
+	adf4351_job_t job;
+	adf4351_plan_t t;
+	uint64_t lim;
+	uint32_t RFoutDIV, R, R_lo, R_hi, b, d, step;
+	int i, status, found;
+
+	memset(plan, 0, sizeof(*plan));
+	plan->RFout = RFout;
+
+	if(RFout > (uint64_t) ADF4351_RFOUT_MAX || RFout < (uint64_t) ADF4351_RFOUT_MIN)
+		return(ADF4351_RFout_RANGE);
+	if(REFin == 0 || REFin > (uint32_t) ADF4351_REFIN_MAX)
+		return(ADF4351_REFin_RANGE);
+
+	memset(&job, 0, sizeof(job));
+	job.mode = mode;
+	job.tolerance = tolerance;
+
+	// ==========================
+	// RF output divider and prescaler, as ADF4351_Config() always did
+	RFoutDIV = 1;
+	while(RFout * RFoutDIV < (uint64_t) ADF4351_VCO_MIN && RFoutDIV < 64)
+	{
+		RFoutDIV <<= 1;
+		job.RFDivSel++;
+	}
+	if(RFout > (uint64_t) ADF4351_MAX_FREQ_45PRE)
+	{
+		job.Prescaler = ADF4351_PRESCALER_8_9;
+		job.N_min = 75;
+	}
+	else
+	{
+		job.Prescaler = ADF4351_PRESCALER_4_5;
+		job.N_min = 23;
+	}
+
+	job.outdiv = regs.r4.FeedbackVCO ? RFoutDIV : 1;
+	job.fb = RFout * job.outdiv;
+	job.ref = REFin * (regs.r2.REFinMUL2 ? 2 : 1);
+	job.refdiv = regs.r2.REFinDIV2 ? 2 : 1;
+
+	// ==========================
+	// R range for PFD < ADF4351_PFD_MAX and N_min <= N < 65536
+	R_lo = job.ref / (job.refdiv * (uint32_t) ADF4351_PFD_MAX) + 1;
+	if(R_lo > ADF4351_R_MAX)
+		return(ADF4351_R_RANGE);
+	lim = ((uint64_t) job.N_min * job.ref + job.fb * job.refdiv - 1) / (job.fb * job.refdiv);
+	if(lim > R_lo)
+		R_lo = (uint32_t) lim;
+	lim = (65536ULL * job.ref - 1) / (job.fb * job.refdiv);
+	R_hi = (lim < ADF4351_R_MAX) ? (uint32_t) lim : ADF4351_R_MAX;
+	if(R_lo > R_hi)
+		return(ADF4351_N_RANGE);
+
+	status = ADF4351_plan_try(&job, R_lo, plan);
+	found = (status == 0);
+
+	// Nothing beats an exact result at the highest PFD for ADF4351_PLAN_ERROR
+	if(found && plan->exact && mode == ADF4351_PLAN_ERROR)
+		return(0);
+
+	// ==========================
+	// The fractional part of N at R reduces to a denominator of
+	// b / gcd(R * refdiv, b), so only R values sharing a factor with b help
+	b = job.ref / ADF4351_GCD32((uint32_t) (job.fb % job.ref), job.ref);
+	ADF4351_divisors(job.ref);
+	for(i = 0; i < plan_divs; ++i)
+	{
+		d = plan_div[i];
+		if(d > b)
+			break;
+		if(b % d)
+			continue;
+		if(mode == ADF4351_PLAN_ERROR && b / d > ADF4351_MOD_MAX)
+			continue;
+
+		// Smallest R >= R_lo where d divides R * refdiv
+		step = (job.refdiv == 2 && !(d & 1)) ? d / 2 : d;
+		R = ((R_lo + step - 1) / step) * step;
+		if(R > R_hi || R == R_lo)
+			continue;
+		if(found && mode == ADF4351_PLAN_ERROR && plan->exact && R >= plan->R)
+			continue;
+
+		if(ADF4351_plan_try(&job, R, &t) == 0 && (!found || ADF4351_plan_better(&job, &t, plan)))
+		{
+			*plan = t;
+			found = 1;
+		}
+	}
+	// ==========================
+	// No exact setting, a smaller PFD gives finer steps
+	if(mode == ADF4351_PLAN_ERROR && !(found && plan->exact))
+	{
+		for(R = R_lo + 1; R <= R_hi && R <= R_lo + ADF4351_PLAN_SCAN; ++R)
+		{
+			if(ADF4351_plan_try(&job, R, &t) == 0 && (!found || ADF4351_plan_better(&job, &t, plan)))
+			{
+				*plan = t;
+				found = 1;
+			}
+		}
+	}
+	return(found ? 0 : status);
+}
+
+/**
+ *  \brief Write a plan into the register buffer
+ *  Call ADF4351_sync() to send it
+ * @param  *plan: plan from ADF4351_Plan()
+ */
+MEMSPACE
+void ADF4351_Apply(adf4351_plan_t *plan)
+{
+	regs.r0.INT = plan->INT;
+	regs.r0.FRAC = plan->FRAC;
+	regs.r1.MOD = plan->MOD;
+	regs.r1.Prescaler = plan->Prescaler;
+
+	regs.r2.R = plan->R;
+
+	regs.r4.BandClkDiv = plan->BandClkDiv;
+	regs.r4.RFDivSel = plan->RFDivSel;
+}
+
+/**
+ *  \brief Display a plan
+ * @param  *plan: plan from ADF4351_Plan()
+ */
+MEMSPACE
+void ADF4351_display_plan(adf4351_plan_t *plan)
+{
+	uint64_t err = plan->error_mHz < 0 ? -plan->error_mHz : plan->error_mHz;
+
+	printf("RFout:     %llu Hz\n", (unsigned long long) plan->RFout);
+	printf("RFoutCalc: %llu.%03u Hz\n",
+		(unsigned long long) (plan->RFout_mHz / 1000ULL),
+		(unsigned int) (plan->RFout_mHz % 1000ULL));
+	printf("error:     %c%llu.%03u Hz%s\n",
+		plan->error_mHz < 0 ? '-' : '+',
+		(unsigned long long) (err / 1000ULL),
+		(unsigned int) (err % 1000ULL),
+		plan->exact ? " exact" : "");
+	printf("  PFD: %lu Hz, R: %lu\n", (unsigned long) plan->PFD, (unsigned long) plan->R);
+	printf("  INT: %lu, FRAC: %lu, MOD: %lu\n",
+		(unsigned long) plan->INT, (unsigned long) plan->FRAC, (unsigned long) plan->MOD);
+	printf("  RFDivSel: %lu, Prescaler: %s, BandClkDiv: %lu\n",
+		(unsigned long) plan->RFDivSel,
+		plan->Prescaler ? "8/9" : "4/5",
+		(unsigned long) plan->BandClkDiv);
+}
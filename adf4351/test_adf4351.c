@@ -0,0 +1,645 @@
+/**
+ @file     test_adf4351.c
+ @brief    Host tests and benchmark for the ADF4351 frequency planner
+ * Checks ADF4351_Plan() against the former double precision
+ * ADF4351_Config(), kept below as ADF4351_Config_ref(), over dense grids.
+
+ @par Copyright &copy; 2016 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// only used when testing standalone on linux
+#ifdef ADF4351_TEST
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#define MEMSPACE
+#include "adf4351/adf4351.h"
+#include "lib/testsup.h"
+
+/// @brief ADF4351 register buffer
+adf4351_regs_t regs;
+
+// ==========================================================
+// The former double precision planner, unchanged except for names
+
+/**
+ *  \brief Compute PFD
+ * @param  REFin: Reference in frequency
+ * @param  R: Reference divider
+ */
+double ADF4351_PFD_ref(double REFin, int R)
+{
+	double PFD = (uint32_t) REFin
+		* (regs.r2.REFinMUL2 ? 2 : 1)
+		/ (R * (regs.r2.REFinDIV2 ? 2 : 1) );
+	return(PFD);
+}
+
+/**
+ *  \brief Calculate register values for ADF4351
+ * @param  RFout: 	Required output frequency in Hz
+ * @param  REFin:	Reference clock in Hz
+ * @param  Spacing:	Output channel spacing in Hz
+ * @paramOut  RFoutCalc: Calculated actual output frequency in Hz
+ * @retval 0=OK, or Error code 
+ *
+ */
+MEMSPACE
+int ADF4351_Config_ref(double RFout, double REFin, double ChannelSpacing, double *RFoutCalc )
+{
+
+	uint32_t	div_gcd;
+    uint32_t 	r0_INT;
+    uint32_t 	r0_FRAC;
+    uint32_t 	r1_MOD;
+	uint32_t    r1_Prescaler;
+	uint32_t	r2_R;
+    uint32_t 	r4_RFDivSel;
+	uint32_t 	r4_BandClkDiv;
+    uint32_t    RFoutDIV;	
+	double 		N;
+	uint32_t    N_min;
+
+	double 		PFD;
+    double 		BandSelectClockFrequency;
+	double      Fres;
+
+	double 		dscale;
+	uint32_t 	temp;
+
+	*RFoutCalc = 0.0;
+
+/**
+ * RFoutVCO = [r0_INT + (r0_FRAC/r1_MOD)] × (PFD)
+ * RFout = [r0_INT + (r0_FRAC/r1_MOD)] × (PFD /RFoutDIV)
+ *   RFout is the RF frequency output.
+ *   r0_INT is the integer division factor.
+ *   r0_FRAC is the numerator of the fractional division (0 to MOD − 1).
+ *   r1_MOD is the preset fractional modulus (2 to 4095).
+ *   RFoutDIV is the VCO output divider.
+ * PFD = REFin × [(1 + REFinMUL2)/(R × (1 + REFinDIV2))]
+ *   REFin is the reference frequency input.
+ *   REFinMUL2 is the REFin doubler bit (0 or 1).
+ *   r2_R is REFin division factor (1 to 1023).
+ *   REFinDIV2 is the reference divide-by-2 bit (0 or 1).
+ * Fres = ChannelSpacing * RFoutDIV
+ * r1_MOD=REFin / Fres
+*/
+
+	// ==========================
+    if (RFout > ADF4351_RFOUT_MAX)
+	{
+#if ADF4351_DEBUG & 1
+		printf("RFout > %.2f\n", (double) ADF4351_RFOUT_MAX);
+#endif
+		return(ADF4351_RFout_RANGE);
+	}
+
+    if (RFout < ADF4351_RFOUT_MIN)
+	{
+#if ADF4351_DEBUG & 1
+		printf("RFout < %.2f\n", (double) ADF4351_RFOUT_MIN);
+#endif
+		return(ADF4351_RFout_RANGE);
+	}
+
+    if (REFin > ADF4351_REFIN_MAX)
+	{
+#if ADF4351_DEBUG & 1
+		printf("REFin > %.2f\n", (double) ADF4351_REFIN_MAX);
+#endif
+		return(ADF4351_REFin_RANGE);
+	}
+
+	// ==========================
+    // Compute RFout divider and R4 register value
+	r4_RFDivSel = 0;
+	RFoutDIV = 1;
+	while(((RFout * RFoutDIV) < ADF4351_VCO_MIN)  && RFoutDIV < 64)
+	{
+		RFoutDIV <<= 1;
+		r4_RFDivSel++;
+	}
+
+	// Compute r1_prescale selector based on RFout
+	if(RFout > ADF4351_MAX_FREQ_45PRE)
+	{
+		r1_Prescaler = 1;
+		N_min = 75;
+	}
+	else
+	{
+		r1_Prescaler = 0;
+		N_min = 23;
+	}
+
+
+	// ==========================
+	// PFD = REFin × [(1 + REFinMUL2)/(R × (1 + REFinDIV2))]
+	//  REFin is the reference frequency input.
+	//  REFinMUL2 is the REFin doubler bit (0 or 1).
+	//  r2_R is REFin division factor (1 to 1023).
+	//  REFinDIV2 is the reference divide-by-2 bit (0 or 1).
+	r2_R = 1;
+	while(r2_R < 4096 )
+	{
+		PFD = ADF4351_PFD_ref(REFin, r2_R);
+		if(PFD < ADF4351_PFD_MAX)
+			break;
+		r2_R++;
+	}
+
+	if(r2_R == 4096)
+	{
+#if ADF4351_DEBUG & 1
+        printf("r2_R == 4096\n");
+#endif
+        return(ADF4351_R_RANGE);
+	}
+
+	// ==========================
+	// Compute N based on R4 feedback path select
+    if (regs.r4.FeedbackVCO)
+        N = ((double)RFout * (double)RFoutDIV) / (double) PFD;
+    else
+        N = ((double)RFout / (double) PFD);
+
+	if(N < N_min || N > 65535U )
+	{
+#if ADF4351_DEBUG & 1
+		printf("N %.2f out of range\n", (double) N);
+#endif
+		return(ADF4351_N_RANGE);
+	}
+
+	// ==========================
+	// Integer
+	r0_INT = (uint32_t) N;
+
+	// r0_INt range check
+    if (r0_INT > 65535U)
+    {
+#if ADF4351_DEBUG & 1
+        printf("INT: %lu\n", (unsigned long) r0_INT);
+#endif
+		return(ADF4351_INT_RANGE);
+    }
+
+	// ==========================
+	// Modulus
+	// FIXME the AD windows driver Main_Form.cs disagrees with their own datasheet
+	// Specifically the RF output divider is not included in the calculation
+	// Datasheet:
+	// Fres is the VCO Channel Spacing
+ 	//   r1_MOD=REFin/Fres
+ 	//   Fres = ChannelSpacing/RFoutDIV
+	//   r1_MOD=(uint32_t) round((double) REFin / (double) Fres);
+
+	// The tested working solution found in the AD driver Main_Form.cs
+	r1_MOD=(uint32_t) round((double) PFD / (double) ChannelSpacing );
+
+	// ==========================
+	// Fractional
+	r0_FRAC = (uint32_t)round( ((double)N-(double)r0_INT)*(double) r1_MOD);
+
+	// ==========================
+	// Reduce r1_MOD and r0_FRAC by greatest common divisor
+
+	div_gcd = ADF4351_GCD32(r1_MOD, r0_FRAC);
+	r1_MOD /= div_gcd;
+	r0_FRAC /= div_gcd;
+
+	// FIXME - why is this needed ?
+	if (r1_MOD == 1)
+		r1_MOD = 2;
+
+	// ==========================
+	// r1_MOD Range check
+	if(r1_MOD == 0 || r1_MOD > 4095U) 
+	{
+#if ADF4351_DEBUG & 1
+		if(r1_MOD == 0)
+			printf("*MOD == 0\n");
+		if(r1_MOD > 4095U)
+			printf("*MOD > 4095\n");
+        printf("*MOD: %lu, INT: %lu, FRAC: %lu\n", (unsigned long) r1_MOD, (unsigned long) r0_INT, (unsigned long) r0_FRAC);
+#endif
+		return(ADF4351_MOD_RANGE);
+	}
+	
+	// ==========================
+	// r0_FRAC range check
+    if (r0_FRAC > 4095U)
+    {
+#if ADF4351_DEBUG & 1
+		if(r0_FRAC > 4095U)
+			printf("*FRAC > 4095\n");
+        printf("MOD: %lu, INT: %lu, *FRAC: %lu\n", (unsigned long) r1_MOD, (unsigned long) r0_INT, (unsigned long) r0_FRAC);
+#endif
+		return(ADF4351_FRAC_RANGE);
+    }
+
+	// ==========================
+	// Check for PFD range errors
+	if (regs.r3.BandClkMode == 0)
+    {
+		if( PFD > ADF4351_PFD_MAX )
+		{
+#if ADF4351_DEBUG & 1
+			printf("PFD: %.2f > %lu && BandClkMode == 0\n", 
+				(double) PFD, (unsigned long) ADF4351_PFD_MAX);
+#endif
+			return(ADF4351_PFD_RANGE);
+		}
+    }
+    else 
+    {
+		if( PFD > ADF4351_PFD_MAX && r0_FRAC != 0)
+		{
+#if ADF4351_DEBUG & 1
+			printf("PFD: %.2f > %lu && BandClkMode == 0\n", 
+				(double) PFD, (unsigned long) ADF4351_PFD_MAX);
+#endif
+			return(ADF4351_PFD_RANGE);
+		}
+		if (PFD > 90 && r0_FRAC != 0)
+		{
+#if ADF4351_DEBUG & 1
+			printf("PFD: %.2f > 90 Band Clock Mode && r0_FRAC != 0\n", 	
+				(double) PFD);
+#endif
+			return(ADF4351_PFD_RANGE);
+		}
+	}
+
+	// ==========================
+	// Band Clock Divider 
+	// FIXME Add user override to pick value
+    // FIXME perhaps we could consider setting regs.r3.BandClkMode based on PFD ?
+	if (regs.r3.BandClkMode == 0)
+		dscale = 8;
+	else
+		dscale = 2;
+	temp = (uint32_t)round(dscale * PFD);
+	if ((dscale * PFD - temp) > 0)
+		temp++;
+
+	temp = (temp > 255) ? 255 : temp;
+	r4_BandClkDiv = temp;
+
+	// ==========================
+	// Band Clock Frequency
+	// FYI temp will always be > 0
+	BandSelectClockFrequency = (PFD / (double)r4_BandClkDiv);
+
+	// ==========================
+	// Band Clock Range Check 
+	if (BandSelectClockFrequency > 500000.0)
+    {
+#if ADF4351_DEBUG & 1
+        printf("Band Select Clock Frequency %.2f > 500000\n", 
+			(double) BandSelectClockFrequency);
+#endif
+		return(ADF4351_BandSelectClockFrequency_RANGE);
+    }
+
+    if ((BandSelectClockFrequency > 125000.0) & (regs.r3.BandClkMode))
+    {
+#if ADF4351_DEBUG & 1
+        printf("Band Select Clock Frequency %.2f > 125000 && regs.r3.BandClkMode\n", 
+			(double) BandSelectClockFrequency);
+#endif
+		return(ADF4351_BandSelectClockFrequency_RANGE);
+    }
+
+	// ==========================
+	// Noise Spur Mode
+    if ((regs.r2.NoiseSpurMode == ADF4351_LOW_SPUR_MODE) && (r1_MOD < 50))
+    {
+#if ADF4351_DEBUG & 1
+        printf("regs.r2.NoiseSpurMode == ADF4351_LOW_SPUR_MODE) && (r1_MOD(%lu) < 50\n",
+		(unsigned long) r1_MOD);
+#endif
+		return(ADF4351_MOD_RANGE);
+    }
+
+	// ==========================
+	// Write Registers
+	regs.r0.INT = r0_INT;
+    regs.r0.FRAC = r0_FRAC;
+	regs.r1.MOD = r1_MOD;
+	regs.r1.Prescaler = r1_Prescaler;
+
+	regs.r2.R = r2_R;
+
+	regs.r4.BandClkDiv = r4_BandClkDiv;
+	regs.r4.RFDivSel = r4_RFDivSel;
+
+	// ==========================
+	// Compute actual RFout
+
+    *RFoutCalc = (double) 
+		( (double) r0_INT + ((double)r0_FRAC / (double)r1_MOD) ) 
+		* ( (double)PFD / (double)(RFoutDIV) );
+
+#if ADF4351_DEBUG & 2
+    printf("RFout:     %.2f Hz\n", RFout);
+    printf("RFoutCalc: %.2f Hz\n", *RFoutCalc);
+    printf("RFin:      %.2f Hz\n", (double) REFin);
+    printf("PFD:       %.2f Hz\n", (double) PFD);
+	printf("RFoutDIV:  %d\n", (int) RFoutDIV);
+    printf("  Channel Spacing: %.2f Hz\n", (double) ChannelSpacing);
+    printf("  BandSelectClockFrequency: %.2f Hz\n", (double) BandSelectClockFrequency);
+    printf("  VCO FeedbackVCO %s\n", regs.r4.FeedbackVCO ? "VCO" : "Divided" );
+    printf("  N: %.2f Hz\n", (double) N);
+	printf("  r0_INT: %lu, r0_FRAC: %lu, r1_MOD: %lu\n",
+		(unsigned long) r0_INT, (unsigned long)r0_FRAC, (unsigned long) r1_MOD);
+	printf("  r2_R:%lu\n", (unsigned long) r2_R);
+	printf("  r1_Prescaler: %s\n", r1_Prescaler ? "8/9" : "4/5");
+	printf("  r4_BandClkDiv %lu\n", (unsigned long) r4_BandClkDiv);
+#endif
+
+	// VCO frequency error ?
+	if (*RFoutCalc != RFout)
+    {
+        return(ADF4351_RFout_MISMATCH);
+    }
+
+    return (0);
+}
+
+// ==========================================================
+
+/**
+  @brief Microsecond clock
+*/
+double now_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec * 1e6 + ts.tv_nsec / 1e3);
+}
+
+/**
+  @brief Register defaults from ADF4351_Init() that the planners use
+*/
+void regs_init(void)
+{
+	memset(&regs, 0, sizeof(regs));
+	regs.r1.MOD = 2;
+	regs.r2.R = 1;
+	regs.r2.NoiseSpurMode = ADF4351_LOW_NOISE_MODE;
+	regs.r3.BandClkMode = 0;
+	regs.r4.BandClkDiv = 200;
+	regs.r4.FeedbackVCO = 1;
+}
+
+/// @brief Grid statistics
+typedef struct
+{
+	long points;
+	long ref_ok;		/* old planner found a setting */
+	long ref_exact;
+	long plan_ok;
+	long plan_exact;
+	long better;		/* smaller error than the old planner */
+	long rescued;		/* old planner failed, new one did not */
+	long spur_lower;	/* smaller MOD than the old planner in ADF4351_PLAN_SPUR */
+	double max_err;		/* largest ADF4351_PLAN_ERROR error in Hz */
+} grid_t;
+
+/**
+  @brief Check one plan against the registers it holds
+  Recomputes the output frequency with 128 bit integers
+*/
+void check_plan(adf4351_plan_t *p, uint32_t REFin)
+{
+	unsigned __int128 num, den, target;
+	uint64_t RFoutDIV = 1ULL << p->RFDivSel;
+	uint64_t outdiv = regs.r4.FeedbackVCO ? RFoutDIV : 1;
+	uint64_t ref = (uint64_t) REFin * (regs.r2.REFinMUL2 ? 2 : 1);
+	uint64_t Rt = (uint64_t) p->R * (regs.r2.REFinDIV2 ? 2 : 1);
+	int64_t err;
+
+	CHECK(p->R >= 1 && p->R <= 1023);
+	CHECK(p->MOD >= 2 && p->MOD <= 4095);
+	CHECK(p->FRAC < p->MOD);
+	CHECK(p->INT >= (p->Prescaler ? 75U : 23U) && p->INT <= 65535);
+	CHECK(ref / Rt < (uint64_t) ADF4351_PFD_MAX);
+	CHECK(p->RFout * RFoutDIV >= (uint64_t) ADF4351_VCO_MIN || p->RFDivSel == 6);
+
+	num = (unsigned __int128) ref * ((unsigned __int128) p->INT * p->MOD + p->FRAC);
+	den = (unsigned __int128) Rt * p->MOD * outdiv;
+	target = (unsigned __int128) p->RFout * den;
+	CHECK(p->exact == (num == target));
+	CHECK(p->RFout_mHz == (uint64_t) (num * 1000 / den));
+	err = num >= target ? (int64_t) ((num - target) * 1000 / den) : -(int64_t) ((target - num) * 1000 / den);
+	CHECK(p->error_mHz == err);
+}
+
+/**
+  @brief Plan one frequency both ways and compare
+*/
+void compare(grid_t *g, uint64_t RFout, uint32_t REFin, double spacing)
+{
+	adf4351_plan_t p, s;
+	double calc, ref_err, err;
+	uint32_t ref_mod, tol;
+	int ref_status, status;
+
+	++g->points;
+	ref_status = ADF4351_Config_ref((double) RFout, (double) REFin, spacing, &calc);
+	ref_mod = regs.r0.FRAC ? regs.r1.MOD : 1;
+
+	status = ADF4351_Plan(RFout, REFin, 0, ADF4351_PLAN_ERROR, &p);
+	if(status == 0)
+	{
+		++g->plan_ok;
+		g->plan_exact += p.exact;
+		check_plan(&p, REFin);
+		err = fabs(p.error_mHz / 1000.0);
+		if(err > g->max_err)
+			g->max_err = err;
+	}
+
+	if(ref_status != 0 && ref_status != ADF4351_RFout_MISMATCH)
+	{
+		if(status == 0)
+			++g->rescued;
+		return;
+	}
+
+	++g->ref_ok;
+	g->ref_exact += (ref_status == 0);
+	ref_err = fabs(calc - (double) RFout);
+
+	// Never worse than the old planner
+	CHECK(status == 0);
+	if(status)
+		return;
+	if(ref_status == 0)
+		CHECK(p.exact);
+	CHECK(err <= ref_err + 0.001);
+	if(err + 0.001 < ref_err)
+		++g->better;
+
+	// Lowest spur, the old setting is within half a channel
+	tol = (uint32_t) (spacing / 2);
+	status = ADF4351_Plan(RFout, REFin, tol, ADF4351_PLAN_SPUR, &s);
+	CHECK(status == 0);
+	if(status)
+		return;
+	check_plan(&s, REFin);
+	CHECK(llabs(s.error_mHz) <= tol * 1000LL);
+	if(ref_err <= tol)
+	{
+		CHECK((s.FRAC ? s.MOD : 1) <= ref_mod);
+		if((s.FRAC ? s.MOD : 1) < ref_mod)
+			++g->spur_lower;
+	}
+}
+
+/**
+  @brief Display grid statistics
+*/
+void grid_stats(char *name, grid_t *g)
+{
+	printf("%-28s points:%-8ld old ok:%-8ld old exact:%-8ld new ok:%-8ld new exact:%-8ld smaller error:%-8ld rescued:%-8ld smaller MOD:%-8ld max error:%.3f Hz\n",
+		name, g->points, g->ref_ok, g->ref_exact, g->plan_ok, g->plan_exact,
+		g->better, g->rescued, g->spur_lower, g->max_err);
+}
+
+/// @brief Channel spacings to check, in Hz
+double spacings[] = { 1000, 5000, 10000, 12500, 25000, 100000, 1000000 };
+/// @brief Reference clocks to check, in Hz
+uint32_t refs[] = { 25000000, 10000000, 26000000, 100000000, 122880000 };
+
+#define ARRAY(a) ((int) (sizeof(a) / sizeof(a[0])))
+
+int main(int argc, char *argv[])
+{
+	grid_t g;
+	adf4351_plan_t p;
+	char name[64];
+	uint64_t f, step;
+	double start, t_ref, t_plan, t_spur, calc;
+	long n;
+	int i, j;
+
+	regs_init();
+
+	// Channel grids, every frequency a multiple of the spacing
+	for(j = 0; j < ARRAY(refs); ++j)
+	{
+		for(i = 0; i < ARRAY(spacings); ++i)
+		{
+			memset(&g, 0, sizeof(g));
+			step = (uint64_t) spacings[i];
+			while(((uint64_t) ADF4351_RFOUT_MAX - (uint64_t) ADF4351_RFOUT_MIN) / step > 20000)
+				step += (uint64_t) spacings[i] * 7;
+			for(f = ((uint64_t) ADF4351_RFOUT_MIN / (uint64_t) spacings[i] + 1) * (uint64_t) spacings[i];
+				f <= (uint64_t) ADF4351_RFOUT_MAX; f += step)
+				compare(&g, f, refs[j], spacings[i]);
+			sprintf(name, "REFin %lu spacing %.0f", (unsigned long) refs[j], spacings[i]);
+			grid_stats(name, &g);
+		}
+	}
+
+	// Any frequency in Hz
+	srand(1);
+	for(j = 0; j < ARRAY(refs); ++j)
+	{
+		memset(&g, 0, sizeof(g));
+		for(n = 0; n < 100000; ++n)
+		{
+			f = (uint64_t) ADF4351_RFOUT_MIN +
+				(((uint64_t) rand() << 16) ^ rand()) % (uint64_t) (ADF4351_RFOUT_MAX - ADF4351_RFOUT_MIN);
+			compare(&g, f, refs[j], spacings[n % ARRAY(spacings)]);
+		}
+		sprintf(name, "REFin %lu any Hz", (unsigned long) refs[j]);
+		grid_stats(name, &g);
+	}
+
+	// Reference doubler and divider
+	memset(&g, 0, sizeof(g));
+	regs.r2.REFinMUL2 = 1;
+	for(f = 35000000; f <= 4400000000ULL; f += 1999000)
+		compare(&g, f, 10000000, 1000);
+	regs.r2.REFinMUL2 = 0;
+	regs.r2.REFinDIV2 = 1;
+	for(f = 35000000; f <= 4400000000ULL; f += 1999000)
+		compare(&g, f, 25000000, 1000);
+	regs.r2.REFinDIV2 = 0;
+	grid_stats("REFin x2 and /2", &g);
+
+	// Exact spot checks, 25 MHz reference
+	CHECK(ADF4351_Plan(100000000ULL, 25000000, 0, ADF4351_PLAN_ERROR, &p) == 0);
+	CHECK(p.exact && p.R == 1 && p.INT == 128 && p.FRAC == 0 && p.RFDivSel == 5);
+	CHECK(ADF4351_Plan(100001000ULL, 25000000, 0, ADF4351_PLAN_ERROR, &p) == 0);
+	CHECK(p.exact && p.R == 1 && p.MOD == 3125 && p.FRAC == 4);
+	// 1 Hz steps need a smaller PFD to be exact
+	CHECK(ADF4351_Plan(100000001ULL, 25000000, 0, ADF4351_PLAN_ERROR, &p) == 0);
+	CHECK(p.exact && p.R > 1);
+	CHECK(ADF4351_Plan(100000001ULL, 25000000, 1000, ADF4351_PLAN_SPUR, &p) == 0);
+	CHECK(p.FRAC == 0 && llabs(p.error_mHz) <= 1000000);
+	CHECK(ADF4351_Plan(4400000001ULL, 25000000, 0, ADF4351_PLAN_ERROR, &p) == ADF4351_RFout_RANGE);
+	CHECK(ADF4351_Plan(100000000ULL, 260000000, 0, ADF4351_PLAN_ERROR, &p) == ADF4351_REFin_RANGE);
+
+	// Low spur mode needs MOD >= 50
+	regs.r2.NoiseSpurMode = ADF4351_LOW_SPUR_MODE;
+	CHECK(ADF4351_Plan(100001000ULL, 25000000, 0, ADF4351_PLAN_ERROR, &p) == 0);
+	CHECK(p.exact && p.MOD >= 50);
+	CHECK(ADF4351_Plan(100000000ULL, 25000000, 0, ADF4351_PLAN_ERROR, &p) == 0);
+	CHECK(p.exact && p.FRAC == 0 && p.MOD >= 50);
+	regs.r2.NoiseSpurMode = ADF4351_LOW_NOISE_MODE;
+
+	// Sweep timing, 1 kHz steps from 100 MHz
+	if(argc > 1 && strcmp(argv[1], "bench") == 0)
+	{
+		n = 1000000;
+		start = now_us();
+		for(i = 0; i < n; ++i)
+			ADF4351_Config_ref(100e6 + i * 1000.0, 25e6, 1000.0, &calc);
+		t_ref = now_us() - start;
+		start = now_us();
+		for(i = 0; i < n; ++i)
+			ADF4351_Plan(100000000ULL + i * 1000ULL, 25000000, 0, ADF4351_PLAN_ERROR, &p);
+		t_plan = now_us() - start;
+		start = now_us();
+		for(i = 0; i < n; ++i)
+			ADF4351_Plan(100000000ULL + i * 1000ULL, 25000000, 500, ADF4351_PLAN_SPUR, &p);
+		t_spur = now_us() - start;
+		printf("1 kHz sweep, %ld steps: old %.1f nS, error %.1f nS, spur %.1f nS per step\n",
+			n, t_ref * 1000.0 / n, t_plan * 1000.0 / n, t_spur * 1000.0 / n);
+
+		start = now_us();
+		for(i = 0; i < n; ++i)
+			ADF4351_Plan(100000000ULL + i * 997ULL, 25000000, 0, ADF4351_PLAN_ERROR, &p);
+		t_plan = now_us() - start;
+		printf("997 Hz sweep, %ld steps: error %.1f nS per step\n", n, t_plan * 1000.0 / n);
+	}
+
+	return(test_result());
+}
+
+#endif	// ADF4351_TEST
@@ -241,6 +241,7 @@ void tft_bit_blit(window *win, uint8_t *ptr, int16_t x, int16_t y, int16_t w, in
 	int wdcount;
 	int ind;
 	uint8_t buf[2*64];
+	PROF_ZONE(PROF_TFT_BLIT);
 
 	// FIXME - do we just want to constrain the values or ignore the request ???
 	if ( tft_window_clip_args(tft,&x,&y,&w,&h) )
@@ -631,6 +632,7 @@ void tft_fillRectWH(window *win, int16_t x, int16_t y, int16_t w, int16_t h, uin
 	int wdcount;
     int ind;
     uint8_t buf[2*64];
+	PROF_ZONE(PROF_TFT_FILL);
 
 	// tft_rel_window clips
 	pixels = tft_rel_window(win, x,y,w,h);
@@ -43,6 +43,15 @@ static void _putc_win_len(struct _printf_t *p, char ch)
 	tft_putch((window *) p->buffer, ch);
 }
 
+static void _write_win(struct _printf_t *p, const char *s, int count)
+{
+	window *win = (window *) p->buffer;
+
+	p->sent += count;
+	while(count--)
+		tft_putch(win, *s++);
+}
+
 /// @brief tft_printf function
 /// @param[in] *win: Window Structure
 /// @param[in] fmt: printf forat string
@@ -55,6 +64,7 @@ int tft_printf(window *win, const char *fmt, ... )
     printf_t fn;
 
     fn.put = _putc_win;
+    fn.write = _write_win;
     fn.sent = 0;
     fn.buffer = (void *) win;
 
@@ -69,4 +79,25 @@ int tft_printf(window *win, const char *fmt, ... )
 
 }
 
+/// @brief tft_printf using a pre-parsed format
+/// @param[in] *win: Window Structure
+/// @param[in] *desc: printf_desc_t list, see PF() and printf_compile()
+/// @param[in] ...: vararg list or arguments
+/// @return size of string
+MEMSPACE
+int tft_printf_desc(window *win, const printf_desc_t *desc, ... )
+{
+    printf_t fn;
+    va_list va;
+
+    fn.put = _putc_win;
+    fn.write = _write_win;
+    fn.sent = 0;
+    fn.buffer = (void *) win;
 
+    va_start(va, desc);
+    _printf_desc_fn(&fn, desc, va);
+    va_end(va);
+
+	return(fn.sent);
+}
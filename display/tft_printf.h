@@ -28,5 +28,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 /* tft_printf.c */
 MEMSPACE int tft_printf ( window *win , const char *fmt , ...);
+MEMSPACE int tft_printf_desc ( window *win , const printf_desc_t *desc , ...);
 
 #endif
@@ -60,6 +60,7 @@ int uart0_printf(const char *format, ...)
 	va_list va;
 
     fn.put = _uart0_fn;
+    fn.write = NULL;
     fn.sent = 0;
    
     va_start(va, format);
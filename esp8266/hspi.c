@@ -265,6 +265,7 @@ static void hspi_readFIFO(uint8_t *read_data, int bytes)
 void hspi_TX(uint8_t *data, int count)
 {
 	int bytes;
+	PROF_ZONE(PROF_HSPI_TX);
 
 	while(count > 0)
 	{
@@ -38,6 +38,14 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 /// @brief malloc may be aliased to safecalloc
 #undef malloc
 
+#ifdef HEAP_TRACE
+/// @brief safe functions may be aliased to heap_trace functions
+#undef safecalloc
+#undef safemalloc
+#undef safemalloc_nozero
+#undef safefree
+#endif
+
 extern void * _heap_start;
 #define HEAP_START  ((uint32_t) & (_heap_start))
 #define HEAP_END    ((uint32_t) (0x3FFFC000UL - 1UL))
@@ -117,6 +125,17 @@ void PrintRam()
 		HEAP_START, HEAP_END, HEAP_END-HEAP_START);
 }
 
+/// @brief Report output to the console
+/// @param[in] *ctx: unused
+/// @param[in] *line: report line
+/// @return  void.
+/// @see report_put_t
+MEMSPACE 
+void report_put_console(void *ctx, char *line)
+{
+	printf("%s", line);
+}
+
 /// @brief Safe Calloc -  Display Error message if Calloc fails
 ///
 ///  - We check if the pointer was in the heap.
@@ -148,6 +167,23 @@ void *safemalloc(size_t size)
     return(safecalloc(size,1));
 }
 
+/// @brief Safe Malloc without clearing - Display Error message if Malloc fails
+///
+///  - For buffers the caller fills completely before use.
+/// @param[in] size:  size 
+/// @return  void.
+MEMSPACE 
+void *safemalloc_nozero(size_t size)
+{
+    void *p = (void *)os_malloc( size );
+    if(!p)
+    {
+        printf("safemalloc_nozero(%d) failed!\n", size);
+		PrintRam();
+    }
+    return(p);
+}
+
 /// @brief Safe free -  Only free a pointer if it is in malloc memory range.
 ///  We want to try to catch frees of static or bogus data
 ///
@@ -175,6 +211,265 @@ void safefree(void *p)
 }
 
 
+#ifdef HEAP_TRACE
+// =============================================
+// Heap tracing
+// =============================================
+// Each allocation carries a small header naming its call site so the
+// bytes outstanding per call site are known when it is freed.
+// The cost is a hash lookup of the call site per allocation, 792 bytes
+// for heap_sites[] and heap_totals and the 8 byte header. Most traced
+// allocations are buffers made once at start up, the connection pool
+// and pool.c objects are one block each, so about 20 are live when idle
+// and their headers add about 160 bytes. That is small enough to leave
+// enabled in field builds.
+
+/// @brief marks a live traced allocation
+#define HEAP_MAGIC 0x4854
+
+/// @brief header in front of each traced allocation, keeps 8 byte alignment
+typedef struct {
+	uint16_t magic;		// HEAP_MAGIC, cleared on free
+	uint16_t site;		// index into heap_sites[]
+	uint32_t size;		// requested size
+} heap_head_t;
+
+/// @brief allocation statistics for one call site
+typedef struct {
+	const char *file;	// __FILE__ of the call site, NULL if unused
+	uint16_t line;		// __LINE__ of the call site
+	uint16_t live;		// allocations outstanding
+	uint32_t allocs;	// allocations made
+	uint32_t bytes;		// bytes outstanding
+	uint32_t peak;		// high water mark of bytes outstanding
+	uint32_t mark;		// bytes outstanding at heap_mark()
+} heap_site_t;
+
+/// @brief call site table, a power of 2
+/// Call sites that do not fit are counted in heap_sites[0]
+#ifndef HEAP_SITES
+#define HEAP_SITES 32
+#endif
+
+static heap_site_t heap_sites[HEAP_SITES];
+
+/// @brief heap totals
+static struct {
+	uint32_t allocs;	// allocations made
+	uint32_t frees;		// allocations freed
+	uint32_t fails;		// allocations that failed
+	uint32_t bytes;		// bytes outstanding
+	uint32_t peak;		// high water mark of bytes outstanding
+	uint32_t min_free;	// low water mark of free heap
+} heap_totals;
+
+/// @brief Find or add a call site
+/// @param[in] file: __FILE__ of the call site
+/// @param[in] line: __LINE__ of the call site
+/// @return index into heap_sites[]
+MEMSPACE 
+static int heap_site(const char *file, int line)
+{
+	int i,n;
+	heap_site_t *sp;
+
+	// Same file always has the same string, compare pointers only
+	i = (((uint32_t) file >> 2) ^ (line * 31)) & (HEAP_SITES-1);
+	for(n=0;n<HEAP_SITES;++n)
+	{
+		// heap_sites[0] is the overflow site
+		if(i)
+		{
+			sp = &heap_sites[i];
+			if(sp->file == file && sp->line == line)
+				return(i);
+			if(!sp->file)
+			{
+				sp->file = file;
+				sp->line = line;
+				return(i);
+			}
+		}
+		i = (i + 1) & (HEAP_SITES-1);
+	}
+	heap_sites[0].file = "other";
+	return(0);
+}
+
+/// @brief Record a traced allocation
+/// @param[in] *p: allocation from the SDK, with room for the header
+/// @param[in] size:  size requested
+/// @param[in] file: __FILE__ of the call site
+/// @param[in] line: __LINE__ of the call site
+/// @return  memory after the header
+MEMSPACE 
+static void *heap_trace_add(void *p, size_t size, const char *file, int line)
+{
+	heap_head_t *h = p;
+	heap_site_t *sp;
+	uint32_t free_heap;
+
+	if(!p)
+	{
+		++heap_totals.fails;
+		printf("%s:%d alloc(%d) failed!\n", file, line, size);
+		PrintRam();
+		return(NULL);
+	}
+
+	h->magic = HEAP_MAGIC;
+	h->site = heap_site(file, line);
+	h->size = size;
+
+	sp = &heap_sites[h->site];
+	++sp->live;
+	++sp->allocs;
+	sp->bytes += size;
+	if(sp->bytes > sp->peak)
+		sp->peak = sp->bytes;
+
+	++heap_totals.allocs;
+	heap_totals.bytes += size;
+	if(heap_totals.bytes > heap_totals.peak)
+		heap_totals.peak = heap_totals.bytes;
+	free_heap = system_get_free_heap_size();
+	if(!heap_totals.min_free || free_heap < heap_totals.min_free)
+		heap_totals.min_free = free_heap;
+
+	return(h + 1);
+}
+
+/// @brief Traced calloc, see safecalloc()
+/// @param[in] nmemb: number of elements
+/// @param[in] size:  size of elements
+/// @param[in] file: __FILE__ of the call site
+/// @param[in] line: __LINE__ of the call site
+/// @return  void * buffer
+MEMSPACE 
+void *heap_trace_calloc(size_t nmemb, size_t size, const char *file, int line)
+{
+	size *= nmemb;
+	return(heap_trace_add((void *)os_zalloc(size + sizeof(heap_head_t)), size, file, line));
+}
+
+/// @brief Traced malloc without clearing, see safemalloc_nozero()
+/// @param[in] size:  size 
+/// @param[in] file: __FILE__ of the call site
+/// @param[in] line: __LINE__ of the call site
+/// @return  void * buffer
+MEMSPACE 
+void *heap_trace_malloc(size_t size, const char *file, int line)
+{
+	return(heap_trace_add((void *)os_malloc(size + sizeof(heap_head_t)), size, file, line));
+}
+
+/// @brief Traced free, see safefree()
+/// @param[in] p: pointer to free.
+/// @return  void.
+MEMSPACE 
+void heap_trace_free(void *p)
+{
+	heap_head_t *h = (heap_head_t *) p - 1;
+	heap_site_t *sp;
+
+	if( (uint32_t) h < HEAP_START || (uint32_t) p > HEAP_END)
+	{
+		printf("safefree: FREE ERROR (%08x)\n", p);
+		PrintRam();
+		return;
+	}
+	if(h->magic != HEAP_MAGIC || h->site >= HEAP_SITES)
+	{
+		printf("safefree: not allocated or freed twice (%08x)\n", p);
+		return;
+	}
+	h->magic = 0;
+
+	sp = &heap_sites[h->site];
+	--sp->live;
+	sp->bytes -= h->size;
+	++heap_totals.frees;
+	heap_totals.bytes -= h->size;
+	os_free((int) h);
+}
+
+/// @brief Find the largest block the heap can allocate
+/// Binary search with trial allocations, used only for reports
+/// @return largest block in bytes
+MEMSPACE 
+size_t heap_largest_block()
+{
+	size_t lo = 0;
+	size_t hi = system_get_free_heap_size();
+	size_t mid;
+	void *p;
+
+	while(hi - lo > 8)
+	{
+		mid = lo + ((hi - lo) >> 1);
+		p = (void *)os_malloc(mid);
+		if(p)
+		{
+			os_free((int) p);
+			lo = mid;
+		}
+		else
+			hi = mid;
+	}
+	return(lo);
+}
+
+/// @brief Remember bytes outstanding per call site for the next heap_report()
+/// @return  void.
+MEMSPACE 
+void heap_mark()
+{
+	int i;
+	for(i=0;i<HEAP_SITES;++i)
+		heap_sites[i].mark = heap_sites[i].bytes;
+}
+
+/// @brief Report heap totals and usage per call site
+/// Growth is the change in bytes outstanding since heap_mark(),
+/// call sites that keep growing are likely leaks
+/// @param[in] put: output function, NULL for the console
+/// @param[in] *ctx: argument for put
+/// @return  void.
+MEMSPACE 
+void heap_report(report_put_t put, void *ctx)
+{
+	char line[96];
+	int i;
+	heap_site_t *sp;
+
+	if(!put)
+		put = report_put_console;
+
+	snprintf(line, sizeof(line), "Heap Free(%lu) Min Free(%lu) Largest Block(%lu)\n",
+		(unsigned long) system_get_free_heap_size(),
+		(unsigned long) heap_totals.min_free,
+		(unsigned long) heap_largest_block());
+	put(ctx, line);
+	snprintf(line, sizeof(line), "Allocs(%lu) Frees(%lu) Fails(%lu) Bytes(%lu) Peak(%lu)\n",
+		(unsigned long) heap_totals.allocs, (unsigned long) heap_totals.frees,
+		(unsigned long) heap_totals.fails, (unsigned long) heap_totals.bytes,
+		(unsigned long) heap_totals.peak);
+	put(ctx, line);
+	put(ctx, "     live     allocs      bytes       peak     growth  site\n");
+	for(i=0;i<HEAP_SITES;++i)
+	{
+		sp = &heap_sites[i];
+		if(!sp->file)
+			continue;
+		snprintf(line, sizeof(line), "%9u %10lu %10lu %10lu %10ld  %s:%d\n",
+			(unsigned) sp->live, (unsigned long) sp->allocs,
+			(unsigned long) sp->bytes, (unsigned long) sp->peak,
+			(long) sp->bytes - (long) sp->mark, sp->file, (int) sp->line);
+		put(ctx, line);
+	}
+}
+#endif	// HEAP_TRACE
+
 /// @brief reset system
 /// @return  void
 MEMSPACE 
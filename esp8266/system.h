@@ -38,13 +38,39 @@ MEMSPACE void reset ( void );
 MEMSPACE void wdt_reset ( void );
 #endif
 
+/// @brief heap_report(), prof_stats() and prof_trace() output function, called once per line
+typedef void (*report_put_t)(void *ctx, char *line);
+
 MEMSPACE size_t freeRam ( void );
 MEMSPACE void PrintRam ( void );
+MEMSPACE void report_put_console ( void *ctx , char *line );
 MEMSPACE void *safecalloc ( size_t nmemb , size_t size );
 MEMSPACE void *safemalloc ( size_t size );
+MEMSPACE void *safemalloc_nozero ( size_t size );
 MEMSPACE void safefree ( void *p );
 MEMSPACE void reset ( void );
 MEMSPACE void wdt_reset ( void );
 
+#ifdef HEAP_TRACE
+MEMSPACE void *heap_trace_calloc ( size_t nmemb , size_t size , const char *file , int line );
+MEMSPACE void *heap_trace_malloc ( size_t size , const char *file , int line );
+MEMSPACE void heap_trace_free ( void *p );
+MEMSPACE size_t heap_largest_block ( void );
+MEMSPACE void heap_mark ( void );
+MEMSPACE void heap_report ( report_put_t put , void *ctx );
+
+// Record the call site of every allocation, see heap_report()
+// Defined after the prototypes above so they are not renamed
+#undef free
+#undef calloc
+#undef malloc
+#define free(p) heap_trace_free(p)
+#define calloc(n,s) heap_trace_calloc(n,s,__FILE__,__LINE__)
+#define malloc(s) heap_trace_calloc(s,1,__FILE__,__LINE__)
+#define safefree(p) heap_trace_free(p)
+#define safecalloc(n,s) heap_trace_calloc(n,s,__FILE__,__LINE__)
+#define safemalloc(s) heap_trace_calloc(s,1,__FILE__,__LINE__)
+#define safemalloc_nozero(s) heap_trace_malloc(s,__FILE__,__LINE__)
+#endif
 
 #endif // _SYSTEM_H_
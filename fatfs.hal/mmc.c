@@ -437,6 +437,7 @@ UINT count     /*< Sector count (1..128) */
 )
 {
     BYTE cmd;
+    PROF_ZONE(PROF_MMC_READ);
 
     if (!count) 
 	{
@@ -43,35 +43,38 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 extern DSTATUS Stat;
 
-/// @brief MMC timeout counter in ms
+/// @brief MMC timeout in ms, cleared when the timeout expires
 uint16_t _mmc_timeout = 0;
 
 /// @brief MMC SPI CLOCK cache
 uint32_t _mmc_clock = 0;
 
-// @brief MMC media status prescaler
-uint16_t _mmc_pre = 0;
+/// @brief Runs mmc_task() at 100HZ
+static wtimer_t mmc_timer;
+/// @brief Ends the timeout set by mmc_set_ms_timeout()
+static wtimer_t mmc_timeout_timer;
 
 /**
- @brief 1000HZ timer task
+ @brief 100HZ timer task
+ @param[in] arg: unused
  @return void
 */
-static void mmc_task(void)
+static void mmc_task(void *arg)
 {
-    if(_mmc_timeout)
-        _mmc_timeout--;
-
-    // 100HZ
-    if(_mmc_pre++  < 10)
-        return;
-
-    _mmc_pre = 0;
-
     mmc_disk_timerproc();
+}
 
+/**
+ @brief One shot timer task that ends an MMC timeout
+ @param[in] arg: unused
+ @return void
+*/
+static void mmc_timeout_task(void *arg)
+{
+    _mmc_timeout = 0;
 }
 
-/// @brief  Install MMC timer task: mmc_task()
+/// @brief  Install MMC timer tasks: mmc_task() and mmc_timeout_task()
 ///
 /// @see  mmc_task()
 /// @return  void
@@ -79,8 +82,9 @@ MEMSPACE
 void mmc_install_timer( void )
 {
     _mmc_timeout = 0;
-    if(set_timers(mmc_task,1) == -1)
-        printf("MMC Clock task init failed\n");
+    wtimer_init(&mmc_timeout_timer, mmc_timeout_task, NULL);
+    wtimer_init(&mmc_timer, mmc_task, NULL);
+    wtimer_start(&mmc_timer, TIMER_MS(10), TIMER_MS(10));
 }
 
 /// @brief  MMC SPI setup and chip select
@@ -163,6 +167,10 @@ void mmc_set_ms_timeout(uint16_t ms)
     mmc_cli();
     _mmc_timeout = ms;
     mmc_sei();
+    if(ms)
+        wtimer_start(&mmc_timeout_timer, TIMER_MS(ms), 0);
+    else
+        wtimer_cancel(&mmc_timeout_timer);
 }
 
 ///@brief Wait for timeout
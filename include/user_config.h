@@ -53,6 +53,12 @@ typedef enum { false, true } bool;
 
 // low level memory and flash reading code
 #include "esp8266/system.h"
+// Fixed size object pools
+#include "pool.h"
+// CCOUNT profiler zones
+#include "prof.h"
+// Periodic task table
+#include "periodic.h"
 
 #include "stringsup.h"
 
@@ -87,6 +93,7 @@ typedef enum { false, true } bool;
 #ifdef YIELD_TASK
 	#include "cont.h"
 	#include "user_task.h"
+	#include "sched.h"
 #endif
 
 // TIME and TIMER FUNCTION
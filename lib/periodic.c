@@ -0,0 +1,247 @@
+/**
+ @file periodic.c
+
+ @brief Periodic task table with deadlines, priorities and overrun statistics
+ Tasks are kept in a min-heap ordered by their next release time so
+ periodic_run() only looks at the top of the heap to know if anything is due.
+ When several tasks are due the lowest priority number runs first, so the
+ 1 mS tasks are not held up behind the 50 mS work.
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef USER_CONFIG
+#include "user_config.h"
+
+#ifdef AVR
+#include <stdlib.h>
+#endif
+#else
+// only used when testing standalone on linux
+#include <stdio.h>
+#include <stdint.h>
+#define MEMSPACE
+extern uint32_t system_get_time(void);
+#endif
+
+#include "lib/periodic.h"
+
+/// @brief min-heap of tasks by next release time
+static periodic_t *periodic_heap[PERIODIC_MAX];
+static int periodic_count = 0;
+
+/// @brief task table in the order it was given, for periodic_stats()
+static periodic_t *periodic_table = NULL;
+
+/// @brief Release time compare that works across system_get_time() wrap around
+#define PERIODIC_BEFORE(a,b) ((int32_t)((a)->next - (b)->next) < 0)
+#define PERIODIC_DUE(t,now) ((int32_t)((now) - (t)->next) >= 0)
+#define PERIODIC_PASSED(t,now) ((int32_t)((now) - (t)->next) > 0)
+
+/**
+  @brief Move a heap entry toward the root until its parent is released first
+  @param[in] i: heap index
+  @return void
+*/
+MEMSPACE
+static void periodic_up(int i)
+{
+	periodic_t *t = periodic_heap[i];
+	int parent;
+
+	while(i > 0)
+	{
+		parent = (i - 1) / 2;
+		if(!PERIODIC_BEFORE(t, periodic_heap[parent]))
+			break;
+		periodic_heap[i] = periodic_heap[parent];
+		i = parent;
+	}
+	periodic_heap[i] = t;
+}
+
+/**
+  @brief Move a heap entry toward the leaves until its children are released later
+  @param[in] i: heap index
+  @return void
+*/
+MEMSPACE
+static void periodic_down(int i)
+{
+	periodic_t *t = periodic_heap[i];
+	int child;
+
+	while((child = 2 * i + 1) < periodic_count)
+	{
+		if(child + 1 < periodic_count &&
+			PERIODIC_BEFORE(periodic_heap[child + 1], periodic_heap[child]))
+			++child;
+		if(!PERIODIC_BEFORE(periodic_heap[child], t))
+			break;
+		periodic_heap[i] = periodic_heap[child];
+		i = child;
+	}
+	periodic_heap[i] = t;
+}
+
+/**
+  @brief Start running a table of periodic tasks
+  All tasks are released at once, the first periodic_run() runs them by priority
+  @param[in] *table: task table
+  @param[in] count: number of tasks in the table
+  @return number of tasks added
+*/
+MEMSPACE
+int periodic_init(periodic_t *table, int count)
+{
+	uint32_t now = system_get_time();
+	int i;
+
+	if(count > PERIODIC_MAX)
+	{
+		printf("periodic_init: only %d of %d tasks added\n", PERIODIC_MAX, count);
+		count = PERIODIC_MAX;
+	}
+
+	periodic_table = table;
+	periodic_count = 0;
+	for(i = 0; i < count; ++i)
+	{
+		table[i].next = now;
+		if(!table[i].deadline)
+			table[i].deadline = table[i].period;
+		periodic_heap[periodic_count] = &table[i];
+		periodic_up(periodic_count++);
+	}
+	periodic_clear();
+	return(periodic_count);
+}
+
+/**
+  @brief Run the tasks that are due, most urgent first
+  The heap root only tells us if anything is due, each task run then
+  scans the whole table for the due task with the lowest priority number.
+  A call runs at most as many tasks as the table holds, a task that is
+  still due after running may be one of them, so the caller and the
+  other scheduler tasks get the CPU back
+  @return number of tasks run
+*/
+MEMSPACE
+int periodic_run(void)
+{
+	periodic_t *t;
+	uint32_t now, start, end;
+	int i, best, ran;
+
+	for(ran = 0; ran < periodic_count; ++ran)
+	{
+		now = system_get_time();
+		if(!PERIODIC_DUE(periodic_heap[0], now))
+			break;
+
+		// A task that is not due has no due tasks below it in the heap,
+		// but the table is small so just check every entry
+		best = 0;
+		for(i = 1; i < periodic_count; ++i)
+		{
+			t = periodic_heap[i];
+			if(!PERIODIC_DUE(t, now))
+				continue;
+			if(t->priority < periodic_heap[best]->priority ||
+				(t->priority == periodic_heap[best]->priority &&
+					PERIODIC_BEFORE(t, periodic_heap[best])))
+				best = i;
+		}
+		t = periodic_heap[best];
+
+		start = system_get_time();
+		t->fn();
+		end = system_get_time();
+
+		t->runs++;
+		t->us += (end - start);
+		if((end - start) > t->max)
+			t->max = end - start;
+		if((start - t->next) > t->late)
+			t->late = start - t->next;
+		if((end - t->next) > t->deadline)
+			t->overruns++;
+
+		// Next release, skipping any that have already passed
+		// A release at end can still start on time
+		t->next += t->period;
+		while(PERIODIC_PASSED(t, end))
+		{
+			t->next += t->period;
+			t->missed++;
+		}
+		periodic_down(best);
+	}
+	return(ran);
+}
+
+/**
+  @brief Clear the task statistics
+  @return void
+*/
+MEMSPACE
+void periodic_clear(void)
+{
+	periodic_t *t;
+	int i;
+
+	for(i = 0; i < periodic_count; ++i)
+	{
+		t = &periodic_table[i];
+		t->runs = 0;
+		t->overruns = 0;
+		t->missed = 0;
+		t->late = 0;
+		t->max = 0;
+		t->us = 0;
+	}
+}
+
+/**
+  @brief Display the periodic task statistics
+  Times are in microseconds
+  @return void
+*/
+MEMSPACE
+void periodic_stats(void)
+{
+	periodic_t *t;
+	int i;
+
+	printf("periodic  prio period  deadline runs       overrun  missed   late     max      avg\n");
+	for(i = 0; i < periodic_count; ++i)
+	{
+		t = &periodic_table[i];
+		printf("%-9s %-4d %-7lu %-8lu %-10lu %-8lu %-8lu %-8lu %-8lu %lu\n",
+			t->name,
+			(int) t->priority,
+			(unsigned long) t->period,
+			(unsigned long) t->deadline,
+			(unsigned long) t->runs,
+			(unsigned long) t->overruns,
+			(unsigned long) t->missed,
+			(unsigned long) t->late,
+			(unsigned long) t->max,
+			(unsigned long) (t->runs ? t->us / t->runs : 0));
+	}
+}
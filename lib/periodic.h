@@ -0,0 +1,65 @@
+/**
+ @file periodic.h
+
+ @brief Periodic task table with deadlines, priorities and overrun statistics
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _PERIODIC_H_
+#define _PERIODIC_H_
+
+// Named address space
+#ifndef MEMSPACE
+#define MEMSPACE /**/
+#endif
+
+/// @brief Maximum number of periodic tasks
+#ifndef PERIODIC_MAX
+#define PERIODIC_MAX 16
+#endif
+
+/// @brief A task run every period microseconds
+/// It should finish within deadline microseconds of its release time
+/// When several tasks are due the lowest priority number runs first
+typedef struct {
+	char *name;
+	void (*fn)(void);
+	uint32_t period;	/* microseconds */
+	uint32_t deadline;	/* microseconds after release, 0 for the period */
+	uint8_t priority;	/* 0 is the most urgent */
+	uint32_t next;		/* next release, system_get_time() */
+	uint32_t runs;		/* times run */
+	uint32_t overruns;	/* runs that finished after the deadline */
+	uint32_t missed;	/* releases skipped because the task was too late */
+	uint32_t late;		/* longest delay from release to start in microseconds */
+	uint32_t max;		/* longest run in microseconds */
+	uint32_t us;		/* total run time in microseconds */
+} periodic_t;
+
+/// @brief Table entry initializer
+#define PERIODIC(name, fn, period, deadline, priority) \
+	{ name, fn, period, deadline, priority, 0, 0, 0, 0, 0, 0, 0 }
+
+/* periodic.c */
+MEMSPACE int periodic_init ( periodic_t *table , int count );
+MEMSPACE int periodic_run ( void );
+MEMSPACE void periodic_clear ( void );
+MEMSPACE void periodic_stats ( void );
+
+#endif	// _PERIODIC_H_
@@ -0,0 +1,146 @@
+/**
+ @file pool.c
+
+ @brief Fixed size object pools
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+  
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Objects that are allocated and freed over and over, in differing sizes,
+  slowly fragment the small ESP8266 heap until a large allocation fails
+  even with plenty of free memory.
+  A pool holds objects of one size in one block allocated once.
+  It falls back to the heap when it is full so callers never see
+  a failure the heap alone would not have given them.
+  See test_pool.c for a heap soak test.
+*/
+
+#ifdef USER_CONFIG
+#include "user_config.h"
+
+#ifdef AVR
+#include <stdlib.h>
+#endif
+#else
+// only used when testing standalone on linux
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#define MEMSPACE
+extern void *safecalloc(size_t nmemb, size_t size);
+extern void *safemalloc_nozero(size_t size);
+extern void safefree(void *p);
+#endif
+
+#include <string.h>
+#include "pool.h"
+
+/**
+  @brief Allocate the pool block and build the free list
+  Called by pool_alloc() on first use
+  @param[in] *pl: pool
+  @return 1 on success, 0 if the block could not be allocated
+*/
+MEMSPACE
+int pool_init(pool_t *pl)
+{
+	int i;
+	char *ptr;
+
+	if(pl->base)
+		return(1);
+
+	pl->base = safemalloc_nozero((size_t) pl->size * pl->count);
+	if(!pl->base)
+		return(0);
+
+	pl->free = NULL;
+	ptr = pl->base + (size_t) pl->size * pl->count;
+	for(i=0;i<pl->count;++i)
+	{
+		ptr -= pl->size;
+		*(void **) ptr = pl->free;
+		pl->free = ptr;
+	}
+	pl->used = 0;
+	return(1);
+}
+
+/**
+  @brief Allocate a zeroed object from a pool, or the heap if it is empty
+  @param[in] *pl: pool
+  @return object, or NULL if there is no memory
+*/
+MEMSPACE
+void *pool_alloc(pool_t *pl)
+{
+	void *p;
+
+	// The heap may have room for the pool later, so keep trying
+	if(!pl->base)
+		pool_init(pl);
+
+	p = pl->free;
+	if(!p)
+	{
+		++pl->heap;
+		return(safecalloc(pl->size,1));
+	}
+	pl->free = *(void **) p;
+	if(++pl->used > pl->peak)
+		pl->peak = pl->used;
+	memset(p, 0, pl->size);
+	return(p);
+}
+
+/**
+  @brief Return an object to its pool, or free it if it came from the heap
+  @param[in] *pl: pool
+  @param[in] *p: object
+  @return void
+*/
+MEMSPACE
+void pool_free(pool_t *pl, void *p)
+{
+	char *ptr = p;
+
+	if(!p)
+		return;
+	if(pl->base && ptr >= pl->base && ptr < pl->base + (size_t) pl->size * pl->count)
+	{
+		*(void **) p = pl->free;
+		pl->free = p;
+		--pl->used;
+		return;
+	}
+	safefree(p);
+}
+
+/**
+  @brief Display pool usage
+  @param[in] *pl: pool
+  @param[in] *name: pool name
+  @return void
+*/
+MEMSPACE
+void pool_stats(pool_t *pl, char *name)
+{
+	printf("%s pool: size:%d, count:%d, used:%d, peak:%d, heap:%lu\n",
+		name, (int) pl->size, (int) pl->count, (int) pl->used, (int) pl->peak,
+		(unsigned long) pl->heap);
+}
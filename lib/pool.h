@@ -0,0 +1,54 @@
+/**
+ @file pool.h
+
+ @brief Fixed size object pools
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+  
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+// Named address space
+#ifndef MEMSPACE
+#define MEMSPACE /**/
+#endif
+
+/// @brief pool of fixed size objects
+/// The objects are carved from one block allocated on first use
+/// When the pool is empty objects come from the heap instead
+typedef struct {
+	uint16_t size;	/* object size, a multiple of 4 */
+	uint16_t count;	/* objects in the pool */
+	uint16_t used;	/* pool objects in use */
+	uint16_t peak;	/* most pool objects in use at once */
+	uint32_t heap;	/* allocations that fell back to the heap */
+	char *base;		/* pool block */
+	void *free;		/* free list, linked through the first word */
+} pool_t;
+
+/// @brief static initializer for a pool of count objects of size bytes
+#define POOL_INIT(size,count) { (((size) + 3) & ~3), (count), 0, 0, 0, NULL, NULL }
+
+/* pool.c */
+MEMSPACE int pool_init ( pool_t *pl );
+MEMSPACE void *pool_alloc ( pool_t *pl );
+MEMSPACE void pool_free ( pool_t *pl , void *p );
+MEMSPACE void pool_stats ( pool_t *pl , char *name );
+
+#endif
@@ -0,0 +1,278 @@
+/**
+ @file prof.c
+
+ @brief Cycle counting profiler
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+  
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Zones are marked with PROF_ZONE() at the top of a block.
+  Entry and exit read the CCOUNT CPU cycle counter, add the time to the
+  zone statistics and log both events in a small ring buffer.
+  prof_trace() exports the ring buffer in the Trace Event JSON format,
+  save it to a file and open it in chrome://tracing or ui.perfetto.dev.
+  CCOUNT wraps every 53 seconds at 80MHz, so a single zone visit must
+  be shorter than that.
+
+  A zone in a sched task may yield, process_requests() waits in
+  wait_send() for example. sched_run() calls prof_switch() around each
+  task so zone statistics count only the cycles their own task ran,
+  not the time it was switched out. Each trace event carries its task
+  as the "tid", so the zones of each task nest on their own track.
+*/
+
+#include "user_config.h"
+
+#include <string.h>
+#include "lib/prof.h"
+
+#ifdef PROFILE
+
+/// @brief zone names, the order must match the zone enum in prof.h
+static const char *prof_names[PROF_ZONES] = {
+	"tft_fillRectWH",
+	"tft_bit_blit",
+	"hspi_TX",
+	"mmc_disk_read",
+	"process_requests",
+	"wire_draw"
+};
+
+/// @brief zone statistics
+static prof_zone_t prof_zones[PROF_ZONES];
+
+/// @brief event ring buffer
+static prof_event_t prof_events[PROF_EVENTS];
+/// @brief events logged, the next event goes in prof_events[prof_head % PROF_EVENTS]
+static uint32_t prof_head;
+/// @brief stop logging while the ring buffer is exported
+static uint8_t prof_paused;
+
+/// @brief cycles each task has run, up to its last switch out
+static uint32_t prof_run[PROF_TASKS];
+/// @brief running task
+static uint8_t prof_task;
+/// @brief CCOUNT when the running task was switched in
+static uint32_t prof_slice;
+
+/**
+  @brief Switch the running task, called by sched_run()
+  @param[in] task: task id, 0 when no task is running
+  @return void
+*/
+void prof_switch(int task)
+{
+	uint32_t now = prof_ccount();
+
+	prof_run[prof_task] += now - prof_slice;
+	prof_task = (task >= 0 && task < PROF_TASKS) ? task : 0;
+	prof_slice = now;
+}
+
+/**
+  @brief Cycles the running task has run
+  @param[in] ccount: CCOUNT now
+  @return cycles, differences are correct across a wrap
+*/
+static uint32_t prof_run_cycles(uint32_t ccount)
+{
+	return(prof_run[prof_task] + (ccount - prof_slice));
+}
+
+/**
+  @brief Log an event in the ring buffer
+  @param[in] zone: zone number
+  @param[in] exit: 0 for entry, 1 for exit
+  @param[in] ccount: CCOUNT of the event
+  @return void
+*/
+static void prof_event(int zone, int exit, uint32_t ccount)
+{
+	prof_event_t *e;
+
+	if(prof_paused)
+		return;
+	e = &prof_events[prof_head++ & (PROF_EVENTS-1)];
+	e->ccount = ccount;
+	e->zone = zone;
+	e->exit = exit;
+	e->task = prof_task;
+}
+
+/**
+  @brief Enter a zone, see PROF_ZONE()
+  @param[in] zone: zone number
+  @return zone state for prof_exit()
+*/
+prof_scope_t prof_enter(int zone)
+{
+	prof_scope_t scope;
+	uint32_t now = prof_ccount();
+
+	scope.zone = zone;
+	scope.task = prof_task;
+	scope.start = prof_run_cycles(now);
+	prof_event(zone, 0, now);
+	return(scope);
+}
+
+/**
+  @brief Exit a zone and update its statistics, see PROF_ZONE()
+  The zone is exited by the task that entered it, on the same stack
+  @param[in] *scope: zone state from prof_enter()
+  @return void
+*/
+void prof_exit(prof_scope_t *scope)
+{
+	uint32_t now = prof_ccount();
+	uint32_t cycles = prof_run_cycles(now) - scope->start;
+	prof_zone_t *z = &prof_zones[scope->zone];
+
+	if(!z->count++ || cycles < z->min)
+		z->min = cycles;
+	if(cycles > z->max)
+		z->max = cycles;
+	z->total += cycles;
+	prof_event(scope->zone, 1, now);
+}
+
+/**
+  @brief Clear zone statistics and the event ring buffer
+  @return void
+*/
+MEMSPACE
+void prof_clear()
+{
+	memset(prof_zones, 0, sizeof(prof_zones));
+	prof_head = 0;
+}
+
+/**
+  @brief Convert cycles to microseconds with 3 decimals
+  @param[out] *buf: result
+  @param[in] max: size of buf
+  @param[in] cycles: CPU cycles
+  @param[in] mhz: CPU clock in MHz
+  @return buf
+*/
+MEMSPACE
+static char *prof_us(char *buf, int max, uint64_t cycles, uint32_t mhz)
+{
+	snprintf(buf, max, "%lu.%03lu",
+		(unsigned long) (cycles / mhz),
+		(unsigned long) ((cycles % mhz) * 1000 / mhz));
+	return(buf);
+}
+
+/**
+  @brief Report statistics of each zone, times in microseconds
+  Times are cycles the zone's task ran, time switched out is not counted
+  @param[in] put: output function, NULL for the console
+  @param[in] *ctx: argument for put
+  @return void
+*/
+MEMSPACE
+void prof_stats(report_put_t put, void *ctx)
+{
+	char line[96];
+	char total[16], avg[16], min[16], max[16];
+	uint32_t mhz = system_get_cpu_freq();
+	prof_zone_t *z;
+	int i;
+
+	if(!put)
+		put = report_put_console;
+
+	put(ctx, "   count       total(uS)   avg(uS)   min(uS)   max(uS)  zone\n");
+	for(i=0;i<PROF_ZONES;++i)
+	{
+		z = &prof_zones[i];
+		if(!z->count)
+			continue;
+		snprintf(line, sizeof(line), "%8lu %15s %9s %9s %9s  %s\n",
+			(unsigned long) z->count,
+			prof_us(total, sizeof(total), z->total, mhz),
+			prof_us(avg, sizeof(avg), z->total / z->count, mhz),
+			prof_us(min, sizeof(min), z->min, mhz),
+			prof_us(max, sizeof(max), z->max, mhz),
+			prof_names[i]);
+		put(ctx, line);
+	}
+}
+
+/**
+  @brief Export the event ring buffer as Trace Event JSON
+  Times are relative to the oldest event in the buffer.
+  Each task is a thread, "tid" is its task id, 0 outside of tasks.
+  Exits from zones entered before the oldest event are skipped.
+  @param[in] put: output function, NULL for the console
+  @param[in] *ctx: argument for put
+  @return void
+*/
+MEMSPACE
+void prof_trace(report_put_t put, void *ctx)
+{
+	char line[96];
+	char ts[24];
+	uint32_t mhz = system_get_cpu_freq();
+	uint32_t i, head, count, last;
+	uint64_t cycles = 0;
+	prof_event_t *e;
+	uint8_t depth[PROF_TASKS];
+	char *sep = "";
+
+	if(!put)
+		put = report_put_console;
+
+	prof_paused = 1;
+	memset(depth, 0, sizeof(depth));
+
+	head = prof_head;
+	count = head < PROF_EVENTS ? head : PROF_EVENTS;
+	last = prof_events[(head - count) & (PROF_EVENTS-1)].ccount;
+
+	put(ctx, "{\"traceEvents\":[\n");
+	for(i = head - count; i != head; ++i)
+	{
+		e = &prof_events[i & (PROF_EVENTS-1)];
+		// Differences are correct across a CCOUNT wrap
+		cycles += (uint32_t) (e->ccount - last);
+		last = e->ccount;
+
+		if(e->exit)
+		{
+			if(!depth[e->task])
+				continue;
+			--depth[e->task];
+		}
+		else
+			++depth[e->task];
+
+		snprintf(line, sizeof(line),
+			"%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%s,\"pid\":1,\"tid\":%d}\n",
+			sep, prof_names[e->zone], e->exit ? 'E' : 'B',
+			prof_us(ts, sizeof(ts), cycles, mhz), (int) e->task);
+		put(ctx, line);
+		sep = ",";
+	}
+	put(ctx, "],\"displayTimeUnit\":\"ns\"}\n");
+
+	prof_paused = 0;
+}
+
+#endif	// PROFILE
@@ -0,0 +1,103 @@
+/**
+ @file prof.h
+
+ @brief Cycle counting profiler
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+  
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+  
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _PROF_H_
+#define _PROF_H_
+
+// Named address space
+#ifndef MEMSPACE
+#define MEMSPACE /**/
+#endif
+
+/// @brief profiled zones
+/// The order must match prof_names[] in prof.c
+enum {
+	PROF_TFT_FILL,
+	PROF_TFT_BLIT,
+	PROF_HSPI_TX,
+	PROF_MMC_READ,
+	PROF_WEB_REQUEST,
+	PROF_WIRE_DRAW,
+	PROF_ZONES
+};
+
+/// @brief size of the event ring buffer, a power of 2
+#ifndef PROF_EVENTS
+#define PROF_EVENTS 128
+#endif
+
+/// @brief tasks with their own run time, SCHED_TASKS + 1
+/// Task 0 is code that does not run in a sched task
+#ifndef PROF_TASKS
+#define PROF_TASKS 9
+#endif
+
+/// @brief zone entry or exit in the event ring buffer
+typedef struct {
+	uint32_t ccount;	/* CCOUNT when the event happened */
+	uint8_t zone;		/* zone number */
+	uint8_t exit;		/* 0 for entry, 1 for exit */
+	uint8_t task;		/* task running the zone */
+} prof_event_t;
+
+/// @brief aggregate statistics of a zone, in CPU cycles
+typedef struct {
+	uint32_t count;		/* zone exits */
+	uint64_t total;		/* cycles spent in the zone */
+	uint32_t min;		/* shortest time in the zone */
+	uint32_t max;		/* longest time in the zone */
+} prof_zone_t;
+
+/// @brief state of an entered zone, see PROF_ZONE()
+typedef struct {
+	uint8_t zone;
+	uint8_t task;
+	uint32_t start;	/* run time of the task on entry */
+} prof_scope_t;
+
+/// @brief Profile the rest of the enclosing block as zone
+/// The zone is exited when the block is left, by any return
+#ifdef PROFILE
+#define PROF_ZONE(zone) prof_scope_t __prof_scope __attribute__((cleanup(prof_exit))) = prof_enter(zone)
+#else
+#define PROF_ZONE(zone)
+#endif
+
+/// @brief Read the CPU cycle counter
+/// @return CCOUNT
+static inline uint32_t prof_ccount(void)
+{
+	uint32_t ccount;
+	__asm__ __volatile__("rsr %0,ccount" : "=a" (ccount));
+	return(ccount);
+}
+
+/* prof.c */
+void prof_switch ( int task );
+prof_scope_t prof_enter ( int zone );
+void prof_exit ( prof_scope_t *scope );
+MEMSPACE void prof_clear ( void );
+MEMSPACE void prof_stats ( report_put_t put , void *ctx );
+MEMSPACE void prof_trace ( report_put_t put , void *ctx );
+
+#endif
@@ -21,7 +21,17 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifdef USER_CONFIG
 #include "user_config.h"
+#else
+// only used when testing standalone on linux
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#define MEMSPACE
+extern void *safecalloc(size_t nmemb, size_t size);
+#endif
 
 #include <string.h>
 #include "lib/stringsup.h"
@@ -116,6 +126,101 @@ toupper(int c)
     return(c);
 }
 
+// =============================================
+// Word at a time support
+// =============================================
+// Strings are read with aligned 32 bit loads, the only way the ESP8266
+// can read flash, and tested or compared a whole word at a time.
+// An aligned load never crosses into the next word so reading the rest
+// of the word holding the EOS is safe.
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error stringsup word functions ASSUME little endian
+#endif
+
+///@brief 32 bit word that may alias characters
+typedef uint32_t __attribute__((__may_alias__)) word_t;
+
+///@brief address bits within a word
+#define WORD_MASK 3
+
+///@brief nonzero if word w has a zero byte
+/// The lowest flagged byte is the first zero byte
+#define WORD_HAS_ZERO(w) (((w) - 0x01010101UL) & ~(w) & 0x80808080UL)
+
+///@brief byte i, 0 .. 3, of word w in address order
+#define WORD_BYTE(w,i) ((uint8_t) ((w) >> ((i) << 3)))
+
+///@brief mask of the bytes in a word before address offset 0 .. 3
+static const uint32_t word_head[] = { 0, 0xffUL, 0xffffUL, 0xffffffUL };
+
+///@brief aligned word holding address p
+#define WORD_AT(p) (*(const word_t *) ((uintptr_t) (p) & ~WORD_MASK))
+
+///@brief Read a byte at any address with an aligned load
+/// @param[in] p: address
+/// @return byte
+MEMSPACE
+static inline uint8_t byte_at(const void *p)
+{
+    return(WORD_BYTE(WORD_AT(p), (uintptr_t) p & WORD_MASK));
+}
+
+///@brief Convert lower case bytes in a word to upper case, see toupper()
+/// @param[in] w: word
+/// @return word with upper case bytes
+MEMSPACE
+static uint32_t word_toupper(uint32_t w)
+{
+    uint32_t low7 = w & 0x7f7f7f7fUL;
+    // high bit set for bytes >= 'a', and for bytes > 'z'
+    uint32_t ge_a = low7 + 0x1f1f1f1fUL;
+    uint32_t gt_z = low7 + 0x05050505UL;
+
+    // 0x80 >> 2 is 'a' - 'A'
+    return(w - (((ge_a & ~gt_z & ~w) & 0x80808080UL) >> 2));
+}
+
+///@brief Count leading bytes of two strings that match a word at a time
+/// Only strings with the same word alignment are compared, and only
+/// whole words without an EOS, so callers finish with a byte compare.
+/// @param[in] str: string to match.
+/// @param[in] pat: pattern to compare.
+/// @param[in] len: maximum number of bytes to compare
+/// @param[in] nocase: compare without case
+/// @return number of matching bytes, none of them EOS
+MEMSPACE
+static size_t word_match(const char *str, const char *pat, size_t len, int nocase)
+{
+    const word_t *wp1, *wp2;
+    const char *end = pat;
+    uint32_t w1, w2;
+    uint32_t off = (uintptr_t) pat & WORD_MASK;
+
+    if(((uintptr_t) str & WORD_MASK) != off)
+        return(0);
+
+    wp1 = &WORD_AT(str);
+    wp2 = &WORD_AT(pat);
+    // bytes before the strings compare equal and are not an EOS
+    while(len >= 4 - off)
+    {
+        w1 = *wp1++ | word_head[off];
+        w2 = *wp2++ | word_head[off];
+        if(nocase)
+        {
+            w1 = word_toupper(w1);
+            w2 = word_toupper(w2);
+        }
+        if(w1 != w2 || WORD_HAS_ZERO(w2))
+            break;
+        end = (const char *) wp2;
+        len -= 4 - off;
+        off = 0;
+    }
+    return(end - pat);
+}
+
 /// @brief find a character in a string of maximum size
 /// @param[in] str: string
 /// @param[in] c: character
@@ -125,10 +230,26 @@ MEMSPACE
 void *memchr(const void *str, int c, size_t size)
 {
     const uint8_t *ptr = str;
+    uint32_t pat = (uint8_t) c * 0x01010101UL;
+
+    while(size && ((uintptr_t) ptr & WORD_MASK))
+    {
+        if (byte_at(ptr) == (uint8_t) c) 
+            return (void *) ptr;
+        ++ptr;
+        --size;
+    }
+    // skip words without c
+    while(size >= 4 && !WORD_HAS_ZERO(*(const word_t *) ptr ^ pat))
+    {
+        ptr += 4;
+        size -= 4;
+    }
     while(size--)
     {
-        if (*ptr++ == (uint8_t) c) 
-            return (void *) (ptr - 1);
+        if (byte_at(ptr) == (uint8_t) c) 
+            return (void *) ptr;
+        ++ptr;
     } 
     return NULL;
 }
@@ -145,11 +266,17 @@ size_t
 WEAK_ATR
 strlen(const char *str)
 {
-    int len=0;
-    // String length
-    while(*str++)
-        ++len;
-    return(len);
+    const word_t *wp = &WORD_AT(str);
+    uint32_t w;
+    int i;
+
+    // bytes before str are not an EOS
+    w = *wp | word_head[(uintptr_t) str & WORD_MASK];
+    while(!WORD_HAS_ZERO(w))
+        w = *++wp;
+    for(i = 0; WORD_BYTE(w,i); ++i)
+        ;
+    return(((const char *) wp + i) - str);
 }
 
 /// @brief copy a string 
@@ -161,12 +288,29 @@ MEMSPACE
 strcpy(char *dest, const char *src)
 {
     char *ptr = dest;
-    while(*src)
+    uint32_t w;
+
+    while((uintptr_t) src & WORD_MASK)
     {
-        *ptr++ = *src++;
-    } 
-    *ptr ++ = 0;
-    return (ptr);
+        if(!(*ptr++ = byte_at(src++)))
+            return(dest);
+    }
+    // whole words when dest is also aligned
+    if(!((uintptr_t) ptr & WORD_MASK))
+    {
+        for(;;)
+        {
+            w = *(const word_t *) src;
+            if(WORD_HAS_ZERO(w))
+                break;
+            *(word_t *) ptr = w;
+            ptr += 4;
+            src += 4;
+        }
+    }
+    while((*ptr++ = byte_at(src++)))
+        ;
+    return (dest);
 }
 
 /// @brief copy a string of at most N characters
@@ -198,10 +342,7 @@ MEMSPACE
 WEAK_ATR
 char * strcat(char *dest, const char *src)
 {
-    char *ptr = dest;
-    while(*ptr)
-        ++ptr;
-    strcpy(ptr,src);
+    strcpy(dest + strlen(dest),src);
     return(dest);
 }
 
@@ -213,10 +354,12 @@ MEMSPACE
 WEAK_ATR
 char * strncat(char *dest, const char *src, size_t max)
 {
-    char *ptr = dest;
-    while(*ptr)
-        ++ptr;
-    strncpy(ptr,src,max);
+    char *ptr = dest + strlen(dest);
+
+    // Unlike strncpy() there is no padding, only an EOS
+    while(max-- && *src)
+        *ptr++ = *src++;
+    *ptr = 0;
     return(dest);
 }
 
@@ -363,10 +506,14 @@ strcmp(const char *str, const char *pat)
 {
     int ret = 0;
     int c1,c2;
+    size_t skip = word_match(str, pat, ~(size_t) 0, 0);
+
+    str += skip;
+    pat += skip;
     while (1)
     {
-        c1 = *str++;
-        c2 = *pat++;
+        c1 = (char) byte_at(str++);
+        c2 = (char) byte_at(pat++);
         if ( (ret = c1 - c2) != 0 || c2 == 0)
             break;
     }
@@ -387,10 +534,15 @@ strncmp(const char *str, const char *pat, size_t len)
 {
     int ret = 0;
     int c1,c2;
+    size_t skip = word_match(str, pat, len, 0);
+
+    str += skip;
+    pat += skip;
+    len -= skip;
     while (len--)
     {
-        c1 = *str++;
-        c2 = *pat++;
+        c1 = (char) byte_at(str++);
+        c2 = (char) byte_at(pat++);
         if ( (ret = c1 - c2) != 0 || c2 == 0)
             break;
     }
@@ -411,10 +563,14 @@ strcasecmp(const char *str, const char *pat)
 {
     int ret = 0;
     int c1,c2;
+    size_t skip = word_match(str, pat, ~(size_t) 0, 1);
+
+    str += skip;
+    pat += skip;
     while (1)
     {
-        c1 = toupper(*str++);
-        c2 = toupper(*pat++);
+        c1 = toupper((char) byte_at(str++));
+        c2 = toupper((char) byte_at(pat++));
         if ( (ret = c1 - c2) != 0 || c2 == 0)
             break;
     }
@@ -433,10 +589,15 @@ strncasecmp(const char *str, const char *pat, size_t len)
 {
     int ret = 0;
     int c1,c2;
+    size_t skip = word_match(str, pat, len, 1);
+
+    str += skip;
+    pat += skip;
+    len -= skip;
     while (len--)
     {
-        c1 = toupper(*str++);
-        c2 = toupper(*pat++);
+        c1 = toupper((char) byte_at(str++));
+        c2 = toupper((char) byte_at(pat++));
         if ( (ret = c1 - c2) != 0 || c2 == 0)
             break;
     }
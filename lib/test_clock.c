@@ -0,0 +1,278 @@
+/**
+ @file test_clock.c
+
+ @brief Host tests for the disciplined clock with a simulated counter
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// only used when testing standalone on linux
+#ifdef CLOCK_TEST
+
+// No stdlib.h, its clockid_t clashes with the one in timer.h
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define MEMSPACE
+#define SYSTEM_TASK_HZ 1000L
+typedef struct timespec ts_t;
+#include "timer.h"
+#include "testsup.h"
+
+// timer.c uses these from the system task code
+void disable_system_task(void) {}
+void enable_system_task(void) {}
+void install_timers_isr(void) {}
+
+/// @brief Time in microseconds, the counter follows it
+uint64_t true_us;
+/// @brief Reference time minus true_us, moved to make offsets
+int64_t ref_adj;
+/// @brief Counter value at true_us 0
+uint32_t counter_start;
+/// @brief Counter rate error in parts per billion, positive runs fast
+int64_t counter_ppb;
+
+/// @brief Simulated system_get_time(), follows true_us with a rate error
+uint32_t clock_counter(void)
+{
+	return(counter_start + (uint32_t) (true_us + (int64_t) true_us * counter_ppb / 1000000000LL));
+}
+
+/// @brief Last clock_real_us() seen by tick()
+uint64_t last_real;
+/// @brief Times the clock was seen running backwards
+long backwards;
+
+/// @brief Advance the reference time one system tick and run the timers
+/// The clock timer calls clock_update() every 1000 ticks
+void tick(void)
+{
+	uint64_t real;
+
+	true_us += SYSTEM_TASK_TIC_US;
+	execute_timers();
+	real = clock_real_us();
+	if(real < last_real)
+		++backwards;
+	last_real = real;
+}
+
+/// @brief Run the clock for a number of seconds
+void run(long sec)
+{
+	long k;
+
+	for(k = 0; k < sec * SYSTEM_TASK_HZ; ++k)
+		tick();
+}
+
+/// @brief Reference time minus our time in microseconds
+int64_t offset(void)
+{
+	return((int64_t) (true_us + ref_adj - clock_real_us()));
+}
+
+/// @brief Start again at true_us 0 with a counter rate error
+/// Tests run whole seconds so clock_update() stays on the second
+void reset(uint32_t start, int64_t ppb)
+{
+	struct timespec ts;
+
+	true_us = 0;
+	ref_adj = 0;
+	counter_start = start;
+	counter_ppb = ppb;
+	ts.tv_sec = 0;
+	ts.tv_nsec = 0;
+	clock_settime(CLOCK_REALTIME, &ts);
+	last_real = clock_real_us();
+	backwards = 0;
+}
+
+// ==========================================================
+
+/// @brief The 32 bit counter wraps every 71.6 minutes, monotonic time must not
+void test_wrap(void)
+{
+	uint64_t mono;
+	struct timespec ts;
+
+	reset(0xFFFFFFFFUL - 10000000UL, 0);
+	mono = clock_mono_us();
+	// The first offset steps, however small
+	CHECK(clock_discipline(0) == 1);
+	run(20);
+	// 20 S later the counter has wrapped 10 S ago
+	CHECK(clock_counter() < 10000001UL);
+	CHECK(clock_mono_us() - mono == 20000000ULL);
+	CHECK(clock_mono_us() > 0xFFFFFFFFULL);
+	CHECK(offset() == 0);
+	clock_gettime(CLOCK_REALTIME, &ts);
+	CHECK(ts.tv_sec == 20 && ts.tv_nsec == 0);
+	// A second wrap with only clock_update() running
+	run(4295);
+	CHECK(clock_mono_us() - mono == 4315000000ULL);
+	CHECK(offset() == 0);
+	CHECK(backwards == 0);
+	printf("wrap: mono %llu uS, offset %lld uS\n",
+		(unsigned long long) clock_mono_us(), (long long) offset());
+}
+
+/// @brief The first offset steps, after that only offsets over CLOCK_STEP_US do
+void test_step(void)
+{
+	reset(12345, 0);
+	run(1);
+
+	// One past the limit steps, both ways
+	ref_adj += CLOCK_STEP_US + 1;
+	CHECK(clock_discipline(offset()) == 1);
+	CHECK(offset() == 0);
+	ref_adj -= CLOCK_STEP_US + 1;
+	CHECK(clock_discipline(offset()) == 1);
+	CHECK(offset() == 0);
+	// Only a step may move the clock back
+	last_real = clock_real_us();
+
+	// The limit itself slews, the clock does not move yet
+	ref_adj += CLOCK_STEP_US;
+	CHECK(clock_discipline(offset()) == 0);
+	CHECK(offset() == CLOCK_STEP_US);
+	ref_adj -= CLOCK_STEP_US;
+	CHECK(clock_discipline(offset()) == 0);
+	CHECK(offset() == 0);
+	CHECK(backwards == 0);
+}
+
+/**
+  @brief Slews run at CLOCK_SLEW_PPM, never faster, then stop
+  @param[in] slew: offset to slew in microseconds
+*/
+void test_slew_one(int64_t slew)
+{
+	int64_t per_sec = (int64_t) CLOCK_SLEW_PPM * (slew < 0 ? -1 : 1);
+	int64_t left = slew;
+	uint64_t real;
+	long sec = 0;
+
+	reset(0x80000000UL, 0);
+	clock_discipline(0);
+	run(1);
+	ref_adj += slew;
+	CHECK(clock_discipline(offset()) == 0);
+	while(left)
+	{
+		real = clock_real_us();
+		run(1);
+		++sec;
+		if(left / per_sec)
+		{
+			CHECK(clock_real_us() - real == 1000000ULL + per_sec);
+			left -= per_sec;
+		}
+		else
+		{
+			CHECK(clock_real_us() - real == 1000000ULL + left);
+			left = 0;
+		}
+		CHECK(offset() == left);
+	}
+	// Once the slew is used up the clock runs at the counter rate again
+	real = clock_real_us();
+	run(10);
+	CHECK(clock_real_us() - real == 10000000ULL);
+	CHECK(offset() == 0);
+	CHECK(backwards == 0);
+	printf("slew: %lld uS in %ld S\n", (long long) slew, sec);
+}
+
+void test_slew(void)
+{
+	test_slew_one(CLOCK_STEP_US);
+	test_slew_one(-CLOCK_STEP_US);
+	test_slew_one(1234);
+	test_slew_one(-50000);
+}
+
+/**
+  @brief Poll a reference every 64 S like network/ntp.c, the frequency
+  correction must cancel the counter rate error
+  @param[in] ppb: counter rate error in parts per billion
+*/
+void test_freq_one(int64_t ppb)
+{
+	int64_t off = 0;
+	uint64_t real;
+	int poll;
+
+	reset(0xFFFF0000UL, ppb);
+	run(1);
+	ref_adj += 5000000;
+	CHECK(clock_discipline(offset()) == 1);
+	for(poll = 0; poll < 60; ++poll)
+	{
+		run(64);
+		off = offset();
+		CHECK(off <= CLOCK_STEP_US && off >= -CLOCK_STEP_US);
+		CHECK(clock_discipline(off) == 0);
+	}
+	// Well under 1 ppm, 64 uS over one poll
+	CHECK(off <= 4 && off >= -4);
+
+	// Let the last slew finish, then free run for 1000 S
+	run(64);
+	off = offset();
+	real = clock_real_us();
+	run(1000);
+	// 10 ppb, so the correction keeps its fraction of a ppm
+	CHECK((int64_t) (clock_real_us() - real) - 1000000000LL <= 10);
+	CHECK((int64_t) (clock_real_us() - real) - 1000000000LL >= -10);
+	CHECK(backwards == 0);
+	printf("freq: %+lld ppb counter, offset %lld uS after 60 polls, %+lld uS over 1000 S\n",
+		(long long) ppb, (long long) off,
+		(long long) ((int64_t) (clock_real_us() - real) - 1000000000LL));
+}
+
+void test_freq(void)
+{
+	// Errors that are not whole ppm need the carried remainder
+	test_freq_one(0);
+	test_freq_one(40300);
+	test_freq_one(-120750);
+	test_freq_one(CLOCK_FREQ_MAX / 2 + 123);
+}
+
+// ==========================================================
+
+int main(int argc, char *argv[])
+{
+	init_timers();
+
+	test_wrap();
+	test_step();
+	test_slew();
+	test_freq();
+	clock_stats();
+
+	return(test_result());
+}
+
+#endif	// CLOCK_TEST
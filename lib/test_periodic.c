@@ -0,0 +1,218 @@
+/**
+ @file test_periodic.c
+
+ @brief Host tests for the periodic task table with a simulated clock
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// only used when testing standalone on linux
+#ifdef PERIODIC_TEST
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MEMSPACE
+#include "lib/periodic.h"
+#include "lib/testsup.h"
+
+/// @brief Simulated system_get_time(), tasks advance it by their run time
+uint32_t now_us;
+
+uint32_t system_get_time(void)
+{
+	return(now_us);
+}
+
+/// @brief Run time of each task in microseconds
+uint32_t cost_a, cost_b, cost_c;
+
+/// @brief Task names in the order they ran
+char order[256];
+int orders;
+
+void log_run(char c)
+{
+	if(orders < (int) sizeof(order) - 1)
+		order[orders++] = c;
+	order[orders] = 0;
+}
+
+void task_a(void) { log_run('a'); now_us += cost_a; }
+void task_b(void) { log_run('b'); now_us += cost_b; }
+void task_c(void) { log_run('c'); now_us += cost_c; }
+
+/// @brief Clear the run order log
+void log_clear(void)
+{
+	orders = 0;
+	order[0] = 0;
+}
+
+// ==========================================================
+
+/// @brief Due tasks run by priority, equal priorities by release time
+void test_priority(void)
+{
+	periodic_t table[] = {
+		PERIODIC("a", task_a, 10000, 0, 2),
+		PERIODIC("b", task_b, 10000, 0, 0),
+		PERIODIC("c", task_c, 10000, 0, 1),
+	};
+
+	now_us = 1000;
+	cost_a = cost_b = cost_c = 0;
+	log_clear();
+	CHECK(periodic_init(table, 3) == 3);
+	CHECK(table[0].deadline == 10000);
+
+	// All are released at once
+	CHECK(periodic_run() == 3);
+	CHECK(strcmp(order, "bca") == 0);
+	CHECK(periodic_run() == 0);
+
+	// a is released first but b and c are more urgent
+	now_us += 10000;
+	CHECK(periodic_run() == 3);
+	CHECK(strcmp(order, "bcabca") == 0);
+
+	// Equal priority, c was due 200 uS before a
+	log_clear();
+	table[0].priority = 1;
+	table[1].next += 5000;
+	now_us = table[2].next + 300;
+	table[0].next = now_us - 100;
+	CHECK(periodic_run() == 2);
+	CHECK(strcmp(order, "ca") == 0);
+	CHECK(table[2].late == 300 && table[0].late == 100);
+}
+
+/**
+  @brief Run a 1 mS, 10 mS and 50 mS task across the system_get_time() wrap
+  The loop polls every 50 uS, each task runs for 10 uS
+*/
+void test_wrap(void)
+{
+	periodic_t table[] = {
+		PERIODIC("a", task_a, 1000, 0, 0),
+		PERIODIC("b", task_b, 10000, 0, 1),
+		PERIODIC("c", task_c, 50000, 0, 2),
+	};
+	uint32_t start = 0xFFFFFFFFUL - 250000;
+	uint32_t duration = 1000000;
+	int i;
+
+	now_us = start;
+	cost_a = cost_b = cost_c = 10;
+	log_clear();
+	periodic_init(table, 3);
+	while(now_us - start < duration)
+	{
+		periodic_run();
+		now_us += 50;
+	}
+	CHECK(now_us < start);
+
+	// Released at start and every period after it
+	CHECK(table[0].runs == duration / 1000);
+	CHECK(table[1].runs == duration / 10000);
+	CHECK(table[2].runs == duration / 50000);
+	for(i = 0; i < 3; ++i)
+	{
+		CHECK(table[i].overruns == 0 && table[i].missed == 0);
+		// a poll interval plus the other two tasks
+		CHECK(table[i].late <= 50 + 20);
+		CHECK(table[i].max == 10 && table[i].us == table[i].runs * 10);
+	}
+	printf("wrap: %lu, %lu and %lu runs, late %lu, %lu and %lu uS\n",
+		(unsigned long) table[0].runs, (unsigned long) table[1].runs,
+		(unsigned long) table[2].runs, (unsigned long) table[0].late,
+		(unsigned long) table[1].late, (unsigned long) table[2].late);
+}
+
+/**
+  @brief Overruns count runs that end after the deadline,
+  missed counts releases skipped because a run ended after them
+*/
+void test_overrun(void)
+{
+	periodic_t table[] = {
+		PERIODIC("a", task_a, 1000, 500, 0),
+	};
+	int k;
+
+	// a ends 700 uS after its release, past its 500 uS deadline
+	now_us = 5000;
+	cost_a = 700;
+	periodic_init(table, 1);
+	for(k = 0; k < 5; ++k)
+	{
+		now_us = table[0].next;
+		CHECK(periodic_run() == 1);
+	}
+	CHECK(table[0].runs == 5 && table[0].overruns == 5 && table[0].missed == 0);
+	CHECK(table[0].max == 700 && table[0].late == 0);
+
+	// Inside its deadline
+	cost_a = 400;
+	periodic_clear();
+	for(k = 0; k < 5; ++k)
+	{
+		now_us = table[0].next;
+		CHECK(periodic_run() == 1);
+	}
+	CHECK(table[0].runs == 5 && table[0].overruns == 0 && table[0].missed == 0);
+
+	// 3500 uS runs skip the releases 1000, 2000 and 3000 uS later
+	table[0].deadline = 1000;
+	cost_a = 3500;
+	periodic_clear();
+	for(k = 0; k < 5; ++k)
+	{
+		now_us = table[0].next;
+		CHECK(periodic_run() == 1);
+		CHECK(table[0].next == now_us + 500);
+	}
+	CHECK(table[0].runs == 5 && table[0].overruns == 5 && table[0].missed == 15);
+
+	// Started 2500 uS late, the run ends on the release 3000 uS after
+	// its own, that release is not missed and runs next
+	cost_a = 500;
+	periodic_clear();
+	now_us = table[0].next + 2500;
+	CHECK(periodic_run() == 1);
+	CHECK(table[0].late == 2500 && table[0].overruns == 1 && table[0].missed == 2);
+	CHECK(table[0].next == now_us);
+	CHECK(periodic_run() == 1);
+	CHECK(table[0].runs == 2 && table[0].late == 2500);
+	periodic_stats();
+}
+
+// ==========================================================
+
+int main(int argc, char *argv[])
+{
+	test_priority();
+	test_wrap();
+	test_overrun();
+
+	return(test_result());
+}
+
+#endif	// PERIODIC_TEST
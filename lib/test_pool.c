@@ -0,0 +1,343 @@
+/**
+ @file test_pool.c
+
+ @brief Host tests and heap soak test for the fixed size object pools
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// only used when testing standalone on linux
+#ifdef POOL_TEST
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pool.h"
+#include "testsup.h"
+
+// ==========================================================
+// First fit heap with block headers and coalescing, like the SDK heap
+
+/// @brief Heap size, about what is left on an ESP8266 with the web server
+#define HEAP_SIZE 40960
+
+typedef struct blk {
+	uint32_t size;
+	uint32_t used;
+	struct blk *next;
+} blk_t;
+
+static unsigned char heap[HEAP_SIZE] __attribute__((aligned(8)));
+static blk_t *heap_first;
+static long heap_fails;
+
+void heap_init(void)
+{
+	heap_first = (blk_t *) heap;
+	heap_first->size = HEAP_SIZE;
+	heap_first->used = 0;
+	heap_first->next = NULL;
+	heap_fails = 0;
+}
+
+void *heap_alloc(size_t size)
+{
+	blk_t *b, *r;
+
+	size = (size + sizeof(blk_t) + 7) & ~7;
+	if(size < 32)
+		size = 32;
+	for(b = heap_first; b; b = b->next)
+	{
+		if(b->used || b->size < size)
+			continue;
+		if(b->size - size >= 32)
+		{
+			r = (blk_t *) ((char *) b + size);
+			r->size = b->size - size;
+			r->used = 0;
+			r->next = b->next;
+			b->next = r;
+			b->size = size;
+		}
+		b->used = 1;
+		return((char *) b + sizeof(blk_t));
+	}
+	++heap_fails;
+	return(NULL);
+}
+
+void heap_free(void *p)
+{
+	blk_t *b;
+
+	if(!p)
+		return;
+	b = (blk_t *) ((char *) p - sizeof(blk_t));
+	b->used = 0;
+	for(b = heap_first; b; b = b->next)
+	{
+		while(!b->used && b->next && !b->next->used)
+		{
+			b->size += b->next->size;
+			b->next = b->next->next;
+		}
+	}
+}
+
+/// @brief Free memory and largest free block
+void heap_stats(size_t *freemem, size_t *largest)
+{
+	blk_t *b;
+
+	*freemem = 0;
+	*largest = 0;
+	for(b = heap_first; b; b = b->next)
+	{
+		if(b->used)
+			continue;
+		*freemem += b->size;
+		if(b->size > *largest)
+			*largest = b->size;
+	}
+}
+
+// pool.c uses these from esp8266/system.c
+void *safecalloc(size_t nmemb, size_t size)
+{
+	void *p = heap_alloc(nmemb * size);
+	if(p)
+		memset(p, 0, nmemb * size);
+	return(p);
+}
+
+void *safemalloc_nozero(size_t size)
+{
+	return(heap_alloc(size));
+}
+
+void safefree(void *p)
+{
+	heap_free(p);
+}
+
+// ==========================================================
+// pool_alloc() and pool_free()
+
+void test_pool(void)
+{
+	pool_t pl = POOL_INIT(10, 2);
+	char *a, *b, *c;
+	size_t freemem, largest;
+
+	heap_init();
+	CHECK(pl.size == 12);
+
+	a = pool_alloc(&pl);
+	b = pool_alloc(&pl);
+	CHECK(a && b && a != b);
+	CHECK(pl.base != NULL && pl.used == 2 && pl.heap == 0);
+	CHECK(a >= pl.base && a < pl.base + 24);
+	CHECK(b >= pl.base && b < pl.base + 24);
+	CHECK(a[0] == 0 && a[11] == 0);
+
+	// pool is empty, falls back to the heap
+	c = pool_alloc(&pl);
+	CHECK(c && (c < pl.base || c >= pl.base + 24));
+	CHECK(pl.heap == 1 && pl.used == 2 && pl.peak == 2);
+
+	memset(a, 0x55, 12);
+	pool_free(&pl, a);
+	pool_free(&pl, c);
+	pool_free(&pl, NULL);
+	CHECK(pl.used == 1);
+
+	// objects are cleared on reuse
+	a = pool_alloc(&pl);
+	CHECK(a && a[0] == 0 && a[11] == 0 && pl.used == 2);
+	pool_free(&pl, a);
+	pool_free(&pl, b);
+	CHECK(pl.used == 0);
+
+	// only the pool block is left on the heap
+	heap_stats(&freemem, &largest);
+	CHECK(freemem == largest);
+	CHECK(freemem == HEAP_SIZE - ((24 + sizeof(blk_t) + 7) & ~7));
+
+	// no room for the pool block, every object comes from the heap
+	heap_init();
+	pl = (pool_t) POOL_INIT(HEAP_SIZE, 2);
+	a = pool_alloc(&pl);
+	CHECK(a == NULL && pl.base == NULL && pl.heap == 1);
+}
+
+// ==========================================================
+// Heap soak test
+//
+// Each simulated web request opens 1-2 files, some send an html_msg(),
+// compile a template or queue pending receive data. Long lived background
+// objects, such as WebSocket and NTP buffers and strings, churn alongside.
+
+/// @brief Object sizes on the ESP8266
+#define SOAK_FILE 40
+#define SOAK_FIL 556
+#define SOAK_MSG (1024 + 4)
+#define SOAK_TPL 56
+#define SOAK_PENDING 1460
+
+typedef struct {
+	size_t largest;	// largest free block at the end
+	size_t low;		// smallest largest free block seen
+	double frag;	// worst 1 - largest / free seen
+	long fails;		// failed allocations
+} soak_t;
+
+/**
+  @brief Run the soak test
+  @param[in] requests: requests to simulate
+  @param[in] live: background objects
+  @param[in] size: largest background object
+  @param[in] count: pool size, 0 for heap only
+  @param[out] *res: results
+*/
+void soak(long requests, int live, int size, int count, soak_t *res)
+{
+	pool_t file_pool = POOL_INIT(SOAK_FILE, count);
+	pool_t fil_pool = POOL_INIT(SOAK_FIL, count);
+	void *objects[256];
+	void *fs[2], *fh[2], *pend, *m;
+	size_t freemem, largest;
+	long r;
+	int i, n, k;
+
+	heap_init();
+	srand(7);
+	memset(objects, 0, sizeof(objects));
+	res->low = HEAP_SIZE;
+	res->frag = 0;
+
+	// connection pool, TCP and UART queues are allocated once at startup
+	heap_alloc(2 * 1004 + 200);
+	heap_alloc(512);
+	heap_alloc(1024);
+
+	for(r = 0; r < requests; ++r)
+	{
+		n = 1 + rand() % 2;
+		for(i = 0; i < n; ++i)
+		{
+			fs[i] = count ? pool_alloc(&file_pool) : safecalloc(SOAK_FILE, 1);
+			fh[i] = count ? pool_alloc(&fil_pool) : safecalloc(SOAK_FIL, 1);
+		}
+		k = 1 + rand() % SOAK_PENDING;
+		pend = (rand() % 4 == 0) ? heap_alloc(k) : NULL;
+
+		// background allocation in the middle of the request
+		k = rand() % live;
+		if(objects[k])
+		{
+			heap_free(objects[k]);
+			objects[k] = NULL;
+		}
+		else
+			objects[k] = heap_alloc(16 + rand() % size);
+
+		if(rand() % 8 == 0)
+		{
+			m = heap_alloc(SOAK_TPL);
+			heap_free(m);
+		}
+		if(rand() % 5 == 0)
+		{
+			m = heap_alloc(SOAK_MSG);
+			heap_free(m);
+		}
+
+		for(i = n - 1; i >= 0; --i)
+		{
+			if(count)
+			{
+				pool_free(&fil_pool, fh[i]);
+				pool_free(&file_pool, fs[i]);
+			}
+			else
+			{
+				heap_free(fh[i]);
+				heap_free(fs[i]);
+			}
+		}
+		heap_free(pend);
+
+		heap_stats(&freemem, &largest);
+		if(largest < res->low)
+			res->low = largest;
+		if(freemem && 1.0 - (double) largest / freemem > res->frag)
+			res->frag = 1.0 - (double) largest / freemem;
+	}
+	heap_stats(&freemem, &res->largest);
+	res->fails = heap_fails;
+}
+
+/**
+  @brief Soak test table, heap only against FILE_POOL 1 and 2
+  @param[in] requests: requests per run
+  @return 1 if the pools were never worse than the heap, otherwise 0
+*/
+int soak_table(long requests)
+{
+	static const int load[][2] = { { 24, 300 }, { 64, 400 }, { 96, 600 } };
+	soak_t res[3];
+	int i, c, ok = 1;
+
+	printf("Soak test, %ld requests, %d byte heap\n", requests, HEAP_SIZE);
+	printf("  background    heap only               FILE_POOL 1             FILE_POOL 2\n");
+	printf("  objects/size  largest  min    frag    largest  min    frag    largest  min    frag\n");
+	for(i = 0; i < 3; ++i)
+	{
+		for(c = 0; c < 3; ++c)
+			soak(requests, load[i][0], load[i][1], c, &res[c]);
+		printf("  %2d / %3d    ", load[i][0], load[i][1]);
+		for(c = 0; c < 3; ++c)
+			printf("  %5lu    %5lu  %4.1f%%", (unsigned long) res[c].largest,
+				(unsigned long) res[c].low, res[c].frag * 100);
+		printf("\n");
+		for(c = 0; c < 3; ++c)
+			CHECK(res[c].fails == 0);
+		// FILE_POOL 1 is the default, it must never lose to the heap
+		if(res[1].low < res[0].low || res[1].frag > res[0].frag)
+			ok = 0;
+	}
+	return(ok);
+}
+
+int main(int argc, char *argv[])
+{
+	long requests = 20000;
+
+	if(argc > 1 && strcmp(argv[1], "soak") == 0)
+		requests = (argc > 2) ? atol(argv[2]) : 1000000;
+
+	test_pool();
+	CHECK(soak_table(requests));
+
+	return(test_result());
+}
+
+#endif	// POOL_TEST
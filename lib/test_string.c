@@ -0,0 +1,416 @@
+/**
+ @file test_string.c
+
+ @brief Host tests and benchmark for the word at a time string functions
+ Each function in stringsup.c is checked against the byte at a time
+ version it replaced and against the C library, over every alignment
+ of both strings, lengths 0 .. 40, high bit bytes and embedded EOS.
+
+ @par Copyright &copy; 2016 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// only used when testing standalone on linux
+#ifdef STRING_TEST
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#define MEMSPACE
+#include "stringsup.h"
+#include "testsup.h"
+
+/// @brief Sign of a compare result
+#define SIGN(x) (((x) > 0) - ((x) < 0))
+
+// stringsup.c uses this from esp8266/system.c
+void *safecalloc(size_t nmemb, size_t size)
+{
+	return(calloc(nmemb, size));
+}
+
+// ==========================================================
+// The byte at a time versions stringsup.c used before
+
+__attribute__((noinline))
+size_t old_strlen(const char *str)
+{
+	int len=0;
+	while(*str++)
+		++len;
+	return(len);
+}
+
+__attribute__((noinline))
+char *old_strcpy(char *dest, const char *src)
+{
+	char *ptr = dest;
+	while(*src)
+		*ptr++ = *src++;
+	*ptr ++ = 0;
+	return (ptr);
+}
+
+__attribute__((noinline))
+int old_strcmp(const char *str, const char *pat)
+{
+	int ret = 0;
+	int c1,c2;
+	while (1)
+	{
+		c1 = *str++;
+		c2 = *pat++;
+		if ( (ret = c1 - c2) != 0 || c2 == 0)
+			break;
+	}
+	return(ret);
+}
+
+__attribute__((noinline))
+int old_strncmp(const char *str, const char *pat, size_t len)
+{
+	int ret = 0;
+	int c1,c2;
+	while (len--)
+	{
+		c1 = *str++;
+		c2 = *pat++;
+		if ( (ret = c1 - c2) != 0 || c2 == 0)
+			break;
+	}
+	return(ret);
+}
+
+__attribute__((noinline))
+int old_strcasecmp(const char *str, const char *pat)
+{
+	int ret = 0;
+	int c1,c2;
+	while (1)
+	{
+		c1 = toupper(*str++);
+		c2 = toupper(*pat++);
+		if ( (ret = c1 - c2) != 0 || c2 == 0)
+			break;
+	}
+	return(ret);
+}
+
+__attribute__((noinline))
+int old_strncasecmp(const char *str, const char *pat, size_t len)
+{
+	int ret = 0;
+	int c1,c2;
+	while (len--)
+	{
+		c1 = toupper(*str++);
+		c2 = toupper(*pat++);
+		if ( (ret = c1 - c2) != 0 || c2 == 0)
+			break;
+	}
+	return(ret);
+}
+
+__attribute__((noinline))
+void *old_memchr(const void *str, int c, size_t size)
+{
+	const uint8_t *ptr = str;
+	while(size--)
+	{
+		if (*ptr++ == (uint8_t) c)
+			return (void *) (ptr - 1);
+	}
+	return NULL;
+}
+
+// ==========================================================
+// The C library versions, stringsup.c replaces them in this program
+
+size_t (*libc_strlen)(const char *);
+char *(*libc_strcpy)(char *, const char *);
+int (*libc_strcmp)(const char *, const char *);
+int (*libc_strncmp)(const char *, const char *, size_t);
+int (*libc_strcasecmp)(const char *, const char *);
+int (*libc_strncasecmp)(const char *, const char *, size_t);
+void *(*libc_memchr)(const void *, int, size_t);
+
+void libc_init(void)
+{
+	libc_strlen = dlsym(RTLD_NEXT, "strlen");
+	libc_strcpy = dlsym(RTLD_NEXT, "strcpy");
+	libc_strcmp = dlsym(RTLD_NEXT, "strcmp");
+	libc_strncmp = dlsym(RTLD_NEXT, "strncmp");
+	libc_strcasecmp = dlsym(RTLD_NEXT, "strcasecmp");
+	libc_strncasecmp = dlsym(RTLD_NEXT, "strncasecmp");
+	libc_memchr = dlsym(RTLD_NEXT, "memchr");
+	CHECK(libc_strlen && libc_strcpy && libc_strcmp && libc_strncmp);
+	CHECK(libc_strcasecmp && libc_strncasecmp && libc_memchr);
+	// Make sure these are not the functions under test
+	CHECK(libc_strlen != strlen && libc_strcmp != strcmp);
+}
+
+// ==========================================================
+// Randomized equivalence test
+
+#define MAXLEN 40
+#define GUARD 16
+
+/// @brief Bytes that matter to the word tests, case folding and sign
+static const char alphabet[] = "aAzZ@[`{_09 \x7f\x80\xc1\xe1\xff";
+
+/// @brief ASCII letters only differ in case
+static int is_ascii(const char *s)
+{
+	for(; *s; ++s)
+		if((uint8_t) *s >= 0x80)
+			return(0);
+	return(1);
+}
+
+/// @brief ASCII without the bytes between 'Z' and 'a'
+/// toupper() and tolower() sort these differently against letters
+static int is_alnum_only(const char *s)
+{
+	for(; *s; ++s)
+		if((uint8_t) *s >= 0x80 || (*s > 'Z' && *s < 'a'))
+			return(0);
+	return(1);
+}
+
+/// @brief Fill a string, often with long runs that match other strings
+static void random_string(char *s, int len)
+{
+	int i;
+	for(i = 0; i < len; ++i)
+		s[i] = (rand() % 4) ? 'a' + rand() % 3 : alphabet[rand() % (sizeof(alphabet) - 1)];
+	s[len] = 0;
+}
+
+/// @brief Make pat from str with a few changes, case flips and length change
+static void mutate(char *pat, const char *str, int len)
+{
+	int i, n;
+
+	memcpy(pat, str, len + 1);
+	for(n = rand() % 3; n; --n)
+	{
+		i = rand() % (len + 1);
+		switch(rand() % 4)
+		{
+		case 0:
+			pat[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+			break;
+		case 1:
+			// Case flip
+			if(pat[i] >= 'a' && pat[i] <= 'z')
+				pat[i] -= 'a' - 'A';
+			else if(pat[i] >= 'A' && pat[i] <= 'Z')
+				pat[i] += 'a' - 'A';
+			break;
+		case 2:
+			// Shorter
+			pat[i] = 0;
+			break;
+		default:
+			break;
+		}
+	}
+	if(rand() % 4 == 0)
+	{
+		// Longer
+		n = strlen(pat);
+		if(n < MAXLEN)
+		{
+			pat[n] = 'a' + rand() % 3;
+			pat[n + 1] = 0;
+		}
+	}
+}
+
+/**
+  @brief Compare every function with the byte version and the C library
+  @param[in] count: random string pairs per alignment pair
+  @return number of cases run
+*/
+long test_equivalence(int count)
+{
+	char sbuf[MAXLEN + 2 * GUARD + 8], pbuf[MAXLEN + 2 * GUARD + 8];
+	char dbuf[MAXLEN + 2 * GUARD + 8], rbuf[MAXLEN + 2 * GUARD + 8];
+	char tmp[MAXLEN + 2];
+	char *s, *p, *d, *r, *ret;
+	int sa, pa, i, len, n, c;
+	long cases = 0;
+
+	srand(1);
+	for(sa = 0; sa < 8; ++sa)
+	for(pa = 0; pa < 8; ++pa)
+	for(i = 0; i < count; ++i)
+	{
+		// Bytes after the EOS are random, the word loads read them
+		memset(sbuf, rand(), sizeof(sbuf));
+		memset(pbuf, rand(), sizeof(pbuf));
+		s = sbuf + GUARD + sa;
+		p = pbuf + GUARD + pa;
+		len = rand() % (MAXLEN + 1);
+		random_string(tmp, len);
+		memcpy(s, tmp, len + 1);
+		mutate(p, s, len);
+		n = rand() % (MAXLEN + 4);
+
+		CHECK(strlen(s) == old_strlen(s) && strlen(s) == libc_strlen(s));
+
+		CHECK(strcmp(s, p) == old_strcmp(s, p));
+		CHECK(strncmp(s, p, n) == old_strncmp(s, p, n));
+		CHECK(strcasecmp(s, p) == old_strcasecmp(s, p));
+		CHECK(strncasecmp(s, p, n) == old_strncasecmp(s, p, n));
+
+		// The C library compares unsigned bytes and folds to lower case
+		if(is_ascii(s) && is_ascii(p))
+		{
+			CHECK(SIGN(strcmp(s, p)) == SIGN(libc_strcmp(s, p)));
+			CHECK(SIGN(strncmp(s, p, n)) == SIGN(libc_strncmp(s, p, n)));
+		}
+		CHECK(!strcmp(s, p) == !libc_strcmp(s, p));
+		CHECK(!strncmp(s, p, n) == !libc_strncmp(s, p, n));
+		CHECK(!strcasecmp(s, p) == !libc_strcasecmp(s, p));
+		CHECK(!strncasecmp(s, p, n) == !libc_strncasecmp(s, p, n));
+		if(is_alnum_only(s) && is_alnum_only(p))
+		{
+			CHECK(SIGN(strcasecmp(s, p)) == SIGN(libc_strcasecmp(s, p)));
+			CHECK(SIGN(strncasecmp(s, p, n)) == SIGN(libc_strncasecmp(s, p, n)));
+		}
+
+		c = (rand() & 1) ? s[rand() % (len + 1)] : alphabet[rand() % (sizeof(alphabet) - 1)];
+		CHECK(memchr(s, c, n) == old_memchr(s, c, n));
+		CHECK(memchr(s, c, n) == libc_memchr(s, c, n));
+
+		// strcpy to every destination alignment, the guard bytes are untouched
+		memset(dbuf, 0x5a, sizeof(dbuf));
+		memset(rbuf, 0x5a, sizeof(rbuf));
+		d = dbuf + GUARD + (rand() % 8);
+		r = rbuf + (d - dbuf);
+		ret = strcpy(d, s);
+		libc_strcpy(r, s);
+		CHECK(ret == d);
+		CHECK(memcmp(dbuf, rbuf, sizeof(dbuf)) == 0);
+
+		++cases;
+	}
+	return(cases);
+}
+
+/// @brief Fixed cases, strings that end at each byte of a word
+void test_edges(void)
+{
+	char buf[32] __attribute__((aligned(8)));
+	char pat[32] __attribute__((aligned(8)));
+	int i;
+
+	for(i = 0; i < 16; ++i)
+	{
+		memset(buf, 'x', sizeof(buf));
+		buf[i] = 0;
+		CHECK(strlen(buf) == i);
+		CHECK(strlen(buf + (i & 3)) == i - (i & 3));
+		memcpy(pat, buf, sizeof(pat));
+		CHECK(strcmp(buf, pat) == 0 && strcasecmp(buf, pat) == 0);
+		pat[i] = 'x';
+		pat[i + 1] = 0;
+		CHECK(strcmp(buf, pat) < 0 && strcmp(pat, buf) > 0);
+		CHECK(strncmp(buf, pat, i) == 0 && strncmp(buf, pat, i + 1) < 0);
+		CHECK(memchr(buf, 0, sizeof(buf)) == buf + i);
+	}
+	// Case folding only changes letters
+	CHECK(strcasecmp("HeLLo@[`{", "hEllO@[`{") == 0);
+	CHECK(strcasecmp("@", "`") != 0 && strcasecmp("[", "{") != 0);
+	CHECK(strcasecmp("\xe1", "\xc1") != 0);
+	CHECK(strncasecmp("ABCDEFGHx", "abcdefghy", 8) == 0);
+	CHECK(strncasecmp("ABCDEFGHx", "abcdefghy", 9) < 0);
+}
+
+// ==========================================================
+// Benchmark
+
+double elapsed(struct timespec *t0, struct timespec *t1)
+{
+	return((t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) * 1e-9);
+}
+
+volatile long sink;
+
+/// @brief Time loops calls of an expression in nS
+#define TIME(expr) ({ \
+	struct timespec t0, t1; \
+	long k; \
+	clock_gettime(CLOCK_MONOTONIC, &t0); \
+	for(k = 0; k < loops; ++k) \
+		sink += (long) (expr); \
+	clock_gettime(CLOCK_MONOTONIC, &t1); \
+	elapsed(&t0, &t1) * 1e9 / loops; })
+
+void bench(void)
+{
+	static const int lens[] = { 1, 16, 256 };
+	static char str[260] __attribute__((aligned(8)));
+	static char pat[260] __attribute__((aligned(8)));
+	static char upp[260] __attribute__((aligned(8)));
+	static char dst[260] __attribute__((aligned(8)));
+	long loops;
+	int i, len;
+
+	printf("Host timings in nS, old/new, on an aligned string\n\n");
+	printf("  len    strlen     strcpy     strcmp     strncmp    strcasecmp   memchr\n");
+	for(i = 0; i < 3; ++i)
+	{
+		len = lens[i];
+		loops = 20000000 / (len + 8);
+		memset(str, 'a', len);
+		str[len] = 0;
+		memcpy(pat, str, len + 1);
+		memset(upp, 'A', len);
+		upp[len] = 0;
+		printf("  %3d", len);
+		printf("  %5.1f/%-5.1f", TIME(old_strlen(str)), TIME(strlen(str)));
+		printf("  %5.1f/%-5.1f", TIME(old_strcpy(dst, str)), TIME(strcpy(dst, str)));
+		printf("  %5.1f/%-5.1f", TIME(old_strcmp(str, pat)), TIME(strcmp(str, pat)));
+		printf("  %5.1f/%-5.1f", TIME(old_strncmp(str, pat, len)), TIME(strncmp(str, pat, len)));
+		printf("  %6.1f/%-6.1f", TIME(old_strcasecmp(str, upp)), TIME(strcasecmp(str, upp)));
+		printf("  %5.1f/%-5.1f", TIME(old_memchr(str, 'b', len)), TIME(memchr(str, 'b', len)));
+		printf("\n");
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	long cases;
+
+	libc_init();
+	test_edges();
+	cases = test_equivalence(argc > 1 && strcmp(argv[1], "long") == 0 ? 300000 : 20000);
+	printf("%ld randomized cases\n", cases);
+	if(argc > 1 && strcmp(argv[1], "bench") == 0)
+		bench();
+
+	return(test_result());
+}
+
+#endif	// STRING_TEST
@@ -0,0 +1,317 @@
+/**
+ @file test_time.c
+
+ @brief Host tests and benchmark for the civil date conversions in time.c
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// only used when testing standalone on linux
+#ifdef TIME_TEST
+
+// No stdlib.h or system time.h, their time types clash with the ones in time.h
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#define MEMSPACE
+#define SYSTEM_TASK_HZ 1000L
+#include "time.h"
+#include "timer.h"
+#include "testsup.h"
+
+// time.c uses these from timer.c
+volatile ts_t __clock;
+int clock_gettime(clockid_t clk_id, struct timespec *ts) { *ts = __clock; return(0); }
+int clock_settime(clockid_t clk_id, const struct timespec *ts) { __clock = *ts; return(0); }
+
+/// @brief The host C library struct tm and time_t, the reference results
+typedef long host_time_t;
+typedef struct {
+	int tm_sec, tm_min, tm_hour, tm_mday, tm_mon, tm_year;
+	int tm_wday, tm_yday, tm_isdst;
+	long tm_gmtoff;
+	const char *tm_zone;
+} host_tm_t;
+
+typedef struct {
+	long tv_sec;
+	long tv_nsec;
+} host_ts_t;
+
+/// @brief time.c replaces these in this program, use the C library ones
+host_tm_t *(*libc_gmtime_r)(const host_time_t *t, host_tm_t *tm);
+host_time_t (*libc_timegm)(host_tm_t *tm);
+int (*libc_clock_gettime)(int clk_id, host_ts_t *ts);
+
+/// @brief Host time in nS
+double now_ns(void)
+{
+	host_ts_t ts;
+	libc_clock_gettime(1, &ts);	// CLOCK_MONOTONIC
+	return(ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+/// @brief Repeatable random numbers
+static uint32_t seed;
+static uint32_t rnd(void)
+{
+	seed = seed * 1103515245UL + 12345;
+	return(seed >> 8);
+}
+
+/// @brief Random number in lo .. hi
+static int rnd_range(int lo, int hi)
+{
+	return(lo + (int) (rnd() % (uint32_t) (hi - lo + 1)));
+}
+
+/// @brief Compare the date and time fields
+/// @return 1 if they match
+int same_tm(tm_t *t, host_tm_t *h)
+{
+	return(t->tm_year == h->tm_year && t->tm_mon == h->tm_mon
+		&& t->tm_mday == h->tm_mday && t->tm_hour == h->tm_hour
+		&& t->tm_min == h->tm_min && t->tm_sec == h->tm_sec
+		&& t->tm_wday == h->tm_wday && t->tm_yday == h->tm_yday);
+}
+
+/**
+  @brief Check gmtime_r() against the C library and timegm() back again
+  @param[in] epoch: time to check
+  @return 1 on success
+*/
+int check_epoch(time_t epoch)
+{
+	tm_t tm;
+	host_tm_t h;
+	host_time_t ht = epoch;
+
+	gmtime_r(&epoch, &tm);
+	libc_gmtime_r(&ht, &h);
+	if(!same_tm(&tm, &h))
+	{
+		if(++errors < 10)
+			printf("FAIL gmtime_r: %10lu, expected %4d,%2d,%2d %02d:%02d:%02d, got %4d,%2d,%2d %02d:%02d:%02d\n",
+				(unsigned long) epoch,
+				h.tm_year + 1900, h.tm_mon, h.tm_mday, h.tm_hour, h.tm_min, h.tm_sec,
+				tm.tm_year + 1900, tm.tm_mon, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+		return(0);
+	}
+	if(timegm(&tm) != epoch)
+	{
+		if(++errors < 10)
+			printf("FAIL timegm: %10lu\n", (unsigned long) epoch);
+		return(0);
+	}
+	return(1);
+}
+
+// ==========================================================
+// Every day of the time_t range
+
+/// @brief time_to_tm() accepts epoch < 0xFFFD5D00
+#define EPOCH_MAX 0xFFFD5D00UL
+
+/**
+  @brief Check the first and last second of every day and one in between
+  then random times, random days defeat the time_to_tm() day cache
+  @return number of days checked
+*/
+long test_range(void)
+{
+	long days;
+	time_t epoch;
+	tm_t tm;
+	long k;
+
+	// The last day is cut short by EPOCH_MAX
+	for(days = 0; (time_t) days * 86400UL < EPOCH_MAX; ++days)
+	{
+		epoch = (time_t) days * 86400UL;
+		check_epoch(epoch);
+		if(epoch + 86399UL >= EPOCH_MAX)
+			continue;
+		check_epoch(epoch + (days * 7919L) % 86400L);
+		check_epoch(epoch + 86399UL);
+	}
+
+	seed = 1;
+	for(k = 0; k < 1000000L; ++k)
+		check_epoch(rnd() % (EPOCH_MAX >> 8) << 8 | (rnd() & 0xff));
+
+	// Out of range
+	epoch = EPOCH_MAX;
+	CHECK(time_to_tm(epoch, 0, &tm) == (time_t) -1);
+	return(days);
+}
+
+// ==========================================================
+// normalize() with fields out of range
+
+/**
+  @brief Random fields, some far out of range, against the C library timegm()
+  which normalizes the same way
+  @param[in] count: number of cases
+*/
+void test_normalize(long count)
+{
+	tm_t tm;
+	host_tm_t h;
+	host_time_t ht;
+	time_t epoch;
+	long k, checked = 0;
+
+	seed = 2;
+	for(k = 0; k < count; ++k)
+	{
+		memset(&tm, 0, sizeof(tm));
+		tm.tm_year = rnd_range(71, 205);
+		tm.tm_mon = rnd_range(-30, 40);
+		tm.tm_mday = rnd_range(-60, 90);
+		tm.tm_hour = rnd_range(-50, 50);
+		tm.tm_min = rnd_range(-200, 200);
+		tm.tm_sec = rnd_range(-5000, 5000);
+		memset(&h, 0, sizeof(h));
+		h.tm_year = tm.tm_year;
+		h.tm_mon = tm.tm_mon;
+		h.tm_mday = tm.tm_mday;
+		h.tm_hour = tm.tm_hour;
+		h.tm_min = tm.tm_min;
+		h.tm_sec = tm.tm_sec;
+
+		ht = libc_timegm(&h);
+		if(ht < 0 || ht >= (host_time_t) EPOCH_MAX)
+			continue;
+		++checked;
+		epoch = normalize(&tm, 0);
+		if(epoch != (time_t) ht || !same_tm(&tm, &h))
+		{
+			if(++errors < 10)
+				printf("FAIL normalize: expected %10ld %4d,%2d,%2d %02d:%02d:%02d, got %10lu %4d,%2d,%2d %02d:%02d:%02d\n",
+					ht, h.tm_year + 1900, h.tm_mon, h.tm_mday, h.tm_hour, h.tm_min, h.tm_sec,
+					(unsigned long) epoch,
+					tm.tm_year + 1900, tm.tm_mon, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+		}
+	}
+	printf("normalize: %ld of %ld cases in range\n", checked, count);
+
+	// 2100 is not a leap year, Feb 29 2100 is Mar 1 2100
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_year = 2100 - 1900;
+	tm.tm_mon = 1;
+	tm.tm_mday = 29;
+	CHECK(timegm(&tm) == 4107542400UL && tm.tm_mon == 2 && tm.tm_mday == 1);
+
+	// 2000 is a leap year
+	memset(&tm, 0, sizeof(tm));
+	tm.tm_year = 2000 - 1900;
+	tm.tm_mon = 1;
+	tm.tm_mday = 29;
+	CHECK(timegm(&tm) == 951782400UL && tm.tm_mon == 1 && tm.tm_mday == 29);
+}
+
+// ==========================================================
+
+#define BENCH 10000000L
+
+/// @brief Time gmtime_r() and timegm() against the C library
+void bench(void)
+{
+	static time_t e[4096];
+	static host_time_t he[4096];
+	tm_t tm;
+	host_tm_t h;
+	time_t epoch;
+	host_time_t ht;
+	volatile long sum = 0;
+	double t0, t1;
+	long k;
+
+	seed = 3;
+	for(k = 0; k < 4096; ++k)
+		he[k] = e[k] = rnd() % (EPOCH_MAX >> 8) << 8;
+
+	t0 = now_ns();
+	for(k = 0; k < BENCH; ++k)
+		sum += gmtime_r(&e[k & 4095], &tm)->tm_mday;
+	t1 = now_ns();
+	printf("gmtime_r, random days: %.1f nS", (t1 - t0) / BENCH);
+	t0 = now_ns();
+	for(k = 0; k < BENCH; ++k)
+		sum += libc_gmtime_r(&he[k & 4095], &h)->tm_mday;
+	t1 = now_ns();
+	printf(", C library %.1f nS\n", (t1 - t0) / BENCH);
+
+	t0 = now_ns();
+	for(k = 0; k < BENCH; ++k)
+	{
+		epoch = 1445000000UL + (k & 0xffff);
+		sum += gmtime_r(&epoch, &tm)->tm_sec;
+	}
+	t1 = now_ns();
+	printf("gmtime_r, same day: %.1f nS", (t1 - t0) / BENCH);
+	t0 = now_ns();
+	for(k = 0; k < BENCH; ++k)
+	{
+		ht = 1445000000L + (k & 0xffff);
+		sum += libc_gmtime_r(&ht, &h)->tm_sec;
+	}
+	t1 = now_ns();
+	printf(", C library %.1f nS\n", (t1 - t0) / BENCH);
+
+	gmtime_r(&e[0], &tm);
+	libc_gmtime_r(&he[0], &h);
+	t0 = now_ns();
+	for(k = 0; k < BENCH; ++k)
+		sum += timegm(&tm);
+	t1 = now_ns();
+	printf("timegm: %.1f nS", (t1 - t0) / BENCH);
+	t0 = now_ns();
+	for(k = 0; k < BENCH; ++k)
+		sum += libc_timegm(&h);
+	t1 = now_ns();
+	printf(", C library %.1f nS\n", (t1 - t0) / BENCH);
+}
+
+int main(int argc, char *argv[])
+{
+	long days;
+
+	libc_gmtime_r = dlsym(RTLD_NEXT, "gmtime_r");
+	libc_timegm = dlsym(RTLD_NEXT, "timegm");
+	libc_clock_gettime = dlsym(RTLD_NEXT, "clock_gettime");
+	if(!libc_gmtime_r || !libc_timegm || !libc_clock_gettime)
+	{
+		printf("FAIL: C library time functions not found\n");
+		return(1);
+	}
+
+	days = test_range();
+	printf("gmtime_r and timegm: %ld days\n", days);
+	test_normalize(1000000L);
+
+	if(argc > 1 && strcmp(argv[1], "bench") == 0)
+		bench();
+
+	return(test_result());
+}
+
+#endif	// TIME_TEST
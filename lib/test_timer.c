@@ -0,0 +1,355 @@
+/**
+ @file test_timer.c
+
+ @brief Host tests and benchmark for the timer wheel
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// only used when testing standalone on linux
+#ifdef TIMER_TEST
+
+// No stdlib.h, its clockid_t clashes with the one in timer.h
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define MEMSPACE
+#define SYSTEM_TASK_HZ 1000L
+typedef struct timespec ts_t;
+#include "timer.h"
+#include "testsup.h"
+
+// timer.c uses these from the system task code
+void disable_system_task(void) {}
+void enable_system_task(void) {}
+void install_timers_isr(void) {}
+
+/// @brief Host time in nS, timer.c has its own clock_gettime()
+double now_ns(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return(tv.tv_sec * 1e9 + tv.tv_usec * 1e3);
+}
+
+/// @brief Repeatable random numbers
+static uint32_t seed;
+static uint32_t rnd(void)
+{
+	seed = seed * 1103515245UL + 12345;
+	return(seed >> 8);
+}
+
+// ==========================================================
+// Mixed one shot and periodic timers
+
+#define TIMERS 5000
+
+wtimer_t t[TIMERS];
+uint32_t want[TIMERS];
+uint32_t period[TIMERS];
+long fired, late;
+
+/// @brief Every run must be on the tick it was due
+void handler(void *arg)
+{
+	int i = (wtimer_t *) arg - t;
+
+	++fired;
+	if(wtimer_ticks() != want[i])
+		++late;
+	if(period[i])
+		want[i] += period[i];
+}
+
+/**
+  @brief Start TIMERS timers, near, middle and far, 1 in 5 periodic
+  then cancel every 7th one
+  @return number of timers that must still be pending at the end
+*/
+long start_mixed(void)
+{
+	uint32_t d;
+	long pending = 0;
+	int i;
+
+	seed = 1;
+	fired = late = 0;
+	for(i = 0; i < TIMERS; ++i)
+	{
+		wtimer_init(&t[i], handler, &t[i]);
+		if(i % 3 == 0)
+			d = 1 + rnd() % 100;
+		else if(i % 3 == 1)
+			d = 1 + rnd() % 50000;
+		else
+			d = 1 + rnd() % 3000000;
+		period[i] = (i % 5 == 0) ? 1 + rnd() % 5000 : 0;
+		wtimer_start(&t[i], d, period[i]);
+		want[i] = wtimer_ticks() + d;
+	}
+	for(i = 0; i < TIMERS; i += 7)
+		wtimer_cancel(&t[i]);
+	for(i = 0; i < TIMERS; ++i)
+	{
+		if(period[i] && i % 7)
+			++pending;
+	}
+	return(pending);
+}
+
+/// @brief Count timers still pending
+long count_pending(void)
+{
+	long pending = 0;
+	int i;
+
+	for(i = 0; i < TIMERS; ++i)
+	{
+		if(wtimer_pending(&t[i]))
+			++pending;
+	}
+	return(pending);
+}
+
+/// @brief Cancel every timer
+void cancel_all(void)
+{
+	int i;
+	for(i = 0; i < TIMERS; ++i)
+		wtimer_cancel(&t[i]);
+}
+
+// ==========================================================
+// Handlers that start and cancel timers
+
+wtimer_t a, b, c;
+long na, nb, nc;
+uint32_t wa, wc;
+
+/// @brief Restarts itself as a one shot, 3 ticks later
+void restart_handler(void *arg)
+{
+	++na;
+	CHECK(wtimer_ticks() == wa);
+	if(na < 10)
+	{
+		wtimer_start(&a, 3, 0);
+		wa = wtimer_ticks() + 3;
+	}
+}
+
+/// @brief Periodic, cancels itself on the 5th run
+void cancel_handler(void *arg)
+{
+	if(++nb == 5)
+		wtimer_cancel(&b);
+}
+
+/// @brief Cancels c, which is due on the same tick
+void cancel_other(void *arg)
+{
+	++nc;
+	wtimer_cancel(&c);
+}
+
+void count_c(void *arg)
+{
+	++nc;
+}
+
+void test_handlers(void)
+{
+	int k;
+
+	na = nb = nc = 0;
+	wtimer_init(&a, restart_handler, NULL);
+	wtimer_start(&a, 1, 0);
+	wa = wtimer_ticks() + 1;
+	wtimer_init(&b, cancel_handler, NULL);
+	wtimer_start(&b, 2, 2);
+	for(k = 0; k < 100; ++k)
+		execute_timers();
+	CHECK(na == 10 && !wtimer_pending(&a));
+	CHECK(nb == 5 && !wtimer_pending(&b));
+
+	// c is added after a so runs after it on the same tick
+	nc = 0;
+	wtimer_init(&c, count_c, NULL);
+	wtimer_init(&a, cancel_other, NULL);
+	wtimer_start(&c, 10, 0);
+	wtimer_start(&a, 10, 0);
+	for(k = 0; k < 20; ++k)
+		execute_timers();
+	CHECK(nc == 1 && !wtimer_pending(&c));
+
+	// A zero delay runs on the next tick, restarting moves the timer
+	wtimer_init(&c, count_c, NULL);
+	nc = 0;
+	wtimer_start(&c, 0, 0);
+	execute_timers();
+	CHECK(nc == 1);
+	wtimer_start(&c, 5, 0);
+	wtimer_start(&c, 100, 0);
+	for(k = 0; k < 99; ++k)
+		execute_timers();
+	CHECK(nc == 1 && wtimer_pending(&c));
+	execute_timers();
+	CHECK(nc == 2 && !wtimer_pending(&c));
+}
+
+// ==========================================================
+// Per tick timers, set_timers() and kill_timer()
+
+long ticks_a, ticks_b;
+void tick_a(void) { ++ticks_a; }
+void tick_b(void) { ++ticks_b; }
+
+void test_set_timers(void)
+{
+	int ia, ib, k;
+
+	ticks_a = ticks_b = 0;
+	ia = set_timers(tick_a, 1);
+	ib = set_timers(tick_b, 1);
+	CHECK(ia >= 0 && ib >= 0 && ia != ib);
+	for(k = 0; k < 50; ++k)
+		execute_timers();
+	CHECK(ticks_a == 50 && ticks_b == 50);
+	CHECK(kill_timer(ia) == ia);
+	CHECK(kill_timer(MAX_TIMER_CNT) == -1);
+	for(k = 0; k < 50; ++k)
+		execute_timers();
+	CHECK(ticks_a == 50 && ticks_b == 100);
+	delete_all_timers();
+	execute_timers();
+	CHECK(ticks_b == 100);
+}
+
+// ==========================================================
+// Timers longer than the wheel span, across the tick counter wrap
+
+wtimer_t la, lb, lc;
+uint32_t wla, wlb, wlc;
+long nla, nlb, nlc, nlate;
+
+void long_a(void *arg) { ++nla; if(wtimer_ticks() != wla) ++nlate; wla += la.period; }
+void long_b(void *arg) { ++nlb; if(wtimer_ticks() != wlb) ++nlate; wlb += lb.period; }
+void long_c(void *arg)
+{
+	++nlc;
+	if(wtimer_ticks() != wlc)
+		++nlate;
+	wtimer_start(&lc, 30000000, 0);
+	wlc = wtimer_ticks() + 30000000;
+}
+
+/**
+  @brief Run long timers
+  @param[in] ticks: ticks to run, more than 2^32 crosses the wrap
+*/
+void test_long(uint64_t ticks)
+{
+	uint64_t k;
+	uint32_t start = wtimer_ticks();
+
+	nla = nlb = nlc = nlate = 0;
+	wtimer_init(&la, long_a, NULL);
+	wtimer_init(&lb, long_b, NULL);
+	wtimer_init(&lc, long_c, NULL);
+	// a has a period longer than TIMER_WHEEL_SPAN
+	wtimer_start(&la, 20000000, 20000001);
+	wla = start + 20000000;
+	wtimer_start(&lb, 1, 999983);
+	wlb = start + 1;
+	wtimer_start(&lc, 30000000, 0);
+	wlc = start + 30000000;
+	for(k = 0; k < ticks; ++k)
+		execute_timers();
+	CHECK(nlate == 0);
+	CHECK(nla == (long) ((ticks - 20000000) / 20000001 + 1));
+	CHECK(nlb == (long) ((ticks - 1) / 999983 + 1));
+	CHECK(nlc == (long) (ticks / 30000000));
+	printf("%llu ticks: %ld, %ld and %ld long timer runs, %ld late\n",
+		(unsigned long long) ticks, nla, nlb, nlc, nlate);
+	wtimer_cancel(&la);
+	wtimer_cancel(&lb);
+	wtimer_cancel(&lc);
+}
+
+// ==========================================================
+
+int main(int argc, char *argv[])
+{
+	long ticks = 3100000;
+	long pending, k;
+	int bench = (argc > 1 && strcmp(argv[1], "bench") == 0);
+	int wrap = (argc > 1 && strcmp(argv[1], "long") == 0);
+	double t0, t1;
+	int i;
+
+	init_timers();
+	delete_all_timers();
+
+	test_handlers();
+	test_set_timers();
+
+	pending = start_mixed();
+	t0 = now_ns();
+	for(k = 0; k < ticks; ++k)
+		execute_timers();
+	t1 = now_ns();
+	CHECK(late == 0);
+	CHECK(count_pending() == pending);
+	printf("%d timers, %ld ticks: %ld runs, %ld late, %.1f nS per tick\n",
+		TIMERS, ticks, fired, late, (t1 - t0) / ticks);
+	cancel_all();
+	CHECK(count_pending() == 0);
+
+	if(bench)
+	{
+		t0 = now_ns();
+		for(k = 0; k < 200; ++k)
+			for(i = 0; i < TIMERS; ++i)
+				wtimer_start(&t[i], 1 + (i * 7919) % 1000000, 0);
+		t1 = now_ns();
+		printf("start: %.1f nS\n", (t1 - t0) / (200.0 * TIMERS));
+		t0 = now_ns();
+		cancel_all();
+		t1 = now_ns();
+		printf("cancel: %.1f nS\n", (t1 - t0) / TIMERS);
+
+		for(i = 0; i < TIMERS; ++i)
+			wtimer_start(&t[i], 2000000 + i, 0);
+		t0 = now_ns();
+		for(k = 0; k < 1000000; ++k)
+			execute_timers();
+		t1 = now_ns();
+		printf("tick with %d far timers: %.1f nS\n", TIMERS, (t1 - t0) / 1e6);
+		cancel_all();
+	}
+
+	// 4.4G ticks crosses the wrap, the default run is past the wheel span
+	test_long(wrap ? 4400000000ULL : 100000000ULL);
+
+	return(test_result());
+}
+
+#endif	// TIMER_TEST
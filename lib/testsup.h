@@ -0,0 +1,46 @@
+/**
+ @file testsup.h
+
+ @brief Checks and the result line shared by the host test programs
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _TESTSUP_H_
+#define _TESTSUP_H_
+
+// Include once, from the test program only
+#include <stdio.h>
+
+/// @brief Failed checks so far
+static int errors = 0;
+
+/// @brief Report a failed check and keep going
+#define CHECK(c) do { if(!(c)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #c); ++errors; } } while(0)
+
+/**
+  @brief Print the PASS or FAIL line that "make test" shows
+  @return exit status for main(), 0 if every check passed
+*/
+static int test_result(void)
+{
+	printf("%s: %d errors\n", errors ? "FAIL" : "PASS", errors);
+	return(errors ? 1 : 0);
+}
+
+#endif	// _TESTSUP_H_
@@ -22,6 +22,7 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifdef USER_CONFIG
 #include "user_config.h"
 
 #ifdef AVR
@@ -41,6 +42,18 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 #include "posix.h"
+#else
+// only used when testing standalone on linux
+// No stdlib.h, its time types clash with the ones in time.h and timer.h
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#define MEMSPACE
+#define SYSTEM_TASK_HZ 1000L
+extern long strtol(const char *nptr, char **endptr, int base);
+#include "time.h"
+#include "timer.h"
+#endif
 
 /// @brief  System Clock Time
 extern volatile ts_t __clock;
@@ -48,18 +61,12 @@ extern volatile ts_t __clock;
 /// @brief  System Time Zone
 tz_t __tzone;
 
-///@brief DST start and stop in GMT epoch
+///@brief DST start and stop in GMT epoch, for the year last used
 dst_t dst;
 
-///@brief accumulated days to the start of a month in a year.
-///
-/// - without Leap days.
-/// - Index: Month 00 .. 11  (12 is a year).
-/// @see timegm().
-static const uint16_t __days_sum[] =
-{
-    0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365
-};
+///@brief DST start and stop for the years either side of dst
+/// @see set_dst()
+static dst_t __dst_years[DST_YEARS];
 
 ///@brief days in each month.
 ///  - without leap days.
@@ -70,6 +77,16 @@ static const uint16_t __days[] =
     31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
 };
 
+///@brief time_to_tm() date of the last day converted.
+/// @see time_to_tm().
+static struct {
+    int32_t days;   ///@brief days since EPOCH_YEAR, -1 if empty
+    int year;       ///@brief tm_year
+    int mon;        ///@brief tm_mon
+    int mday;       ///@brief tm_mday
+    int yday;       ///@brief tm_yday
+} __day_cache = { -1L, 0, 0, 0, 0 };
+
 ///@brief Short Name of each Day in a week.
 ///
 /// - Day 0 .. 6 to string.
@@ -140,37 +157,6 @@ static int IS_Leap(int year)
 }
 
 
-/// @brief  Number of leap days since 1900 to the BEGINNING of the year.
-///
-/// @param[in] year: valid over 1900..2199.
-///
-/// @warning No limit checking
-///
-/// @return days.
-///
-/// @see time_to_tm() 
-/// @see ctime_gm() 
-/// @see gmtime_r() 
-/// @see localtime_r()
-MEMSPACE
-static int Leap_Days_Since_1900(int year)
-{
-    int sum;
-
-    year -= 1900;
-
-    if(year>0)
-        --year;
-
-    sum = (year >> 2);
-
-
-    if(year >= 200 )
-        --sum;
-
-    return(sum);
-}
-
 ///@brief return day of week for givenn day, month, year
 /// @param[in] year: year  such as 2016
 /// @param[in] month: month 0 .. 11
@@ -195,22 +181,76 @@ int finddayofweek(int year, int month, int day)
 
 
 
-/// @brief  Find number of days in a given year.
+/// @brief Floor division carry from one tm_t field into the next larger one
 ///
-/// @param[in] year: valid over 1900..2199.
+/// @param[in,out] value: field, result is 0 .. base-1
+/// @param[in,out] carry: next larger field, adjusted by whole multiples of base
+/// @param[in] base: value units per carry unit
 ///
-/// @warning No limit checking
+/// @return void
+MEMSPACE
+static void tm_carry(int *value, int *carry, int base)
+{
+    int q = *value / base;
+
+    *value -= q * base;
+    if(*value < 0)
+    {
+        *value += base;
+        --q;
+    }
+    *carry += q;
+}
+
+/// @brief Days since Jan 1 EPOCH_YEAR for a Gregorian date in constant time.
 ///
-/// @return days in a given year.
+/// - Years start on Mar 1 so the leap day is the last day of a year,
+///   and 400 year eras have a fixed number of days.
+/// - Days outside of the month count from the 1st, Jan 0 is Dec 31.
+/// @see H. Hinnant, "chrono-Compatible Low-Level Date Algorithms"
 ///
-/// @see time_to_tm() 
-/// @see ctime_gm() 
-/// @see gmtime_r() 
-/// @see localtime_r()
+/// @param[in] year: year such as 2016
+/// @param[in] month: month 1 .. 12
+/// @param[in] day: day of the month, 1 based
+///
+/// @return days, negative before EPOCH_YEAR
 MEMSPACE
-static int Days_Per_Year(int year)
+static int32_t days_from_civil(int year, int month, int day)
 {
-    return(IS_Leap(year) ? 366 : 365);
+    int32_t era, yoe, doy;
+
+    if(month <= 2)
+        --year;
+    era = (year >= 0 ? year : year - 399) / 400;
+    yoe = year - era * 400;                                 // 0 .. 399
+    doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    return(era * 146097L + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468L);
+}
+
+/// @brief Gregorian date for days since Jan 1 EPOCH_YEAR in constant time.
+///
+/// @param[in] days: days since Jan 1 EPOCH_YEAR
+/// @param[out] year: year such as 2016
+/// @param[out] month: month 1 .. 12
+/// @param[out] day: day of the month 1 .. 31
+///
+/// @return void
+/// @see days_from_civil()
+MEMSPACE
+static void civil_from_days(int32_t days, int *year, int *month, int *day)
+{
+    int32_t era;
+    uint32_t doe, yoe, doy, mp;
+
+    days += 719468L;
+    era = (days >= 0 ? days : days - 146096L) / 146097L;
+    doe = days - era * 146097L;                             // 0 .. 146096
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;  // 0 .. 399
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);          // 0 .. 365
+    mp = (5 * doy + 2) / 153;                               // 0 .. 11, 0 = Mar
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = mp < 10 ? mp + 3 : mp - 9;
+    *year = yoe + era * 400 + (*month <= 2);
 }
 
 /// @brief days in a month
@@ -225,16 +265,7 @@ int Days_Per_Month(int month, int year)
 	int days;
 
 	// Normalize month
-	while(month >= 12)
-	{
-		++year;
-		month -= 12;
-	}
-	while(month < 0)
-	{
-		--year;
-		month += 12;
-	}
+	tm_carry(&month, &year, 12);
 	days = __days[month];
 	if( month ==  1 && IS_Leap(year))
 		++days;
@@ -261,7 +292,7 @@ int Days_Per_Month(int month, int year)
 MEMSPACE
 time_t time_to_tm(time_t epoch, int32_t offset, tm_t *t)
 {
-    int year,month,tmp;
+    int year,month,mday;
     int flag = 0;
     int32_t days;
 	time_t save = epoch;
@@ -301,31 +332,21 @@ time_t time_to_tm(time_t epoch, int32_t offset, tm_t *t)
     {
         t->tm_wday = (EPOCH_DAY + days) % 7;
 
-        year=EPOCH_YEAR;
-        while (days >= (tmp=Days_Per_Year(year)) )
+        // Consecutive calls are usually for the same day
+        if(days != __day_cache.days)
         {
-            ++year;
-            days -= tmp;
+            civil_from_days(days, &year, &month, &mday);
+            __day_cache.year = year - 1900;
+            __day_cache.mon = month - 1;
+            __day_cache.mday = mday;
+            __day_cache.yday = days - days_from_civil(year, 1, 1);
+            __day_cache.days = days;
         }
 
-        t->tm_year = year - 1900;
-        t->tm_yday = days;
-
-        month = 0;
-
-        while(days > 0 && month < 12)
-        {
-            tmp=__days[month];
-            if( month ==  1 && IS_Leap(year))
-                ++tmp;
-            if(days < tmp)
-                break;
-            days -= tmp;
-            ++month;
-        }
-
-        t->tm_mon = month;
-        t->tm_mday = days + 1;
+        t->tm_year = __day_cache.year;
+        t->tm_yday = __day_cache.yday;
+        t->tm_mon = __day_cache.mon;
+        t->tm_mday = __day_cache.mday;
     }
     return(save - offset);
 }
@@ -500,14 +521,17 @@ tm_t *localtime_r(time_t *t, tm_t *result)
 {
     tz_t tz;
     long int offset;
+    int isdst;
     time_t epoch = *t;
 
     gettimezone(&tz);
     offset = 60L * tz.tz_minuteswest;
 
-	if(is_dst(epoch - offset))
+	isdst = is_dst(epoch);
+	if(isdst)
 		offset -= 3600L;
     (void) time_to_tm(epoch, offset, result);
+	result->tm_isdst = isdst;
 
     return(result);
 }
@@ -614,22 +638,7 @@ time_t tm2epoch( tm_t *t )
         return(-1);
 	}
 
-///  Note: To simplify we caculate Leap Day contributions in stages
-
-    days = ( year  - EPOCH_YEAR );
-
-    days *= (time_t) 365L;
-
-    days += (time_t) __days_sum[mon];
-
-    days += (time_t) mday;
-
-    days += (time_t) Leap_Days_Since_1900(year);
-
-    days -= (time_t) 17;
-
-    if(mon > 1 && IS_Leap(year))
-        ++days;
+    days = (time_t) days_from_civil(year, mon + 1, mday + 1);
 
     seconds = days;
 
@@ -655,6 +664,8 @@ time_t normalize(tm_t *t, int normalize_to_timezone)
 {
 	time_t epoch;
 	int32_t offset;
+	int32_t days;
+	int year, month, mday;
 	int isdst;
 
 // 	struct tm
@@ -670,81 +681,19 @@ time_t normalize(tm_t *t, int normalize_to_timezone)
 // 		int tm_isdst;  /*<  DST.         [-1/0/1] */
 // 	};
 
-	// Normalize t->tm_seconds
-	while(t->tm_sec >= 60)
-	{
-		++t->tm_min;
-		t->tm_sec -= 60;
-	}
-	while(t->tm_sec < 0)
-	{
-		--t->tm_min;
-		t->tm_sec += 60;
-	}
-
-	// Normalize t->tm_miniutes
-	while(t->tm_min >= 60)
-	{
-		++t->tm_hour;
-		t->tm_min -= 60;
-	}
-	while(t->tm_min < 0)
-	{
-		--t->tm_hour;
-		t->tm_min += 60;
-	}
-
-	// Normalize t->tm_hours
-	while(t->tm_hour >= 24)
-	{
-		++t->tm_mday;
-		t->tm_hour -= 24;
-	}
-	while(t->tm_hour < 0)
-	{
-		--t->tm_mday;
-		t->tm_hour += 24;
-	}
-
-	// Normalize t->tm_months
-	while(t->tm_mon >= 12)
-	{
-		++t->tm_year;
-		t->tm_mon -= 12;
-	}
-	while(t->tm_mon < 0)
-	{
-		--t->tm_year;
-		t->tm_mon += 12;
-	}
+	// Normalize t->tm_sec, t->tm_min, t->tm_hour and t->tm_mon
+	tm_carry(&t->tm_sec, &t->tm_min, 60);
+	tm_carry(&t->tm_min, &t->tm_hour, 60);
+	tm_carry(&t->tm_hour, &t->tm_mday, 24);
+	tm_carry(&t->tm_mon, &t->tm_year, 12);
 
 	// Normalize t->tm_mday
-	// t->tm_mday is 1 based
-	while(t->tm_mday > Days_Per_Month(t->tm_mon,t->tm_year) )
-	{
-		// subtract days in current t->tm_month
-		t->tm_mday -= Days_Per_Month(t->tm_mon,t->tm_year);
-		// Keep month normalized
-		if(++t->tm_mon >= 12)
-		{
-			t->tm_mon -= 12;
-			++t->tm_year;
-		}
-	}
-
-	// t->tm_mday is 1 based
-	while(t->tm_mday < 1)
-	{
-		// Keep month normalized
-		if(--t->tm_mon < 0)
-		{
-			t->tm_mon += 12;
-			--t->tm_year;
-		}
-		// add days in previous mount
-		t->tm_mday += Days_Per_Month(t->tm_mon,t->tm_year);
-	}
-
+	// t->tm_mday is 1 based, days outside of the month move the month and year
+	days = days_from_civil(t->tm_year + 1900, t->tm_mon + 1, t->tm_mday);
+	civil_from_days(days, &year, &month, &mday);
+	t->tm_year = year - 1900;
+	t->tm_mon = month - 1;
+	t->tm_mday = mday;
 
 	// We can now set the remain values by converting to EPOCH and back again
 	// convert to EPOCH based seconds
@@ -1015,7 +964,7 @@ int setdate_r (char *buf)
 /// @param[in] dst:    0 .. 1    DST needs to be applied to the arguments for DST caluclulations
 /// @param[in] epoch:  0 | epoch if non-zero - UTC epoch time used to obtain year of DST calculations 
 /// @param[in] year:   0 | year  if non-zero - UTC year of DST calcululation, if year and epoch are used - ignore epoch
-/// @param[in] month:  0 .. 11,  local time month DST transition
+/// @param[in] month:  1 .. 12,  local time month DST transition
 /// @param[in] weekno: 1 .. 4    localtime dayno count in this month
 /// @param[in] dayno:  0 .. 6,   localtime day of DST transition, 0 = Sunday
 /// @param[in] hour:   0 .. 23   local time hour of DST transition
@@ -1040,78 +989,71 @@ time_t find_dst(int dst, time_t epoch, int year, int month, int weekno, int dayn
 	tm_t t;
 	tz_t tz;
 	tv_t tv;
-	time_t dst_epoch;
 	int32_t offset;
-	int days;
+	int32_t days;
 
 	// Get timezone and clock time
 	gettimeofday(&tv, &tz);
 
 	// Local time offset in seconds
 	// Get local timezone offset in seconds without DST offset
-	offset = tz.tz_minuteswest * 60UL;
+	offset = tz.tz_minuteswest * 60L;
 	// Add DST offset if DST end time includes DST offset
 	if(dst)
-		offset -= (60UL * 60UL);
+		offset -= (60L * 60L);
 
-	if(year)
-	{
-		// Year is specified - use it
-		t.tm_year = year - 1900;   // 0 = 1900
-	}
-	else
+	if(!year)
 	{
 		// Otherwise, Calculate year from epoch or GMT time
 		if(!epoch)
 			epoch = tv.tv_sec;
 		(void) time_to_tm(epoch, offset, &t);	
+		year = t.tm_year + 1900;
 	}
 
-	// Local time of DST
-	// We compute seconds for start of month in which DST happens
-	// Result from timegm() is in GMT
-    t.tm_mon = month - 1;   // 0..11
-    t.tm_mday = 1;          // 1..28,29,30,31
-    t.tm_hour = hour;		// 0 .. 23
-    t.tm_min =  0; 			// 0..59
-    t.tm_sec =  0;			// 0..59
-
-
-	// Adjust tm_t to localtime - we can not use normalize as it calls us
-
-	// local seconds as timegm does not add offset
-	dst_epoch = timegm(&t);
-	
-	// Add offset for localtime
-	dst_epoch += offset;
-
-	// Convert to back to tm_t structure with localtime offsets applied
-	(void) time_to_tm(dst_epoch, 0L, &t);	
-
-	dayno = dayno;
-	weekno= weekno;
-	days= 0;
-	while( 1 )
-	{
-		if( ((t.tm_wday + days) % 7) == dayno)
-		{
-			if( (--weekno) == 0)
-				break;
-		}
-		++days;
-		dst_epoch += 86400L;
-	}
+	// Local day of the first dayno in the month, then weekno-1 weeks later
+	days = days_from_civil(year, month, 1);
+	days += (dayno - (EPOCH_DAY + days) % 7 + 7) % 7;
+	days += (weekno - 1) * 7L;
 
 	// Return GMT
-	return(dst_epoch);
+	return( (time_t) days * 86400UL + hour * 3600UL + offset );
+}
+
+/// @brief Calculate DST start and end for a year
+/// @param[out] d: DST year entry
+/// @param[in] year: year such as 2016
+/// @param[in] minuteswest: local timezone
+/// @return void
+MEMSPACE
+static void dst_year(dst_t *d, int year, int32_t minuteswest)
+{
+	d->year = 0;
+	d->minuteswest = minuteswest;
+	// time_t can not hold the years either side of its range
+	if(year < EPOCH_YEAR || year >= 2106)
+		return;
+	d->first = (time_t) days_from_civil(year, 1, 1) * 86400UL + minuteswest * 60L;
+	d->last = (time_t) days_from_civil(year + 1, 1, 1) * 86400UL + minuteswest * 60L;
+	// US rules, 2nd Sunday of Mar at 2:00am to 1st Sunday of Nov at 2:00am
+	d->start = find_dst(0, 0, year,  3, 2, 0, 2);
+	d->end   = find_dst(1, 0, year, 11, 1, 0, 2);
+	d->year = year;
 }
 
 /// @brief Set DST start and end time for the given epoch year
+/// Transitions for the current year and the years either side are cached
+/// so most calls are a range check, the cache is refreshed when epoch
+/// moves outside of these years or the timezone changes
 /// @param[in] 0 - or epoch seconds in GMT used to determin the year to aply DST in
 ///            If 0 we get local GMT epoch time in seconds
 MEMSPACE
 void set_dst(time_t epoch)
 {
+	int32_t minuteswest = __tzone.tz_minuteswest;
+	tm_t t;
+	int i;
+
 	if(epoch == 0)
 	{
 		tv_t tv;
@@ -1121,22 +1063,26 @@ void set_dst(time_t epoch)
 		epoch = tv.tv_sec;
 	}
 
-	// Cache caclulations so we do not do them more often then once a day
-	if(dst.epoch >= epoch)
-	{
-		if((dst.epoch - epoch) < 86400L)
-			return;
-	}
-	else
+	// Same year as the last call
+	if(dst.year && dst.minuteswest == minuteswest 
+		&& epoch >= dst.first && epoch < dst.last)
+		return;
+
+	for(i=0;i<DST_YEARS;++i)
 	{
-		if((epoch - dst.epoch) < 86400L)
+		if(__dst_years[i].year && __dst_years[i].minuteswest == minuteswest
+			&& epoch >= __dst_years[i].first && epoch < __dst_years[i].last)
+		{
+			dst = __dst_years[i];
 			return;
+		}
 	}
 
-	dst.epoch = epoch;
-	// FIXME think of ways to cache this computation
-    dst.start = find_dst(0, epoch, 0,  3, 2, 0, 2);
-    dst.end   = find_dst(1, epoch, 0, 11, 1, 0, 2);
+	// Year of epoch in local standard time, and the years either side
+	(void) time_to_tm(epoch, minuteswest * 60L, &t);
+	for(i=0;i<DST_YEARS;++i)
+		dst_year(&__dst_years[i], t.tm_year + 1900 + i - DST_YEARS/2, minuteswest);
+	dst = __dst_years[DST_YEARS/2];
 }
 
 /// @brief Test GMT epoch time to see if DST applies in a local timezone
@@ -1148,7 +1094,7 @@ int is_dst(time_t epoch)
 {
     set_dst(epoch);
 
-    if( epoch >= dst.start && epoch <= dst.end)
+    if( dst.year && epoch >= dst.start && epoch < dst.end)
 		return(1);
 	return(0);
 }
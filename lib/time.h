@@ -101,13 +101,19 @@ extern volatile ts_t __clock;
 extern tz_t __tzone;
 
 
-///@brief  DST structure
+///@brief  DST structure, transitions for one year
 typedef struct {
     time_t start;	///@brief Start of local DST in GMT
     time_t end;		///@brief End of local DST in GMT
-    time_t epoch;	///@brief epoch used to determine the year of DST start and end caluclulation - for caching
+    time_t first;	///@brief Start of the year in GMT, local standard time
+    time_t last;	///@brief Start of the next year in GMT, local standard time
+    int year;		///@brief year such as 2016, 0 if not used
+    int32_t minuteswest;	///@brief timezone used for the caluclulation
 } dst_t;
 
+///@brief Number of years in the DST cache, the current year and the years either side
+#define DST_YEARS 3
+
 /* time.c */
 MEMSPACE char *tm_wday_to_ascii ( int i );
 MEMSPACE char *tm_mon_to_ascii ( int i );
@@ -22,6 +22,7 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifdef USER_CONFIG
 #include "user_config.h"
 
 #ifdef AVR
@@ -32,8 +33,35 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "printf/mathio.h"
 
 #include "lib/time.h"
+#else
+// only used when testing standalone on linux
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/time.h>
+#define MEMSPACE
+#define SYSTEM_TASK_HZ 1000L
+typedef struct timespec ts_t;
+typedef struct { int tz_minuteswest; int tz_dsttime; } tz_t;
+extern void disable_system_task(void);
+extern void enable_system_task(void);
+extern void install_timers_isr(void);
+#endif
+
 #include "lib/timer.h"
 
+/// @brief The ESP8266 keeps time with a disciplined microsecond clock
+/// CLOCK_TEST builds the same clock on linux with a simulated counter
+#if defined(ESP8266) || defined(CLOCK_TEST)
+#define HAVE_CLOCK_DISCIPLINE
+#endif
+
+#ifdef CLOCK_TEST
+/// @brief Free running microsecond counter, simulated by test_clock.c
+extern uint32_t clock_counter(void);
+#else
+#define clock_counter() system_get_time()
+#endif
+
 /// @brief  System Clock Time
 volatile ts_t __clock;
 
@@ -46,6 +74,190 @@ static int timers_configured = 0;
 /// @brief  array or user timers
 TIMERS timer_irq[MAX_TIMER_CNT];
 
+/// @brief  Timer wheel
+/// Level 0 has one slot per tick, each higher level slot covers a whole
+/// lower level. Timers move down a level when their slot comes around so
+/// each tick only touches the timers that expire on it.
+static wtimer_t *timer_wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+
+/// @brief  Ticks since init_timers()
+static volatile uint32_t timer_jiffies = 0;
+/// @brief  Next tick the wheel will process
+static uint32_t timer_wheel_time = 1;
+
+/// @brief The AVR runs execute_timers() from an interrupt
+/// ESP8266 os_timer callbacks never preempt the caller
+#ifdef AVR
+#define TIMER_LOCK()   uint8_t _sreg = SREG; cli()
+#define TIMER_UNLOCK() SREG = _sreg
+#else
+#define TIMER_LOCK()
+#define TIMER_UNLOCK()
+#endif
+
+/// @brief  Link a timer into the wheel slot for its expire time.
+///
+/// @param[in] t: timer, not pending.
+///
+/// @return  void.
+static void wtimer_add(wtimer_t *t)
+{
+    uint32_t delta = t->expires - timer_wheel_time;
+    uint32_t when = t->expires;
+    wtimer_t **slot;
+    int level;
+
+    if((int32_t) delta < 0)
+    {
+        // Already due, run on the next tick
+        when = timer_wheel_time;
+        delta = 0;
+    }
+    else if(delta > TIMER_WHEEL_SPAN)
+    {
+        // Wait in the last level, it is added again when its slot comes around
+        when = timer_wheel_time + TIMER_WHEEL_SPAN;
+        delta = TIMER_WHEEL_SPAN;
+    }
+
+    for(level = 0; level < TIMER_WHEEL_LEVELS - 1; ++level)
+    {
+        if(delta < (1UL << (TIMER_WHEEL_BITS * (level + 1))))
+            break;
+    }
+    slot = &timer_wheel[level][(when >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+
+    t->next = *slot;
+    if(t->next)
+        t->next->pprev = &t->next;
+    t->pprev = slot;
+    *slot = t;
+}
+
+/// @brief  Unlink a pending timer.
+///
+/// @param[in] t: timer.
+///
+/// @return  void.
+static void wtimer_del(wtimer_t *t)
+{
+    *t->pprev = t->next;
+    if(t->next)
+        t->next->pprev = t->pprev;
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+/// @brief  Move the timers in one higher level slot down the wheel.
+///
+/// @param[in] level: wheel level, 1 or more.
+///
+/// @return  slot index that was moved, 0 when the next level is due as well.
+static int wtimer_cascade(int level)
+{
+    int index = (timer_wheel_time >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+    wtimer_t *t = timer_wheel[level][index];
+
+    timer_wheel[level][index] = NULL;
+    while(t)
+    {
+        wtimer_t *next = t->next;
+        wtimer_add(t);
+        t = next;
+    }
+    return(index);
+}
+
+/// @brief  Prepare a timer.
+///
+/// @param[in] t: timer.
+/// @param[in] handler: function called when the timer expires.
+/// @param[in] arg: argument passed to handler.
+///
+/// @return  void.
+MEMSPACE
+void wtimer_init(wtimer_t *t, void (*handler)(void *arg), void *arg)
+{
+    t->next = NULL;
+    t->pprev = NULL;
+    t->expires = 0;
+    t->period = 0;
+    t->handler = handler;
+    t->arg = arg;
+}
+
+/// @brief  Start or restart a timer.
+///
+/// - Insert is O(1), the timer is placed by its expire time.
+///
+/// @param[in] t: timer set up by wtimer_init().
+/// @param[in] ticks: System task ticks until the first run, see TIMER_MS().
+/// @param[in] period: ticks between later runs, 0 for a one shot timer.
+///
+/// @return  void.
+MEMSPACE
+void wtimer_start(wtimer_t *t, uint32_t ticks, uint32_t period)
+{
+    TIMER_LOCK();
+    if(t->pprev)
+        wtimer_del(t);
+    if(!ticks)
+        ticks = 1;
+    t->expires = timer_jiffies + ticks;
+    t->period = period;
+    wtimer_add(t);
+    TIMER_UNLOCK();
+}
+
+/// @brief  Stop a timer, it is safe to cancel a timer that is not pending.
+///
+/// - A handler may cancel its own timer.
+///
+/// @param[in] t: timer.
+///
+/// @return  void.
+MEMSPACE
+void wtimer_cancel(wtimer_t *t)
+{
+    TIMER_LOCK();
+    if(t->pprev)
+        wtimer_del(t);
+    t->period = 0;
+    TIMER_UNLOCK();
+}
+
+/// @brief  Is the timer waiting to run ?
+///
+/// @param[in] t: timer.
+///
+/// @return  1 if pending, 0 if not.
+MEMSPACE
+int wtimer_pending(wtimer_t *t)
+{
+    return(t->pprev != NULL);
+}
+
+/// @brief  System task ticks since init_timers().
+///
+/// @return  ticks, wraps around.
+uint32_t wtimer_ticks()
+{
+    return(timer_jiffies);
+}
+
+/// @brief  Run a set_timers() user task every tick.
+///
+/// @param[in] arg: TIMERS entry.
+///
+/// @return  void.
+static void timer_irq_task(void *arg)
+{
+    TIMERS *p = (TIMERS *) arg;
+
+    if(p->timer && p->user_timer_handler != NULL)
+        (*p->user_timer_handler)();
+}
+
 
 /// @brief  Install a user timer task.
 ///
@@ -77,6 +289,8 @@ int set_timers(void (*handler)(void), int timer)
             timer_irq[i].timer = 0;   // Set to disable
             timer_irq[i].user_timer_handler = handler;
             timer_irq[i].timer = 1;      // Set if enabled, 0 if not
+            wtimer_init(&timer_irq[i].wt, timer_irq_task, &timer_irq[i]);
+            wtimer_start(&timer_irq[i].wt, 1, 1);
             ret = i;
             break;
         }
@@ -100,9 +314,10 @@ MEMSPACE
 int kill_timer( int timer )
 {
     int ret = -1;
-    if(timer >= 0 && timer <= MAX_TIMER_CNT)
+    if(timer >= 0 && timer < MAX_TIMER_CNT)
     {
         timer_irq[timer].timer = 0;               // Disable
+        wtimer_cancel(&timer_irq[timer].wt);
         timer_irq[timer].user_timer_handler = 0;
         ret = timer;
     }
@@ -120,6 +335,7 @@ void delete_all_timers()
     for(i=0; i < MAX_TIMER_CNT; i++)
     {
         timer_irq[i].timer = 0;                   // Disable
+        wtimer_cancel(&timer_irq[i].wt);
         timer_irq[i].user_timer_handler = 0;
     }
 }
@@ -254,35 +470,71 @@ void enable_timers()
     }
 }
 
-/// @brief  Execute all user timers at SYSTEM_HZ rate.
-///  Called by system task
+/// @brief  Advance the timer wheel one tick and run the timers that expire.
+///  Called by system task at SYSTEM_HZ rate
+///
+/// - Cost is proportional to the number of timers that expire, plus
+///   moving one higher level slot down the wheel every TIMER_WHEEL_SIZE ticks.
 ///
 /// @return  void
 void execute_timers()
 {
-    int i;
+    wtimer_t *list, *t;
+    int level, index;
 
-    for(i=0; i < MAX_TIMER_CNT; i++)
+    ++timer_jiffies;
+
+    while((int32_t) (timer_jiffies - timer_wheel_time) >= 0)
     {
-        if(timer_irq[i].timer && timer_irq[i].user_timer_handler != NULL)
-            (*timer_irq[i].user_timer_handler)();
+        index = timer_wheel_time & TIMER_WHEEL_MASK;
+        for(level = 1; !index && level < TIMER_WHEEL_LEVELS; ++level)
+            index = wtimer_cascade(level);
+
+        // Take the slot so handlers can add timers to the wheel
+        index = timer_wheel_time & TIMER_WHEEL_MASK;
+        list = timer_wheel[0][index];
+        timer_wheel[0][index] = NULL;
+        if(list)
+            list->pprev = &list;
+        ++timer_wheel_time;
+
+        while((t = list) != NULL)
+        {
+            wtimer_del(t);
+            if(t->period)
+            {
+                t->expires += t->period;
+                wtimer_add(t);
+            }
+            // The handler may cancel or restart any timer, including this one
+            t->handler(t->arg);
+        }
     }
 }
 
 /**
  @brief 1000HZ timer task
+ On the ESP8266 the clock comes from system_get_time() and this runs once a second
+ @param[in] arg: unused
  @return void
 */
-void clock_task(void)
+void clock_task(void *arg)
 {
+#ifdef HAVE_CLOCK_DISCIPLINE
+    clock_update();
+#else
     __clock.tv_nsec += 1000000;
     if(__clock.tv_nsec >= 1000000000L)
     {
         __clock.tv_sec++;
         __clock.tv_nsec = 0;
     }
+#endif
 }
 
+/// @brief  Runs clock_task()
+static wtimer_t clock_timer;
+
 /// @brief  Setup all timers tasksi and enable interrupts
 ///
 /// @see clock_task()
@@ -308,8 +560,12 @@ void init_timers()
     printf("Clock Init\n");
 
 ///  See time.c
-    if(set_timers(clock_task,1) == -1)
-        printf("Clock task init failed\n");
+    wtimer_init(&clock_timer, clock_task, NULL);
+#ifdef HAVE_CLOCK_DISCIPLINE
+    wtimer_start(&clock_timer, TIMER_MS(1000), TIMER_MS(1000));
+#else
+    wtimer_start(&clock_timer, 1, 1);
+#endif
     printf("Clock Installed\n");
 
     enable_timers();
@@ -318,6 +574,213 @@ void init_timers()
 }
 
 
+#ifdef HAVE_CLOCK_DISCIPLINE
+/// @brief The ESP8266 keeps time with the system_get_time() microsecond counter
+/// The counter wraps every 71.6 minutes, clock_update() runs once a second
+/// to extend it to 64 bits so no per tick update is needed.
+static uint32_t clock_last = 0;
+static uint32_t clock_high = 0;
+
+/// @brief Time of day in microseconds is clock_real_base at monotonic time
+/// clock_mono_base, corrected by clock_freq and by the part of clock_slew
+/// applied since then
+static uint64_t clock_mono_base = 0;
+static uint64_t clock_real_base = 0;
+/// @brief Frequency correction in parts per billion
+static int32_t clock_freq = 0;
+/// @brief Part of the frequency correction under 1 uS, carried past clock_update()
+/// so corrections finer than 1 ppm are not lost when the base moves
+static int64_t clock_freq_rem = 0;
+/// @brief Offset still to be slewed in microseconds
+static int64_t clock_slew = 0;
+
+/// @brief clock_discipline() state
+static int64_t clock_offset = 0;
+static uint64_t clock_sync = 0;
+static uint8_t clock_synced = 0;
+static uint32_t clock_steps = 0;
+
+/// @brief Monotonic microseconds since power on.
+///
+/// @return microseconds.
+uint64_t clock_mono_us()
+{
+    uint32_t now = clock_counter();
+
+    if(now < clock_last)
+        ++clock_high;
+    clock_last = now;
+    return(((uint64_t) clock_high << 32) | now);
+}
+
+/// @brief Part of clock_slew applied over an interval.
+///
+/// @param[in] elapsed: monotonic microseconds.
+///
+/// @return microseconds, never more than clock_slew.
+static int64_t clock_slewed(uint64_t elapsed)
+{
+    int64_t s = (int64_t) ((elapsed * CLOCK_SLEW_PPM) / 1000000ULL);
+
+    if(clock_slew >= 0)
+        return(s < clock_slew ? s : clock_slew);
+    return(-s > clock_slew ? -s : clock_slew);
+}
+
+/// @brief Time of day at a monotonic time.
+///
+/// @param[in] mono: monotonic microseconds, from clock_mono_us().
+///
+/// @return microseconds since the epoch.
+static uint64_t clock_real_at(uint64_t mono)
+{
+    uint64_t elapsed = mono - clock_mono_base;
+
+    return(clock_real_base + elapsed +
+        ((int64_t) elapsed * clock_freq + clock_freq_rem) / 1000000000LL +
+        clock_slewed(elapsed));
+}
+
+/// @brief Time of day in microseconds since the epoch.
+///
+/// @return microseconds.
+uint64_t clock_real_us()
+{
+    return(clock_real_at(clock_mono_us()));
+}
+
+/// @brief Move the clock base to now and use up the slew applied so far.
+///  Called once a second by clock_task().
+///
+/// @return void.
+void clock_update()
+{
+    uint64_t mono = clock_mono_us();
+    int64_t slewed = clock_slewed(mono - clock_mono_base);
+
+    clock_real_base = clock_real_at(mono);
+    clock_freq_rem = ((int64_t) (mono - clock_mono_base) * clock_freq + clock_freq_rem) % 1000000000LL;
+    clock_mono_base = mono;
+    clock_slew -= slewed;
+}
+
+/// @brief Read clock time resolution into struct timepec *ts - POSIX function.
+///  - Note: We ignore clk_id
+/// @param[in] clk_id:  unused hardware clock index.
+/// @param[out] res:        timespec resolution result.
+///
+/// @return 0 on success.
+/// @return -1 on error.
+MEMSPACE
+int clock_getres(clockid_t clk_id, struct timespec *res)
+{
+    res->tv_sec = 0;
+    res->tv_nsec = 1000L;
+    return(0);
+}
+
+/// @brief Set system clock using seconds and nonoseconds - POSIX function.
+///
+///  - Note: This steps the clock, see clock_discipline() to slew it.
+///
+/// @param[in] clk_id: Only CLOCK_REALTIME can be set.
+/// @param[in] ts: struct timespec input.
+///
+/// @return 0 on success.
+/// @return -1 on error.
+MEMSPACE
+int clock_settime(clockid_t clk_id, const struct timespec *ts)
+{
+    if(clk_id != CLOCK_REALTIME)
+        return(-1);
+
+    clock_mono_base = clock_mono_us();
+    clock_real_base = (uint64_t) ts->tv_sec * 1000000ULL + ts->tv_nsec / 1000L;
+    clock_freq_rem = 0;
+    clock_slew = 0;
+    return(0);
+}
+
+/// @brief Read clock time into struct timepec *ts - POSIX function.
+///
+/// @param[in] clk_id:  CLOCK_MONOTONIC for time since power on, otherwise time of day.
+/// @param[out] ts:     timespec result.
+///
+/// @return 0 on success.
+MEMSPACE
+int clock_gettime(clockid_t clk_id, struct timespec *ts)
+{
+    uint64_t us = clock_mono_us();
+
+    if(clk_id != CLOCK_MONOTONIC)
+        us = clock_real_at(us);
+    ts->tv_sec = us / 1000000ULL;
+    ts->tv_nsec = (us % 1000000ULL) * 1000L;
+    return(0);
+}
+
+/// @brief Correct the time of day with a measured offset, usually from NTP.
+///
+/// - Large offsets, and the first one, step the clock.
+/// - Small offsets are slewed at up to CLOCK_SLEW_PPM so time never jumps
+///   or runs backwards, and the part the last slew did not explain
+///   corrects the frequency.
+///
+/// @param[in] offset: reference time minus our time in microseconds.
+///
+/// @return 1 if the clock was stepped, 0 if it is being slewed.
+MEMSPACE
+int clock_discipline(int64_t offset)
+{
+    int64_t residual, interval;
+    int32_t freq;
+
+    clock_update();
+    clock_offset = offset;
+
+    if(!clock_synced || offset > CLOCK_STEP_US || offset < -CLOCK_STEP_US)
+    {
+        clock_real_base += offset;
+        clock_slew = 0;
+        clock_sync = clock_mono_base;
+        clock_synced = 1;
+        ++clock_steps;
+        return(1);
+    }
+
+    // Any slew still pending is part of the offset we just measured
+    residual = offset - clock_slew;
+    interval = clock_mono_base - clock_sync;
+    if(interval >= CLOCK_FREQ_INTERVAL)
+    {
+        freq = clock_freq + (int32_t) ((residual * 1000000000LL / interval) / CLOCK_FREQ_GAIN);
+        if(freq > CLOCK_FREQ_MAX)
+            freq = CLOCK_FREQ_MAX;
+        if(freq < -CLOCK_FREQ_MAX)
+            freq = -CLOCK_FREQ_MAX;
+        clock_freq = freq;
+    }
+    clock_sync = clock_mono_base;
+    clock_slew = offset;
+    return(0);
+}
+
+/// @brief Display the clock discipline state.
+///
+/// @return void.
+MEMSPACE
+void clock_stats()
+{
+    printf("clock: synced:%d, steps:%lu, offset:%ld uS, slew left:%ld uS, freq:%ld ppb\n",
+        (int) clock_synced,
+        (unsigned long) clock_steps,
+        (long) clock_offset,
+        (long) clock_slew,
+        (long) clock_freq);
+}
+
+#else	// HAVE_CLOCK_DISCIPLINE
+
 /// @brief Read clock time resolution into struct timepec *ts - POSIX function.
 ///  - Note: We ignore clk_id
 /// @param[in] clk_id:  unused hardware clock index.
@@ -391,3 +854,5 @@ int clock_gettime(clockid_t clk_id, struct timespec *ts)
 }
 
 #endif
+
+#endif	// HAVE_CLOCK_DISCIPLINE
@@ -31,11 +31,33 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ///@brief type of clockid_t.
 typedef uint16_t clockid_t;
 
+///@brief Timer wheel slots per level, as a power of 2
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+///@brief Timer wheel levels, each level is TIMER_WHEEL_SIZE times slower
+#define TIMER_WHEEL_LEVELS 4
+///@brief Ticks covered by the wheel, longer timers wait in the last level
+#define TIMER_WHEEL_SPAN ((1UL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+///@brief Timer wheel entry, one shot or periodic
+/// The caller owns the storage so starting and cancelling never allocate
+typedef struct wtimer_
+{
+    struct wtimer_ *next;
+    struct wtimer_ **pprev;                       // NULL when not pending
+    uint32_t expires;                             // tick the timer runs on
+    uint32_t period;                              // ticks between runs, 0 for one shot
+    void (*handler)(void *arg);
+    void *arg;
+} wtimer_t;
+
 ///@brief user timer struct
 typedef struct
 {
     void (*user_timer_handler)(void);             // user task
     uint8_t timer;                                // user task enabled ?
+    wtimer_t wt;                                  // runs the user task every tick
 } TIMERS;
 
 ///@brief System task in HZ.
@@ -43,6 +65,28 @@ typedef struct
 #error #define SYSTEM_TASK_HZ 1000L
 #endif
 
+///@brief Clocks for clock_gettime()
+#ifndef CLOCK_REALTIME
+#define CLOCK_REALTIME 0
+#endif
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC 1
+#endif
+
+///@brief clock_discipline() steps the clock for offsets larger than this in microseconds
+#define CLOCK_STEP_US 128000LL
+///@brief Fastest slew in parts per million
+#define CLOCK_SLEW_PPM 500ULL
+///@brief Largest frequency correction in parts per billion
+#define CLOCK_FREQ_MAX 500000L
+///@brief Frequency corrections are divided by this to filter measurement noise
+#define CLOCK_FREQ_GAIN 4
+///@brief Shortest interval in microseconds used to estimate the frequency
+#define CLOCK_FREQ_INTERVAL 8000000LL
+
+///@brief Milliseconds to System task ticks, rounded up
+#define TIMER_MS(ms) ((((uint32_t)(ms)) * SYSTEM_TASK_HZ + 999L) / 1000L)
+
 ///@brief System task in Nanoseconds.
 #define SYSTEM_TASK_TIC_NS ( 1000000000L / SYSTEM_TASK_HZ )
 ///@brief System task in Microseconds.
@@ -56,6 +100,11 @@ typedef struct
 #define CLOCK_TIC_US SYSTEM_TASK_TIC_US
 
 /* timer.c */
+MEMSPACE void wtimer_init ( wtimer_t *t , void (*handler )(void *arg ), void *arg );
+MEMSPACE void wtimer_start ( wtimer_t *t , uint32_t ticks , uint32_t period );
+MEMSPACE void wtimer_cancel ( wtimer_t *t );
+MEMSPACE int wtimer_pending ( wtimer_t *t );
+uint32_t wtimer_ticks ( void );
 MEMSPACE int set_timers ( void (*handler )(void ), int timer );
 MEMSPACE int kill_timer ( int timer );
 MEMSPACE void delete_all_timers ( void );
@@ -69,10 +118,15 @@ MEMSPACE void disable_timers ( void );
 MEMSPACE void enable_timers ( void );
 void execute_timers ( void );
 MEMSPACE void clock_init ( void );
-void clock_task ( void );
+void clock_task ( void *arg );
 MEMSPACE void init_timers ( void );
+uint64_t clock_mono_us ( void );
+uint64_t clock_real_us ( void );
+void clock_update ( void );
 MEMSPACE int clock_getres ( clockid_t clk_id , struct timespec *res );
 MEMSPACE int clock_settime ( clockid_t clk_id , const struct timespec *ts );
+MEMSPACE int clock_discipline ( int64_t offset );
+MEMSPACE void clock_stats ( void );
 
 extern MEMSPACE int clock_gettime ( clockid_t clk_id , struct timespec *ts );
 /* timer_hal.c */
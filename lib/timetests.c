@@ -95,6 +95,151 @@ int myrand(int start, int end)
 }
 
 
+/// @brief Check gmtime_r() and timegm() for every day of the time_t range
+/// A date counted forward one day at a time is compared with each conversion
+/// @return number of errors
+MEMSPACE
+long time_range_tests()
+{
+    time_t epoch;
+    tm_t tm;
+    long days;
+    long errors = 0;
+    int year = EPOCH_YEAR;
+    int mon = 0;
+    int mday = 1;
+    int yday = 0;
+    int sec;
+
+    // time_to_tm() accepts epoch < 0xFFFD5D00
+    for(days = 0; days < 49709L; ++days)
+    {
+#ifdef ESP8266
+        if((days & 1023) == 0)
+            optimistic_yield(1000);
+#endif
+        // a different time of day for each day
+        sec = (days * 7919L) % 86400L;
+        epoch = (time_t) days * 86400UL + sec;
+        if(epoch >= 0xFFFD5D00UL)
+            break;
+
+        gmtime_r(&epoch, &tm);
+        if(tm.tm_year != year - 1900 || tm.tm_mon != mon || tm.tm_mday != mday 
+            || tm.tm_yday != yday || tm.tm_wday != (EPOCH_DAY + days) % 7
+            || tm.tm_hour != sec / 3600 || tm.tm_min != (sec / 60) % 60 || tm.tm_sec != sec % 60)
+        {
+            if(++errors < 10)
+                printf("gmtime_r: %10lu, expected %4d,%2d,%2d, got %4d,%2d,%2d\n", 
+                    (long) epoch, year, mon, mday, 
+                    (int)tm.tm_year+1900, (int)tm.tm_mon, (int)tm.tm_mday);
+        }
+        if(timegm(&tm) != epoch)
+        {
+            if(++errors < 10)
+                printf("timegm: %10lu, %4d,%2d,%2d\n", (long) epoch, year, mon, mday);
+        }
+
+        // next day
+        ++yday;
+        if(++mday > Days_Per_Month(mon, year))
+        {
+            mday = 1;
+            if(++mon >= 12)
+            {
+                mon = 0;
+                yday = 0;
+                ++year;
+            }
+        }
+    }
+
+    // 2100 is not a leap year, Feb 29 2100 is Mar 1 2100
+    tm.tm_year = 2100 - 1900;
+    tm.tm_mon = 1;
+    tm.tm_mday = 29;
+    tm.tm_hour = 0;
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    if(timegm(&tm) != 4107542400UL || tm.tm_mon != 2 || tm.tm_mday != 1)
+    {
+        ++errors;
+        printf("timegm: Feb 29 2100 is %4d,%2d,%2d\n", 
+            (int)tm.tm_year+1900, (int)tm.tm_mon, (int)tm.tm_mday);
+    }
+
+    printf("time range tests: %ld days, %ld errors\n", days, errors);
+    return(errors);
+}
+
+/// @brief Check localtime_r() one second either side of each DST transition
+/// US Eastern time, DST starts the 2nd Sunday of Mar at 2:00am EST
+/// and ends the 1st Sunday of Nov at 2:00am EDT
+/// Years are visited out of order so the DST cache is refreshed
+/// @return number of errors
+MEMSPACE
+long dst_tests()
+{
+    tz_t tz, save;
+    tm_t tm;
+    time_t start, end, epoch;
+    long errors = 0;
+    int i, year;
+
+    gettimezone(&save);
+    tz.tz_minuteswest = 300;
+    tz.tz_dsttime = 0;
+    settimezone(&tz);
+
+    for(i = 0; i < 135; ++i)
+    {
+        year = 1971 + (i * 37) % 135;  // 1971 .. 2105
+
+        // 2016 is Mar 13 07:00 GMT and Nov 6 06:00 GMT
+        start = find_dst(0, 0, year,  3, 2, 0, 2);
+        end   = find_dst(1, 0, year, 11, 1, 0, 2);
+
+        epoch = start - 1;
+        localtime_r(&epoch, &tm);
+        if(tm.tm_isdst || tm.tm_mon != 2 || tm.tm_hour != 1 || tm.tm_min != 59)
+            ++errors;
+        epoch = start;
+        localtime_r(&epoch, &tm);
+        if(!tm.tm_isdst || tm.tm_mon != 2 || tm.tm_wday != 0 
+            || tm.tm_mday < 8 || tm.tm_mday > 14 || tm.tm_hour != 3 || tm.tm_min != 0)
+            ++errors;
+        epoch = end - 1;
+        localtime_r(&epoch, &tm);
+        if(!tm.tm_isdst || tm.tm_mon != 10 || tm.tm_hour != 1 || tm.tm_min != 59)
+            ++errors;
+        epoch = end;
+        localtime_r(&epoch, &tm);
+        if(tm.tm_isdst || tm.tm_mon != 10 || tm.tm_wday != 0 
+            || tm.tm_mday > 7 || tm.tm_hour != 1 || tm.tm_min != 0)
+            ++errors;
+        // mid summer and new year
+        epoch = start + 100 * 86400L;
+        if(!is_dst(epoch))
+            ++errors;
+        epoch = end + 60 * 86400L;
+        if(is_dst(epoch))
+            ++errors;
+        if(errors && errors < 10)
+            printf("DST %4d error\n", year);
+    }
+
+    epoch = 1457852400UL;    // Sun Mar 13 07:00:00 2016 GMT
+    if(find_dst(0, epoch, 0, 3, 2, 0, 2) != epoch || !is_dst(epoch) || is_dst(epoch - 1))
+        ++errors;
+    epoch = 1478412000UL;    // Sun Nov  6 06:00:00 2016 GMT
+    if(find_dst(1, epoch, 0, 11, 1, 0, 2) != epoch || is_dst(epoch) || !is_dst(epoch - 1))
+        ++errors;
+
+    settimezone(&save);
+    printf("DST tests: %ld errors\n", errors);
+    return(errors);
+}
+
 MEMSPACE
 int timetests(char *str, int check)
 {
@@ -173,6 +318,9 @@ int timetests(char *str, int check)
     }
     printf("-1 = %d\n", -1);
 
+    time_range_tests();
+    dst_tests();
+
     if (fp != stdout )
         if( fclose(fp) )
             perror("timetest fclose failed");
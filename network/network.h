@@ -31,7 +31,6 @@ extern int network_init;
 /* network.c */
 MEMSPACE char *ipv4_2str(uint32_t ip);
 MEMSPACE void poll_network_message ( window *win );
-void ntp_setup ( void );
 MEMSPACE void my_receive ( void *arg , char *pdata , unsigned short len );
 MEMSPACE void wifi_event_cb ( System_Event_t *event_p );
 MEMSPACE void setup_networking ( void );
@@ -0,0 +1,263 @@
+/**
+ @file ntp.c
+
+ @brief SNTP client that disciplines the system clock
+ The SDK sntp client only gives whole seconds and was stopped once the
+ time was set, so the clock then drifted. This sends an NTP request every
+ NTP_POLL seconds, measures the offset and round trip delay from the four
+ timestamps and passes the offset to clock_discipline(), which slews the
+ clock and tracks its frequency error.
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "user_config.h"
+
+#include <string.h>
+
+#include "lib/time.h"
+#include "lib/timer.h"
+#include "display/ili9341.h"
+#include "network/network.h"
+#include "network/ntp.h"
+
+/// @brief NTP servers, from pool.ntp.org
+static char *ntp_servers[] = { "206.108.0.131", "167.114.204.238" };
+#define NTP_SERVERS (sizeof(ntp_servers) / sizeof(char *))
+
+/// @brief Request states
+#define NTP_IDLE 0
+#define NTP_WAIT 1
+
+static struct espconn ntp_conn;
+static esp_udp ntp_udp;
+
+/// @brief 0 not started, 1 waiting for the first reply, 2 clock set, 3 time zone set
+static int ntp_init = 0;
+
+static uint8_t ntp_state = NTP_IDLE;
+static uint8_t ntp_server = 0;
+/// @brief Transmit timestamp of our request, the reply must echo it
+static uint8_t ntp_xmt[8];
+/// @brief Our time of day when the request was sent, T1, in microseconds
+static uint64_t ntp_t1;
+/// @brief Monotonic time the request was sent and the next one is due
+static uint64_t ntp_sent;
+static uint64_t ntp_next;
+
+/// @brief Statistics
+static int64_t ntp_offset = 0;
+static int64_t ntp_delay = 0;
+static uint32_t ntp_replies = 0;
+static uint32_t ntp_timeouts = 0;
+
+/**
+  @brief Time of day in microseconds to an NTP timestamp
+  @param[out] *p: 8 byte big endian timestamp
+  @param[in] us: microseconds since the Unix epoch
+  @return void
+*/
+MEMSPACE
+static void ntp_put_time(uint8_t *p, uint64_t us)
+{
+	uint32_t sec = (uint32_t) (us / 1000000ULL) + NTP_UNIX_OFFSET;
+	uint32_t frac = (uint32_t) (((us % 1000000ULL) << 32) / 1000000ULL);
+
+	p[0] = sec >> 24;
+	p[1] = sec >> 16;
+	p[2] = sec >> 8;
+	p[3] = sec;
+	p[4] = frac >> 24;
+	p[5] = frac >> 16;
+	p[6] = frac >> 8;
+	p[7] = frac;
+}
+
+/**
+  @brief NTP timestamp to time of day in microseconds
+  @param[in] *p: 8 byte big endian timestamp
+  @return microseconds since the Unix epoch
+*/
+MEMSPACE
+static uint64_t ntp_get_time(uint8_t *p)
+{
+	uint32_t sec = ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+	uint32_t frac = ((uint32_t) p[4] << 24) | ((uint32_t) p[5] << 16) | ((uint32_t) p[6] << 8) | p[7];
+
+	// Unsigned subtract keeps working after the NTP era rolls over in 2036
+	sec -= NTP_UNIX_OFFSET;
+	return((uint64_t) sec * 1000000ULL + (((uint64_t) frac * 1000000ULL) >> 32));
+}
+
+/**
+  @brief Send a client request to the current server
+  @return void
+*/
+MEMSPACE
+static void ntp_send(void)
+{
+	uint8_t buf[NTP_PACKET];
+	ip_addr_t addr;
+
+	memset(buf, 0, sizeof(buf));
+	buf[0] = 0x23;	// LI 0, version 4, mode 3 client
+
+	ipaddr_aton(ntp_servers[ntp_server], &addr);
+	memcpy(ntp_udp.remote_ip, &addr.addr, 4);
+	ntp_udp.remote_port = NTP_PORT;
+
+	ntp_sent = clock_mono_us();
+	ntp_t1 = clock_real_us();
+	ntp_put_time(buf + 40, ntp_t1);
+	memcpy(ntp_xmt, buf + 40, 8);
+
+	ntp_state = NTP_WAIT;
+	espconn_send(&ntp_conn, buf, sizeof(buf));
+}
+
+/**
+  @brief Receive an NTP reply and correct the clock
+  @param[in] *arg: connection
+  @param[in] *data: packet
+  @param[in] len: packet length
+  @return void
+*/
+MEMSPACE
+static void ntp_receive(void *arg, char *data, unsigned short len)
+{
+	uint8_t *p = (uint8_t *) data;
+	uint64_t t2, t3, t4;
+
+	t4 = clock_real_us();
+
+	if(ntp_state != NTP_WAIT || len < NTP_PACKET)
+		return;
+	// Server mode, a stratum of 0 is a kiss of death
+	if((p[0] & 7) != 4 || p[1] == 0 || p[1] > 15)
+		return;
+	// Origin timestamp must be the one we sent
+	if(memcmp(p + 24, ntp_xmt, 8) != 0)
+		return;
+
+	t2 = ntp_get_time(p + 32);
+	t3 = ntp_get_time(p + 40);
+
+	ntp_offset = ((int64_t) (t2 - ntp_t1) + (int64_t) (t3 - t4)) / 2;
+	ntp_delay = (int64_t) (t4 - ntp_t1) - (int64_t) (t3 - t2);
+	++ntp_replies;
+
+	ntp_state = NTP_IDLE;
+	ntp_next = clock_mono_us() + NTP_POLL * 1000000ULL;
+
+	if(clock_discipline(ntp_offset))
+	{
+		printf("NTP: clock stepped %ld mS\n", (long) (ntp_offset / 1000));
+		if(ntp_init == 1)
+			ntp_init = 2;
+	}
+}
+
+/**
+  @brief NTP state machine, called every 50mS
+  Sends a request every NTP_POLL seconds once we have an IP address
+  @return void
+*/
+void ntp_setup(void)
+{
+	tz_t tz;
+	time_t sec;
+	tm_t *p;
+	uint64_t now;
+
+	// Wait until we have an IP address before we set the time
+	if(!network_init)
+		return;
+
+	if(ntp_init == 0)
+	{
+		ntp_conn.type = ESPCONN_UDP;
+		ntp_conn.state = ESPCONN_NONE;
+		ntp_conn.proto.udp = &ntp_udp;
+		ntp_udp.local_port = espconn_port();
+		ntp_udp.remote_port = NTP_PORT;
+		espconn_regist_recvcb(&ntp_conn, ntp_receive);
+		if(espconn_create(&ntp_conn) != 0)
+		{
+			printf("NTP: espconn_create failed\n");
+			return;
+		}
+		ntp_next = clock_mono_us();
+		ntp_init = 1;
+		printf("NTP:1\n");
+	}
+
+	now = clock_mono_us();
+
+	if(ntp_state == NTP_WAIT && (now - ntp_sent) > NTP_TIMEOUT * 1000000ULL)
+	{
+		++ntp_timeouts;
+		ntp_state = NTP_IDLE;
+		ntp_server = (ntp_server + 1) % NTP_SERVERS;
+		ntp_next = now;
+	}
+
+	if(ntp_state == NTP_IDLE && (int64_t) (now - ntp_next) >= 0)
+		ntp_send();
+
+	if(ntp_init == 2)
+	{
+		printf("NTP:2\n");
+
+		time(&sec);
+		printf("ntp_init: %s\n", asctime(gmtime(&sec)));
+		printf("ntp_init: %s\n", ctime_gm(&sec));
+
+		tz.tz_minuteswest = 300;
+		tz.tz_dsttime = 0;
+		settimezone(&tz);
+
+		printf("SEC:%ld\n",sec);
+		printf("TIME:%s\n", ctime(&sec));
+		ntp_init = 3;
+
+		set_dst(sec);
+
+		print_dst_gmt();
+		print_dst();
+
+		p = gmtime(&sec);
+		mktime(p);
+		printf("Localtime: %s\n", asctime(p));
+	}
+}
+
+/**
+  @brief Display NTP and clock discipline statistics
+  @return void
+*/
+MEMSPACE
+void ntp_stats(void)
+{
+	printf("NTP: server:%s, replies:%lu, timeouts:%lu, offset:%ld uS, delay:%ld uS\n",
+		ntp_servers[ntp_server],
+		(unsigned long) ntp_replies,
+		(unsigned long) ntp_timeouts,
+		(long) ntp_offset,
+		(long) ntp_delay);
+	clock_stats();
+}
@@ -0,0 +1,45 @@
+/**
+ @file ntp.h
+
+ @brief SNTP client that disciplines the system clock
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _NTP_H_
+#define _NTP_H_
+
+///@brief NTP server UDP port
+#define NTP_PORT 123
+///@brief NTP packet size without extensions
+#define NTP_PACKET 48
+///@brief Seconds from the NTP epoch, 1900, to the Unix epoch, 1970
+#define NTP_UNIX_OFFSET 2208988800UL
+
+///@brief Seconds between requests once the clock is set
+#ifndef NTP_POLL
+#define NTP_POLL 64
+#endif
+///@brief Seconds to wait for a reply before trying the next server
+#define NTP_TIMEOUT 4
+
+/* ntp.c */
+void ntp_setup ( void );
+MEMSPACE void ntp_stats ( void );
+
+#endif	// _NTP_H_
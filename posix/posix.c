@@ -138,6 +138,19 @@ int errno;
 /// - __iob[2] = stderr.
 FILE *__iob[MAX_FILES];
 
+///@brief Open files that get their FILE and FIL objects from a pool
+/// Files opened beyond this use the heap
+/// More than one reserves memory the lib/test_pool.c soak test shows is
+/// better left to the heap
+#ifndef FILE_POOL
+#define FILE_POOL 1
+#endif
+
+///@brief FILE objects of open files
+static pool_t file_pool = POOL_INIT(sizeof(FILE), FILE_POOL);
+///@brief FatFs FIL objects of open files
+static pool_t fil_pool = POOL_INIT(sizeof(FIL), FILE_POOL);
+
 /// @brief POSIX error messages for each errno value.
 ///
 /// - man page errno (3)
@@ -2330,7 +2343,7 @@ int free_file_descriptor(int fileno)
 
     if(fh != NULL)
     {
-        safefree(fh);
+        pool_free(&fil_pool, fh);
     }
 
     if(stream->buf != NULL && stream->flags & __SMALLOC)
@@ -2339,10 +2352,22 @@ int free_file_descriptor(int fileno)
     }
 
     __iob[fileno]  = NULL;
-    safefree(stream);
+    pool_free(&file_pool, stream);
     return(fileno);
 }
 
+// =============================================
+/// @brief Display FILE and FIL pool usage.
+/// NOT POSIX
+///
+/// @return void.
+MEMSPACE
+void posix_pool_stats( void )
+{
+    pool_stats(&file_pool, "FILE");
+    pool_stats(&fil_pool, "FIL");
+}
+
 
 
 // =============================================
@@ -2364,16 +2389,16 @@ int new_file_descriptor( void )
             continue;
         if( __iob[i] == NULL)
         {
-            stream = (FILE *) safecalloc(sizeof(FILE),1);
+            stream = (FILE *) pool_alloc(&file_pool);
             if(stream == NULL)
             {
                 errno = ENOMEM;
                 return(-1);
             }
-            fh = (FIL *) safecalloc(sizeof(FIL),1);
+            fh = (FIL *) pool_alloc(&fil_pool);
             if(fh == NULL)
             {
-                safefree(stream);
+                pool_free(&file_pool, stream);
                 errno = ENOMEM;
                 return(-1);
             }
@@ -2471,6 +2496,17 @@ static void _fprintf_putc(struct _printf_t *p, char ch)
         fputc(ch, (FILE *) p->buffer);
 }
 
+/// @brief fprintf block write function
+/// @param[in] *p: printf user buffer
+/// @param[in] *s: characters
+/// @param[in] count: number of characters
+MEMSPACE
+static void _fprintf_write(struct _printf_t *p, const char *s, int count)
+{
+        p->sent += count;
+        fwrite(s, 1, count, (FILE *) p->buffer);
+}
+
 
 /// @brief fprintf function
 ///  Example user defined printf function using fputc for I/O
@@ -2487,6 +2523,7 @@ fprintf(FILE *fp, const char *format, ...)
     va_list va;
 
     fn.put = _fprintf_putc;
+    fn.write = _fprintf_write;
     fn.sent = 0;
     fn.buffer = (void *) fp;
 
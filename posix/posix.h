@@ -382,6 +382,7 @@ MEMSPACE time_t fat_time_to_unix ( uint16_t date , uint16_t time );
 MEMSPACE void unix_time_to_fat(time_t epoch, uint16_t *date, uint16_t *time);
 MEMSPACE FIL *fileno_to_fatfs ( int fileno );
 MEMSPACE int free_file_descriptor ( int fileno );
+MEMSPACE void posix_pool_stats ( void );
 MEMSPACE int new_file_descriptor ( void );
 MEMSPACE int posix_fopen_modes_to_open ( const char *mode );
 
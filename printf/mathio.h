@@ -77,10 +77,17 @@ MEMSPACE double atof ( const char *str );
 
 // =============================================
 /* printf.c */
+///@brief _printf_fn() output staging size for printf_t write
+#ifndef PRINTF_STAGE_SIZE
+#define PRINTF_STAGE_SIZE 32
+#endif
+
 ///@brief  We let printf use user defined I/O functions
+/// write is optional, when set output is staged and written in blocks
 typedef struct _printf_t
 {
     void (*put)(struct _printf_t *, char);
+    void (*write)(struct _printf_t *, const char *, int);
     void *buffer;
     int len;
     int sent;
@@ -101,25 +108,79 @@ typedef union {
     unsigned short all;
 } f_t;
 
+/// @brief Conversion modes for fp_digits()
+enum {
+    FP_FIXED,       ///@brief ndigits after the decimal point, %f
+    FP_DIGITS,      ///@brief ndigits significant digits, %e %g
+    FP_SHORTEST     ///@brief fewest digits that read back as the same value
+};
+
+/// @brief Pre-parsed printf conversion, see printf_compile() and PF()
+/// Each entry is the literal text before a conversion and the conversion
+/// A list ends with PF_END, lit == NULL
+typedef struct {
+    const char *lit;    ///@brief literal text before the conversion
+    uint16_t litlen;    ///@brief literal text length
+    uint8_t spec;       ///@brief conversion character, 0 for literal text only
+    uint8_t size;       ///@brief argument size in bytes
+    short width;        ///@brief field width
+    short prec;         ///@brief precision
+    f_t f;              ///@brief format flags
+} printf_desc_t;
+
+///@brief PF() flags, these match the f_t bit order
+#define PF_WIDTH    0x01
+#define PF_PREC     0x02
+#define PF_PLUS     0x04
+#define PF_LEFT     0x08
+#define PF_SPACE    0x10
+#define PF_ZERO     0x20
+#define PF_ALT      0x80
+
+///@brief Build a printf_desc_t at compile time
+/// lit: literal text before the conversion
+/// flags: PF_LEFT, PF_PLUS, PF_SPACE, PF_ZERO, PF_ALT or 0
+/// width: field width, 0 for none
+/// prec: precision, -1 for none
+/// type: argument type, long for %ld, double for %f, etc
+/// spec: conversion character
+/// Example: "Iter:% 10ld\n" is
+///   PF("Iter:", PF_SPACE, 10, -1, long, 'd'), PF_LIT("\n"), PF_END
+#define PF(lit, flags, width, prec, type, spec) \
+    { lit, sizeof(lit) - 1, spec, sizeof(type), width, ((prec) < 0 ? 0 : (prec)), \
+      { .all = (flags) | ((width) ? PF_WIDTH : 0) | ((prec) < 0 ? 0 : PF_PREC) } }
+///@brief printf_desc_t literal text only
+#define PF_LIT(lit) { lit, sizeof(lit) - 1, 0, 0, 0, 0, { .all = 0 } }
+///@brief printf_desc_t list end
+#define PF_END { NULL, 0, 0, 0, 0, 0, { .all = 0 } }
+
 /* printf.c */
 MEMSPACE size_t WEAK_ATR strlen ( const char *str );
 MEMSPACE int WEAK_ATR isdigit ( int c );
 MEMSPACE void WEAK_ATR reverse ( char *str );
 MEMSPACE void WEAK_ATR strupper ( char *str );
 MEMSPACE int bin2num ( uint8_t *str , int strmax , int nummin , int base , uint8_t *nump , int numsize , int sign_ch );
+MEMSPACE int uint2num ( uint8_t *str , int strmax , int nummin , int base , uint64_t num , int sign_ch );
 MEMSPACE void pch_init ( char *str , int max );
 MEMSPACE int pch ( char ch );
 MEMSPACE int pch_ind ( void );
 MEMSPACE int pch_max_ind ( void );
 MEMSPACE void print_flags ( f_t f );
 MEMSPACE int p_ntoa ( uint8_t *nump , int numsize , char *str , int strmax , int radix , int width , int prec , f_t f );
+MEMSPACE int fp_digits ( double val , char *digits , int max , int mode , int ndigits , int *exp10 );
 MEMSPACE int p_ftoa ( double val , char *str , int max , int width , int prec , f_t f );
 MEMSPACE int p_etoa ( double val , char *str , int max , int width , int prec , f_t f );
+MEMSPACE int p_gtoa ( double val , char *str , int max , int width , int prec , f_t f );
+MEMSPACE int p_dtoa ( double val , char *str , int max );
 MEMSPACE void _puts_pad ( printf_t *fn , char *s , int width , int count , int left );
 MEMSPACE void _printf_fn ( printf_t *fn , __memx const char *fmt , va_list va );
+MEMSPACE int printf_compile ( const char *fmt , printf_desc_t *desc , int max );
+MEMSPACE void _printf_desc_fn ( printf_t *fn , const printf_desc_t *desc , va_list va );
 MEMSPACE void _putc_buffer_fn ( struct _printf_t *p , char ch );
+MEMSPACE void _write_buffer_fn ( struct _printf_t *p , const char *s , int count );
 MEMSPACE int vsnprintf ( char *str , size_t size , const char *format , va_list va );
 MEMSPACE int snprintf ( char *str , size_t size , const char *format , ...);
+MEMSPACE int snprintf_desc ( char *str , size_t size , const printf_desc_t *desc , ...);
 MEMSPACE int printf ( const char *format , ...);
 #ifdef AVR
 MEMSPACE int vsnprintf_P ( char *str , size_t size , __memx const char *format , va_list va );
@@ -44,6 +44,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 // They are included within printf to allow this to be standalone
 // This is done by looking at header defines for the time being
 
+#ifndef ESP8266
+// lib/stringsup.c provides a word at a time strlen on the ESP8266
 /// @brief String Length
 /// @param[in] str: string
 /// @return string length
@@ -58,6 +60,7 @@ strlen(const char *str)
         ++len;
     return(len);
 }
+#endif
 
 // Skip if we have linux ctype.h
 /// @brief test if a character is a digit
@@ -203,6 +206,123 @@ int bin2num(uint8_t *str, int strmax, int nummin, int base, uint8_t *nump, int n
     return(nummin); // Return string size
 }
 
+/// @brief Two digit decimal lookup table used by uint2num()
+static const char _digits100[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/// @brief Digits for power of two bases used by uint2num()
+static const char _digits16[] = "0123456789abcdef";
+
+/// @brief Convert a 32 bit unsigned number to decimal, two digits per step
+/// Digits are written backwards ending just before end
+/// @param[in] end: one past the last digit
+/// @param[in] num: number
+/// @return pointer to the first digit, a 0 value has no digits
+static char *u32_dec(char *end, uint32_t num)
+{
+    uint32_t q,r;
+
+    while(num >= 100)
+    {
+        q = num / 100;
+        r = (num - q * 100) << 1;
+        num = q;
+        *--end = _digits100[r+1];
+        *--end = _digits100[r];
+    }
+    if(num >= 10)
+    {
+        r = num << 1;
+        *--end = _digits100[r+1];
+        *--end = _digits100[r];
+    }
+    else if(num)
+        *--end = '0' + num;
+    return(end);
+}
+
+/// @brief Convert an unsigned number to ASCII in base 2, 8, 10 or 16
+/// Fast path for p_ntoa, gives the same result as bin2num()
+///   - Decimal uses a two digit table, 64 bit values are split into
+///   9 digit groups so the digits are found with 32 bit divides
+///   - Base 2, 8 and 16 use shift and mask
+/// @param[out] str: ASCII number string result
+/// @param[in] strmax: maximum size of str in bytes
+/// @param[in] nummin: minimum number of digits to display
+/// @param[in] base: 2, 8, 10 or 16
+/// @param[in] num: number
+/// @param[in] sign_ch: sign of number, or 0 for none
+/// @return string size, or -1 if the result does not fit, see bin2num()
+MEMSPACE
+int uint2num(uint8_t *str, int strmax, int nummin, int base, uint64_t num, int sign_ch)
+{
+    char tmp[sizeof(uint64_t)*8];
+    char *end = tmp + sizeof(tmp);
+    char *ptr = end;
+    char *group;
+    uint64_t q;
+    uint32_t lo;
+    int shift,mask;
+    int len,ind;
+
+    if(base == 10)
+    {
+        while(num >> 32)
+        {
+            q = num / 1000000000UL;
+            lo = (uint32_t) (num - q * 1000000000UL);
+            num = q;
+            // exactly 9 digits for this group
+            group = ptr - 9;
+            ptr = u32_dec(ptr, lo);
+            while(ptr > group)
+                *--ptr = '0';
+        }
+        ptr = u32_dec(ptr, (uint32_t) num);
+    }
+    else
+    {
+        shift = (base == 16) ? 4 : (base == 8) ? 3 : 1;
+        mask = base - 1;
+        while(num >> 32)
+        {
+            *--ptr = _digits16[(int) num & mask];
+            num >>= shift;
+        }
+        lo = (uint32_t) num;
+        while(lo)
+        {
+            *--ptr = _digits16[lo & mask];
+            lo >>= shift;
+        }
+    }
+
+    len = end - ptr;
+    if(nummin < len)
+        nummin = len;
+    if(nummin > strmax - 2)
+        return(-1);
+
+    ind = 0;
+    if(sign_ch)
+        str[ind++] = sign_ch;
+    while(len < nummin--)
+        str[ind++] = '0';
+    memcpy(str + ind, ptr, len);
+    ind += len;
+    str[ind] = 0;
+    return(ind);
+}
+
 // =============================================
 /// @brief Data structure for character buffer with limits
 typedef struct {
@@ -316,6 +436,7 @@ int p_ntoa(uint8_t *nump, int numsize, char *str, int strmax, int radix, int wid
         unsigned int sign_ch;
         int ind;
         int digits;
+        uint64_t num;
 
         digits = 0;
 
@@ -366,379 +487,1028 @@ int p_ntoa(uint8_t *nump, int numsize, char *str, int strmax, int radix, int wid
                     --digits;
             }
         }
+        // Values that fit in 64 bits take the fast path
+        if(numsize <= sizeof(num) && 
+            (radix == 10 || radix == 16 || radix == 8 || radix == 2) )
+        {
+            num = 0;
+            // little endian, see bin2num
+            memcpy(&num, nump, numsize);
+            ind = uint2num((uint8_t *)str, strmax, digits, radix, num, sign_ch);
+            if(ind >= 0)
+                return(ind);
+        }
         ind = bin2num((uint8_t *)str, strmax, digits, radix, nump, numsize, sign_ch);
         return(ind);
 }
 
 
 #ifdef FLOATIO
-/// @brief float to ASCII 
+// =============================================
+// Float to decimal conversion
+//
+// The double is split into its integer mantissa and binary exponent and
+// all digits are found with integer arithmetic, no floating point
+// operations are used - these are library calls on a soft-float CPU.
+//
+// Each double is an exact binary fraction, so every digit we emit is the
+// exact decimal value, rounded half to even at the last digit - as GLIBC does.
+//   - Fixed point values that fit in 64 bits use 64 bit integers
+//   - All other values use small bignums, see Steele and White, Dragon4
+//     and Burger and Dybvig "Printing Floating-Point Numbers Quickly and Accurately"
+//   - The shortest mode returns the fewest digits that read back as the same double
+// =============================================
+
+/// @brief bignum size in 32 bit words
+/// The largest value is about 2**1080 for the smallest denormal numbers
+#define BN_SIZE 36
+
+/// @brief Small bignum, least significant word first
+typedef struct {
+    int size;               ///@brief words in use
+    uint32_t d[BN_SIZE];    ///@brief value
+} bn_t;
+
+/// @brief Set a bignum to a 64 bit value
+/// @param[out] a: bignum
 /// @param[in] val: value
-/// @param[in] str: converted string
-/// @param[in] width: field width is the minimum number of characters in converted string
-/// @param[in] prec: number of digits emitted after after the radix point
-/// @param[in] sign: sign type flag
-/// @return size of string
-MEMSPACE 
-int p_ftoa(double val, char *str, int max, int width, int prec, f_t f)
+/// @return void
+static void bn_set(bn_t *a, uint64_t val)
 {
+    a->size = 0;
+    while(val)
+    {
+        a->d[a->size++] = (uint32_t) val;
+        val >>= 32;
+    }
+}
 
-    char *save = str;
-    double fscale;
-    int idigits, digits;
-    int digit;
+/// @brief Multiply a bignum by a 32 bit value
+/// @param[in,out] a: bignum
+/// @param[in] m: multiplier
+/// @return void
+static void bn_mul(bn_t *a, uint32_t m)
+{
+    int i;
+    uint64_t carry = 0;
 
-    pch_init(str,max);
+    for(i=0;i<a->size;++i)
+    {
+        carry += (uint64_t) a->d[i] * m;
+        a->d[i] = (uint32_t) carry;
+        carry >>= 32;
+    }
+    if(carry && a->size < BN_SIZE)
+        a->d[a->size++] = (uint32_t) carry;
+}
 
-/* 
-FIXME 
-Notice rounding - testing will be tricky
-ERROR: [% 15.1f], [-10252956608208.250000]
-    G[-10252956608208.2]
-    B[-10252956608208.3]
-    error:9.90567929632045986708e-15
+/// @brief Multiply a bignum by 10**exp10
+/// @param[in,out] a: bignum
+/// @param[in] exp10: power of 10, >= 0
+/// @return void
+static void bn_mul_pow10(bn_t *a, int exp10)
+{
+    static const uint32_t pow10[] = {
+        1,10,100,1000,10000,100000,1000000,10000000,100000000,1000000000
+    };
+    while(exp10 >= 9)
+    {
+        bn_mul(a, pow10[9]);
+        exp10 -= 9;
+    }
+    if(exp10)
+        bn_mul(a, pow10[exp10]);
+}
 
-*/
-//printf("val:%.20e\n", val);
-//print_flags(f);
-    if(val < 0.0)
+/// @brief Shift a bignum left
+/// @param[in,out] a: bignum
+/// @param[in] bits: bits to shift
+/// @return void
+static void bn_shl(bn_t *a, int bits)
+{
+    int i;
+    int words = bits >> 5;
+
+    bits &= 31;
+    if(!a->size)
+        return;
+    if(bits)
     {
-        val = -val;
-        f.b.neg = 1;
+        bn_mul(a, 1UL << bits);
     }
-    if(f.b.neg)
-        pch('-');
-    else if(f.b.plus)
-        pch('+');
-    else if(f.b.space)
-        pch(' ');
+    if(words)
+    {
+        for(i=a->size-1;i>=0;--i)
+            a->d[i+words] = a->d[i];
+        for(i=0;i<words;++i)
+            a->d[i] = 0;
+        a->size += words;
+    }
+}
 
-    // prec only applies to fractional digits
-    if(prec < 0)
-        prec = 0;
+/// @brief Compare a + b with c, b may be NULL
+/// @param[in] a: bignum
+/// @param[in] b: bignum added to a, or NULL
+/// @param[in] c: bignum
+/// @return < 0, 0, > 0 as a + b is less, equal or greater then c
+static int bn_cmp(bn_t *a, bn_t *b, bn_t *c)
+{
+    int i, size;
+    int64_t acc;
+    int nonzero;
+
+    size = a->size;
+    if(b && b->size > size)
+        size = b->size;
+    if(c->size > size)
+        size = c->size;
+
+    // (a + b) - c one word at a time, acc holds the signed carry
+    acc = 0;
+    nonzero = 0;
+    for(i=0;i<size;++i)
+    {
+        if(i < a->size)
+            acc += a->d[i];
+        if(b && i < b->size)
+            acc += b->d[i];
+        if(i < c->size)
+            acc -= c->d[i];
+        if((uint32_t) acc)
+            nonzero = 1;
+        acc >>= 32;
+    }
+    if(acc < 0)
+        return(-1);
+    if(acc > 0)
+        return(1);
+    return(nonzero);
+}
 
-    // NOTE: prec is anchored at the decimal point
+/// @brief Subtract b from a, a >= b
+/// @param[in,out] a: bignum
+/// @param[in] b: bignum
+/// @return void
+static void bn_sub(bn_t *a, bn_t *b)
+{
+    int i;
+    int64_t acc = 0;
 
-    fscale = 0.0;
-    idigits = 1;    // number of integer digits 
-    if(val) // if zero no rounding needed
+    for(i=0;i<a->size;++i)
     {
-        // do rounding - IF precision specified
-        // number of fractional digits to display
-        fscale = 0.5;   // rounding value if prec = 0
-        if(f.b.prec)
-        {
-            digits = prec;
-            while(digits > 0)
-            {
-                fscale /= 10.0; // adjust rounding value
-                --digits;
-            }
-        }
-//printf("val;:%.20e, fscale:%.20e\n", val, fscale);
-        val += fscale;      // round to prec
+        acc += a->d[i];
+        if(i < b->size)
+            acc -= b->d[i];
+        a->d[i] = (uint32_t) acc;
+        acc >>= 32;
+    }
+    while(a->size && !a->d[a->size-1])
+        --a->size;
+}
 
-        while(val >= 10.0)
-        {
-            ++idigits;
-            val /= 10.0;
-        }
-        // So we know that fval < 1.0;
+/// @brief Next decimal digit, r = r * 10, return r / s, r = r % s
+/// @param[in,out] r: bignum remainder, r < s
+/// @param[in] s: bignum scale
+/// @return digit 0 .. 9
+static int bn_digit(bn_t *r, bn_t *s)
+{
+    int digit = 0;
+
+    bn_mul(r, 10);
+    while(bn_cmp(r, NULL, s) >= 0)
+    {
+        bn_sub(r, s);
+        ++digit;
     }
+    return(digit);
+}
 
-//printf("idigits:%d\n",idigits);
+/// @brief fp_split() exponent for infinity, mant = 0, and NaN, mant != 0
+#define FP_SPECIAL 0x7ff
 
-    if(f.b.zero && !f.b.left)
+/// @brief Split a double into sign, integer mantissa and binary exponent
+/// val = mant * 2**exp2
+/// @param[in] val: value
+/// @param[out] mant: mantissa
+/// @param[out] exp2: binary exponent, FP_SPECIAL for infinity and NaN
+/// @return 1 if negative, 0 if positive
+static int fp_split(double val, uint64_t *mant, int *exp2)
+{
+    uint64_t bits;
+    int exp;
+
+    // IEEE 754 double, the same byte order as our integers
+    memcpy(&bits, &val, sizeof(bits));
+    exp = (int) (bits >> 52) & 0x7ff;
+    *mant = bits & ((1ULL << 52) - 1);
+    if(exp == 0x7ff)
+        *exp2 = FP_SPECIAL;
+    else if(exp)
     {
-        if(f.b.prec && prec)
-            digits = width - idigits - pch_ind() - prec -1; 
-        else
-            digits = width - idigits - pch_ind();
+        *mant |= 1ULL << 52;
+        *exp2 = exp - 1075;
+    }
+    else
+    {
+        *exp2 = -1074;      // denormal
+    }
+    return( (int) (bits >> 63) );
+}
+
+/// @brief Round a digit string up by one in the last digit
+/// @param[in,out] digits: digit string
+/// @param[in] n: number of digits
+/// @param[in,out] exp10: decimal exponent, incremented if all digits were 9
+/// @param[in] mode: FP_FIXED keeps the digits after the decimal point
+/// @return number of digits
+static int fp_round_up(char *digits, int n, int *exp10, int mode)
+{
+    int i;
 
-        while(digits > 0)
+    for(i=n-1;i>=0;--i)
+    {
+        if(digits[i] != '9')
         {
-            pch('0');
-            --digits;
+            ++digits[i];
+            return(n);
         }
+        digits[i] = '0';
     }
+    // 999 rounded to 1000, the value now has one more integer digit
+    digits[0] = '1';
+    ++*exp10;
+    if(mode == FP_FIXED && n)
+        digits[n] = '0';
+    if(mode == FP_FIXED || !n)
+        ++n;
+    return(n);
+}
 
-    // Display integer part of number
-    while(idigits > 0)
+/// @brief Scale a double to bignums, val = r / s * 10**k, 0.1 <= r / s < 10
+/// mp and mm are half the distance to the next and previous double,
+/// all values are scaled by 2 so they are integers
+/// @param[in] mant: mantissa from fp_split()
+/// @param[in] exp2: binary exponent from fp_split()
+/// @param[out] r: bignum numerator
+/// @param[out] s: bignum denominator
+/// @param[out] mp: bignum upper half distance, or NULL
+/// @param[out] mm: bignum lower half distance, or NULL
+/// @return k, it may be one too small, the caller makes the final adjustment
+static int fp_scale(uint64_t mant, int exp2, bn_t *r, bn_t *s, bn_t *mp, bn_t *mm)
+{
+    int k, bits, high;
+    uint64_t tmp;
+
+    // The distance above is twice as big when mant is a power of two
+    high = (mp && mant == (1ULL << 52) && exp2 > -1074);
+    bn_set(r, mant << (1 + high));
+    bn_set(s, 2 << high);
+    if(mp)
     {
-        digit = val;
-//printf("ival:%.16e, int:%d\n", ival, digit);
-        pch(digit + '0');
-        val -= (double) digit;
-        --idigits;
-        val *= 10.0;
+        bn_set(mp, 1 << high);
+        bn_set(mm, 1);
     }
-    // display fractional part  
-    if(f.b.prec && prec > 0 )
+    if(exp2 >= 0)
     {
-        pch('.');
-        while(prec > 0 )
+        bn_shl(r, exp2);
+        if(mp)
         {
-            digit = val;
-            val -= (double) digit;
-            digit += '0';
-            pch(digit);
-            --prec;
-            val *= 10.0;
+            bn_shl(mp, exp2);
+            bn_shl(mm, exp2);
         }
     }
-    pch(0);
-    return(strlen(save));
-}
-
+    else
+    {
+        bn_shl(s, -exp2);
+    }
 
+    // Estimate k so that 10**(k-1) <= val < 10**k
+    // 2**bits <= val, floor(bits * log10(2)) = (bits * 78913) >> 18
+    bits = exp2;
+    for(tmp=mant;tmp>1;tmp>>=1)
+        ++bits;
+    if(bits >= 0)
+        k = ((bits * 78913) >> 18) + 1;
+    else
+        k = -((-bits * 78913) >> 18);
+    if(k >= 0)
+        bn_mul_pow10(s, k);
+    else
+    {
+        bn_mul_pow10(r, -k);
+        if(mp)
+        {
+            bn_mul_pow10(mp, -k);
+            bn_mul_pow10(mm, -k);
+        }
+    }
+    return(k);
+}
 
-/// @brief float to ASCII 
-/// @param[in] x: value
-/// @param[in] str: converted string
-/// @param[in] prec: digits after decimal place
-/// @param[in] sign: sign
-/// @return size of string
-MEMSPACE 
-int p_etoa(double val,char *str, int max, int width, int prec, f_t f)
+/// @brief Shortest digits that read back as the same double
+/// Stop as soon as the digits so far, or the digits plus one in the
+/// last place, are within half the distance to the neighbouring doubles
+/// @param[in] mant: mantissa from fp_split()
+/// @param[in] exp2: binary exponent from fp_split()
+/// @param[out] digits: ASCII digits, no EOS
+/// @param[in] max: size of digits
+/// @param[out] exp10: decimal exponent
+/// @return number of digits
+static int fp_shortest(uint64_t mant, int exp2, char *digits, int max, int *exp10)
 {
-    double fscale;
-    int digits;
-    int digit;
-    int exp10;
-    uint8_t exp10_str[7];   // +E123  and EOS
-    int  expsize;
-    int i;
-    int sign_ch;
+    bn_t r,s,mp,mm;
+    int k, n, i, even, low, high;
 
-    pch_init(str,max);
+    k = fp_scale(mant, exp2, &r, &s, &mp, &mm);
 
-/* FIXME 
-Notice rounding - testing will be tricky
-ERROR: [% 15.1f], [-10252956608208.250000]
-    G[-10252956608208.2]
-    B[-10252956608208.3]
-    error:9.90567929632045986708e-15
+    // Values exactly half way read back as the even mantissa
+    even = !(mant & 1);
 
-*/
-//printf("val:%.20e\n", val);
-//print_flags(f);
-    if(val < 0.0)
+    // fixup k, the upper limit r + mp must be below 1
+    while( (i = bn_cmp(&r, &mp, &s)) > 0 || (even && i == 0) )
     {
-        val = -val;
-        f.b.neg = 1;
+        bn_mul(&s, 10);
+        ++k;
     }
-    if(f.b.neg)
-        pch('-');
-    else if(f.b.plus)
-        pch('+');
-    else if(f.b.space)
-        pch(' ');
+    *exp10 = k;
 
-    // prec only applies to fractional digits
-    if(prec < 0)
-        prec = 0;
+    n = 0;
+    while(n < max)
+    {
+        bn_mul(&mp, 10);
+        bn_mul(&mm, 10);
+        i = bn_digit(&r, &s);
+        // low: the digits so far are close enough
+        // high: the digits plus one in the last place are close enough
+        low = bn_cmp(&r, NULL, &mm);
+        low = even ? low <= 0 : low < 0;
+        high = bn_cmp(&r, &mp, &s);
+        high = even ? high >= 0 : high > 0;
+        if(!low && !high)
+        {
+            digits[n++] = '0' + i;
+            continue;
+        }
+        if(low && high)
+        {
+            // choose the nearest, 2r vs s
+            low = bn_cmp(&r, &r, &s) < 0;
+        }
+        digits[n++] = '0' + i + (low ? 0 : 1);
+        break;
+    }
+    return(n);
+}
+
+/// @brief Convert the absolute value of a double to decimal digits
+/// The result is 0.DIGITS * 10**exp10, digits are exact and correctly rounded
+///   - digits past max are not computed, treat them as 0
+///   - zero gives no digits and exp10 = 1
+/// @param[in] val: value, infinity and NaN give no digits
+/// @param[out] digits: ASCII digits, no EOS
+/// @param[in] max: size of digits
+/// @param[in] mode: FP_FIXED, FP_DIGITS or FP_SHORTEST
+/// @param[in] ndigits: digits after the decimal point, FP_FIXED, or significant digits, FP_DIGITS
+/// @param[out] exp10: decimal exponent
+/// @return number of digits
+MEMSPACE
+int fp_digits(double val, char *digits, int max, int mode, int ndigits, int *exp10)
+{
+    bn_t r,s;
+    uint64_t mant, ip, fp, half;
+    int exp2, bits, k, n, i;
+
+    fp_split(val, &mant, &exp2);
 
-    // NOTE: prec is anchored at the decimal point
+    // keep room for a carry, see fp_round_up()
+    --max;
+    *exp10 = 1;
+    if(!mant || exp2 == FP_SPECIAL)
+        return(0);
 
-    fscale = 1.0;   // rounding value if prec = 0
-    exp10 = 0;
+    if(mode == FP_SHORTEST)
+        return( fp_shortest(mant, exp2, digits, max, exp10) );
 
-    if(val) // if zero no rounding needed
+    // Fixed point value with a 64 bit integer part and at most 60 fraction bits
+    if(mode == FP_FIXED && exp2 >= -60 && exp2 <= 11)
     {
-        fscale = 0.5;   // rounding value if prec = 0
-        // do rounding - IF precision specified
-        // number of fractional digits to display
-        if(f.b.prec)
+        if(exp2 >= 0)
         {
-            digits = prec;
-            while(digits > 0)
-            {
-                fscale /= 10.0; // adjust rounding value
-                --digits;
-            }
+            ip = mant << exp2;
+            fp = 0;
+            bits = 0;
         }
-
-        // scale number  1.0 <= x < 10.0
-        while(val < 1.0 )
+        else
         {
-            val *= 10.0;
-            exp10--;
-
+            bits = -exp2;
+            ip = mant >> bits;
+            fp = mant & ((1ULL << bits) - 1);
         }
-        while(val >= 10.0)
+        n = 0;
+        if(ip)
         {
-            ++exp10;
-            val /= 10.0;
+            char tmp[24];
+            n = uint2num((uint8_t *)tmp, sizeof(tmp), 0, 10, ip, 0);
+            if(n + ndigits <= max)
+                memcpy(digits, tmp, n);
         }
-        val += fscale;  
-        while(val >= 10.0)
+        if(n + ndigits <= max)
         {
-            ++exp10;
-            val /= 10.0;
+            // 0.00ddd when there is no integer part
+            *exp10 = n;
+            for(i=0;i<ndigits;++i)
+            {
+                fp *= 10;
+                digits[n++] = '0' + (int) (fp >> bits);
+                fp &= (1ULL << bits) - 1;
+            }
+            if(bits)
+            {
+                half = 1ULL << (bits - 1);
+                if(fp > half || (fp == half && n && (digits[n-1] & 1)))
+                    n = fp_round_up(digits, n, exp10, mode);
+                else if(!n)
+                    *exp10 = 1;
+            }
+            return(n);
         }
-        // round
-        //printf("val;:%.20e, fscale:%.20e\n", val, fscale);
-        //val += fscale;        // round to prec
     }
 
-    // ====================
-    // Exponent
-    exp10_str[0] = 'e';
-    if ( exp10 < 0 ) 
-    { 
-        sign_ch = '-';
-        exp10 = -exp10; 
-    }
-    else    
-    {
-        sign_ch = '+';
-    }
-    // result is +NN[N] if we have three digits shorten digits by one
-    expsize = bin2num(exp10_str+1, sizeof(exp10_str)-1-1, 2, 10, (uint8_t *) &exp10, sizeof(int), sign_ch);
-
-#if 0
-    if ( exp10 < 0 ) 
-    { 
-        exp10_str[1] = '-';
-        exp10 = -exp10; 
-    }
-    else    
+    // val = r / s * 10**k
+    k = fp_scale(mant, exp2, &r, &s, NULL, NULL);
+
+    // fixup k
+    while(bn_cmp(&r, NULL, &s) >= 0)
     {
-        exp10_str[1] = '+';
+        bn_mul(&s, 10);
+        ++k;
     }
-    if(exp >= 100)
-        ind = 4;
+    *exp10 = k;
+
+    if(mode == FP_FIXED)
+        n = k + ndigits;
     else
-        ind = 3;
+        n = ndigits;
+    if(n < 0)
+        return(0);          // less then half of the last digit
+
+    for(i=0;i<n && i<max;++i)
+        digits[i] = '0' + bn_digit(&r, &s);
+    if(n > max)
+        return(max);        // digits past max are treated as zeros
+
+    // Round half to even on the remainder
+    i = bn_cmp(&r, &r, &s);
+    if(i > 0 || (i == 0 && n && (digits[n-1] & 1)))
+        n = fp_round_up(digits, n, exp10, mode);
+    return(n);
+}
 
-    exp10_str[ind] = '0' + (exp % 10);
-    exp10 /= 10;
-    exp10_str[ind] = '0' + (exp % 10);
-    exp10 /= 10;
-    exp10_str[ind] = '0' + (exp % 10);
+/// @brief Digit buffer size for float conversions
+/// Digits past this are displayed as 0
+#ifndef FP_DIGITS_MAX
+#ifdef PRINTF_TEST
+#define FP_DIGITS_MAX 400
+#else
+#define FP_DIGITS_MAX 40
 #endif
-    
-    // ====================
+#endif
+
+/// @brief Emit the sign of a float, and inf or nan if it is not a number
+/// @param[in] val: value
+/// @param[in] f: flags
+/// @return 1 if val is inf or nan, 0 otherwise
+static int fp_sign(double val, f_t f)
+{
+    uint64_t mant;
+    int exp2;
+    char *ptr;
+
+    if(fp_split(val, &mant, &exp2))
+        f.b.neg = 1;
+    if(f.b.neg)
+        pch('-');
+    else if(f.b.plus)
+        pch('+');
+    else if(f.b.space)
+        pch(' ');
+
+    if(exp2 != FP_SPECIAL)
+        return(0);
+    ptr = mant ? "nan" : "inf";
+    while(*ptr)
+        pch(*ptr++);
+    pch(0);
+    return(1);
+}
+
+/// @brief Emit 0.DIGITS * 10**exp10 as a fixed point number
+/// @param[in] digits: digits from fp_digits(), missing digits are 0
+/// @param[in] n: number of digits
+/// @param[in] exp10: decimal exponent
+/// @param[in] width: field width, for leading zeros
+/// @param[in] prec: number of digits after the decimal point
+/// @param[in] f: flags
+/// @return void
+static void fp_put_fixed(char *digits, int n, int exp10, int width, int prec, f_t f)
+{
+    int i, pad;
 
-    // [+]N.FFe+00, where ".e+00" = 5 digits, pch_ind holds optional sign offset
     if(f.b.zero && !f.b.left)
     {
-        if(f.b.prec && prec)
-            digits = width - pch_ind() - prec - 6;  
-        else
-            digits = width - pch_ind() - 5;
-        if(expsize > 3)
-            --digits;
-        while(digits > 0)
-        {
+        pad = width - pch_ind() - (exp10 > 0 ? exp10 : 1);
+        if(prec || f.b.alt)
+            pad -= prec + 1;
+        while(pad-- > 0)
             pch('0');
-            --digits;
-        }
     }
 
+    // integer part
+    if(exp10 <= 0)
+        pch('0');
+    for(i=0;i<exp10;++i)
+        pch(i < n ? digits[i] : '0');
+
+    // fractional part
+    if(prec || f.b.alt)
+        pch('.');
+    for(i=exp10;i<exp10+prec;++i)
+        pch( (i >= 0 && i < n) ? digits[i] : '0');
+    pch(0);
+}
+
+/// @brief Emit D.IGITS * 10**exp10 as an exponential number
+/// @param[in] digits: digits from fp_digits(), missing digits are 0
+/// @param[in] n: number of digits
+/// @param[in] exp10: decimal exponent
+/// @param[in] width: field width, for leading zeros
+/// @param[in] prec: number of digits after the decimal point
+/// @param[in] f: flags
+/// @return void
+static void fp_put_exp(char *digits, int n, int exp10, int width, int prec, f_t f)
+{
+    uint8_t exp10_str[8];   // e+123 and EOS
+    int i, pad, sign_ch;
 
-    // Number
-    digit = val;
-//printf("ival:%.16e, int:%d\n", ival, digit);
-    pch(digit + '0');
-    val -= (double) digit;
-    val *= 10.0;
+    exp10_str[0] = 'e';
+    sign_ch = '+';
+    if(exp10 < 0)
+    {
+        sign_ch = '-';
+        exp10 = -exp10;
+    }
+    uint2num(exp10_str+1, sizeof(exp10_str)-1, 2, 10, exp10, sign_ch);
 
-    // display fractional part  
-    if(f.b.prec && prec > 0 )
+    if(f.b.zero && !f.b.left)
     {
-        pch('.');
-        while(prec > 0 )
-        {
-            digit = val;
-            val -= (double) digit;
-            digit += '0';
-            pch(digit);
-            val *= 10.0;
-            --prec;
-        }
+        pad = width - pch_ind() - 1 - strlen((char *) exp10_str);
+        if(prec || f.b.alt)
+            pad -= prec + 1;
+        while(pad-- > 0)
+            pch('0');
     }
 
+    pch(n ? digits[0] : '0');
+    if(prec || f.b.alt)
+        pch('.');
+    for(i=1;i<=prec;++i)
+        pch(i < n ? digits[i] : '0');
     for(i=0;exp10_str[i];++i)
         pch(exp10_str[i]);
-
     pch(0);
-    return(strlen(str));
 }
-              
-#endif
 
-
-
-// =============================================
-// _puts_pad
-//   Put string count bytes long, padded up to width, left or right aligned
-// Padding is always done with spaces
-//
-// count number of characters to copy from buff
-// width number of characters to pad up to - if needed
-// left string is left aligned
-//_puts(buff, width, count, left);
-MEMSPACE
-void _puts_pad(printf_t *fn, char *s, int width, int count, int left)
+/// @brief float to ASCII, %f
+/// @param[in] val: value
+/// @param[out] str: converted string
+/// @param[in] max: size of str
+/// @param[in] width: field width is the minimum number of characters in converted string
+/// @param[in] prec: number of digits emitted after after the radix point
+/// @param[in] f: flags
+/// @return size of string
+MEMSPACE 
+int p_ftoa(double val, char *str, int max, int width, int prec, f_t f)
 {
-    int size = 0;
-    int pad = 0;
+    char digits[FP_DIGITS_MAX];
+    int n, exp10;
 
-    // note - if width > count we pad
-    //        if width <= count we do not pad
-    if(width > count)
-    {
-        pad = width - count;
-    }
+    pch_init(str,max);
 
-//printf("_puts_pad:(%s) width:%d, count:%d, left:%d, pad:%d, len:%d\n", s, width, count, left, pad, len);
+    if(fp_sign(val, f))
+        return(strlen(str));
 
-    // left padding ?
-    if(!left)
-    {
-//printf("_puts_pad:pad:%d\n", pad);
-        while(pad--)
-        {
-            fn->put(fn,' ');
-            ++size;
-        }
-    }
-//printf("_puts_pad:count:%d\n", count);
+    // prec only applies to fractional digits
+    if(prec < 0)
+        prec = 0;
 
-    // string
-    while(*s && count--)
-    {
-        fn->put(fn,*s);
-        ++s;
-        ++size;
-    }
-    // right padding
-    if(left)
+    n = fp_digits(val, digits, sizeof(digits), FP_FIXED, prec, &exp10);
+    fp_put_fixed(digits, n, exp10, width, prec, f);
+    return(strlen(str));
+}
+
+/// @brief float to ASCII, %e
+/// @param[in] val: value
+/// @param[out] str: converted string
+/// @param[in] max: size of str
+/// @param[in] width: field width is the minimum number of characters in converted string
+/// @param[in] prec: number of digits emitted after after the radix point
+/// @param[in] f: flags
+/// @return size of string
+MEMSPACE 
+int p_etoa(double val,char *str, int max, int width, int prec, f_t f)
+{
+    char digits[FP_DIGITS_MAX];
+    int n, exp10;
+
+    pch_init(str,max);
+
+    if(fp_sign(val, f))
+        return(strlen(str));
+
+    // prec only applies to fractional digits
+    if(prec < 0)
+        prec = 0;
+
+    n = fp_digits(val, digits, sizeof(digits), FP_DIGITS, prec + 1, &exp10);
+    fp_put_exp(digits, n, n ? exp10 - 1 : 0, width, prec, f);
+    return(strlen(str));
+}
+
+/// @brief float to ASCII, %g
+/// Uses %e when the exponent is < -4 or >= prec, otherwise %f
+/// Trailing zeros are removed unless f.b.alt is set
+/// @param[in] val: value
+/// @param[out] str: converted string
+/// @param[in] max: size of str
+/// @param[in] width: field width is the minimum number of characters in converted string
+/// @param[in] prec: number of significant digits
+/// @param[in] f: flags
+/// @return size of string
+MEMSPACE 
+int p_gtoa(double val,char *str, int max, int width, int prec, f_t f)
+{
+    char digits[FP_DIGITS_MAX];
+    int n, exp10;
+
+    pch_init(str,max);
+
+    if(fp_sign(val, f))
+        return(strlen(str));
+
+    if(prec < 1)
+        prec = 1;
+
+    n = fp_digits(val, digits, sizeof(digits), FP_DIGITS, prec, &exp10);
+    exp10 = n ? exp10 - 1 : 0;
+    if(!f.b.alt)
+    {
+        while(n && digits[n-1] == '0')
+            --n;
+    }
+
+    if(exp10 < -4 || exp10 >= prec)
+        fp_put_exp(digits, n, exp10, width, f.b.alt ? prec - 1 : (n ? n - 1 : 0), f);
+    else
+        fp_put_fixed(digits, n, exp10 + 1, width, f.b.alt ? prec - 1 - exp10 : (n > exp10 + 1 ? n - exp10 - 1 : 0), f);
+    return(strlen(str));
+}
+
+/// @brief float to ASCII, shortest string that reads back as the same value
+/// Uses %e form when the exponent is < -4 or > 16, otherwise %f form
+/// @param[in] val: value
+/// @param[out] str: converted string
+/// @param[in] max: size of str
+/// @return size of string
+MEMSPACE 
+int p_dtoa(double val,char *str, int max)
+{
+    char digits[FP_DIGITS_MAX];
+    int n, exp10;
+    f_t f;
+
+    f.all = 0;
+    pch_init(str,max);
+
+    if(fp_sign(val, f))
+        return(strlen(str));
+
+    n = fp_digits(val, digits, sizeof(digits), FP_SHORTEST, 0, &exp10);
+    exp10 = n ? exp10 - 1 : 0;
+
+    if(exp10 < -4 || exp10 > 16)
+        fp_put_exp(digits, n, exp10, 0, n ? n - 1 : 0, f);
+    else
+        fp_put_fixed(digits, n, exp10 + 1, 0, (n > exp10 + 1 ? n - exp10 - 1 : 0), f);
+    return(strlen(str));
+}
+#endif
+
+
+
+// =============================================
+/// @brief Output staging for _printf_fn()
+/// When the printf_t has a write function, literal text and converted
+/// fields are collected here and written in blocks, otherwise each
+/// character goes to put
+typedef struct {
+    printf_t *fn;                   ///@brief output functions
+    int ind;                        ///@brief characters staged
+    char buf[PRINTF_STAGE_SIZE];    ///@brief staged characters
+} p_out_t;
+
+/// @brief Write any staged characters
+/// @param[in] *out: output staging
+/// @return void
+static void p_out_flush(p_out_t *out)
+{
+    if(out->ind)
     {
-//printf("_puts_pad:pad:%d\n", pad);
+        out->fn->write(out->fn, out->buf, out->ind);
+        out->ind = 0;
+    }
+}
+
+/// @brief Output a character
+/// @param[in] *out: output staging
+/// @param[in] ch: character
+/// @return void
+static void p_out_ch(p_out_t *out, char ch)
+{
+    if(!out->fn->write)
+    {
+        out->fn->put(out->fn, ch);
+        return;
+    }
+    out->buf[out->ind++] = ch;
+    if(out->ind >= (int) sizeof(out->buf))
+        p_out_flush(out);
+}
+
+/// @brief Output a character count times
+/// @param[in] *out: output staging
+/// @param[in] ch: character
+/// @param[in] count: number of characters
+/// @return void
+static void p_out_fill(p_out_t *out, char ch, int count)
+{
+    while(count-- > 0)
+        p_out_ch(out, ch);
+}
 
-        while(pad--) 
+/// @brief Output count characters of a string
+/// Strings larger then the staging buffer are written directly
+/// @param[in] *out: output staging
+/// @param[in] *s: string
+/// @param[in] count: number of characters
+/// @return void
+static void p_out_str(p_out_t *out, char *s, int count)
+{
+    if(!out->fn->write)
+    {
+        while(count--)
+            out->fn->put(out->fn, *s++);
+        return;
+    }
+    if(out->ind + count > (int) sizeof(out->buf))
+    {
+        p_out_flush(out);
+        if(count >= (int) sizeof(out->buf))
         {
-            fn->put(fn,' ');
-            ++size;
+            out->fn->write(out->fn, s, count);
+            return;
         }
     }
-//printf("_puts_pad:size:%d\n", size);
+    memcpy(out->buf + out->ind, s, count);
+    out->ind += count;
+}
+
+/// @brief Put string count bytes long, padded up to width, left or right aligned
+/// Padding is always done with spaces
+/// @param[in] *out: output staging
+/// @param[in] *s: string
+/// @param[in] width: number of characters to pad up to - if needed
+/// @param[in] count: number of characters to copy from s
+/// @param[in] left: string is left aligned
+/// @return void
+static void p_out_pad(p_out_t *out, char *s, int width, int count, int left)
+{
+    int len = 0;
+
+    // string length limited to count
+    while(len < count && s[len])
+        ++len;
+
+    // note - if width > len we pad
+    //        if width <= len we do not pad
+    if(!left)
+        p_out_fill(out, ' ', width - len);
+    p_out_str(out, s, len);
+    if(left)
+        p_out_fill(out, ' ', width - len);
+}
+
+// =============================================
+// _puts_pad
+//   Put string count bytes long, padded up to width, left or right aligned
+// Padding is always done with spaces
+//
+// count number of characters to copy from buff
+// width number of characters to pad up to - if needed
+// left string is left aligned
+//_puts(buff, width, count, left);
+MEMSPACE
+void _puts_pad(printf_t *fn, char *s, int width, int count, int left)
+{
+    p_out_t out;
+
+    out.fn = fn;
+    out.ind = 0;
+    p_out_pad(&out, s, width, count, left);
+    p_out_flush(&out);
 }   // _puts_pad()
 
 
+/// @brief Set printf_desc_t literal text
+/// @param[out] *d: conversion descriptor
+/// @param[in] *s: text
+/// @param[in] end: last character of the text, or earlier EOS
+/// @return void
+static void p_desc_lit(printf_desc_t *d, __memx const char *s, __memx const char *end)
+{
+    int len = 0;
 
+    while(s + len <= end && s[len])
+        ++len;
+    d->lit = (const char *) s;
+    d->litlen = len;
+    d->spec = 0;
+}
 
+/// @brief Parse a printf conversion specification
+/// Only the syntax is handled here, p_conv() applies the flag rules and defaults
+/// An invalid specification is returned as literal text with spec = 0
+/// @param[in] fmt: format string at the '%'
+/// @param[out] *d: conversion descriptor
+/// @return format string after the specification
+static __memx const char *p_parse(__memx const char *fmt, printf_desc_t *d)
+{
+    __memx const char *fmtptr = fmt;
+    int width, prec, size;
+    f_t f;
 
+    // process % specifier
+    fmt++;
 
-/// @brief vsnprintf function
-/// @param[out] fn: output character function pointer 
-/// @param[in] fmt: printf forat string
-/// @param[in] va: va_list arguments
-/// @return size of string
-MEMSPACE 
-void _printf_fn(printf_t *fn, __memx const char *fmt, va_list va)
+    prec = 0;   // minimum number of digits displayed 
+    width = 0;  // padded width
+
+    // we accept multiple flag combinations and duplicates as does GLIBC printf
+    // ['#']['-'][' '|'+']
+    // [' '|'+']['-']['#']
+    // ...
+
+    // reset flags
+    f.all = 0;
+    while(*fmt == '#' || *fmt == '+' || *fmt == '-' || *fmt == ' ' || *fmt == '0')
+    {
+        if(*fmt == '#') 
+            f.b.alt = 1;
+        else if(*fmt == '+') 
+            f.b.plus = 1;
+        else if(!f.b.left && *fmt == '-') 
+            f.b.left = 1;
+        else if(!f.b.space && *fmt == ' ') 
+            f.b.space = 1;
+        else if(!f.b.zero && *fmt == '0') 
+            f.b.zero = 1;
+        // format error
+        ++fmt;
+    }
+
+    // width specifier 
+    // Note: we permit zero as the first digit
+    if(isdigit(*fmt))
+    {
+        // optional width
+        width = 0;
+        while(isdigit(*fmt))
+            width = width*10 + *fmt++ - '0';
+        f.b.width = 1;
+    }
+
+    // prec always impiles zero fill to prec digigits for ints and longs
+    //      is the number of digits after the . for float and double
+    // regardlles of sign
+    if( *fmt == '.' ) 
+    {
+        fmt++;
+        prec = 0;
+        while(isdigit(*fmt))
+            prec = prec*10 + *fmt++ - '0';
+        f.b.prec = 1;
+    }
+
+/** Calling Variadic Functions 
+  - exceprt from https://www.gnu.org/software/libc/manual/html_node/Calling-Variadics.html
+Since the prototype doesn’t specify types for optional arguments, in a call to a variadic function the default argument promotions are performed on the optional argument values. This means the objects of type char or short int (whether signed or not) are promoted to either int or unsigned int, as appropriate; and that objects of type float are promoted to type double. So, if the caller passes a char as an optional argument, it is promoted to an int, and the function can access it with va_arg (ap, int).
+*/
+
+    size = sizeof(int); // int is default
+
+    if( *fmt == 'I' ) 
+    {
+        fmt++;
+        size = 0;
+        while(isdigit(*fmt))
+            size = size*10 + *fmt++ - '0';
+        if(size == 0 || size & 7)
+            size = 0;
+        else
+            size >>= 3;
+    }
+    else if(*fmt == 'h')
+    {
+        fmt++;
+        size = sizeof(short);
+    }
+    else if(*fmt == 'l') 
+    {
+        fmt++;
+        size = sizeof(long);
+        if(*fmt == 'l')
+        {
+            fmt++;
+            size = sizeof(long long);
+        }
+    }
+
+    // unknown specifiers are output as is
+    if(!size)
+    {
+        p_desc_lit(d, fmtptr, fmt);
+        return(fmt);
+    }
+
+    switch(*fmt) 
+    {
+        case 'p':
+        case 'P':
+            size = sizeof(void *);
+            break;
+        case 'b':
+        case 'B':
+        case 'o':
+        case 'O':
+        case 'x':
+        case 'X':
+        case 'u':
+        case 'U':
+        case 'D':
+        case 'd':
+            if(size != sizeof(short) && size != sizeof(int) 
+                && size != sizeof(long) && size != sizeof(long long)
+#ifdef __SIZEOF_INT128__
+                && size != sizeof(__uint128_t)
+#endif
+                && size != sizeof(void *))
+            {
+                // unsupported size, the argument is not used
+                p_desc_lit(d, fmtptr, fmt + 1);
+                return(fmt + 1);
+            }
+            break;
+#ifdef FLOATIO
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+#endif
+        case 's':
+        case 'c':
+            break;
+        default:
+            p_desc_lit(d, fmtptr, fmt);
+            return(fmt);
+    }
+
+    d->lit = NULL;
+    d->litlen = 0;
+    d->spec = *fmt;
+    d->size = size;
+    d->width = width;
+    d->prec = prec;
+    d->f = f;
+    return(fmt + 1);
+}
+
+/// @brief Convert and output one printf argument
+/// @param[in] *out: output staging
+/// @param[in] *d: conversion descriptor, spec != 0
+/// @param[in] *va: va_list arguments
+/// @return void
+static void p_conv(p_out_t *out, const printf_desc_t *d, va_list *va)
 {
     int prec, width;
     int count;
@@ -761,7 +1531,6 @@ void _printf_fn(printf_t *fn, __memx const char *fmt, va_list va)
 #endif
     char chartmp[2];
     char *ptr;
-    __memx const char *fmtptr;
 
     // buff has to be at least as big at the largest converted number
     // in this case base 2 long long with sign and end of string
@@ -771,327 +1540,342 @@ void _printf_fn(printf_t *fn, __memx const char *fmt, va_list va)
     char buff[sizeof( long long ) * 8 + 2];
 #endif
 
-    while(*fmt) 
-    {
-        // emit up to %
-        if(*fmt != '%') 
-        {
-            fn->put(fn,*fmt++);
-            continue;
-        }
-
-        fmtptr = fmt;
-        // process % specifier
-        fmt++;
-
-        prec = 0;   // minimum number of digits displayed 
-        width = 0;  // padded width
+    spec = d->spec;
+    size = d->size;
+    width = d->width;
+    prec = d->prec;
+    f = d->f;
 
+    sign = 0;
+    if(spec == 'd' || spec == 'D')
+        sign = 1;
 
-        // we accept multiple flag combinations and duplicates as does GLIBC printf
-        // ['#']['-'][' '|'+']
-        // [' '|'+']['-']['#']
-        // ...
-
-        // reset flags
-        f.all = 0;
-        while(*fmt == '#' || *fmt == '+' || *fmt == '-' || *fmt == ' ' || *fmt == '0')
-        {
-            if(*fmt == '#') 
-                f.b.alt = 1;
-            else if(*fmt == '+') 
-                f.b.plus = 1;
-            else if(!f.b.left && *fmt == '-') 
-                f.b.left = 1;
-            else if(!f.b.space && *fmt == ' ') 
-                f.b.space = 1;
-            else if(!f.b.zero && *fmt == '0') 
-                f.b.zero = 1;
-            // format error
-            ++fmt;
-        }
-
-        // width specifier 
-        // Note: we permit zero as the first digit
-        if(isdigit(*fmt))
-        {
-            // optional width
-            width = 0;
-            while(isdigit(*fmt))
-                width = width*10 + *fmt++ - '0';
-            f.b.width = 1;
-        }
-
-        // prec always impiles zero fill to prec digigits for ints and longs
-        //      is the number of digits after the . for float and double
-        // regardlles of sign
-        if( *fmt == '.' ) 
-        {
-            fmt++;
-            prec = 0;
-            while(isdigit(*fmt))
-                prec = prec*10 + *fmt++ - '0';
-            f.b.prec = 1;
-        }
-
-/** Calling Variadic Functions 
-  - exceprt from https://www.gnu.org/software/libc/manual/html_node/Calling-Variadics.html
-Since the prototype doesn’t specify types for optional arguments, in a call to a variadic function the default argument promotions are performed on the optional argument values. This means the objects of type char or short int (whether signed or not) are promoted to either int or unsigned int, as appropriate; and that objects of type float are promoted to type double. So, if the caller passes a char as an optional argument, it is promoted to an int, and the function can access it with va_arg (ap, int).
-*/
-
-        size = sizeof(int); // int is default
-
-        if( *fmt == 'I' ) 
-        {
-            fmt++;
-            size = 0;
-            while(isdigit(*fmt))
-                size = size*10 + *fmt++ - '0';
-            if(size == 0 || size & 7)
-                size = 0;
-            else
-                size >>= 3;
-        }
-        else if(*fmt == 'h')
-        {
-            fmt++;
-            size = sizeof(short);
-        }
-        else if(*fmt == 'l') 
-        {
-            fmt++;
-            size = sizeof(long);
-            if(*fmt == 'l')
+    nump = (uint8_t *) &numi;
+    // process integer arguments
+    switch(spec) 
+    {
+        case 'p':
+        case 'P':
+        // Unsigned numbers
+        case 'b':
+        case 'B':
+        case 'o':
+        case 'O':
+        case 'x':
+        case 'X':
+            if(f.b.zero && f.b.left)
+                f.b.zero = 0;
+            if(f.b.zero && f.b.prec)
+                f.b.zero = 0;
+            if(f.b.zero && f.b.width)
             {
-                fmt++;
-                size = sizeof(long long);
+                if(width > prec)
+                    prec = width;
             }
-        }
-
-        if(size)
-            spec = *fmt;
-        else
-            spec = 0;
-
-        sign = 0;
-        if(spec == 'd' || spec == 'D')
-            sign = 1;
-
-    
-        nump = (uint8_t *) &numi;
-
-        // process integer arguments
-        switch(spec) 
-        {
-            case 'p':
-            case 'P':
-                size = sizeof(void *);
-            // Unsigned numbers
-            case 'b':
-            case 'B':
-            case 'o':
-            case 'O':
-            case 'x':
-            case 'X':
-                if(f.b.zero && f.b.left)
-                    f.b.zero = 0;
-                if(f.b.zero && f.b.prec)
-                    f.b.zero = 0;
-                if(f.b.zero && f.b.width)
-                {
-                    if(width > prec)
-                        prec = width;
-                }
-                if(f.b.zero && f.b.width && f.b.prec)
-                {
-                    if(width > prec)
-                        prec = width;
-                }
-            case 'u':
-            case 'U':
-                f.b.space = 0;
-                f.b.plus = 0;
-                f.b.neg = 0;
-            case 'D':
-            case 'd':
-                // make lint shut up
+            if(f.b.zero && f.b.width && f.b.prec)
+            {
+                if(width > prec)
+                    prec = width;
+            }
+        case 'u':
+        case 'U':
+            f.b.space = 0;
+            f.b.plus = 0;
+            f.b.neg = 0;
+        case 'D':
+        case 'd':
+            // make lint shut up
 //FIXME vararg functions promote short - make this a conditional
-                if(size == sizeof(short))
+            if(size == sizeof(short))
+            {
+                nums = (short) va_arg(*va, int);
+                if(sign && nums < 0)
                 {
-                    nums = (short) va_arg(va, int);
-                    if(sign && nums < 0)
-                    {
-                        f.b.neg = 1;
-                        nums = -nums;
-                    }
-                    nump = (uint8_t *) &nums;
+                    f.b.neg = 1;
+                    nums = -nums;
                 }
-                else if(size == sizeof(int))
+                nump = (uint8_t *) &nums;
+            }
+            else if(size == sizeof(int))
+            {
+                numi = (int) va_arg(*va, int);
+                if(sign && numi < 0)
                 {
-                    numi = (int) va_arg(va, int);
-                    if(sign && numi < 0)
-                    {
-                        f.b.neg = 1;
-                        numi = -numi;
-                    }
-                    nump = (uint8_t *) &numi;
+                    f.b.neg = 1;
+                    numi = -numi;
                 }
-                else if(size == sizeof(long))
+                nump = (uint8_t *) &numi;
+            }
+            else if(size == sizeof(long))
+            {
+                numl = (long) va_arg(*va, long);
+                if(sign && numl < 0)
                 {
-                    numl = (long) va_arg(va, long);
-                    if(sign && numl < 0)
-                    {
-                        f.b.neg = 1;
-                        numl = -numl;
-                    }
-                    nump = (uint8_t *) &numl;
+                    f.b.neg = 1;
+                    numl = -numl;
                 }
-                else if(size == sizeof(long long))
+                nump = (uint8_t *) &numl;
+            }
+            else if(size == sizeof(long long))
+            {
+                numll = (long long) va_arg(*va, long long);  
+                if(sign && numll < 0)
                 {
-                    numll = (long long) va_arg(va, long long);  
-                    if(sign && numll < 0)
-                    {
-                        f.b.neg = 1;
-                        numll = -numll;
-                    }
-                    nump = (uint8_t *) &numll;
+                    f.b.neg = 1;
+                    numll = -numll;
                 }
+                nump = (uint8_t *) &numll;
+            }
 #ifdef __SIZEOF_INT128__
-                else if(size == sizeof(__uint128_t))
-                {
-                    num128 = (__uint128_t) va_arg(va, __uint128_t); 
-                    if(sign && numll < 0)
-                    {
-                        f.b.neg = 1;
-                        num128 = -128;
-                    }
-                    nump = (uint8_t *) &num128;
-                }
-#endif
-                else if(size == sizeof(void *))
-                {
-                    numv = (void *) va_arg(va, void *);  
-                    nump = (uint8_t *) &numv;
-                }
-                else
-                {
-                    spec = 0;
-                }
-                // FIXME default;
-                ++fmt;
-                break;
-#ifdef FLOATIO
-            case 'f':
-            case 'F':
-            case 'e':
-            case 'E':
-                // K&R defines 'f' type as 6 - and matches GNU printf
-                if(!f.b.prec)
+            else if(size == sizeof(__uint128_t))
+            {
+                num128 = (__uint128_t) va_arg(*va, __uint128_t); 
+                if(sign && numll < 0)
                 {
-                    prec = 6;
-                    f.b.prec = 1;
+                    f.b.neg = 1;
+                    num128 = -128;
                 }
-                dnum = va_arg(va, double);
-                ++fmt;
-                break;
+                nump = (uint8_t *) &num128;
+            }
 #endif
-            case 's':
-                ++fmt;
-                break;
-            case 'c':
-                ++fmt;
-                break;
-            default:
-                break;
-        }
-
-        switch(spec) 
-        {
-        case 'u':
-        case 'U':
-            f.b.space = 0;
-            f.b.plus = 0;
-            // FIXME sign vs FILL
-            //count = p_itoa(nump, size, buff, sizeof(buff), width, prec, f);
-            count = p_ntoa(nump, size, buff, sizeof(buff), 10, width, prec, f);
-            _puts_pad(fn,buff, width, count, f.b.left);
-            break;
-            // FIXME sign vs FILL
-        case 'd':
-        case 'D':
-            count = p_ntoa(nump, size, buff, sizeof(buff), 10, width, prec, f);
-            _puts_pad(fn,buff, width, count, f.b.left);
-            break;
-        case 'b':
-        case 'B':
-            count = p_ntoa(nump, size, buff, sizeof(buff), 2, width, prec,f);
-            _puts_pad(fn,buff, width, count, f.b.left);
-            break;
-        case 'o':
-        case 'O':
-            count = p_ntoa(nump, size, buff, sizeof(buff), 8, width, prec,f);
-            _puts_pad(fn,buff, width, count, f.b.left);
-            break;
-        case 'p':
-        case 'P':
-                // size = sizeof(void *);
-        case 'x':
-        case 'X':
-            count = p_ntoa(nump, size, buff, sizeof(buff), 16, width, prec,f);
-            if(spec == 'X' || spec == 'P')
-                strupper(buff);
-            _puts_pad(fn,buff, width, count, f.b.left);
+            else
+            {
+                numv = (void *) va_arg(*va, void *);  
+                nump = (uint8_t *) &numv;
+            }
             break;
 #ifdef FLOATIO
         case 'f':
         case 'F':
-            count = p_ftoa(dnum, buff, sizeof(buff), width, prec, f);
-            _puts_pad(fn,buff, width, count, f.b.left);
-            break;
-
         case 'e':
         case 'E':
-            count = p_etoa(dnum, buff, sizeof(buff), width, prec, f);
-            if(spec == 'E')
-                strupper(buff);
-            _puts_pad(fn,buff, width, count, f.b.left);
-            break;
-#endif
-        case 's':
-        case 'c':
-            ptr = NULL; // stops bogus error that ptr may be uninitalized
-            if(spec == 's')
-            {
-                ptr = va_arg(va, char *);
-                if(!ptr)
-                    ptr = "(null)";
-            }
-            else // 'c'
+        case 'g':
+        case 'G':
+            // K&R defines 'f' type as 6 - and matches GNU printf
+            if(!f.b.prec)
             {
-                chartmp[0] = (char) va_arg(va, int);
-                chartmp[1] = 0;
-                ptr = chartmp;
+                prec = 6;
+                f.b.prec = 1;
             }
-            count = strlen(ptr);
-            if(prec)
-                count = prec;
-            if(count > width && width != 0)
-                count = width;
-//printf("width:%d,count:%d,left:%d\n", width, count, f.b.left);
-            _puts_pad(fn,ptr, width, count, f.b.left);
+            dnum = va_arg(*va, double);
             break;
+#endif
         default:
-            while(fmtptr <= fmt && *fmtptr)
-                fn->put(fn, *fmtptr++);
             break;
+    }
+    switch(spec) 
+    {
+    case 'u':
+    case 'U':
+        // FIXME sign vs FILL
+        //count = p_itoa(nump, size, buff, sizeof(buff), width, prec, f);
+        count = p_ntoa(nump, size, buff, sizeof(buff), 10, width, prec, f);
+        p_out_pad(out, buff, width, count, f.b.left);
+        break;
+        // FIXME sign vs FILL
+    case 'd':
+    case 'D':
+        count = p_ntoa(nump, size, buff, sizeof(buff), 10, width, prec, f);
+        p_out_pad(out, buff, width, count, f.b.left);
+        break;
+    case 'b':
+    case 'B':
+        count = p_ntoa(nump, size, buff, sizeof(buff), 2, width, prec,f);
+        p_out_pad(out, buff, width, count, f.b.left);
+        break;
+    case 'o':
+    case 'O':
+        count = p_ntoa(nump, size, buff, sizeof(buff), 8, width, prec,f);
+        p_out_pad(out, buff, width, count, f.b.left);
+        break;
+    case 'p':
+    case 'P':
+    case 'x':
+    case 'X':
+        count = p_ntoa(nump, size, buff, sizeof(buff), 16, width, prec,f);
+        if(spec == 'X' || spec == 'P')
+            strupper(buff);
+        p_out_pad(out, buff, width, count, f.b.left);
+        break;
+#ifdef FLOATIO
+    case 'f':
+    case 'F':
+        count = p_ftoa(dnum, buff, sizeof(buff), width, prec, f);
+        if(spec == 'F')
+            strupper(buff);
+        p_out_pad(out, buff, width, count, f.b.left);
+        break;
+    case 'e':
+    case 'E':
+        count = p_etoa(dnum, buff, sizeof(buff), width, prec, f);
+        if(spec == 'E')
+            strupper(buff);
+        p_out_pad(out, buff, width, count, f.b.left);
+        break;
+    case 'g':
+    case 'G':
+        count = p_gtoa(dnum, buff, sizeof(buff), width, prec, f);
+        if(spec == 'G')
+            strupper(buff);
+        p_out_pad(out, buff, width, count, f.b.left);
+        break;
+#endif
+    case 's':
+    case 'c':
+        ptr = NULL; // stops bogus error that ptr may be uninitalized
+        if(spec == 's')
+        {
+            ptr = va_arg(*va, char *);
+            if(!ptr)
+                ptr = "(null)";
+        }
+        else // 'c'
+        {
+            chartmp[0] = (char) va_arg(*va, int);
+            chartmp[1] = 0;
+            ptr = chartmp;
+        }
+        count = strlen(ptr);
+        if(prec)
+            count = prec;
+        if(count > width && width != 0)
+            count = width;
+//printf("width:%d,count:%d,left:%d\n", width, count, f.b.left);
+        p_out_pad(out, ptr, width, count, f.b.left);
+        break;
+    default:
+        break;
+    }
+}
+
+/// @brief vsnprintf function
+/// @param[out] fn: output character function pointer 
+/// @param[in] fmt: printf forat string
+/// @param[in] va: va_list arguments
+/// @return size of string
+MEMSPACE 
+void _printf_fn(printf_t *fn, __memx const char *fmt, va_list va)
+{
+    printf_desc_t d;
+    __memx const char *ptr;
+    int count;
+    p_out_t out;
+    va_list ap;
+
+    out.fn = fn;
+    out.ind = 0;
+    va_copy(ap, va);
+
+    while(*fmt) 
+    {
+        // emit up to %
+        if(*fmt != '%') 
+        {
+            p_out_ch(&out, *fmt++);
+            continue;
+        }
+
+        fmt = p_parse(fmt, &d);
+        if(d.spec)
+        {
+            p_conv(&out, &d, &ap);
+            continue;
         }
-//printf("fmt:(%s)\n", fmt);
+        // invalid specifier
+        ptr = (__memx const char *) d.lit;
+        count = d.litlen;
+        while(count--)
+            p_out_ch(&out, *ptr++);
     }
-//printf("fmt exit:(%s)\n", fmt);
+    va_end(ap);
+    p_out_flush(&out);
+}
 
+/// @brief Parse a format string into a printf_desc_t list for _printf_desc_fn()
+/// Each entry holds the literal text before a conversion and the conversion,
+/// so the format string is only parsed once for hot call sites
+/// The entries point into fmt, it must remain valid while the list is used
+/// @param[in] fmt: printf format string
+/// @param[out] *desc: descriptor list, ends with a PF_END entry
+/// @param[in] max: size of desc in entries
+/// @return number of entries used including the end, -1 if desc is too small
+MEMSPACE
+int printf_compile(const char *fmt, printf_desc_t *desc, int max)
+{
+    printf_desc_t conv;
+    printf_desc_t *d;
+    const char *lit;
+    int n = 0;
+
+    while(*fmt)
+    {
+        if(n >= max - 1)
+            return(-1);
+        d = &desc[n++];
+
+        // literal text up to %
+        lit = fmt;
+        while(*fmt && *fmt != '%')
+            ++fmt;
+        d->lit = lit;
+        d->litlen = fmt - lit;
+        d->spec = 0;
+        d->size = 0;
+        d->width = 0;
+        d->prec = 0;
+        d->f.all = 0;
+        if(!*fmt)
+            break;
+
+        conv.lit = NULL;
+        fmt = p_parse(fmt, &conv);
+        if(conv.spec)
+        {
+            d->spec = conv.spec;
+            d->size = conv.size;
+            d->width = conv.width;
+            d->prec = conv.prec;
+            d->f = conv.f;
+        }
+        else
+        {
+            // invalid specifier, it joins the literal text
+            d->litlen = (conv.lit - lit) + conv.litlen;
+        }
+    }
+    if(n >= max)
+        return(-1);
+    desc[n].lit = NULL;
+    desc[n].litlen = 0;
+    desc[n].spec = 0;
+    return(n + 1);
 }
 
+/// @brief printf using a printf_desc_t list from printf_compile() or PF()
+/// @param[out] fn: output character function pointer 
+/// @param[in] desc: printf_desc_t list
+/// @param[in] va: va_list arguments
+/// @return void
+MEMSPACE 
+void _printf_desc_fn(printf_t *fn, const printf_desc_t *desc, va_list va)
+{
+    p_out_t out;
+    va_list ap;
+
+    out.fn = fn;
+    out.ind = 0;
+    va_copy(ap, va);
 
+    for( ; desc->lit; ++desc)
+    {
+        if(desc->litlen)
+            p_out_str(&out, (char *) desc->lit, desc->litlen);
+        if(desc->spec)
+            p_conv(&out, desc, &ap);
+    }
+    va_end(ap);
+    p_out_flush(&out);
+}
 // =============================================
 /// @brief _putc_buffer_fn - character output to a string buffer
 /// Used by snprintf and vsnprintf
@@ -1117,6 +1901,52 @@ void _putc_buffer_fn(struct _printf_t *p, char ch)
     *((char *)p->buffer) = 0;
 }   
 
+/// @brief _write_buffer_fn - block output to a string buffer
+/// Used by snprintf and vsnprintf, see _putc_buffer_fn
+/// @param[in] *p: structure with pointers and buffer to be written to
+/// @param[in] *s: characters to place in buffer
+/// @param[in] count: number of characters
+/// @return void
+MEMSPACE
+void _write_buffer_fn(struct _printf_t *p, const char *s, int count)
+{
+    char *str = (char *) p->buffer;
+
+    if(count > p->len)
+        count = p->len;
+    memcpy(str, s, count);
+    str += count;
+    p->len -= count;
+    p->sent += count;
+    *str = 0;
+    p->buffer = (void *) str;
+}
+
+// =============================================
+/// @brief snprintf using a printf_desc_t list, see printf_compile() and PF()
+/// @param[out] str: string buffer for result
+/// @param[in] size: size of str including the EOS, at least 1
+/// @param[in] desc: printf_desc_t list
+/// @param[in] ...: list of arguments
+/// @return string size
+MEMSPACE 
+int snprintf_desc(char* str, size_t size, const printf_desc_t *desc, ...)
+{
+    printf_t fn;
+    va_list va;
+
+    *str = 0;
+    fn.put = _putc_buffer_fn;
+    fn.write = _write_buffer_fn;
+    fn.len = size - 1;
+    fn.sent = 0;
+    fn.buffer = (void *) str;
+    va_start(va, desc);
+    _printf_desc_fn(&fn, desc, va);
+    va_end(va);
+    return( strlen(str) );
+}
+
 #ifdef PRINTF_TEST
 #ifdef DEFINE_PRINTF
 #error DEFINE_PRINTF must not be defined when testing
@@ -1142,6 +1972,7 @@ int vsnprintf(char* str, size_t size, const char *format, va_list va)
     *str = 0;
 
     fn.put = _putc_buffer_fn;
+    fn.write = _write_buffer_fn;
     fn.len = size;
     fn.sent = 0;
     fn.buffer = (void *) str;
@@ -1191,6 +2022,7 @@ int vsnprintf_P(char* str, size_t size, __memx const char *format, va_list va)
     *str = 0;
 
     fn.put = _putc_buffer_fn;
+    fn.write = _write_buffer_fn;
     fn.len = size;
     fn.sent = 0;
     fn.buffer = (void *) str;
@@ -1273,6 +2105,7 @@ printf(const char *format, ...)
     va_list va;
 
     fn.put = _putc_fn;
+    fn.write = NULL;
     fn.sent = 0;
 
     va_start(va, format);
@@ -1297,6 +2130,7 @@ printf_P(__memx const char *format, ...)
     va_list va;
 
     fn.put = _putc_fn;
+    fn.write = NULL;
     fn.sent = 0;
 
     va_start(va, format);
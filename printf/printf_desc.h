@@ -0,0 +1,95 @@
+/**
+ @file printf_desc.h
+
+ @brief Project format strings and their pre-parsed PF() lists
+ Each list is written by hand from its format string, the format is kept
+ next to it so printf/test_printf.c can check the list with printf_compile()
+ and compare the output with printf(). Use them as
+   static const printf_desc_t stats_volt[] = STATS_VOLT_DESC;
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PRINTF_DESC_H_
+#define _PRINTF_DESC_H_
+
+// =============================================
+// user/user_main.c status lines
+
+#define STATS_VOLT_FMT "Volt:%2.2f\n"
+#define STATS_VOLT_DESC { \
+    PF("Volt:", 0, 2, 2, double, 'f'), \
+    PF_LIT("\n"), \
+    PF_END \
+}
+
+#define STATS_ITER_FMT "Iter:% 10ld, %+7.2f\n"
+#define STATS_ITER_DESC { \
+    PF("Iter:", PF_SPACE, 10, -1, long, 'd'), \
+    PF(", ", PF_PLUS, 7, 2, double, 'f'), \
+    PF_LIT("\n"), \
+    PF_END \
+}
+
+#define STATS_HEAP_FMT "Heap: %d, Conn:%d\n"
+#define STATS_HEAP_DESC { \
+    PF("Heap: ", 0, 0, -1, int, 'd'), \
+    PF(", Conn:", 0, 0, -1, int, 'd'), \
+    PF_LIT("\n"), \
+    PF_END \
+}
+
+#define STATS_WIFI_FMT "CH:%02d, DB:%+02d\n"
+#define STATS_WIFI_DESC { \
+    PF("CH:", PF_ZERO, 2, -1, int, 'd'), \
+    PF(", DB:", PF_PLUS | PF_ZERO, 2, -1, int, 'd'), \
+    PF_LIT("\n"), \
+    PF_END \
+}
+
+// =============================================
+// web/web.c response headers
+
+#define HEAD_NOT_MODIFIED_FMT "HTTP/1.1 %s\nConnection: %s\n"
+#define HEAD_NOT_MODIFIED_DESC { \
+    PF("HTTP/1.1 ", 0, 0, -1, char *, 's'), \
+    PF("\nConnection: ", 0, 0, -1, char *, 's'), \
+    PF_LIT("\n"), \
+    PF_END \
+}
+
+#define HEAD_LENGTH_FMT "HTTP/1.1 %s\nContent-Type: %s\nConnection: %s\nContent-Length: %lu\n"
+#define HEAD_LENGTH_DESC { \
+    PF("HTTP/1.1 ", 0, 0, -1, char *, 's'), \
+    PF("\nContent-Type: ", 0, 0, -1, char *, 's'), \
+    PF("\nConnection: ", 0, 0, -1, char *, 's'), \
+    PF("\nContent-Length: ", 0, 0, -1, long, 'u'), \
+    PF_LIT("\n"), \
+    PF_END \
+}
+
+#define HEAD_CHUNKED_FMT "HTTP/1.1 %s\nContent-Type: %s\nConnection: %s\nTransfer-Encoding: chunked\n\n"
+#define HEAD_CHUNKED_DESC { \
+    PF("HTTP/1.1 ", 0, 0, -1, char *, 's'), \
+    PF("\nContent-Type: ", 0, 0, -1, char *, 's'), \
+    PF("\nConnection: ", 0, 0, -1, char *, 's'), \
+    PF_LIT("\nTransfer-Encoding: chunked\n\n"), \
+    PF_END \
+}
+
+#endif	// _PRINTF_DESC_H_
@@ -35,8 +35,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdarg.h>
 #include <stdint.h>
 #include <math.h>
+#include <time.h>
 
 #include "mathio.h"
+#include "printf_desc.h"
 
 
 /// @brief compare significant digits and exponennt of floating point numbers
@@ -212,6 +214,7 @@ int t_printf(const char *format, ...)
     va_list va;
 
     fn.put = _putc_fn;
+    fn.write = NULL;
     fn.sent = 0;
 
     va_start(va, format);
@@ -241,6 +244,7 @@ int t_vsnprintf(char* str, size_t size, const char *format, va_list va)
     *str = 0;
 
     fn.put = _putc_buffer_fn;
+    fn.write = _write_buffer_fn;
     fn.len = size;
     fn.sent = 0;
     fn.buffer = (void *) str;
@@ -252,6 +256,50 @@ int t_vsnprintf(char* str, size_t size, const char *format, va_list va)
     return( len );
 }
 
+// =============================================
+/// @brief Our vsnprintf function one character at a time, no write function
+/// @param[out] str: string buffer for result
+/// @param[in] size: maximum length of converted string
+/// @param[in] format: printf forat string
+/// @param[in] va: va_list list of arguments
+/// @return string size
+MEMSPACE
+int t_vsnprintf_putc(char* str, size_t size, const char *format, va_list va)
+{
+    printf_t fn;
+
+    *str = 0;
+
+    fn.put = _putc_buffer_fn;
+    fn.write = NULL;
+    fn.len = size;
+    fn.sent = 0;
+    fn.buffer = (void *) str;
+
+    _printf_fn(&fn, format, va);
+
+    return( fn.sent );
+}
+
+// =============================================
+/// @brief Our snprintf function for testing
+/// @param[out] str: string buffer for result
+/// @param[in] size: maximum length of converted string
+/// @param[in] format: printf forat string
+/// @param[in] ...: list of arguments
+/// @return string size
+MEMSPACE
+int t_snprintf(char* str, size_t size, const char *format, ...)
+{
+    int len;
+    va_list va;
+
+    va_start(va, format);
+    len = t_vsnprintf(str, size, format, va);
+    va_end(va);
+    return( len );
+}
+
 
 // =============================================
 int display_good = 0;
@@ -271,6 +319,7 @@ void tp(const char *format, ...)
     char fmt[1024];
     char str1[1024];
     char str2[1024];
+    char str3[1024];
     int f;
     int find, ind, len;
     int matched;
@@ -340,6 +389,19 @@ void tp(const char *format, ...)
     va_end(va);
     fflush(stdout);
 
+    // Our Printf one character at a time in str3, must match str2
+    va_start(va, format);
+    t_vsnprintf_putc(str3, sizeof(str3)-1, format, va);
+    va_end(va);
+    if(strcmp(str2,str3) != 0)
+    {
+        printf("ERROR: write vs put [%s]\n", format);
+        printf("    W[%s]\n", str2);
+        printf("    P[%s]\n", str3);
+        ++tp_bad;
+        return;
+    }
+
 
 
     //FIXME add more as printf gains more conversion functions
@@ -361,13 +423,11 @@ void tp(const char *format, ...)
             exit(1);
         }
 
-        // Compare results to N digit window
-        error = numcmp(str1,str2,digits);
-
-        // A double 1 LSB error would be 10LL
-        // Remember the numbers may be rounded so we use less then 15LL
-        if(error < 0 || error > 14LL)
+        // Conversions are exact and correctly rounded so they must match GLIBC
+        // The N digit window comparison shows the size of any error
+        if(strcmp(str1,str2) != 0)
         {
+            error = numcmp(str1,str2,digits);
             printf("ERROR: [%s], [%s]\n", format, str0);
             printf("    G[%s]\n", str1);
             printf("    B[%s]\n", str2);
@@ -458,7 +518,7 @@ void random_tests(int flag, char *size)
     //printf("num:%ld\n",num);
 
     // With f we limit the exponent to +/-2 ** sizeof(long long)
-    if(flag == 'e' || flag == 'f' )
+    if(flag == 'e' || flag == 'f' || flag == 'g')
     {
         /*
          * Single mantissa 24bits   base10 digits   7.22     
@@ -561,6 +621,77 @@ void random_tests(int flag, char *size)
     }
 }
 
+// =============================================
+/// @brief Random double bit patterns - glibc vs ours
+/// Covers denormals, infinity, NaN and the full exponent range with %e and %g
+/// and checks that p_dtoa() gives the shortest string that reads back the same
+/// @param[in] loops: number of tests
+/// @return void
+MEMSPACE
+void random_bits_tests(long loops)
+{
+    char str[1024];
+    char tmp[1024];
+    char format[64];
+    uint64_t bits;
+    double dnum, rnum;
+    long i;
+    int prec, digits;
+    char *ptr;
+    char *ops = "eEgG";
+
+    for(i=0;i<loops;++i)
+    {
+        bits = ((uint64_t) lrand48() << 42) ^ ((uint64_t) lrand48() << 21) ^ lrand48();
+        memcpy(&dnum, &bits, sizeof(dnum));
+
+        snprintf(format,sizeof(format)-1, "%%.%d%c", (int) (drand48() * 20.0), ops[i & 3]);
+        tp(format, dnum);
+
+        if(isnan(dnum) || isinf(dnum))
+            continue;
+
+        // Shortest round trip, GLIBC sscanf reads the value back
+        p_dtoa(dnum, str, sizeof(str));
+        rnum = 0;
+        sscanf(str, "%lf", &rnum);
+
+        // Count significant digits without trailing zeros
+        digits = 0;
+        prec = 0;
+        for(ptr = str; *ptr && *ptr != 'e'; ++ptr)
+        {
+            if(!isdigit(*ptr) || (*ptr == '0' && !digits))
+                continue;
+            ++digits;
+            prec = (*ptr == '0') ? prec + 1 : 0;
+        }
+        digits -= prec;
+
+        // One digit less must not read back the same
+        tmp[0] = 0;
+        if(digits > 1)
+        {
+            snprintf(tmp,sizeof(tmp)-1, "%.*e", digits - 2, dnum);
+            sscanf(tmp, "%lf", &rnum);
+            if(rnum != dnum)
+                tmp[0] = 0;
+            sscanf(str, "%lf", &rnum);
+        }
+
+        if(memcmp(&rnum, &dnum, sizeof(dnum)) != 0 || tmp[0])
+        {
+            printf("ERROR: shortest [%.17g]\n", dnum);
+            printf("    B[%s]\n", str);
+            if(tmp[0])
+                printf("    shorter[%s]\n", tmp);
+            ++tp_bad;
+        }
+        else
+            ++tp_good;
+    }
+}
+
 // =============================================
 /// @brief Manual printf tests - glibc vc ours
 /// Compare printf results from gcc printf and this printf
@@ -750,6 +881,423 @@ void tests()
     printf("\n");
 }
 
+// =============================================
+/// @brief Project format strings as PF() lists, see desc_tests() and bench()
+/// These are the lists used by user_main.c and web.c, from printf_desc.h
+static const printf_desc_t desc_iter[] = STATS_ITER_DESC;
+static const printf_desc_t desc_volt[] = STATS_VOLT_DESC;
+static const printf_desc_t desc_heap[] = STATS_HEAP_DESC;
+static const printf_desc_t desc_ch[] = STATS_WIFI_DESC;
+static const printf_desc_t desc_head[] = HEAD_LENGTH_DESC;
+static const printf_desc_t desc_not_modified[] = HEAD_NOT_MODIFIED_DESC;
+static const printf_desc_t desc_chunked[] = HEAD_CHUNKED_DESC;
+
+/// @brief Compare _printf_desc_fn() using printf_compile() with _printf_fn()
+/// @param[in] format: printf format string
+/// @param[in] ...: list of arguments
+/// @return void
+void tdesc(const char *format, ...)
+{
+    char str1[1024];
+    char str2[1024];
+    printf_desc_t desc[32];
+    printf_t fn;
+    va_list va;
+
+    va_start(va, format);
+    t_vsnprintf(str1, sizeof(str1)-1, format, va);
+    va_end(va);
+
+    if(printf_compile(format, desc, 32) < 0)
+    {
+        printf("ERROR: printf_compile fmt:[%s] too many conversions\n", format);
+        tp_bad++;
+        return;
+    }
+    str2[0] = 0;
+    fn.put = _putc_buffer_fn;
+    fn.write = _write_buffer_fn;
+    fn.len = sizeof(str2)-1;
+    fn.sent = 0;
+    fn.buffer = (void *) str2;
+    va_start(va, format);
+    _printf_desc_fn(&fn, desc, va);
+    va_end(va);
+
+    if(strcmp(str1, str2) != 0)
+    {
+        printf("ERROR: desc fmt:[%s]\n  printf:[%s]\n  desc:  [%s]\n", format, str1, str2);
+        tp_bad++;
+    }
+    else
+        tp_good++;
+}
+
+/// @brief Compare a PF() list with printf_compile() of the same format
+/// Argument sizes only matter, and are only compared, for integers
+/// @param[in] *pf: PF() list
+/// @param[in] format: printf format string
+/// @return void
+void tdesc_pf(const printf_desc_t *pf, const char *format)
+{
+    printf_desc_t desc[32];
+    const printf_desc_t *d;
+    int n;
+
+    n = printf_compile(format, desc, 32);
+    for(d = desc; n > 0 && pf->lit && d->lit; ++pf, ++d)
+    {
+        if(pf->litlen != d->litlen || memcmp(pf->lit, d->lit, d->litlen) != 0)
+            break;
+        if(pf->spec != d->spec || pf->width != d->width || pf->prec != d->prec || pf->f.all != d->f.all)
+            break;
+        if(strchr("bBoOxXuUdD", d->spec) && pf->size != d->size)
+            break;
+    }
+    if(n <= 0 || pf->lit || d->lit)
+    {
+        printf("ERROR: PF list does not match fmt:[%s] at entry %d\n", format, (int) (d - desc));
+        tp_bad++;
+    }
+    else
+        tp_good++;
+}
+
+/// @brief Compare snprintf_desc() of a PF() list with our snprintf
+/// @param[in] *pf: PF() list
+/// @param[in] format: printf format string
+/// @param[in] ...: list of arguments
+/// @return void
+void tdesc_run(const printf_desc_t *pf, const char *format, ...)
+{
+    char str1[256];
+    char str2[256];
+    printf_t fn;
+    va_list va;
+
+    va_start(va, format);
+    t_vsnprintf(str1, sizeof(str1)-1, format, va);
+    va_end(va);
+
+    str2[0] = 0;
+    fn.put = _putc_buffer_fn;
+    fn.write = _write_buffer_fn;
+    fn.len = sizeof(str2)-1;
+    fn.sent = 0;
+    fn.buffer = (void *) str2;
+    va_start(va, format);
+    _printf_desc_fn(&fn, pf, va);
+    va_end(va);
+
+    if(strcmp(str1, str2) != 0)
+    {
+        printf("ERROR: PF run fmt:[%s]\n  printf:[%s]\n  desc:  [%s]\n", format, str1, str2);
+        tp_bad++;
+    }
+    else
+        tp_good++;
+}
+
+/// @brief Pre-parsed format tests, printf_compile(), PF() and _printf_desc_fn()
+/// @return void
+void desc_tests()
+{
+    printf_desc_t desc[4];
+    char str[64];
+    int i;
+
+    tdesc("");
+    tdesc("no conversions");
+    tdesc("%d", -12345);
+    tdesc("[%5d][%-5d][%05d][%+d][% d]", 42, 42, 42, 42, 42);
+    tdesc("%ld %lld %hd %u", -123456789L, -1234567890123LL, (short) -1234, 4000000000U);
+    tdesc("%x %X %08x %#o %b %B", 0xbeef, 0xbeef, 0xbeef, 0755, 5, 6);
+    tdesc("%p %P", (void *) 0x1234, (void *) 0xabcd);
+    tdesc("[%s][%10s][%-10s][%.2s][%c]", "str", "right", "left", "cut", 'z');
+    tdesc("%s", NULL);
+    tdesc("%f %e %g %.3f %10.4e %-10g|", 3.14159, 1e-10, 1e20, -2.5, 12345.678, 0.0001);
+    tdesc("%F %E %G", 1e300 * 1e300, 1e300, 1e-300);
+    tdesc("Iter:% 10ld, %+7.2f\n", 123456L, -45.678);
+    tdesc("100%% done");
+    tdesc("%y %k", 1, 2);
+    tdesc("trailing %");
+    tdesc("%I24d %d", 5, 6);
+    tdesc("%I12d %d", 5, 6);
+    tdesc("%I16x %I32x %I64x", 0x1234, 0x12345678, 0x123456789abcdefULL);
+    tdesc("%-+ #05.3d|%5.3x|%-8.3o|", 7, 7, 7);
+
+    // compile overflow
+    if(printf_compile("%d %d %d %d", desc, 4) != -1 || printf_compile("%d %d %d", desc, 4) != 4)
+    {
+        printf("ERROR: printf_compile size limit\n");
+        tp_bad++;
+    }
+    else
+        tp_good++;
+
+    tdesc_pf(desc_iter, STATS_ITER_FMT);
+    tdesc_pf(desc_volt, STATS_VOLT_FMT);
+    tdesc_pf(desc_heap, STATS_HEAP_FMT);
+    tdesc_pf(desc_ch, STATS_WIFI_FMT);
+    tdesc_pf(desc_head, HEAD_LENGTH_FMT);
+    tdesc_pf(desc_not_modified, HEAD_NOT_MODIFIED_FMT);
+    tdesc_pf(desc_chunked, HEAD_CHUNKED_FMT);
+
+    for(i = -3; i < 4; ++i)
+    {
+        tdesc_run(desc_iter, STATS_ITER_FMT, (long) i * 987654L, i * 12.345);
+        tdesc_run(desc_volt, STATS_VOLT_FMT, i * 1.001);
+        tdesc_run(desc_heap, STATS_HEAP_FMT, i * 4096, i);
+        tdesc_run(desc_ch, STATS_WIFI_FMT, i + 3, i * 30);
+        tdesc_run(desc_head, HEAD_LENGTH_FMT,
+            "200 OK", "text/html", "keep-alive", (unsigned long) i * 1000);
+        tdesc_run(desc_not_modified, HEAD_NOT_MODIFIED_FMT,
+            "304 Not Modified", i < 0 ? "close" : "keep-alive");
+        tdesc_run(desc_chunked, HEAD_CHUNKED_FMT,
+            "200 OK", "application/json", i < 0 ? "close" : "keep-alive");
+    }
+
+    // size limit
+    snprintf_desc(str, 8, desc_heap, 1234, 5);
+    if(strcmp(str, "Heap: 1") != 0)
+    {
+        printf("ERROR: snprintf_desc size limit:[%s]\n", str);
+        tp_bad++;
+    }
+    else
+        tp_good++;
+}
+
+/// @brief Print a format string as a PF() list to paste into C code
+/// Run with: ./test_printf desc 'Iter:% 10ld, %+7.2f\n'
+/// C escapes \\n \\t \\r \\\\ and \\" in the argument are converted
+/// @param[in] arg: printf format string
+/// @return void
+void desc_gen(char *arg)
+{
+    char fmt[256];
+    printf_desc_t desc[32];
+    const char *conv, *end, *type;
+    int i, n, len;
+
+    // undo C escapes
+    for(len = 0; *arg && len < (int) sizeof(fmt) - 1; ++arg)
+    {
+        if(*arg == '\\' && arg[1])
+        {
+            ++arg;
+            if(*arg == 'n') fmt[len++] = '\n';
+            else if(*arg == 't') fmt[len++] = '\t';
+            else if(*arg == 'r') fmt[len++] = '\r';
+            else fmt[len++] = *arg;
+        }
+        else
+            fmt[len++] = *arg;
+    }
+    fmt[len] = 0;
+
+    n = printf_compile(fmt, desc, 32);
+    if(n < 0)
+    {
+        printf("ERROR: too many conversions\n");
+        return;
+    }
+    for(i = 0; desc[i].lit; ++i)
+    {
+        printf("    %s(\"", desc[i].spec ? "PF" : "PF_LIT");
+        for(n = 0; n < desc[i].litlen; ++n)
+        {
+            char ch = desc[i].lit[n];
+            if(ch == '\n') printf("\\n");
+            else if(ch == '\t') printf("\\t");
+            else if(ch == '\r') printf("\\r");
+            else if(ch == '"' || ch == '\\') printf("\\%c", ch);
+            else if(ch < ' ' || ch > '~') printf("\\%03o", ch & 0xff);
+            else putchar(ch);
+        }
+        printf("\"");
+        if(!desc[i].spec)
+        {
+            printf("),\n");
+            continue;
+        }
+        // argument type from the conversion text
+        conv = desc[i].lit + desc[i].litlen;
+        end = desc[i+1].lit ? desc[i+1].lit : conv + strlen(conv);
+        type = "int";
+        if(strchr("fFeEgG", desc[i].spec))
+            type = "double";
+        else if(desc[i].spec == 's')
+            type = "char *";
+        else if(desc[i].spec == 'p' || desc[i].spec == 'P')
+            type = "void *";
+        else if(desc[i].spec != 'c')
+        {
+            for( ; conv < end; ++conv)
+            {
+                if(conv[0] == 'l')
+                {
+                    type = conv[1] == 'l' ? "long long" : "long";
+                    break;
+                }
+                if(conv[0] == 'h')
+                    type = "short";
+                if(conv[0] == 'I')
+                {
+                    type = desc[i].size == 2 ? "int16_t" : desc[i].size == 4 ? "int32_t"
+                        : desc[i].size == 8 ? "int64_t" : "__int128_t";
+                    break;
+                }
+            }
+        }
+        printf(", ");
+        if(!(desc[i].f.all & (PF_LEFT | PF_PLUS | PF_SPACE | PF_ZERO | PF_ALT)))
+            printf("0");
+        else
+        {
+            const char *sep = "";
+            if(desc[i].f.b.left) { printf("%sPF_LEFT", sep); sep = " | "; }
+            if(desc[i].f.b.plus) { printf("%sPF_PLUS", sep); sep = " | "; }
+            if(desc[i].f.b.space) { printf("%sPF_SPACE", sep); sep = " | "; }
+            if(desc[i].f.b.zero) { printf("%sPF_ZERO", sep); sep = " | "; }
+            if(desc[i].f.b.alt) { printf("%sPF_ALT", sep); sep = " | "; }
+        }
+        printf(", %d, %d, %s, '%c'),\n", desc[i].width, desc[i].f.b.prec ? desc[i].prec : -1, type, desc[i].spec);
+    }
+    printf("    PF_END\n");
+}
+
+/// @brief Number of conversions timed by bench()
+#define BENCH_LOOPS 1000000
+
+/// @brief CPU time in nS per loop since start
+/// @param[in] start: clock() at the start of the test
+/// @return nS per loop
+double bench_ns(clock_t start)
+{
+    return( (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / BENCH_LOOPS );
+}
+
+/// @brief Benchmark integer conversions, bin2num vs uint2num and full formats
+/// Run with: ./test_printf bench
+/// @return void
+void bench()
+{
+    char str[128];
+    uint8_t num[128];
+    uint64_t vals[256];
+#ifdef FLOATIO
+    double dvals[256];
+#endif
+    volatile int sink = 0;
+    clock_t start;
+    int i, base;
+    int bases[] = { 10, 16, 8, 0 };
+
+    for(i=0;i<256;++i)
+        vals[i] = ((uint64_t) random() << 32) ^ random();
+
+    printf("Integer conversion, %d loops, nS per conversion\n", BENCH_LOOPS);
+    for(base=0;bases[base];++base)
+    {
+        start = clock();
+        for(i=0;i<BENCH_LOOPS;++i)
+            sink += bin2num(num, sizeof(num), 1, bases[base], (uint8_t *) &vals[i & 255], sizeof(uint32_t), 0);
+        printf("base %2d 32 bit: bin2num %7.1f", bases[base], bench_ns(start));
+        start = clock();
+        for(i=0;i<BENCH_LOOPS;++i)
+            sink += uint2num(num, sizeof(num), 1, bases[base], (uint32_t) vals[i & 255], 0);
+        printf(", uint2num %7.1f\n", bench_ns(start));
+
+        start = clock();
+        for(i=0;i<BENCH_LOOPS;++i)
+            sink += bin2num(num, sizeof(num), 1, bases[base], (uint8_t *) &vals[i & 255], sizeof(uint64_t), 0);
+        printf("base %2d 64 bit: bin2num %7.1f", bases[base], bench_ns(start));
+        start = clock();
+        for(i=0;i<BENCH_LOOPS;++i)
+            sink += uint2num(num, sizeof(num), 1, bases[base], vals[i & 255], 0);
+        printf(", uint2num %7.1f\n", bench_ns(start));
+    }
+
+    printf("\nsnprintf, nS per call\n");
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += t_snprintf(str, sizeof(str), "%d", (int) vals[i & 255]);
+    printf("%-12s %7.1f\n", "%d", bench_ns(start));
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += t_snprintf(str, sizeof(str), "%08x", (unsigned int) vals[i & 255]);
+    printf("%-12s %7.1f\n", "%08x", bench_ns(start));
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += t_snprintf(str, sizeof(str), "%lld", (long long) vals[i & 255]);
+    printf("%-12s %7.1f\n", "%lld", bench_ns(start));
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += t_snprintf(str, sizeof(str), "Conn:%d Heap:%u Time:%02d:%02d:%02d",
+            i & 7, (unsigned int) vals[i & 255] & 0xffff, i % 24, i % 60, (i >> 6) % 60);
+    printf("%-12s %7.1f\n", "status line", bench_ns(start));
+
+#ifdef FLOATIO
+    for(i=0;i<256;++i)
+        dvals[i] = (double) (vals[i] % 2000000) / 1000.0 - 1000.0;
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += t_snprintf(str, sizeof(str), "%+7.2f", dvals[i & 255]);
+    printf("%-12s %7.1f\n", "%+7.2f", bench_ns(start));
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += t_snprintf(str, sizeof(str), "%2.2f", dvals[i & 255]);
+    printf("%-12s %7.1f\n", "%2.2f", bench_ns(start));
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += t_snprintf(str, sizeof(str), "%e", dvals[i & 255] * 1e100);
+    printf("%-12s %7.1f\n", "%e", bench_ns(start));
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += t_snprintf(str, sizeof(str), "%.3e", dvals[i & 255] * 1e-200);
+    printf("%-12s %7.1f\n", "%.3e", bench_ns(start));
+#endif
+
+    printf("\nProject formats, format string vs PF() list, nS per call\n");
+#ifdef FLOATIO
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += t_snprintf(str, sizeof(str), "Iter:% 10ld, %+7.2f\n", (long) i, dvals[i & 255]);
+    printf("%-12s %7.1f", "Iter", bench_ns(start));
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += snprintf_desc(str, sizeof(str), desc_iter, (long) i, dvals[i & 255]);
+    printf(", %7.1f\n", bench_ns(start));
+#endif
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += t_snprintf(str, sizeof(str), "Heap: %d, Conn:%d\n", (int) vals[i & 255] & 0xffff, i & 7);
+    printf("%-12s %7.1f", "Heap", bench_ns(start));
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += snprintf_desc(str, sizeof(str), desc_heap, (int) vals[i & 255] & 0xffff, i & 7);
+    printf(", %7.1f\n", bench_ns(start));
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += t_snprintf(str, sizeof(str), "CH:%02d, DB:%+02d\n", i % 14, (i & 63) - 90);
+    printf("%-12s %7.1f", "CH", bench_ns(start));
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += snprintf_desc(str, sizeof(str), desc_ch, i % 14, (i & 63) - 90);
+    printf(", %7.1f\n", bench_ns(start));
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += t_snprintf(str, sizeof(str), "HTTP/1.1 %s\nContent-Type: %s\nConnection: %s\nContent-Length: %lu\n",
+            "200 OK", "text/html", "keep-alive", (unsigned long) vals[i & 255] & 0xffff);
+    printf("%-12s %7.1f", "html_head", bench_ns(start));
+    start = clock();
+    for(i=0;i<BENCH_LOOPS;++i)
+        sink += snprintf_desc(str, sizeof(str), desc_head,
+            "200 OK", "text/html", "keep-alive", (unsigned long) vals[i & 255] & 0xffff);
+    printf(", %7.1f\n", bench_ns(start));
+}
+
 /// @brief main printf test programe
 /// Run a number of conversion tests and display good and bad result totals
 /// @return 0
@@ -770,7 +1318,18 @@ int main(int argc, char *argv[])
 
     char *intops = "duxXo";
     char *sizeops[] = { "short", "int", "long", "long long", NULL };
-    char *floatops = "fe";
+    char *floatops = "feg";
+
+    if(argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        bench();
+        return(0);
+    }
+    if(argc > 2 && strcmp(argv[1], "desc") == 0)
+    {
+        desc_gen(argv[2]);
+        return(0);
+    }
 
     printf("=======================\n");
     printf("Start of Manual tests\n");
@@ -830,6 +1389,15 @@ int main(int argc, char *argv[])
     display_good = 0;
     tests();
 
+    tp_good = 0;
+    tp_bad = 0;
+    printf("=======================\n");
+    printf("Start:(pre-parsed formats)\n");
+    desc_tests();
+    printf("End:  (pre-parsed formats)\n");
+    printf("Good:%ld, Bad:%ld\n", tp_good, tp_bad);
+    printf("=======================\n");
+
     printf("\n\n");
     printf("Start of random tests\n");
 
@@ -864,6 +1432,15 @@ int main(int argc, char *argv[])
         printf("Good:%ld, Bad:%ld, fmt:%ld\n", tp_good, tp_bad, tp_fmt);    
         printf("=======================\n");
     }
+
+    tp_good = 0;
+    tp_bad = 0;
+    printf("=======================\n");
+    printf("Start:(random double bits)\n");
+    random_bits_tests(1000000);
+    printf("End:  (random double bits)\n");
+    printf("Good:%ld, Bad:%ld, fmt:%ld\n", tp_good, tp_bad, tp_fmt);    
+    printf("=======================\n");
     printf("\n");
     printf("Random done\n");
 
@@ -40,11 +40,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "matrix.h"
 #include "esp8266/system.h"
 #include "lib/stringsup.h"
+#include "printf/printf_desc.h"
+
+#ifdef WEBSERVER
+	#include "web/web.h"
+	#include "web/websocket.h"
+#endif
 
 #ifdef DISPLAY
 	#include "display/ili9341.h"
+	#include "display/tft_printf.h"
 	
 	#include "network/network.h"
+	#include "network/ntp.h"
 	
 	#ifdef WIRECUBE
 		#include "cordic/cordic.h"
@@ -116,6 +124,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 	LOCAL point V;
 	LOCAL point S;
 
+	#ifdef DEBUG_STATS
+		// Status lines are updated every loop, they are parsed at compile time
+		// See printf/printf_desc.h for the format strings, test_printf checks them
+		static const printf_desc_t stats_volt[] = STATS_VOLT_DESC;
+		static const printf_desc_t stats_iter[] = STATS_ITER_DESC;
+		static const printf_desc_t stats_heap[] = STATS_HEAP_DESC;
+		static const printf_desc_t stats_wifi[] = STATS_WIFI_DESC;
+	#endif
+
 
 #endif
 
@@ -124,154 +141,39 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 void ets_timer_disarm(ETSTimer *ptimer);
 void ets_timer_setfn(ETSTimer *ptimer, ETSTimerFunc *pfunction, void *parg);
 
+/// @brief  wtimer_ticks() when ms_clear() was called
 unsigned long ms_time = 0;
 
 // ==================================================================
 // ==================================================================
 
 /// @brief  Clear 1000HZ timer 
-/// We loop in case the update of ms_time is not "atomic" - done in a single instruction
 /// @return  void.
 MEMSPACE
 void ms_clear()
 {
-	while(ms_time)
-		ms_time = 0;
+	ms_time = wtimer_ticks();
 }
 
 /// @brief  Read 1000HZ timer 
-/// We loop in case the update of ms_time is not "atomic" - done in a single instruction
+/// The timer wheel counts System task ticks, one per millisecond
 /// @return  time in milliseconds
 MEMSPACE
 unsigned long ms_read()
 {
-	unsigned long ret = 0;
-	while(ret != ms_time)
-		ret = ms_time;
-	return(ret);
+	return(wtimer_ticks() - ms_time);
 }
 
-/**
- @brief 1000HZ timer task
- @return void
-*/
-void ms_task(void)
-{
-    ms_time++;
-}
-
-/// @brief  Initialize 1000HZ timer task
+/// @brief  Initialize 1000HZ timer
 /// @return  void.
 MEMSPACE
 void ms_init()
 {
-	ms_time = 0;
-    if(set_timers(ms_task,1) == -1)
-        printf("Clock task init failed\n");
+	ms_clear();
 }
 
 
-// FIXME we need to add time zone and timezone processing rules
-int ntp_init = 0;
-void ntp_setup(void)
-{
-    tv_t tv;
-    tz_t tz;
-	time_t sec;
-	struct ip_info getinfo;
-
-
-	// Wait until we have an IP address before we set the time
-    if(!network_init)
-		return;
-
-	if(ntp_init == 0)
-    {
-        ip_addr_t *addr = (ip_addr_t *)safecalloc(sizeof(ip_addr_t),1);
-
-		// form pool.ntp.org
-		ipaddr_aton("206.108.0.131", addr);
-		sntp_setserver(1,addr);
-		ipaddr_aton("167.114.204.238", addr);
-		sntp_setserver(2,addr);
-
-#if 0
-		// Alternate time setting if the local router does NTP
-		if(wifi_get_ip_info(0, &getinfo))
-		{
-			printf("NTP:0 GW: %s\n", ipv4_2str(getinfo.gw.addr));
-			printf("NTP:0 IP: %s\n", ipv4_2str(getinfo.ip.addr));
-			sntp_setserver(1, & getinfo.gw);
-			sntp_setserver(2, & getinfo.ip);
-		}
-		else
-		{
-			printf("NTP:0 failed to get GW address\n");
-			return;
-		}
-#endif
-
-        if( sntp_set_timezone(0) )
-		{
-			printf("NTP: set_timeone OK\n");
-			sntp_init();
-            safefree(addr);
-		    ntp_init = 1;
-            printf("NTP:1\n");
-		}
-		else
-		{
-			printf("NTP: set_timeone Failed\n");
-		}
-    }
-
-	if(ntp_init == 1)
-	{
-		// they hard coded it to +8 hours from GMT
-		if( (sec = sntp_get_current_timestamp()) > 10 )
-		{
-			sntp_stop();
-			ntp_init = 2;
-		}
-	}
-	if(ntp_init == 2)
-	{
-		time_t s;
-
-		tm_t *p;
-
-		printf("NTP:2\n");
-
-		// they return GMT + 8
-        // sec = sec - (8UL * 3600UL);
-
-        tv.tv_sec = sec;
-		printf("ntp_init: %s\n", asctime(gmtime(&sec)));
-		printf("ntp_init: %s\n", ctime_gm(&sec));
-
-        tv.tv_usec = 0;
-        tz.tz_minuteswest = 300;
-		tz.tz_dsttime = 0;
-
-        settimeofday(&tv, &tz);
-
-        printf("SEC:%ld\n",sec);
-        printf("TIME:%s\n", ctime(&sec));
-		printf("Zone: %d\n", (int) sntp_get_timezone());
-		ntp_init = 3;
-
-		set_dst(tv.tv_sec);
-
-		print_dst_gmt();
-		print_dst();
-
-		p = gmtime(&tv.tv_sec);
-		mktime(p);
-		printf("Localtime: %s\n", asctime(p));
-    }
-}
- 
-user_tasks()
+void user_tasks()
 {
 	char buffer[260];
 	int argc;
@@ -290,8 +192,6 @@ user_tasks()
 // Signal strength update interval
 int signal_loop = 0;
 
-time_t seconds = 0;
-
 /**
  @brief test task
   Runs corrected cube demo from Sem
@@ -303,10 +203,6 @@ extern uint8_t ip_msg[];
 
 int skip = 0;
 
-long last_time10 = 0;
-long last_time50 = 0;
-time_t sec = 0;
-
 int loop_cnt = 0;
 
 // VCC voltage divider
@@ -344,54 +240,14 @@ float adc_read()
 
 // ============================================================
 
-// main task loop called by yield code
-void user_loop(void)
-{
-	extern int connections;
-	uint32_t time1,time2;
-	long t;
 #ifdef DISPLAY
-	char time_tmp[32];
+/// @brief Touch, statistics and cube demo, run every 50mS
+void display_task(void)
+{
 	uint8_t red, blue,green;
 	int touched;
 	uint16_t X,Y;
-#endif
-
-	// getinfo.ip.addr, getinfo.gw.addr, getinfo.netmask.addr
-	struct ip_info getinfo;
-	char *ptr;
-
-	// ========================================================
-	// Run all remaining tasks once every 1mS
-	t = ms_read();
-	if((t - last_time10) < 1U)
-		return;
-	last_time10 = t;
-	// ========================================================
-// Tasks that must run very fast , once every millisecond should be at the top
 
-#ifdef ADF4351
-	ADF4351_task();
-#endif
-#ifdef XPT2046
-	XPT2046_task();
-#endif
-
-	// ========================================================
-	// Only run every 50mS
-	t = ms_read();
-	if((t - last_time50) < 50U)
-		return;
-	last_time50 = t;
-	// ========================================================
-
-	user_tasks();
-
-	// NTP state machine
-	ntp_setup();
-
-
-#ifdef DISPLAY
 	#ifdef XPT2046
 		if(tft_is_calibrated)
 		{
@@ -400,6 +256,10 @@ void user_loop(void)
 				if(touched)
 					tft_printf(winmsg,"X:%d,Y:%d\n",(int)X,(int)Y);
 			#endif
+			#ifdef WEBSERVER
+				if(touched)
+					ws_printf("{\"touch\":[%d,%d]}",(int)X,(int)Y);
+			#endif
 		}
 	#endif
 
@@ -412,7 +272,7 @@ void user_loop(void)
 			#ifdef DEBUG_STATS
 				// Do NOT run adc_read() every millisecond as system_adc_read() blocks WIFI 
 				tft_set_textpos(wintop, 0,2);
-				tft_printf(wintop,"Volt:%2.2f\n", (float)adc_read());
+				tft_printf_desc(wintop, stats_volt, (double)adc_read());
 			#endif
 		#endif // VOLTAGE_TEST
 
@@ -420,7 +280,7 @@ void user_loop(void)
 		tft_set_textpos(wintop, 0,0);
 		tft_set_font(wintop,0);
 		tft_font_fixed(wintop);
-		tft_printf(wintop,"Iter:% 10ld, %+7.2f\n", count, degree);
+		tft_printf_desc(wintop, stats_iter, count, degree);
 	#endif
 
 	#ifdef CIRCLE
@@ -480,15 +340,32 @@ void user_loop(void)
 		rad = dscale; // +/- 90
 		tft_drawCircle(wincube, wincube->w/2, wincube->h/2, rad, tft_RGBto565(red,green,blue));
 	#endif
+}
 #endif	// DISPLAY
 
-	// ========================================================
-	// Tasks run only once every second go after this
+/// @brief Status display and WebSocket status, updated when the second changes
+/// Run every 50 ms so the display follows the clock, not the task phase
+void status_task(void)
+{
+	extern int connections;
+	static time_t last = 0;
+	time_t sec;
+#ifdef DISPLAY
+	char time_tmp[32];
+	// getinfo.ip.addr, getinfo.gw.addr, getinfo.netmask.addr
+	struct ip_info getinfo;
+#endif
+
 	time(&sec);
-	if(sec == seconds)
+	if(sec == last)
 		return;
-	seconds=sec;
-	// ========================================================
+	last = sec;
+
+#ifdef WEBSERVER
+	// Live status for WebSocket clients, see html/live.htm
+	ws_printf("{\"time\":%lu,\"heap\":%u,\"conn\":%d}",
+		(unsigned long) sec, (unsigned) system_get_free_heap_size(), connections);
+#endif
 
 #ifdef DISPLAY
 	// ========================================================
@@ -515,27 +392,54 @@ void user_loop(void)
 		// ========================================================
 		// HEAP size
 		tft_set_textpos(wintop, 0,1);
-		tft_printf(wintop,"Heap: %d, Conn:%d\n", 
-		system_get_free_heap_size(), connections);
+		tft_printf_desc(wintop, stats_heap,
+		(int) system_get_free_heap_size(), connections);
 		
 		// ========================================================
 		// WIFI status
 		tft_set_textpos(wintop, 0,3);
-		tft_printf(wintop,"CH:%02d, DB:%+02d\n", 
-		wifi_get_channel(),
-		wifi_station_get_rssi());
+		tft_printf_desc(wintop, stats_wifi,
+		(int) wifi_get_channel(),
+		(int) wifi_station_get_rssi());
 	#endif	// DEBUG_STATS
 #endif	//DISPLAY
 
 }
 
+/// @brief Periodic tasks run by user_loop()
+/// Period and deadline are in microseconds, priority 0 runs first
+/// The "tasks" command shows how often each one misses its deadline
+periodic_t user_periodic[] = {
+#ifdef ADF4351
+	PERIODIC("adf4351", ADF4351_task, 1000, 1000, 0),
+#endif
+#ifdef XPT2046
+	PERIODIC("touch", XPT2046_task, 1000, 1000, 0),
+#endif
+	PERIODIC("user", user_tasks, 50000, 50000, 1),
+	// NTP state machine
+	PERIODIC("ntp", ntp_setup, 50000, 50000, 2),
+	PERIODIC("status", status_task, 50000, 50000, 2),
+#ifdef DISPLAY
+	PERIODIC("display", display_task, 50000, 50000, 3),
+#endif
+};
+
+// main task loop called by yield code
+void user_loop(void)
+{
+	periodic_run();
+}
+
 int inloop = 0;
+int loop_reentered = 0;
 void loop()
 {
 	int ret;
 	if(inloop)
 	{
-		printf("Error: loop() task overrun\n");
+		// Shown by the "tasks" command
+		++loop_reentered;
 		inloop = 0;
 		return;
 	}
@@ -607,10 +511,17 @@ void user_help()
         "calibrate_test N\n"
 		"display_clock\n"
         "draw C[1]\n"
+#ifdef HEAP_TRACE
+        "heap [mark]\n"
+#endif
         "mem\n"
+#ifdef PROFILE
+        "prof [clear|trace]\n"
+#endif
 		"pixel\n"
         "rotate N\n"
 		"setdate YYYY MM DD HH:MM:SS\n"
+        "tasks [clear]\n"
 		"time\n"
 		"timetest\n"
 		"\n");
@@ -678,6 +589,7 @@ int user_tests(int argc, char *argv[])
     {
 		t = time(0);	
 		printf("TIME:%s\n", ctime(&t));
+		ntp_stats();
         return(1);
 	}
     if (MATCHARGS(ptr,"connection", (ind + 0) ,argc))
@@ -685,9 +597,51 @@ int user_tests(int argc, char *argv[])
 		printf("connections:%d\n", connections);
         return(1);
 	}
+#ifdef HEAP_TRACE
+    if (MATCHARGS(ptr,"heap", (ind + 0) ,argc))
+    {
+		if(ind < argc && MATCHI(argv[ind],"mark"))
+			heap_mark();
+		else
+			heap_report(NULL, NULL);
+        return(1);
+	}
+#endif
+#ifdef PROFILE
+    if (MATCHARGS(ptr,"prof", (ind + 0) ,argc))
+    {
+		if(ind < argc && MATCHI(argv[ind],"clear"))
+			prof_clear();
+		else if(ind < argc && MATCHI(argv[ind],"trace"))
+			prof_trace(NULL, NULL);
+		else
+			prof_stats(NULL, NULL);
+        return(1);
+	}
+#endif
+    if (MATCHARGS(ptr,"tasks", (ind + 0) ,argc))
+    {
+		if(ind < argc && MATCHI(argv[ind],"clear"))
+		{
+			periodic_clear();
+			loop_reentered = 0;
+			return(1);
+		}
+#ifdef YIELD_TASK
+		sched_stats();
+#endif
+		periodic_stats();
+		if(loop_reentered)
+			printf("loop() reentered: %d\n", loop_reentered);
+        return(1);
+	}
     if (MATCHARGS(ptr,"mem", (ind + 0) ,argc))
     {
 		PrintRam();
+		posix_pool_stats();
+#ifdef WEBSERVER
+		web_mem_stats();
+#endif
         return(1);
 	}
     if (MATCHARGS(ptr,"timetest", (ind + 1) ,argc))
@@ -975,7 +929,6 @@ void setup(void)
 	int ret;
 	uint16_t *ptr;
 	double ang;
-	extern web_init();
 	int w,h;
 
 	ip_msg[0] = 0;
@@ -1102,6 +1055,8 @@ void setup(void)
     sep();
     PrintRam();
 
+	periodic_init(user_periodic, sizeof(user_periodic) / sizeof(periodic_t));
+
 	system_set_os_print(0);
 
 } //setup()
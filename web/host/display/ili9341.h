@@ -0,0 +1,41 @@
+/**
+ @file ili9341.h
+
+ @brief Host build of the web server for web/test_web.c
+ msg.cgi writes to the display, here the windows are not drawn
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ILI9341_H_
+#define _ILI9341_H_
+
+typedef struct {
+	int w, h;
+	int bg;
+} window;
+
+extern window *wintop;
+extern window *winmsg;
+
+#define tft_fillWin(win,c)
+#define tft_set_textpos(win,x,y)
+#define tft_set_font(win,f)
+#define tft_printf(win,...)
+
+#endif
@@ -0,0 +1,137 @@
+/**
+ @file user_config.h
+
+ @brief Host build of the web server for web/test_web.c
+ Stands in for include/user_config.h, the SDK and the FatFs posix layer.
+ Files are served from the host file system, the network is the
+ simulated espconn layer in test_web.c
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _USER_CONFIG_H_
+#define _USER_CONFIG_H_
+
+// only used when testing standalone on linux
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define MEMSPACE
+
+#include "printf/mathio.h"
+#include "lib/stringsup.h"
+
+// esp8266/system.h
+#define safecalloc(n,s) calloc(n,s)
+// test_web.c can make it fail
+#define safemalloc(s) web_safemalloc(s)
+extern void *web_safemalloc(size_t size);
+#define safefree(p) free(p)
+extern uint32_t system_get_time(void);
+extern uint32_t system_get_free_heap_size(void);
+#define optimistic_yield(us)
+
+// posix/posix.h
+#define MAX_NAME_LEN 255
+// Request paths start with "/", the SD card root, served from the current directory
+#define fopen(name,mode) web_fopen(name,mode)
+#define stat(name,sp) web_stat(name,sp)
+#define unlink(name) web_unlink(name)
+extern FILE *web_fopen(const char *name, const char *mode);
+extern int web_stat(const char *name, struct stat *sp);
+extern int web_unlink(const char *name);
+
+// lib/time.h, the host time functions are used
+#include <sys/time.h>
+typedef struct tm tm_t;
+typedef struct timeval tv_t;
+typedef struct {
+	int tz_minuteswest;
+	int tz_dsttime;
+} tz_t;
+extern char *tm_wday_to_ascii(int i);
+extern char *tm_mon_to_ascii(int i);
+extern int is_dst(time_t t);
+
+// lib/prof.h
+#define PROF_ZONE(zone)
+
+// yield/sched.h
+#define SCHED_EV_POST 1
+extern uint32_t sched_wait(uint32_t events, uint32_t timeout);
+extern void esp_schedule(void);
+
+// SDK espconn.h, only what web.c uses
+typedef void (*espconn_connect_callback)(void *arg);
+typedef void (*espconn_recv_callback)(void *arg, char *pdata, unsigned short len);
+typedef void (*espconn_sent_callback)(void *arg);
+typedef void (*espconn_reconnect_callback)(void *arg, int8_t err);
+
+typedef struct _esp_tcp {
+	int remote_port;
+	int local_port;
+	uint8_t local_ip[4];
+	uint8_t remote_ip[4];
+	espconn_connect_callback connect_callback;
+	espconn_reconnect_callback reconnect_callback;
+	espconn_connect_callback disconnect_callback;
+} esp_tcp;
+
+struct espconn {
+	int type;
+	int state;
+	union {
+		esp_tcp *tcp;
+	} proto;
+	espconn_recv_callback recv_callback;
+	espconn_sent_callback sent_callback;
+	void *reverse;
+};
+
+#define ESPCONN_TCP 0x10
+#define ESPCONN_NONE 0
+#define ESPCONN_REUSEADDR 0x01
+#define ESPCONN_MEM -1
+#define ESPCONN_ARG -12
+#define ESPCONN_MAXNUM -7
+#define ESPCONN_IF -14
+#define NONE_SLEEP_T 0
+
+extern int8_t espconn_send(struct espconn *conn, uint8_t *data, uint16_t len);
+extern int8_t espconn_disconnect(struct espconn *conn);
+extern int8_t espconn_accept(struct espconn *conn);
+extern int8_t espconn_regist_connectcb(struct espconn *conn, espconn_connect_callback fn);
+extern int8_t espconn_regist_recvcb(struct espconn *conn, espconn_recv_callback fn);
+extern int8_t espconn_regist_sentcb(struct espconn *conn, espconn_sent_callback fn);
+extern int8_t espconn_regist_disconcb(struct espconn *conn, espconn_connect_callback fn);
+extern int8_t espconn_regist_reconcb(struct espconn *conn, espconn_reconnect_callback fn);
+extern int8_t espconn_recv_hold(struct espconn *conn);
+extern int8_t espconn_recv_unhold(struct espconn *conn);
+#define espconn_regist_time(conn,sec,type) ((void) 0)
+#define espconn_set_opt(conn,opt) ((void) 0)
+extern int8_t espconn_tcp_set_max_con_allow(struct espconn *conn, uint8_t num);
+extern int8_t espconn_tcp_get_max_con_allow(struct espconn *conn);
+#define wifi_set_sleep_type(type) ((void) 0)
+
+#endif
@@ -0,0 +1,595 @@
+/**
+ @file http_parse.c
+
+ @brief HTTP request parser for the esp8266 web server
+  A single pass state machine over the request in the read buffer.
+  Methods and header names are found with a switch on the name length
+  and first character, then one compare against msg_headers[].
+  Values are terminated in place and hinfo_t points into the buffer,
+  nothing is allocated or copied.
+  GET and POST arguments are percent decoded in place.
+  Builds stand alone on the host for testing, see web/Makefile
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef USER_CONFIG
+#include "user_config.h"
+#else
+// Host test build
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#define MEMSPACE
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include "web/http_parse.h"
+
+///@brief HTTP methods and headers we understand
+/// The order must match the TOKEN_ enum
+header_t msg_headers[] = {
+	{ "GET", 				TOKEN_GET },
+	{ "PUT", 				TOKEN_PUT },
+	{ "POST", 				TOKEN_POST },
+	{ "HEAD", 				TOKEN_HEAD },
+	{ "Host:", 				TOKEN_HOST },
+	{ "User-Agent:", 		TOKEN_USER_AGENT },
+	{ "HTTPS:", 			TOKEN_HTTPS},
+	{ "DNT:", 				TOKEN_DNT},
+	{ "Accept:", 			TOKEN_ACCEPT },
+	{ "Accept-Language:", 	TOKEN_ACCEPT_LANGUAGE },
+	{ "Accept-Encoding:", 	TOKEN_ACCEPT_ENCODING },
+	{ "Connection:", 		TOKEN_CONNECTION },
+	{ "Referer:", 			TOKEN_REFERER },
+	{ "Content-Length:", 	TOKEN_CONTENT_LENGTH },
+	{ "Content-Type:", 		TOKEN_CONTENT_TYPE },
+	{ "Cache-Control:", 	TOKEN_CACHE_CONTROL },
+	{ "If-None-Match:", 	TOKEN_IF_NONE_MATCH },
+	{ "If-Modified-Since:",	TOKEN_IF_MODIFIED_SINCE },
+	{ "Upgrade:",			TOKEN_UPGRADE },
+	{ "Sec-WebSocket-Key:",	TOKEN_SEC_WEBSOCKET_KEY },
+	{ "Sec-WebSocket-Version:",	TOKEN_SEC_WEBSOCKET_VERSION },
+	{ NULL,                 -1}
+};
+
+/// @brief http_parse() states
+enum {
+	HP_METHOD,		// GET
+	HP_TARGET,		// /index.html
+	HP_ARGS,		// ?name=value
+	HP_VERSION,		// HTTP/1.1
+	HP_CR,			// seen CR at the end of a line
+	HP_LINE,		// start of a header line
+	HP_NAME,		// header name
+	HP_VALUE,		// header value
+	HP_SKIP,		// line we do not understand
+	HP_BLANK		// seen CR of the blank line
+};
+
+/**
+	Initilize hinfo_t structure
+	@param[in] *hi: hinfo_t structure pointer to initialize
+	@return hinfo_t structure pointer to initialize
+*/
+MEMSPACE
+void init_hinfo(hinfo_t *hi)
+{
+	hi->type = -1;	// GET,PUT,HEADER
+	hi->filename = NULL;
+	hi->connection = NULL;
+	hi->accept_encoding = NULL;
+	hi->if_none_match = NULL;
+	hi->if_modified_since = NULL;
+	hi->upgrade = NULL;
+	hi->ws_key = NULL;
+	hi->ws_version = NULL;
+	hi->args = NULL;
+	hi->arg_ptr = NULL;
+	hi->args_length = 0;
+	hi->html_encoding= NULL;
+	hi->content_type = NULL;
+	hi->content_length = 0;
+	hi->msg = NULL;
+}
+
+/**
+	@brief Confirm a name against its msg_headers[] entry
+	@param[in] *str: name, not terminated
+	@param[in] len: length of name without the ':'
+	@param[in] token: msg_headers[] index to compare with
+	@return token on match, otherwise -1
+*/
+MEMSPACE
+static int http_token(char *str, int len, int token)
+{
+	char *pattern = msg_headers[token].pattern;
+
+	if(strncasecmp(str, pattern, len) == 0
+		&& (pattern[len] == 0 || pattern[len] == ':'))
+		return(token);
+	return(-1);
+}
+
+/**
+	@brief Identify a request method
+	@param[in] *str: method, not terminated
+	@param[in] len: length of method
+	@return TOKEN_GET, TOKEN_PUT, TOKEN_POST, TOKEN_HEAD or -1
+*/
+MEMSPACE
+int http_method_id(char *str, int len)
+{
+	int c = str[0] | 0x20;
+
+	switch(len)
+	{
+	case 3:
+		if(c == 'g') return(http_token(str, len, TOKEN_GET));
+		if(c == 'p') return(http_token(str, len, TOKEN_PUT));
+		break;
+	case 4:
+		if(c == 'p') return(http_token(str, len, TOKEN_POST));
+		if(c == 'h') return(http_token(str, len, TOKEN_HEAD));
+		break;
+	}
+	return(-1);
+}
+
+/**
+	@brief Identify a header name
+	The length and first character select at most one candidate
+	@param[in] *str: header name, not terminated
+	@param[in] len: length of name without the ':'
+	@return TOKEN_ header index or -1
+*/
+MEMSPACE
+int http_header_id(char *str, int len)
+{
+	int c;
+
+	if(len < 3)
+		return(-1);
+
+	c = str[0] | 0x20;
+	switch(len)
+	{
+	case 3:
+		if(c == 'd') return(http_token(str, len, TOKEN_DNT));
+		break;
+	case 4:
+		if(c == 'h') return(http_token(str, len, TOKEN_HOST));
+		break;
+	case 5:
+		if(c == 'h') return(http_token(str, len, TOKEN_HTTPS));
+		break;
+	case 6:
+		if(c == 'a') return(http_token(str, len, TOKEN_ACCEPT));
+		break;
+	case 7:
+		if(c == 'r') return(http_token(str, len, TOKEN_REFERER));
+		if(c == 'u') return(http_token(str, len, TOKEN_UPGRADE));
+		break;
+	case 10:
+		if(c == 'c') return(http_token(str, len, TOKEN_CONNECTION));
+		if(c == 'u') return(http_token(str, len, TOKEN_USER_AGENT));
+		break;
+	case 12:
+		if(c == 'c') return(http_token(str, len, TOKEN_CONTENT_TYPE));
+		break;
+	case 13:
+		if(c == 'i') return(http_token(str, len, TOKEN_IF_NONE_MATCH));
+		if(c == 'c') return(http_token(str, len, TOKEN_CACHE_CONTROL));
+		break;
+	case 14:
+		if(c == 'c') return(http_token(str, len, TOKEN_CONTENT_LENGTH));
+		break;
+	case 15:
+		// Accept-Encoding and Accept-Language
+		if(c != 'a')
+			break;
+		if((str[7] | 0x20) == 'e')
+			return(http_token(str, len, TOKEN_ACCEPT_ENCODING));
+		return(http_token(str, len, TOKEN_ACCEPT_LANGUAGE));
+	case 17:
+		if(c == 'i') return(http_token(str, len, TOKEN_IF_MODIFIED_SINCE));
+		if(c == 's') return(http_token(str, len, TOKEN_SEC_WEBSOCKET_KEY));
+		break;
+	case 21:
+		if(c == 's') return(http_token(str, len, TOKEN_SEC_WEBSOCKET_VERSION));
+		break;
+	}
+	return(-1);
+}
+
+/**
+	@brief Value of a hex digit
+	@param[in] c: character
+	@return 0 .. 15 or -1 if not a hex digit
+*/
+MEMSPACE
+static int http_hex(int c)
+{
+	if(c >= '0' && c <= '9')
+		return(c - '0');
+	c |= 0x20;
+	if(c >= 'a' && c <= 'f')
+		return(c - 'a' + 10);
+	return(-1);
+}
+
+/**
+	@brief Decode GET argments or POST message name/value data in place
+	Names and values are each terminated with an EOS by replacing
+	'=' and '&', '+' becomes a space and %XX is decoded.
+	The output is never longer then the input.
+	@param[in] *hi: hinfo_t structure to fill
+	@param[in] *ptr: arguments, ptr[len] must be writable
+	@param[in] len: length of arguments
+	@return decoded length
+*/
+MEMSPACE
+int http_args(hinfo_t *hi, char *ptr, int len)
+{
+	char *out = ptr;
+	char *end = ptr + len;
+	int c,h,l;
+
+	hi->args = ptr;
+	hi->arg_ptr = ptr;
+
+	while(ptr < end)
+	{
+		c = *ptr++;
+		if(c == '=' || c == '&')
+			c = 0;
+		else if(c == '+')
+			c = ' ';
+		else if(c == '%')
+		{
+			// Make sure we do not go past the end of the string
+			if(end - ptr < 2)
+			{
+#if WEB_DEBUG & 1+8
+				printf("http_args: HTML %%HEX decode short string\n");
+#endif
+				break;
+			}
+			h = http_hex(ptr[0]);
+			l = http_hex(ptr[1]);
+			ptr += 2;
+			// The data was not HEX
+			c = (h < 0 || l < 0) ? ' ' : ((h << 4) | l);
+		}
+		*out++ = c;
+	}
+	// EOS at very end of arguments
+	*out = 0;
+	hi->args_length = out - hi->args;
+	return(hi->args_length);
+}
+
+/**
+    @brief Find the length of the request headers at the start of a buffer
+	The headers end with a blank line, Content-Length bytes of message
+	body follow
+	Pipelined requests that follow are not touched
+    @param[in] *str: buffer holding received data
+    @param[in] len: bytes in buffer
+    @param[out] *body: Content-Length of the message body, 0 if none
+    @return header length, or 0 if the headers are not complete yet
+*/
+MEMSPACE
+int http_header_len(char *str, int len, long *body)
+{
+	int start,end,line;
+
+	*body = 0;
+
+	start = 0;
+	while(start < len)
+	{
+		// find end of this line
+		end = start;
+		while(end < len && str[end] != '\n')
+			++end;
+		if(end >= len)
+			break;
+
+		line = end - start;
+		if(line && str[end-1] == '\r')
+			--line;
+
+		// Blank line ends the headers
+		if(!line)
+			return(end + 1);
+
+		if(line > 15 && strncasecmp(str+start,"Content-Length:",15) == 0)
+			*body = atol(str+start+15);
+
+		start = end + 1;
+	}
+	return(0);
+}
+
+/**
+	@brief Save a header value we use
+	@param[in] *hi: hinfo_t structure to fill
+	@param[in] token: TOKEN_ header index
+	@param[in] *value: value, terminated and trimmed
+	@return void
+*/
+MEMSPACE
+static void http_header_value(hinfo_t *hi, int token, char *value)
+{
+	switch(token)
+	{
+	case TOKEN_CONTENT_LENGTH:
+		hi->content_length = atoi(value);
+		break;
+	case TOKEN_CONTENT_TYPE:
+		hi->content_type = value;
+		break;
+	// Used to select a pre-compressed file, see gzip_name()
+	case TOKEN_ACCEPT_ENCODING:
+		hi->accept_encoding = value;
+		break;
+	// Conditional GET, see not_modified()
+	case TOKEN_IF_NONE_MATCH:
+		hi->if_none_match = value;
+		break;
+	case TOKEN_IF_MODIFIED_SINCE:
+		hi->if_modified_since = value;
+		break;
+	// See http_keepalive()
+	case TOKEN_CONNECTION:
+		hi->connection = value;
+		break;
+	// See ws_upgrade()
+	case TOKEN_UPGRADE:
+		hi->upgrade = value;
+		break;
+	case TOKEN_SEC_WEBSOCKET_KEY:
+		hi->ws_key = value;
+		break;
+	case TOKEN_SEC_WEBSOCKET_VERSION:
+		hi->ws_version = value;
+		break;
+	}
+}
+
+/**
+	@brief Parse a request in place in a single pass
+	GET /name?args HTTP/1.1, the headers, a blank line, then any
+	message body. POST message bodies are decoded as arguments.
+	Lines may end with CRLF or LF, unknown headers are skipped.
+	@param[out] *hi: hinfo_t structure to fill, points into buf
+	@param[in] *buf: request, buf[len] must be writable
+	@param[in] len: length of request and message body
+	@return 1 on success, 0 if the request is not understood
+*/
+MEMSPACE
+int http_parse(hinfo_t *hi, char *buf, int len)
+{
+	char *ptr,*end,*start,*last;
+	int c,state,token;
+
+	init_hinfo(hi);
+
+	if(!buf || len <= 0)
+		return(0);
+
+	state = HP_METHOD;
+	token = -1;
+	start = last = buf;
+	end = buf + len;
+
+	// A pass past the end as a LF ends any partial line
+	for(ptr = buf; ptr <= end; ++ptr)
+	{
+		c = (ptr < end) ? *ptr : '\n';
+
+		switch(state)
+		{
+		case HP_METHOD:
+			if(c == ' ')
+			{
+				hi->type = http_method_id(start, ptr - start);
+				if(hi->type < 0)
+					return(0);
+				*ptr = 0;
+				start = ptr + 1;
+				state = HP_TARGET;
+			}
+			else if(c < ' ')
+				return(0);
+			break;
+
+		case HP_TARGET:
+			if(c == ' ' && ptr == start)
+			{
+				++start;
+				break;
+			}
+			if(c == '?' || c == ' ' || c == '\r' || c == '\n')
+			{
+				*ptr = 0;	// Filename EOS
+				hi->filename = start;
+				start = ptr + 1;
+				if(c == '?')
+					state = HP_ARGS;
+				else if(c == ' ')
+					state = HP_VERSION;
+				else
+					state = (c == '\r') ? HP_CR : HP_LINE;
+			}
+			break;
+
+		case HP_ARGS:
+			if(c == ' ' || c == '\r' || c == '\n')
+			{
+				http_args(hi, start, ptr - start);
+				start = ptr + 1;
+				if(c == ' ')
+					state = HP_VERSION;
+				else
+					state = (c == '\r') ? HP_CR : HP_LINE;
+			}
+			break;
+
+		case HP_VERSION:
+			if(c == ' ' && ptr == start)
+			{
+				++start;
+				break;
+			}
+			if(c == '\r' || c == '\n')
+			{
+				*ptr = 0;
+				hi->html_encoding = start;
+				state = (c == '\r') ? HP_CR : HP_LINE;
+			}
+			break;
+
+		case HP_CR:
+			if(c == '\n')
+			{
+				state = HP_LINE;
+				break;
+			}
+			// A CR alone also ends the line
+			// fall through
+
+		case HP_LINE:
+			if(c == '\r')
+			{
+				state = HP_BLANK;
+				break;
+			}
+			if(c == '\n')
+				goto body;
+			start = ptr;
+			state = HP_NAME;
+			// fall through
+
+		case HP_NAME:
+			if(c == ':')
+			{
+				token = http_header_id(start, ptr - start);
+#if WEB_DEBUG & 8
+				if(token < 0)
+					printf("header skip: length %d\n", (int)(ptr - start));
+#endif
+				start = last = ptr + 1;
+				state = (token < 0) ? HP_SKIP : HP_VALUE;
+			}
+			else if(c == '\r' || c == '\n')
+				state = (c == '\r') ? HP_CR : HP_LINE;
+			else if(c <= ' ')
+				state = HP_SKIP;
+			break;
+
+		case HP_VALUE:
+			if(c == '\r' || c == '\n')
+			{
+				// Trim trailing spaces
+				*last = 0;
+				http_header_value(hi, token, start);
+				state = (c == '\r') ? HP_CR : HP_LINE;
+			}
+			else if(c == ' ' || c == '\t')
+			{
+				// Skip leading spaces
+				if(ptr == start)
+					start = last = ptr + 1;
+			}
+			else
+				last = ptr + 1;
+			break;
+
+		case HP_SKIP:
+			if(c == '\r' || c == '\n')
+				state = (c == '\r') ? HP_CR : HP_LINE;
+			break;
+
+		case HP_BLANK:
+			if(c == '\n')
+				goto body;
+			// A CR alone ends the headers
+			--ptr;
+			goto body;
+		}
+	}
+	// Ran out of data before the blank line
+	return(1);
+
+body:
+	// The message body follows the blank line
+	++ptr;
+	if(ptr > end)
+		ptr = end;
+	hi->msg = ptr;
+
+	// POST has arguments after all headers
+	// A large body is streamed, it is not in the buffer
+	if(hi->type == TOKEN_POST)
+	{
+		len = end - ptr;
+		if(hi->content_length < len)
+			len = hi->content_length;
+		if(len > 0)
+			http_args(hi, ptr, len);
+	}
+	return(1);
+}
+
+/**
+	@brief Lookup and argument name and return its value
+	Arguments are name and value pairs each ending with an EOS
+	@param[in] *hi: hinfo_t structure with arguments
+	@param[in] *str: string to lookup
+	@return argument value or NULL
+*/
+MEMSPACE
+char *http_value(hinfo_t *hi, char *str)
+{
+	char *ptr,*end,*value;
+
+	ptr = hi->args;
+	if(!ptr)
+		return(NULL);
+	end = ptr + hi->args_length;
+
+	while(ptr < end && *ptr)
+	{
+		value = ptr + strlen(ptr) + 1;
+		if(value > end)
+			break;
+		if(strcasecmp(ptr,str) == 0)
+		{
+#if WEB_DEBUG & 8
+		    printf("http_value:%s=%s\n",str,value);
+#endif
+			return(value);
+		}
+		ptr = value + strlen(value) + 1;
+	}
+	return(NULL);
+}
@@ -0,0 +1,99 @@
+/**
+ @file http_parse.h
+
+ @brief HTTP request parser for the esp8266 web server
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef	__HTTP_PARSE_H__
+#define	__HTTP_PARSE_H__
+
+// =======================================================
+// HTML HEADER information
+// All pointers point into the request buffer, nothing is copied
+typedef struct {
+// GET /LEDCTL.CGI?led2=on&led3=on HTTP/1.1
+// TOKEN_GET,TOKEN_POST,TOKEN_HEAD
+    int type;
+    char *filename;
+    char *arg_ptr;
+    char *args;
+    uint16_t args_length;
+    char *html_encoding;
+	char *connection;
+	char *accept_encoding;	// Accept-Encoding: gzip, deflate
+	char *if_none_match;	// If-None-Match: "etag"
+	char *if_modified_since;	// If-Modified-Since: date
+	char *upgrade;			// Upgrade: websocket
+	char *ws_key;			// Sec-WebSocket-Key: nonce
+	char *ws_version;		// Sec-WebSocket-Version: 13
+// POST msg_pointers
+// Content-Type: application/x-www-form-urlencoded
+// Content-Length: 165
+    char *content_type;
+    uint16_t content_length;
+// Follows msg headers
+    char *msg;
+} hinfo_t;
+
+// HTTP headers from the client
+// The order must match msg_headers[]
+enum {
+    TOKEN_GET,
+    TOKEN_PUT,
+    TOKEN_POST,
+    TOKEN_HEAD,
+    TOKEN_HOST,
+    TOKEN_USER_AGENT,
+    TOKEN_HTTPS,
+    TOKEN_DNT,
+    TOKEN_ACCEPT,
+    TOKEN_ACCEPT_LANGUAGE,
+    TOKEN_ACCEPT_ENCODING,
+    TOKEN_CONNECTION,
+    TOKEN_REFERER,
+    TOKEN_CONTENT_LENGTH,
+    TOKEN_CONTENT_TYPE,
+    TOKEN_CACHE_CONTROL,
+    TOKEN_IF_NONE_MATCH,
+    TOKEN_IF_MODIFIED_SINCE,
+    TOKEN_UPGRADE,
+    TOKEN_SEC_WEBSOCKET_KEY,
+    TOKEN_SEC_WEBSOCKET_VERSION,
+};
+
+
+typedef struct {
+    char *pattern;
+    int type;
+} header_t;
+
+extern header_t msg_headers[];
+
+// ============================================================
+/* http_parse.c */
+MEMSPACE void init_hinfo ( hinfo_t *hi );
+MEMSPACE int http_method_id ( char *str , int len );
+MEMSPACE int http_header_id ( char *str , int len );
+MEMSPACE int http_args ( hinfo_t *hi , char *ptr , int len );
+MEMSPACE int http_header_len ( char *str , int len , long *body );
+MEMSPACE int http_parse ( hinfo_t *hi , char *buf , int len );
+MEMSPACE char *http_value ( hinfo_t *hi , char *str );
+
+#endif	/* end of __HTTP_PARSE_H__ */
@@ -0,0 +1,237 @@
+/**
+ @file route.c
+
+ @brief CGI route and CGI token tables for the esp8266 web server
+  Routes and tokens are registered at init time with web_route_add()
+  and web_token_add(), so an application can add handlers without
+  editing web.c.
+  Routes are kept sorted by name and found with a binary search.
+  Tokens get an id in registration order, compiled templates store
+  the id so sending a token is a table index.
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "user_config.h"
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "web/web.h"
+#include "web/route.h"
+
+///@brief CGI routes sorted by name
+static web_route_t web_routes[WEB_ROUTES_MAX];
+static int web_routes_count = 0;
+
+///@brief CGI tokens indexed by token id
+static web_token_t web_tokens[WEB_TOKENS_MAX];
+///@brief CGI token ids sorted by token name
+static uint8_t web_tokens_sorted[WEB_TOKENS_MAX];
+static int web_tokens_count = 0;
+
+// =======================================================
+/**
+  @brief Register a CGI route
+  A route with the same name is replaced
+  @param[in] *name: file name without the path, example "led.cgi"
+  @param[in] fn: route handler
+  @return 1 on success, 0 if the table is full
+*/
+MEMSPACE
+int web_route_add(char *name, web_route_fn fn)
+{
+	int i,ret;
+
+	// Find the insert position, keeping the table sorted
+	for(i=0;i<web_routes_count;++i)
+	{
+		ret = strcmp(name, web_routes[i].name);
+		if(ret == 0)
+		{
+			web_routes[i].fn = fn;
+			return(1);
+		}
+		if(ret < 0)
+			break;
+	}
+
+	if(web_routes_count >= WEB_ROUTES_MAX)
+	{
+#if WEB_DEBUG & 1
+		printf("web_route_add: table full, %s\n", name);
+#endif
+		return(0);
+	}
+
+	memmove(&web_routes[i+1], &web_routes[i], (web_routes_count - i) * sizeof(web_route_t));
+	web_routes[i].name = name;
+	web_routes[i].fn = fn;
+	++web_routes_count;
+	return(1);
+}
+
+/**
+  @brief Find the CGI route for a file name
+  Only the last part of the path is used, "/cgi/led.cgi" finds "led.cgi"
+  @param[in] *name: file name from the request
+  @return route handler or NULL if none
+*/
+MEMSPACE
+web_route_fn web_route_find(char *name)
+{
+	int lo,hi,mid,ret;
+	char *ptr;
+
+	if(!name)
+		return(NULL);
+
+	for(ptr = name; *ptr; ++ptr)
+	{
+		if(*ptr == '/')
+			name = ptr + 1;
+	}
+
+	lo = 0;
+	hi = web_routes_count - 1;
+	while(lo <= hi)
+	{
+		mid = (lo + hi) >> 1;
+		ret = strcmp(name, web_routes[mid].name);
+		if(ret == 0)
+			return(web_routes[mid].fn);
+		if(ret < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	return(NULL);
+}
+
+/**
+  @brief Register a CGI token
+  A token with the same name keeps its id and gets the new handler
+  Note: token ids are saved in compiled templates, see web_token_hash()
+  @param[in] *name: whole token, example "@_TIMER_@"
+  @param[in] fn: token handler
+  @return token id or -1 if the table is full
+*/
+MEMSPACE
+int web_token_add(char *name, web_token_fn fn)
+{
+	int i,id,ret;
+
+	for(i=0;i<web_tokens_count;++i)
+	{
+		id = web_tokens_sorted[i];
+		ret = strcmp(name, web_tokens[id].name);
+		if(ret == 0)
+		{
+			web_tokens[id].fn = fn;
+			return(id);
+		}
+		if(ret < 0)
+			break;
+	}
+
+	if(web_tokens_count >= WEB_TOKENS_MAX || web_tokens_count >= CGI_TOKEN_UNKNOWN)
+	{
+#if WEB_DEBUG & 1
+		printf("web_token_add: table full, %s\n", name);
+#endif
+		return(-1);
+	}
+
+	id = web_tokens_count++;
+	web_tokens[id].name = name;
+	web_tokens[id].fn = fn;
+
+	memmove(&web_tokens_sorted[i+1], &web_tokens_sorted[i], (id - i) * sizeof(uint8_t));
+	web_tokens_sorted[i] = id;
+	return(id);
+}
+
+/**
+  @brief Hash of the registered token names in id order
+  Compiled templates save this so they are rebuilt if the ids change
+  FNV-1a hash
+  @return hash
+*/
+MEMSPACE
+uint32_t web_token_hash()
+{
+	int i;
+	char *ptr;
+	uint32_t hash = 2166136261UL;
+
+	for(i=0;i<web_tokens_count;++i)
+	{
+		for(ptr = web_tokens[i].name; *ptr; ++ptr)
+		{
+			hash ^= (uint8_t) *ptr;
+			hash *= 16777619UL;
+		}
+		// separator
+		hash ^= 0xff;
+		hash *= 16777619UL;
+	}
+	return(hash);
+}
+
+/**
+    @brief Lookup a CGI token
+	CGI tokens have the following syntax @_example123_@
+    @param[in] *src: string with token, example @_A_@
+    @return CGI token id or CGI_TOKEN_UNKNOWN
+*/
+MEMSPACE
+int cgi_token_id(char *src)
+{
+	int lo,hi,mid,ret,id;
+
+	lo = 0;
+	hi = web_tokens_count - 1;
+	while(lo <= hi)
+	{
+		mid = (lo + hi) >> 1;
+		id = web_tokens_sorted[mid];
+		ret = strcmp(src, web_tokens[id].name);
+		if(ret == 0)
+			return(id);
+		if(ret < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	return(CGI_TOKEN_UNKNOWN);
+}
+
+/**
+    @brief Write the CGI result for a CGI token id
+    @param[in] *p: socket stream
+    @param[in] id: CGI token id
+    @return length of replaced text or 0 if no CGI handler was matched
+*/
+MEMSPACE
+int cgi_token_write(rwbuf_t *p, int id)
+{
+	if(id < 0 || id >= web_tokens_count || !web_tokens[id].fn)
+		return(0);
+	return( web_tokens[id].fn(p) );
+}
@@ -0,0 +1,70 @@
+/**
+ @file route.h
+
+ @brief CGI route and CGI token tables for the esp8266 web server
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef	__ROUTE_H__
+#define	__ROUTE_H__
+
+/// @brief maximum number of CGI routes
+#ifndef WEB_ROUTES_MAX
+	#define WEB_ROUTES_MAX 16
+#endif
+/// @brief maximum number of CGI tokens, ids must stay below CGI_TOKEN_UNKNOWN
+#ifndef WEB_TOKENS_MAX
+	#define WEB_TOKENS_MAX 16
+#endif
+
+/// @brief token id for unknown tokens, see TPL_LITERAL in template.h
+#define CGI_TOKEN_UNKNOWN 0xfe
+
+/// @brief CGI route handler
+/// Arguments are in hi, see http_value()
+/// @return name of the file to send, or NULL if the handler sent the response
+typedef char *(*web_route_fn)(rwbuf_t *p, hinfo_t *hi);
+
+/// @brief CGI token handler, writes the text that replaces the token
+/// @return bytes written
+typedef int (*web_token_fn)(rwbuf_t *p);
+
+// =======================================================
+/// @brief CGI route table entry, sorted by name
+typedef struct {
+	char *name;			// file name without the path, example "led.cgi"
+	web_route_fn fn;
+} web_route_t;
+
+/// @brief CGI token table entry, indexed by token id
+typedef struct {
+	char *name;			// whole token, example "@_TIMER_@"
+	web_token_fn fn;
+} web_token_t;
+
+// ============================================================
+/* route.c */
+MEMSPACE int web_route_add ( char *name , web_route_fn fn );
+MEMSPACE web_route_fn web_route_find ( char *name );
+MEMSPACE int web_token_add ( char *name , web_token_fn fn );
+MEMSPACE uint32_t web_token_hash ( void );
+MEMSPACE int cgi_token_id ( char *src );
+MEMSPACE int cgi_token_write ( rwbuf_t *p , int id );
+
+#endif	/* end of __ROUTE_H__ */
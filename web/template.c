@@ -0,0 +1,397 @@
+/**
+ @file template.c
+
+ @brief Precompiled CGI token templates for the esp8266 web server
+  HTML and text pages are compiled once, on first access, into a
+  sidecar file (name.tpl) holding a segment table of literal byte
+  ranges and CGI token ids.
+  Serving a page is then a single sequential read of the source file:
+  stream each literal range, call the token handler for each token.
+  No scanning for "@_" and no seeking back to re-read the file.
+  The sidecar is rebuilt when the source size or mtime changes, or
+  when a token is no longer at the offset the sidecar recorded.
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "user_config.h"
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "web/web.h"
+#include "web/template.h"
+#include "web/route.h"
+
+// =======================================================
+/**
+  @brief Make the sidecar file name for a template
+  @param[in] *name: source file name
+  @param[out] *buf: sidecar name result
+  @param[in] max: size of buf
+  @return buf or NULL if name is too long
+*/
+MEMSPACE
+char *tpl_name(char *name, char *buf, int max)
+{
+	int len = strlen(name);
+
+	if(len + (int) sizeof(TPL_EXT) > max)
+		return(NULL);
+	strcpy(buf, name);
+	strcpy(buf+len, TPL_EXT);
+	return(buf);
+}
+
+/**
+  @brief Write a segment to the sidecar
+  Literal runs longer than TPL_SEG_MAX are split
+  @param[in] *t: template compiler state
+  @param[in] offset: offset in source file
+  @param[in] length: length in source file
+  @param[in] token: CGI token id or TPL_LITERAL
+  @return 1 on success, 0 on write error
+*/
+MEMSPACE
+static int tpl_seg(tpl_t *t, uint32_t offset, uint32_t length, int token)
+{
+	tpl_seg_t seg;
+
+	while(length)
+	{
+		seg.offset = offset;
+		seg.length = (length > TPL_SEG_MAX) ? TPL_SEG_MAX : length;
+		seg.token = token;
+		seg.pad = 0;
+		if(fwrite(&seg, 1, sizeof(seg), t->fo) != sizeof(seg))
+			return(0);
+		t->head.count++;
+		if(token != TPL_LITERAL)
+			t->head.tokens++;
+		offset += seg.length;
+		length -= seg.length;
+	}
+	return(1);
+}
+
+/**
+  @brief Template compiler - scan one byte of the source file
+  CGI tokens have the following syntax @_example123_@
+  This is the stream form of find_cgitoken_start() and is_cgitoken()
+  so tokens split across read buffers are found
+  @param[in] *t: template compiler state
+  @param[in] c: character
+  @param[in] offset: offset of c in source file
+  @return 1 on success, 0 on write error
+*/
+MEMSPACE
+static int tpl_scan(tpl_t *t, int c, uint32_t offset)
+{
+	// state 2: inside token body
+	if(t->state == 2)
+	{
+		if(is_cgitoken_char(c) && t->toklen < CGI_TOKEN_SIZE)
+		{
+			t->tokbuf[t->toklen++] = c;
+			// End of Token
+			if(t->toklen >= 4 && t->tokbuf[t->toklen-2] == '_' && c == '@')
+			{
+				t->tokbuf[t->toklen] = 0;
+				t->state = 0;
+				if(!tpl_seg(t, t->lit_start, t->tok_start - t->lit_start, TPL_LITERAL))
+					return(0);
+				if(!tpl_seg(t, t->tok_start, t->toklen, cgi_token_id(t->tokbuf)))
+					return(0);
+				t->lit_start = offset + 1;
+#if WEB_DEBUG & 8
+				printf("tpl_scan: token %s @ %ld\n", t->tokbuf, (long) t->tok_start);
+#endif
+			}
+			return(1);
+		}
+		// Not a token - it stays in the literal run
+		t->state = 0;
+	}
+	// state 1: seen '@'
+	if(t->state == 1)
+	{
+		if(c == '_')
+		{
+			t->tokbuf[0] = '@';
+			t->tokbuf[1] = '_';
+			t->toklen = 2;
+			t->state = 2;
+			return(1);
+		}
+		t->state = 0;
+	}
+	if(c == '@')
+	{
+		t->tok_start = offset;
+		t->state = 1;
+	}
+	return(1);
+}
+
+/**
+  @brief Compile a template into its sidecar file
+  @param[in] *name: source file name
+  @param[in] *sp: stat of the source file
+  @return 1 on success, 0 on error
+*/
+MEMSPACE
+int tpl_compile(char *name, struct stat *sp)
+{
+	FILE *fi;
+	tpl_t *t;
+	uint32_t offset;
+	int i,len;
+	int ret = 0;
+	char tname[MAX_NAME_LEN+4];
+	char buff[READBUFFSIZE];
+
+	if(!tpl_name(name, tname, sizeof(tname)))
+		return(0);
+
+	t = safecalloc(sizeof(tpl_t),1);
+	if(!t)
+		return(0);
+
+	fi = fopen(name,"r");
+	if(!fi)
+	{
+		safefree(t);
+		return(0);
+	}
+
+	t->fo = fopen(tname,"w");
+	if(!t->fo)
+	{
+#if WEB_DEBUG & 1
+		printf("tpl_compile: can not create %s\n", tname);
+#endif
+		fclose(fi);
+		safefree(t);
+		return(0);
+	}
+
+	t->head.magic = TPL_MAGIC;
+	t->head.size = sp->st_size;
+	t->head.mtime = sp->st_mtime;
+	t->head.count = 0;
+	t->head.tokens = 0;
+	t->head.hash = web_token_hash();
+
+	// Room for the header, rewritten when we know the count
+	if(fwrite(&t->head, 1, sizeof(tpl_head_t), t->fo) != sizeof(tpl_head_t))
+		goto done;
+
+	offset = 0;
+	while( (len = fread(buff, 1, sizeof(buff), fi)) > 0 )
+	{
+		for(i=0;i<len;++i)
+		{
+			if(!tpl_scan(t, 0xff & buff[i], offset+i))
+				goto done;
+		}
+		offset += len;
+		optimistic_yield(1000);
+	}
+
+	// Literal data after the last token
+	if(!tpl_seg(t, t->lit_start, offset - t->lit_start, TPL_LITERAL))
+		goto done;
+
+	if(fseek(t->fo, 0L, SEEK_SET) < 0)
+		goto done;
+	if(fwrite(&t->head, 1, sizeof(tpl_head_t), t->fo) != sizeof(tpl_head_t))
+		goto done;
+	ret = 1;
+
+#if WEB_DEBUG & 8
+	printf("tpl_compile: %s, size:%ld, segments:%d, tokens:%d\n",
+		name, (long) offset, (int) t->head.count, (int) t->head.tokens);
+#endif
+
+done:
+	fclose(t->fo);
+	fclose(fi);
+	if(!ret)
+	{
+#if WEB_DEBUG & 1
+		printf("tpl_compile: %s write failed\n", tname);
+#endif
+		unlink(tname);
+	}
+	safefree(t);
+	return(ret);
+}
+
+/**
+  @brief Check the token segments of a sidecar against the source file
+  FatFs keeps mtime to 2 seconds, so an edit that keeps the file size
+  can leave both size and mtime unchanged. Literal ranges are always read
+  from the source, it is only a moved or changed token that would send
+  the wrong bytes, so each token is read back at its recorded offset.
+  A token added to literal text by such an edit is sent unexpanded.
+  @param[in] *name: source file name
+  @param[in] *ft: sidecar positioned at the first segment
+  @param[in] *head: sidecar header
+  @return 1 if every token matches, 0 if not
+*/
+MEMSPACE
+static int tpl_verify(char *name, FILE *ft, tpl_head_t *head)
+{
+	FILE *fi;
+	tpl_seg_t seg;
+	int i;
+	int ret = 0;
+	char tok[CGI_TOKEN_SIZE+4];
+
+	if(!head->tokens)
+		return(1);
+
+	fi = fopen(name,"r");
+	if(!fi)
+		return(0);
+
+	for(i=0;i<head->count;++i)
+	{
+		if(fread(&seg, 1, sizeof(seg), ft) != sizeof(seg))
+			goto done;
+		if(seg.token == TPL_LITERAL)
+			continue;
+		if(seg.length < 4 || seg.length > CGI_TOKEN_SIZE)
+			goto done;
+		if(fseek(fi, seg.offset, SEEK_SET) < 0)
+			goto done;
+		if(fread(tok, 1, seg.length, fi) != seg.length)
+			goto done;
+		tok[seg.length] = 0;
+		if(tok[0] != '@' || tok[1] != '_' || tok[seg.length-2] != '_' || tok[seg.length-1] != '@')
+			goto done;
+		if(cgi_token_id(tok) != seg.token)
+			goto done;
+	}
+	ret = 1;
+
+done:
+	fclose(fi);
+#if WEB_DEBUG & 8
+	if(!ret)
+		printf("tpl_verify: %s tokens moved, rebuilding\n", name);
+#endif
+	// Back to the first segment
+	if(ret && fseek(ft, (long) sizeof(tpl_head_t), SEEK_SET) < 0)
+		ret = 0;
+	return(ret);
+}
+
+/**
+  @brief Open the sidecar for a template - compile it if missing or stale
+  @param[in] *name: source file name
+  @param[in] *sp: stat of the source file
+  @param[out] *head: sidecar header
+  @return FILE pointer positioned at the first segment or NULL
+*/
+MEMSPACE
+FILE *tpl_open(char *name, struct stat *sp, tpl_head_t *head)
+{
+	FILE *ft;
+	int pass;
+	char tname[MAX_NAME_LEN+4];
+
+	if(!tpl_name(name, tname, sizeof(tname)))
+		return(NULL);
+
+	for(pass = 0; pass < 2; ++pass)
+	{
+		ft = fopen(tname,"r");
+		if(ft)
+		{
+			if(fread(head, 1, sizeof(tpl_head_t), ft) == sizeof(tpl_head_t)
+				&& head->magic == TPL_MAGIC
+				&& head->size == sp->st_size
+				&& head->mtime == sp->st_mtime
+				&& head->hash == web_token_hash()
+				&& tpl_verify(name, ft, head))
+			{
+				return(ft);
+			}
+			fclose(ft);
+		}
+		if(pass || !tpl_compile(name, sp))
+			break;
+	}
+	return(NULL);
+}
+
+/**
+  @brief Send the next part of a compiled template
+  Literal ranges are read from the source file directly into the
+  socket write buffer until it is full, each token segment calls
+  the CGI token handler
+  Called by web_task once per socket buffer
+  @param[in] *p: rwbuf_t pointer to socket buffer
+   p->fi: source file
+   p->ft: sidecar positioned at the next segment
+   p->tpl_segs: segments left in the sidecar
+   p->tpl_left: bytes left in the current literal segment
+  @return 1 if there is more to send, 0 when done, -1 on error
+*/
+MEMSPACE
+int tpl_send_chunk(rwbuf_t *p)
+{
+	tpl_seg_t seg;
+	int size;
+
+	while(p->wind < p->wsize)
+	{
+		if(!p->tpl_left)
+		{
+			if(!p->tpl_segs)
+				return(0);
+			if(fread(&seg, 1, sizeof(seg), p->ft) != sizeof(seg))
+				return(-1);
+			p->tpl_segs--;
+			p->sd_read += sizeof(seg);
+
+			if(seg.token != TPL_LITERAL)
+			{
+				// Token text is skipped, never sent or read
+				if(fseek(p->fi, seg.offset + seg.length, SEEK_SET) < 0)
+					return(-1);
+				cgi_token_write(p, seg.token);
+				continue;
+			}
+			p->tpl_left = seg.length;
+		}
+
+		size = p->wsize - p->wind;
+		if(size > p->tpl_left)
+			size = p->tpl_left;
+		size = fread(p->wbuf + p->wind, 1, size, p->fi);
+		if(size <= 0)
+			return(-1);
+		p->wind += size;
+		p->tpl_left -= size;
+		p->sd_read += size;
+	}
+	return(1);
+}
@@ -0,0 +1,78 @@
+/**
+ @file template.h
+
+ @brief Precompiled CGI token templates for the esp8266 web server
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef	__TEMPLATE_H__
+#define	__TEMPLATE_H__
+
+/// @brief sidecar file name extension, index.html -> index.html.tpl
+#define TPL_EXT ".tpl"
+/// @brief sidecar file magic number "TPL2"
+#define TPL_MAGIC 0x324c5054UL
+/// @brief largest literal run stored in one segment
+#define TPL_SEG_MAX 0xffffU
+
+/// @brief segment token id for literal data
+#define TPL_LITERAL 0xff
+
+// =======================================================
+/// @brief Sidecar header
+/// size and mtime must match the source file or the sidecar is rebuilt
+/// and so must the token text at each token segment, see tpl_verify()
+/// hash must match the registered CGI tokens, see web_token_hash()
+typedef struct {
+	uint32_t magic;		// TPL_MAGIC
+	uint32_t size;		// source file size
+	uint32_t mtime;		// source file modification time
+	uint32_t hash;		// web_token_hash() when compiled
+	uint16_t count;		// number of segments that follow
+	uint16_t tokens;	// number of token segments
+} tpl_head_t;
+
+/// @brief Sidecar segment
+/// Segments are stored in file order and cover the whole source file
+typedef struct {
+	uint32_t offset;	// offset in source file
+	uint16_t length;	// bytes in source file
+	uint8_t token;		// CGI token id or TPL_LITERAL
+	uint8_t pad;
+} tpl_seg_t;
+
+/// @brief Template compiler state
+typedef struct {
+	FILE *fo;			// sidecar being written
+	tpl_head_t head;
+	uint32_t lit_start;	// start of current literal run
+	uint32_t tok_start;	// start of current token candidate
+	int state;			// token scanner state
+	int toklen;
+	char tokbuf[CGI_TOKEN_SIZE+4];
+} tpl_t;
+
+// ============================================================
+/* template.c */
+MEMSPACE char *tpl_name ( char *name , char *buf , int max );
+MEMSPACE int tpl_compile ( char *name , struct stat *sp );
+MEMSPACE FILE *tpl_open ( char *name , struct stat *sp , tpl_head_t *head );
+MEMSPACE int tpl_send_chunk ( rwbuf_t *p );
+
+#endif	/* end of __TEMPLATE_H__ */
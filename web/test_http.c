@@ -0,0 +1,343 @@
+/**
+ @file test_http.c
+
+ @brief Host tests and benchmark for the HTTP request parser
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// only used when testing standalone on linux
+#ifdef HTTP_TEST
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <time.h>
+
+#define MEMSPACE
+#include "web/http_parse.h"
+#include "lib/testsup.h"
+
+/// @brief captured requests
+char *requests[] = {
+	"GET / HTTP/1.1\r\n"
+	"Host: 192.168.200.116\r\n"
+	"Connection: keep-alive\r\n"
+	"Cache-Control: max-age=0\r\n"
+	"Upgrade-Insecure-Requests: 1\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/56.0.2924.87 Safari/537.36\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,*/*;q=0.8\r\n"
+	"DNT: 1\r\n"
+	"Accept-Encoding: gzip, deflate, sdch\r\n"
+	"Accept-Language: en-US,en;q=0.8\r\n"
+	"\r\n",
+
+	"GET /led.cgi?led0=on HTTP/1.1\r\n"
+	"Host: 192.168.200.116\r\n"
+	"Connection: keep-alive\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:51.0) Gecko/20100101 Firefox/51.0\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+	"Accept-Language: en-US,en;q=0.5\r\n"
+	"Accept-Encoding: gzip, deflate\r\n"
+	"Referer: http://192.168.200.116/dout.htm\r\n"
+	"If-None-Match: \"58a3c1d2-1f4\"\r\n"
+	"If-Modified-Since: Wed, 15 Feb 2017 02:47:14 GMT\r\n"
+	"\r\n",
+
+	"POST /msg.cgi HTTP/1.1\r\n"
+	"Host: 192.168.200.116\r\n"
+	"Content-Type: application/x-www-form-urlencoded\r\n"
+	"Content-Length: 75\r\n"
+	"Connection: close\r\n"
+	"\r\n"
+	"title=Mike+Gore&contact=x%40y.com&location=Lab&return=Soon%21&return_other=",
+
+	"HEAD /readme.html HTTP/1.0\n"
+	"user-agent: curl/7.47.0\n"
+	"accept: */*\n"
+	"\n",
+
+	"GET /ws HTTP/1.1\r\n"
+	"Host: 192.168.200.116\r\n"
+	"Upgrade: websocket\r\n"
+	"Connection: Upgrade\r\n"
+	"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+	"Sec-WebSocket-Version: 13\r\n"
+	"\r\n",
+};
+#define REQUESTS (int)(sizeof(requests)/sizeof(char *))
+
+/// @brief compare a string result, NULL must match NULL
+int same(char *a, char *b)
+{
+	if(!a || !b)
+		return(a == b);
+	return(strcmp(a,b) == 0);
+}
+
+/// @brief parse a copy of a request, buf[len] writable like rbuf
+int parse(hinfo_t *hi, char *str, char *buf)
+{
+	int len = strlen(str);
+	memcpy(buf, str, len);
+	buf[len] = 0;
+	return(http_parse(hi, buf, len));
+}
+
+/// @brief known answers for the captured requests
+void test_requests()
+{
+	hinfo_t hi;
+	char buf[1024];
+
+	CHECK(parse(&hi, requests[0], buf) == 1);
+	CHECK(hi.type == TOKEN_GET);
+	CHECK(same(hi.filename, "/"));
+	CHECK(same(hi.html_encoding, "HTTP/1.1"));
+	CHECK(same(hi.connection, "keep-alive"));
+	CHECK(same(hi.accept_encoding, "gzip, deflate, sdch"));
+	CHECK(hi.args == NULL);
+
+	CHECK(parse(&hi, requests[1], buf) == 1);
+	CHECK(same(hi.filename, "/led.cgi"));
+	CHECK(same(http_value(&hi, "led0"), "on"));
+	CHECK(same(http_value(&hi, "LED0"), "on"));
+	CHECK(http_value(&hi, "led1") == NULL);
+	CHECK(same(hi.if_none_match, "\"58a3c1d2-1f4\""));
+	CHECK(same(hi.if_modified_since, "Wed, 15 Feb 2017 02:47:14 GMT"));
+
+	CHECK(parse(&hi, requests[2], buf) == 1);
+	CHECK(hi.type == TOKEN_POST);
+	CHECK(hi.content_length == 75);
+	CHECK(same(hi.content_type, "application/x-www-form-urlencoded"));
+	CHECK(same(hi.connection, "close"));
+	CHECK(same(http_value(&hi, "title"), "Mike Gore"));
+	CHECK(same(http_value(&hi, "contact"), "x@y.com"));
+	CHECK(same(http_value(&hi, "return"), "Soon!"));
+	CHECK(same(http_value(&hi, "return_other"), ""));
+
+	CHECK(parse(&hi, requests[3], buf) == 1);
+	CHECK(hi.type == TOKEN_HEAD);
+	CHECK(same(hi.filename, "/readme.html"));
+	CHECK(same(hi.html_encoding, "HTTP/1.0"));
+
+	CHECK(parse(&hi, requests[4], buf) == 1);
+	CHECK(same(hi.filename, "/ws"));
+	CHECK(same(hi.upgrade, "websocket"));
+	CHECK(same(hi.connection, "Upgrade"));
+	CHECK(same(hi.ws_key, "dGhlIHNhbXBsZSBub25jZQ=="));
+	CHECK(same(hi.ws_version, "13"));
+
+	// Odd but legal forms
+	CHECK(parse(&hi, "GET /a?x=%4a%4B+%zz&y HTTP/1.1\r\nHost:   h   \r\n\r\n", buf) == 1);
+	CHECK(same(hi.filename, "/a"));
+	CHECK(same(http_value(&hi, "x"), "JK  "));
+	CHECK(http_value(&hi, "y") == NULL);
+	CHECK(parse(&hi, "GET /x\r\n\r\n", buf) == 1);
+	CHECK(same(hi.filename, "/x"));
+	CHECK(hi.html_encoding == NULL);
+	CHECK(parse(&hi, "GET /x HTTP/1.1\r\nConnection:close", buf) == 1);
+	CHECK(same(hi.connection, "close"));
+	CHECK(parse(&hi, "GET /x HTTP/1.1\r\nbad header\r\nConnection: close\r\n\r\n", buf) == 1);
+	CHECK(same(hi.connection, "close"));
+
+	// Not understood
+	CHECK(parse(&hi, "BREW /pot HTTP/1.1\r\n\r\n", buf) == 0);
+	CHECK(parse(&hi, "GETS / HTTP/1.1\r\n\r\n", buf) == 0);
+	CHECK(parse(&hi, "\r\n", buf) == 0);
+
+	// Name lookup agrees with the table for every entry
+	{
+		int i,len;
+		char *name;
+		for(i=0; msg_headers[i].pattern; ++i)
+		{
+			name = msg_headers[i].pattern;
+			len = strlen(name);
+			if(name[len-1] == ':')
+				CHECK(http_header_id(name, len-1) == i);
+			else
+				CHECK(http_method_id(name, len) == i);
+		}
+		CHECK(http_header_id("Accept-Encodinx", 15) == -1);
+		CHECK(http_header_id("Upgrade-Insecure-Requests", 25) == -1);
+	}
+}
+
+/// @brief find where each pipelined request ends
+void test_header_len()
+{
+	char buf[1024];
+	char *get = "GET / HTTP/1.1\r\nHost: h\r\n\r\n";
+	char *post = "POST /msg.cgi HTTP/1.1\r\ncontent-length: 7\r\n\r\ntitle=x";
+	long body;
+	int len,n;
+
+	// Back to back requests, only the first one is measured
+	len = strlen(get);
+	snprintf(buf, sizeof(buf), "%s%s", get, get);
+	CHECK(http_header_len(buf, strlen(buf), &body) == len);
+	CHECK(body == 0);
+
+	// The body follows the headers, then the next request
+	snprintf(buf, sizeof(buf), "%s%s", post, get);
+	len = strstr(post, "\r\n\r\n") - post + 4;
+	CHECK(http_header_len(buf, strlen(buf), &body) == len);
+	CHECK(body == 7);
+	CHECK(http_header_len(buf + len + body, strlen(get), &body) == strlen(get));
+	CHECK(body == 0);
+
+	// Bare LF line endings
+	CHECK(http_header_len("GET / HTTP/1.0\n\nGET", 19, &body) == 16);
+
+	// Incomplete headers, at every split point
+	len = strlen(get);
+	for(n=0; n<len; ++n)
+		CHECK(http_header_len(get, n, &body) == 0);
+	CHECK(http_header_len(get, len, &body) == len);
+}
+
+/// @brief parse every prefix and random mutations of the captured requests
+/// Each buffer is allocated with exactly len+1 bytes so a run under
+/// valgrind or -fsanitize=address finds any access past the end
+void test_fuzz(int count)
+{
+	hinfo_t hi;
+	char *buf;
+	int i,r,n,len,pos;
+	static char chars[] = " \r\n:?=&%+@_aZ09\t";
+
+	srand(1);
+	for(r=0; r<REQUESTS; ++r)
+	{
+		len = strlen(requests[r]);
+		for(n=0; n<=len; ++n)
+		{
+			buf = malloc(n + 1);
+			memcpy(buf, requests[r], n);
+			buf[n] = 0;
+			(void) http_parse(&hi, buf, n);
+			free(buf);
+		}
+	}
+	for(i=0; i<count; ++i)
+	{
+		r = rand() % REQUESTS;
+		len = strlen(requests[r]);
+		buf = malloc(len + 1);
+		memcpy(buf, requests[r], len);
+		buf[len] = 0;
+		for(n = 1 + rand() % 8; n; --n)
+		{
+			pos = rand() % len;
+			if(rand() & 1)
+				buf[pos] = chars[rand() % (sizeof(chars)-1)];
+			else
+				buf[pos] = rand();
+		}
+		if(http_parse(&hi, buf, len))
+		{
+			// Every pointer must be inside the buffer
+			CHECK(!hi.filename || (hi.filename >= buf && hi.filename <= buf + len));
+			CHECK(!hi.args || (hi.args >= buf && hi.args + hi.args_length <= buf + len));
+			(void) http_value(&hi, "title");
+		}
+		free(buf);
+	}
+}
+
+/// @brief old style lookup, compare each pattern in turn
+int linear_header_id(char *str)
+{
+	int i;
+	for(i=0; msg_headers[i].pattern; ++i)
+	{
+		if(strncasecmp(str, msg_headers[i].pattern, strlen(msg_headers[i].pattern)) == 0)
+			return(i);
+	}
+	return(-1);
+}
+
+/// @brief seconds between two clock values
+double elapsed(struct timespec *t0, struct timespec *t1)
+{
+	return((t1->tv_sec - t0->tv_sec) + (t1->tv_nsec - t0->tv_nsec) / 1e9);
+}
+
+/// @brief parser throughput on the captured requests
+void bench(int loops)
+{
+	hinfo_t hi;
+	char buf[1024];
+	int i,r,len;
+	long bytes = 0;
+	volatile int sink = 0;
+	struct timespec t0,t1;
+	double t;
+	static char *names[] = {
+		"Host: x", "Connection: x", "Accept-Language: x",
+		"If-Modified-Since: x", "Upgrade-Insecure-Requests: x"
+	};
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for(i=0; i<loops; ++i)
+	{
+		for(r=0; r<REQUESTS; ++r)
+		{
+			len = strlen(requests[r]);
+			memcpy(buf, requests[r], len + 1);
+			sink += http_parse(&hi, buf, len);
+			bytes += len;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	t = elapsed(&t0, &t1);
+	printf("http_parse: %d requests, %.1f MB/s, %.0f ns/request\n",
+		loops * REQUESTS, bytes / t / 1e6, t * 1e9 / (loops * REQUESTS));
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for(i=0; i<loops; ++i)
+		for(r=0; r<5; ++r)
+			sink += http_header_id(names[r], strchr(names[r],':') - names[r]);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	printf("http_header_id: %.1f ns/lookup\n", elapsed(&t0, &t1) * 1e9 / (loops * 5));
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for(i=0; i<loops; ++i)
+		for(r=0; r<5; ++r)
+			sink += linear_header_id(names[r]);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	printf("linear search: %.1f ns/lookup\n", elapsed(&t0, &t1) * 1e9 / (loops * 5));
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+
+	test_requests();
+	test_header_len();
+	test_fuzz(100000);
+	ret = test_result();
+	if(!ret && argc > 1 && strcmp(argv[1], "bench") == 0)
+		bench(200000);
+	return(ret);
+}
+
+#endif
@@ -0,0 +1,1503 @@
+/**
+ @file test_web.c
+
+ @brief Host tests for the web server with simulated clients
+ A stub espconn layer stands in for the SDK network stack and web_task()
+ is run the way the main loop runs it. Each simulated client records all
+ the server sends, so the responses can be parsed and checked.
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// only used when testing standalone on linux
+#ifdef WEB_TEST
+
+#include "user_config.h"
+#include <utime.h>
+#include "display/ili9341.h"
+#include "web/web.h"
+#include "web/route.h"
+#include "web/websocket.h"
+#include "lib/testsup.h"
+
+// ==========================================================
+// SDK and system stubs
+
+/// @brief Simulated time in microseconds
+uint32_t now_us = 1000000;
+
+/// @brief Free heap reported to the connect callback
+uint32_t heap_free = 30000;
+
+window *wintop, *winmsg;
+
+/// @brief Open connections, counted by web_task()
+extern int connections;
+
+uint32_t system_get_time(void)
+{
+	return(now_us);
+}
+
+uint32_t system_get_free_heap_size(void)
+{
+	return(heap_free);
+}
+
+char *tm_wday_to_ascii(int i)
+{
+	static char *days[] = { "Sun","Mon","Tue","Wed","Thu","Fri","Sat" };
+	return(days[i % 7]);
+}
+
+char *tm_mon_to_ascii(int i)
+{
+	static char *months[] = { "Jan","Feb","Mar","Apr","May","Jun",
+		"Jul","Aug","Sep","Oct","Nov","Dec" };
+	return(months[i % 12]);
+}
+
+int is_dst(time_t t)
+{
+	return(0);
+}
+
+void esp_schedule(void)
+{
+}
+
+// esp8266/system.c
+/// @brief safemalloc() fails while this is set
+int fail_malloc;
+
+void *web_safemalloc(size_t size)
+{
+	if(fail_malloc)
+		return(NULL);
+	return(calloc(size, 1));
+}
+
+// posix/posix.c - file names are relative to the SD card root
+FILE *web_fopen(const char *name, const char *mode)
+{
+	while(*name == '/')
+		++name;
+	return((fopen)(name, mode));
+}
+
+int web_stat(const char *name, struct stat *sp)
+{
+	while(*name == '/')
+		++name;
+	return((stat)(name, sp));
+}
+
+int web_unlink(const char *name)
+{
+	while(*name == '/')
+		++name;
+	return((unlink)(name));
+}
+
+// ==========================================================
+// Simulated network
+
+/// @brief Largest TCP segment delivered to the receive callback
+#define TCP_MSS 1460
+#define CLIENTS 8
+#define CLIENT_OUT (64 * 1024)
+
+typedef struct {
+	struct espconn conn;
+	esp_tcp tcp;
+	int used;
+	char in[8192];		// data waiting to be received by the server
+	int inlen, inoff;
+	char out[CLIENT_OUT+1];	// everything the server sent
+	int outlen, outoff;
+	int sending;		// a send is waiting for its sent callback
+	int sends;			// espconn_send() calls
+	int busy;			// espconn_send() calls while a send was outstanding
+	int closing;		// espconn_disconnect() was called
+	int closed;
+	int held;			// receive is on hold
+	int holds;			// espconn_recv_hold() calls
+} client_t;
+
+client_t clients[CLIENTS];
+
+/// @brief Listener connect callback registered by web_init()
+espconn_connect_callback web_accept;
+
+/// @brief Client index of every espconn_send() in order
+int send_log[4096];
+int sends;
+
+client_t *client_find(struct espconn *conn)
+{
+	int i;
+	for(i = 0; i < CLIENTS; ++i)
+	{
+		if(clients[i].used && conn == &clients[i].conn)
+			return(&clients[i]);
+	}
+	return(NULL);
+}
+
+int8_t espconn_send(struct espconn *conn, uint8_t *data, uint16_t len)
+{
+	client_t *c = client_find(conn);
+
+	if(!c || c->closed)
+		return(ESPCONN_ARG);
+	// The SDK allows one send at a time per connection
+	if(c->sending)
+	{
+		++c->busy;
+		return(ESPCONN_MAXNUM);
+	}
+	if(c->outlen + len > CLIENT_OUT)
+		return(ESPCONN_MEM);
+	memcpy(c->out + c->outlen, data, len);
+	c->outlen += len;
+	c->sending = 1;
+	++c->sends;
+	if(sends < (int) (sizeof(send_log) / sizeof(int)))
+		send_log[sends++] = c - clients;
+	return(0);
+}
+
+int8_t espconn_disconnect(struct espconn *conn)
+{
+	client_t *c = client_find(conn);
+	if(c)
+		c->closing = 1;
+	return(0);
+}
+
+int8_t espconn_accept(struct espconn *conn)
+{
+	return(0);
+}
+
+/// @brief Connections the SDK accepts, more are refused before the connect callback
+int max_con = 5;
+
+int8_t espconn_tcp_set_max_con_allow(struct espconn *conn, uint8_t num)
+{
+	max_con = num;
+	return(0);
+}
+
+int8_t espconn_tcp_get_max_con_allow(struct espconn *conn)
+{
+	return(max_con);
+}
+
+int8_t espconn_regist_connectcb(struct espconn *conn, espconn_connect_callback fn)
+{
+	if(client_find(conn))
+		conn->proto.tcp->connect_callback = fn;
+	else
+		web_accept = fn;
+	return(0);
+}
+
+int8_t espconn_regist_recvcb(struct espconn *conn, espconn_recv_callback fn)
+{
+	conn->recv_callback = fn;
+	return(0);
+}
+
+int8_t espconn_regist_sentcb(struct espconn *conn, espconn_sent_callback fn)
+{
+	conn->sent_callback = fn;
+	return(0);
+}
+
+int8_t espconn_regist_disconcb(struct espconn *conn, espconn_connect_callback fn)
+{
+	conn->proto.tcp->disconnect_callback = fn;
+	return(0);
+}
+
+int8_t espconn_regist_reconcb(struct espconn *conn, espconn_reconnect_callback fn)
+{
+	conn->proto.tcp->reconnect_callback = fn;
+	return(0);
+}
+
+int8_t espconn_recv_hold(struct espconn *conn)
+{
+	client_t *c = client_find(conn);
+	if(c)
+	{
+		c->held = 1;
+		++c->holds;
+	}
+	return(0);
+}
+
+int8_t espconn_recv_unhold(struct espconn *conn)
+{
+	client_t *c = client_find(conn);
+	if(c)
+		c->held = 0;
+	return(0);
+}
+
+/**
+  @brief Acknowledge sends and deliver disconnects, like the SDK does
+  between calls to the main task
+*/
+void net_sent(void)
+{
+	client_t *c;
+	int i;
+
+	for(i = 0; i < CLIENTS; ++i)
+	{
+		c = &clients[i];
+		if(!c->used || c->closed)
+			continue;
+		if(c->sending)
+		{
+			c->sending = 0;
+			if(c->conn.sent_callback)
+				c->conn.sent_callback(&c->conn);
+		}
+		if(c->closing)
+		{
+			c->closed = 1;
+			if(c->tcp.disconnect_callback)
+				c->tcp.disconnect_callback(&c->conn);
+		}
+	}
+}
+
+/// @brief Deliver one TCP segment of waiting data to each client connection
+void net_recv(void)
+{
+	client_t *c;
+	int i, len;
+
+	for(i = 0; i < CLIENTS; ++i)
+	{
+		c = &clients[i];
+		if(!c->used || c->closed || c->held || c->inoff >= c->inlen)
+			continue;
+		len = c->inlen - c->inoff;
+		if(len > TCP_MSS)
+			len = TCP_MSS;
+		c->conn.recv_callback(&c->conn, c->in + c->inoff, len);
+		c->inoff += len;
+	}
+}
+
+/// @brief wait_send() gives the network a chance to send
+uint32_t sched_wait(uint32_t events, uint32_t timeout)
+{
+	now_us += 100;
+	net_sent();
+	return(SCHED_EV_POST);
+}
+
+/**
+  @brief Run the main loop
+  @param[in] passes: number of times web_task() is called
+*/
+void run(int passes)
+{
+	while(passes--)
+	{
+		net_recv();
+		web_task();
+		net_sent();
+		now_us += 1000;
+	}
+}
+
+/**
+  @brief Connect a new client
+  @param[in] port: client port, makes the connection unique
+  @return client
+*/
+client_t *client_connect(int port)
+{
+	static const uint8_t ip[4] = { 192, 168, 200, 10 };
+	static const uint8_t local[4] = { 192, 168, 200, 116 };
+	client_t *c;
+	int i, open = 0;
+
+	for(i = 0; i < CLIENTS; ++i)
+	{
+		if(clients[i].used && !clients[i].closed)
+			++open;
+	}
+	for(i = 0; i < CLIENTS; ++i)
+	{
+		if(!clients[i].used)
+			break;
+	}
+	if(i == CLIENTS)
+		return(NULL);
+	c = &clients[i];
+	memset(c, 0, sizeof(*c));
+	c->used = 1;
+	c->tcp.remote_port = port;
+	c->tcp.local_port = 80;
+	memcpy(c->tcp.remote_ip, ip, 4);
+	memcpy(c->tcp.local_ip, local, 4);
+	c->conn.type = ESPCONN_TCP;
+	c->conn.proto.tcp = &c->tcp;
+	// Over the SDK limit the server never hears of the connection
+	if(open >= max_con)
+		c->closed = 1;
+	else
+		web_accept(&c->conn);
+	return(c);
+}
+
+/// @brief Queue binary data for the server to receive
+void client_send_len(client_t *c, char *data, int len)
+{
+	if(c->inlen + len > (int) sizeof(c->in))
+	{
+		CHECK(!"client input overflow");
+		return;
+	}
+	memcpy(c->in + c->inlen, data, len);
+	c->inlen += len;
+}
+
+/// @brief Queue a string for the server to receive
+void client_send(client_t *c, char *str)
+{
+	client_send_len(c, str, strlen(str));
+}
+
+/// @brief The client closes the connection
+void client_close(client_t *c)
+{
+	if(!c->closed)
+	{
+		c->closed = 1;
+		if(c->tcp.disconnect_callback)
+			c->tcp.disconnect_callback(&c->conn);
+	}
+}
+
+/// @brief Release all clients, run until the server has let go of them
+void client_reset(void)
+{
+	int i;
+
+	for(i = 0; i < CLIENTS; ++i)
+	{
+		if(clients[i].used)
+			client_close(&clients[i]);
+	}
+	run(2);
+	for(i = 0; i < CLIENTS; ++i)
+		clients[i].used = 0;
+	sends = 0;
+}
+
+// ==========================================================
+// Response parser
+
+#define BODY_MAX (32 * 1024)
+
+typedef struct {
+	int status;
+	int close;			// Connection: close
+	long length;		// Content-Length or -1
+	int chunked;
+	char etag[64];
+	char body[BODY_MAX+1];
+	int bodylen;
+} resp_t;
+
+/**
+  @brief Parse the next response the client received
+  Response headers end lines with "\n", chunks with "\r\n"
+  @param[in] *c: client
+  @param[out] *r: response
+  @param[in] head_only: response to HEAD, the headers are all there is
+  @return 1 if a complete response was parsed, otherwise 0
+*/
+int parse_response(client_t *c, resp_t *r, int head_only)
+{
+	char *ptr = c->out + c->outoff;
+	char *end = c->out + c->outlen;
+	char *head, *line;
+	long len;
+
+	memset(r, 0, sizeof(*r));
+	r->length = -1;
+	*end = 0;
+	head = strstr(ptr, "\n\n");
+	if(!head || strncmp(ptr, "HTTP/1.1 ", 9) != 0)
+		return(0);
+	r->status = atoi(ptr + 9);
+	for(line = ptr; line && line < head; line = strchr(line, '\n') + 1)
+	{
+		if(strncasecmp(line, "Connection: close", 17) == 0)
+			r->close = 1;
+		else if(strncasecmp(line, "Content-Length: ", 16) == 0)
+			r->length = atol(line + 16);
+		else if(strncasecmp(line, "Transfer-Encoding: chunked", 26) == 0)
+			r->chunked = 1;
+		else if(strncasecmp(line, "ETag: ", 6) == 0)
+			sscanf(line + 6, "%63s", r->etag);
+	}
+	ptr = head + 2;
+
+	if(head_only)
+		;
+	else if(r->chunked)
+	{
+		while(1)
+		{
+			if(!strstr(ptr, "\r\n"))
+				return(0);
+			len = strtol(ptr, NULL, 16);
+			ptr = strstr(ptr, "\r\n") + 2;
+			if(ptr + len + 2 > end)
+				return(0);
+			if(len == 0)
+				break;
+			if(r->bodylen + len > BODY_MAX)
+				return(0);
+			memcpy(r->body + r->bodylen, ptr, len);
+			r->bodylen += len;
+			ptr += len;
+			CHECK(ptr[0] == '\r' && ptr[1] == '\n');
+			ptr += 2;
+		}
+		ptr += 2;
+	}
+	else if(r->length >= 0 || r->status == 304)
+	{
+		len = r->length > 0 ? r->length : 0;
+		if(ptr + len > end || len > BODY_MAX)
+			return(0);
+		memcpy(r->body, ptr, len);
+		r->bodylen = len;
+		ptr += len;
+	}
+	else
+	{
+		// The body ends when the server closes the connection
+		if(!c->closing || end - ptr > BODY_MAX)
+			return(0);
+		r->bodylen = end - ptr;
+		memcpy(r->body, ptr, r->bodylen);
+		ptr = end;
+	}
+	r->body[r->bodylen] = 0;
+	c->outoff = ptr - c->out;
+	return(1);
+}
+
+/// @brief Parse the next response
+int response(client_t *c, resp_t *r)
+{
+	return(parse_response(c, r, 0));
+}
+
+/// @brief Parse the next response, to a HEAD request
+int head_response(client_t *c, resp_t *r)
+{
+	return(parse_response(c, r, 1));
+}
+
+/// @brief Nothing more was received
+int no_response(client_t *c)
+{
+	return(c->outoff == c->outlen);
+}
+
+// ==========================================================
+// Test files
+
+#define BIG_SIZE 20000
+#define STYLE_SIZE 3000
+
+char index_html[] = "<html><body>index page</body></html>\n";
+char dout_htm[] = "<html><body>LED</body></html>\n";
+char time_htm[] = "<html><body>@_DATE_@</body></html>\n";
+char msg_cgi[] = "<html><body>Message sent</body></html>\n";
+
+void make_file(char *name, char *data, int len)
+{
+	FILE *fp = fopen(name, "w");
+	CHECK(fp != NULL);
+	if(!fp)
+		return;
+	fwrite(data, 1, len, fp);
+	fclose(fp);
+}
+
+/// @brief Contents of a pattern file, every one is different
+char *pattern(int size, int seed)
+{
+	static char buf[BIG_SIZE];
+	int i;
+	for(i = 0; i < size; ++i)
+		buf[i] = 'a' + (i / 7 + seed) % 26;
+	return(buf);
+}
+
+/// @brief Make the files served by the tests in a temporary directory
+void make_files(void)
+{
+	char dir[] = "/tmp/test_webXXXXXX";
+
+	CHECK(mkdtemp(dir) != NULL);
+	CHECK(chdir(dir) == 0);
+	make_file("index.html", index_html, strlen(index_html));
+	make_file("dout.htm", dout_htm, strlen(dout_htm));
+	make_file("time.htm", time_htm, strlen(time_htm));
+	make_file("msg.cgi", msg_cgi, strlen(msg_cgi));
+	make_file("style.css", pattern(STYLE_SIZE, 0), STYLE_SIZE);
+	make_file("big.css", pattern(BIG_SIZE, 1), BIG_SIZE);
+}
+
+/// @brief Remove the test files
+void remove_files(void)
+{
+	char dir[256];
+	char *names[] = { "index.html", "index.html.tpl", "dout.htm", "dout.htm.tpl",
+		"time.htm", "time.htm.tpl", "msg.cgi", "msg.cgi.tpl",
+		"edit.htm", "edit.htm.tpl", "style.css", "big.css", NULL };
+	int i;
+
+	for(i = 0; names[i]; ++i)
+		unlink(names[i]);
+	if(getcwd(dir, sizeof(dir)))
+	{
+		CHECK(chdir("/") == 0);
+		rmdir(dir);
+	}
+}
+
+// ==========================================================
+// Captured browser requests
+
+#define BROWSER \
+	"Host: 192.168.200.116\r\n" \
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/56.0.2924.87 Safari/537.36\r\n" \
+	"Accept-Language: en-US,en;q=0.8\r\n"
+
+char get_index[] =
+	"GET / HTTP/1.1\r\n"
+	"Connection: keep-alive\r\n"
+	"Cache-Control: max-age=0\r\n"
+	"Upgrade-Insecure-Requests: 1\r\n"
+	BROWSER
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,*/*;q=0.8\r\n"
+	"DNT: 1\r\n"
+	"Accept-Encoding: gzip, deflate, sdch\r\n"
+	"\r\n";
+
+char get_style[] =
+	"GET /style.css HTTP/1.1\r\n"
+	"Connection: keep-alive\r\n"
+	BROWSER
+	"Accept: text/css,*/*;q=0.1\r\n"
+	"Referer: http://192.168.200.116/\r\n"
+	"Accept-Encoding: gzip, deflate, sdch\r\n"
+	"\r\n";
+
+char get_led[] =
+	"GET /led.cgi?led0=on HTTP/1.1\r\n"
+	"Connection: keep-alive\r\n"
+	BROWSER
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+	"Referer: http://192.168.200.116/dout.htm\r\n"
+	"\r\n";
+
+char get_time[] =
+	"GET /timer.cgi HTTP/1.1\r\n"
+	BROWSER
+	"\r\n";
+
+char post_msg[] =
+	"POST /msg.cgi HTTP/1.1\r\n"
+	"Connection: keep-alive\r\n"
+	BROWSER
+	"Content-Type: application/x-www-form-urlencoded\r\n"
+	"Content-Length: 41\r\n"
+	"\r\n"
+	"title=Hello&contact=Mike&location=Offsite";
+
+// ==========================================================
+// Persistent connections and pipelining
+
+/// @brief Replay a browser loading the main page, its style sheet and a CGI
+void test_session(void)
+{
+	client_t *c;
+	resp_t r;
+	char req[512];
+	char etag[64];
+
+	c = client_connect(5001);
+	CHECK(c && c->conn.recv_callback);
+
+	client_send(c, get_index);
+	run(4);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && !r.close);
+	CHECK(r.length == (long) strlen(index_html));
+	CHECK(strcmp(r.body, index_html) == 0);
+	CHECK(r.etag[0] == '"');
+	strcpy(etag, r.etag);
+
+	// The style sheet is bigger than a socket buffer
+	client_send(c, get_style);
+	run(8);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && !r.close && r.length == STYLE_SIZE);
+	CHECK(r.bodylen == STYLE_SIZE && memcmp(r.body, pattern(STYLE_SIZE, 0), STYLE_SIZE) == 0);
+
+	client_send(c, get_led);
+	run(4);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && !r.close && strcmp(r.body, dout_htm) == 0);
+
+	// Status messages from html_msg() have a Content-Length too
+	client_send(c, "GET /missing.htm HTTP/1.1\r\n" BROWSER "\r\n");
+	run(4);
+	CHECK(response(c, &r));
+	CHECK(r.status == 404 && !r.close && r.length == r.bodylen);
+	CHECK(strstr(r.body, "missing.htm not found") != NULL);
+
+	// Reload, the browser has index.html cached
+	snprintf(req, sizeof(req),
+		"GET / HTTP/1.1\r\n" BROWSER "If-None-Match: %s\r\n\r\n", etag);
+	client_send(c, req);
+	run(4);
+	CHECK(response(c, &r));
+	CHECK(r.status == 304 && !r.close && r.bodylen == 0);
+
+	// Templates with CGI tokens are chunked
+	client_send(c, get_time);
+	run(4);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && r.chunked && !r.close);
+	CHECK(strncmp(r.body, "<html><body>Date: ", 18) == 0);
+
+	CHECK(no_response(c) && !c->closing && !c->busy);
+	CHECK(connections == 1);
+	client_reset();
+}
+
+/// @brief Several requests in one segment are answered in order
+void test_pipeline(void)
+{
+	client_t *c;
+	resp_t r;
+	int i;
+
+	c = client_connect(5002);
+	for(i = 0; i < 4; ++i)
+	{
+		client_send(c, get_led);
+		client_send(c, get_index);
+	}
+	// More than rbuf, BUFFER_SIZE, holds so receive is held until there is room
+	CHECK(c->inlen > 1000);
+	run(40);
+	CHECK(c->holds > 0 && !c->held);
+	for(i = 0; i < 4; ++i)
+	{
+		CHECK(response(c, &r));
+		CHECK(r.status == 200 && strcmp(r.body, dout_htm) == 0);
+		CHECK(response(c, &r));
+		CHECK(r.status == 200 && strcmp(r.body, index_html) == 0);
+	}
+	CHECK(no_response(c) && !c->closing && !c->busy);
+
+	// A POST body followed by the next request in the same segment
+	client_send(c, post_msg);
+	client_send(c, get_index);
+	run(8);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && r.chunked && strcmp(r.body, msg_cgi) == 0);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && strcmp(r.body, index_html) == 0);
+	CHECK(no_response(c) && !c->closing);
+	client_reset();
+}
+
+char get_hello[] =
+	"GET /hello.cgi HTTP/1.1\r\n"
+	BROWSER
+	"\r\n";
+
+/// @brief Calls to web_route_hello()
+int hello_calls;
+
+/// @brief CGI route hello.cgi, sends its own response
+char *web_route_hello(rwbuf_t *p, hinfo_t *hi)
+{
+	++hello_calls;
+	html_msg(p, STATUS_OK, PTYPE_HTML, "hello\n");
+	return(NULL);
+}
+
+/// @brief Make a HEAD request from a GET request
+char *head_of(char *get, char *buf)
+{
+	strcpy(buf, "HEAD");
+	strcat(buf, get + 3);
+	return(buf);
+}
+
+/**
+  @brief HEAD gets the headers GET would, with no body
+  Each is followed by a pipelined GET, a body would be read as its response
+  CGI routes change state so HEAD is refused without calling the handler
+*/
+void test_head(void)
+{
+	client_t *c;
+	resp_t r, g;
+	char buf[1024];
+
+	c = client_connect(5010);
+
+	// A file, Content-Length is the file length
+	client_send(c, head_of(get_style, buf));
+	client_send(c, get_style);
+	// A page without CGI tokens
+	client_send(c, head_of(get_index, buf));
+	client_send(c, get_index);
+	// A template, chunked, not even the last chunk is sent
+	client_send(c, "HEAD /time.htm HTTP/1.1\r\n" BROWSER "\r\n");
+	client_send(c, "GET /time.htm HTTP/1.1\r\n" BROWSER "\r\n");
+	// A CGI handler that writes its own response
+	client_send(c, head_of(get_hello, buf));
+	client_send(c, get_index);
+	// A CGI handler that turns on the LED and returns a page
+	client_send(c, head_of(get_led, buf));
+	client_send(c, get_index);
+	hello_calls = 0;
+	run(40);
+
+	CHECK(head_response(c, &r));
+	CHECK(response(c, &g));
+	CHECK(r.status == 200 && r.length == STYLE_SIZE && !r.close);
+	CHECK(g.status == 200 && g.bodylen == STYLE_SIZE && strcmp(r.etag, g.etag) == 0);
+
+	CHECK(head_response(c, &r));
+	CHECK(response(c, &g));
+	CHECK(r.status == 200 && r.length == (long) strlen(index_html));
+	CHECK(g.status == 200 && strcmp(g.body, index_html) == 0);
+
+	CHECK(head_response(c, &r));
+	CHECK(response(c, &g));
+	CHECK(r.status == 200 && r.chunked && !r.close);
+	CHECK(g.status == 200 && g.chunked && g.bodylen > 0);
+
+	CHECK(head_response(c, &r));
+	CHECK(response(c, &g));
+	CHECK(r.status == 405 && r.length == 0 && !r.close);
+	CHECK(g.status == 200 && strcmp(g.body, index_html) == 0);
+	CHECK(hello_calls == 0);
+
+	CHECK(head_response(c, &r));
+	CHECK(response(c, &g));
+	CHECK(r.status == 405 && r.length == 0 && !r.close);
+	CHECK(g.status == 200 && strcmp(g.body, index_html) == 0);
+
+	// GET still runs the handler
+	client_send(c, get_hello);
+	run(4);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && strcmp(r.body, "<html><body>hello\n</html></body>") == 0);
+	CHECK(hello_calls == 1);
+
+	CHECK(no_response(c) && !c->closing);
+	client_reset();
+}
+
+/// @brief Received data that can not be kept closes the connection
+void test_lost(void)
+{
+	client_t *c;
+	int i;
+
+	// More than rbuf in one segment, the rest can not be saved
+	c = client_connect(5011);
+	for(i = 0; i < 4; ++i)
+		client_send(c, get_index);
+	CHECK(c->inlen > 1000);
+	fail_malloc = 1;
+	run(1);
+	fail_malloc = 0;
+	run(4);
+	CHECK(c->closing && c->outlen == 0);
+	client_reset();
+	CHECK(connections == 0);
+
+	// Data received while receive is held
+	c = client_connect(5012);
+	for(i = 0; i < 4; ++i)
+		client_send(c, get_index);
+	net_recv();
+	CHECK(c->held);
+	c->conn.recv_callback(&c->conn, get_index, strlen(get_index));
+	run(4);
+	CHECK(c->closing && c->outlen == 0);
+	client_reset();
+	CHECK(connections == 0);
+}
+
+/// @brief Accept-Encoding values, an explicit gzip entry wins over "*"
+void test_accept_gzip(void)
+{
+	static const struct {
+		char *value;
+		int gzip;
+	} tests[] = {
+		{ "gzip, deflate, sdch", 1 },
+		{ "deflate, GZIP", 1 },
+		{ "deflate", 0 },
+		{ "", 0 },
+		{ "gzip;q=0", 0 },
+		{ "gzip ; q=0.000", 0 },
+		{ "gzip;q=0.001", 1 },
+		{ "gzip;q=1.0", 1 },
+		{ "*", 1 },
+		{ "*;q=0", 0 },
+		{ "*;q=1, gzip;q=0", 0 },
+		{ "gzip;q=0, *", 0 },
+		{ "*;q=0, gzip;q=0.5", 1 },
+		{ "gzip;level=1;q=0", 0 },
+		{ "gzipx, x-gzip", 0 },
+	};
+	int i;
+
+	CHECK(accept_gzip(NULL) == 0);
+	for(i = 0; i < (int) (sizeof(tests) / sizeof(tests[0])); ++i)
+	{
+		if(accept_gzip(tests[i].value) != tests[i].gzip)
+		{
+			printf("FAIL accept_gzip(\"%s\") != %d\n", tests[i].value, tests[i].gzip);
+			++errors;
+		}
+	}
+}
+
+/// @brief If-Modified-Since dates in each format, compared with the file mtime
+void test_if_modified_since(void)
+{
+	static const struct {
+		char *value;
+		time_t t;
+	} dates[] = {
+		{ "Sun, 06 Nov 1994 08:49:37 GMT", 784111777 },
+		{ "Sunday, 06-Nov-94 08:49:37 GMT", 784111777 },
+		{ "Sun Nov  6 08:49:37 1994", 784111777 },
+		{ "sun, 06 nov 1994 08:49:37 gmt", 784111777 },
+		{ "Thursday, 01-Jan-15 00:00:00 GMT", 1420070400 },
+	};
+	static char *bad[] = { "", "yesterday", "Sun, 06 Nov 1994 08:49 GMT",
+		"Sun, 06 Xyz 1994 08:49:37 GMT", "Sun, 06 Nov 1994 08:49:37", NULL };
+	client_t *c;
+	resp_t r;
+	struct stat sp;
+	char req[512], date[HTTP_DATE_SIZE];
+	time_t t;
+	int i;
+
+	for(i = 0; i < (int) (sizeof(dates) / sizeof(dates[0])); ++i)
+	{
+		t = 0;
+		if(!http_date_parse(dates[i].value, &t) || t != dates[i].t)
+		{
+			printf("FAIL http_date_parse(\"%s\") = %ld\n", dates[i].value, (long) t);
+			++errors;
+		}
+	}
+	for(i = 0; bad[i]; ++i)
+	{
+		if(http_date_parse(bad[i], &t))
+		{
+			printf("FAIL http_date_parse(\"%s\") accepted\n", bad[i]);
+			++errors;
+		}
+	}
+
+	CHECK(stat("index.html", &sp) == 0);
+	c = client_connect(5014);
+
+	// The Last-Modified date we sent, and a later date in another format
+	snprintf(req, sizeof(req), "GET / HTTP/1.1\r\nIf-Modified-Since: %s\r\n\r\n",
+		http_date(sp.st_mtime, date));
+	client_send(c, req);
+	t = sp.st_mtime + 3600;
+	strftime(date, sizeof(date), "%a %b %e %H:%M:%S %Y", gmtime(&t));
+	snprintf(req, sizeof(req), "GET / HTTP/1.1\r\nIf-Modified-Since: %s\r\n\r\n", date);
+	client_send(c, req);
+	// Earlier than the file, and a date that can not be parsed
+	snprintf(req, sizeof(req), "GET / HTTP/1.1\r\nIf-Modified-Since: %s\r\n\r\n",
+		http_date(sp.st_mtime - 1, date));
+	client_send(c, req);
+	client_send(c, "GET / HTTP/1.1\r\nIf-Modified-Since: yesterday\r\n\r\n");
+	run(16);
+
+	CHECK(response(c, &r));
+	CHECK(r.status == 304 && r.bodylen == 0);
+	CHECK(response(c, &r));
+	CHECK(r.status == 304 && r.bodylen == 0);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && strcmp(r.body, index_html) == 0);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && strcmp(r.body, index_html) == 0);
+	CHECK(no_response(c));
+	client_reset();
+}
+
+/**
+  @brief An edit that keeps the size and mtime of a template
+  FatFs mtime has a 2 second resolution, the moved token must be found
+*/
+void test_template_edit(void)
+{
+	client_t *c;
+	resp_t r;
+	struct stat sp;
+	struct utimbuf ut;
+	char before[] = "<p>@_DATE_@ and text</p>\n";
+	char after[] = "<p>and text @_DATE_@</p>\n";
+
+	make_file("edit.htm", before, strlen(before));
+	c = client_connect(5013);
+	client_send(c, "GET /edit.htm HTTP/1.1\r\n" BROWSER "\r\n");
+	run(4);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && strncmp(r.body, "<p>Date: ", 9) == 0);
+	CHECK(strstr(r.body, " and text</p>\n") != NULL);
+
+	CHECK(stat("edit.htm", &sp) == 0);
+	make_file("edit.htm", after, strlen(after));
+	ut.actime = sp.st_atime;
+	ut.modtime = sp.st_mtime;
+	CHECK(utime("edit.htm", &ut) == 0);
+
+	client_send(c, "GET /edit.htm HTTP/1.1\r\n" BROWSER "\r\n");
+	run(8);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && strncmp(r.body, "<p>and text Date: ", 18) == 0);
+	CHECK(strstr(r.body, "@_") == NULL);
+	client_reset();
+}
+
+/// @brief A request split across segments is processed once it is complete
+void test_split(void)
+{
+	client_t *c;
+	resp_t r;
+	char part[256];
+	int n = 40;
+
+	c = client_connect(5003);
+	memcpy(part, get_index, n);
+	part[n] = 0;
+	client_send(c, part);
+	run(4);
+	CHECK(no_response(c));
+	client_send(c, get_index + n);
+	run(4);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && strcmp(r.body, index_html) == 0);
+
+	// Headers complete, the POST body arrives later
+	n = strstr(post_msg, "\r\n\r\n") - post_msg + 4 + 10;
+	memcpy(part, post_msg, n);
+	part[n] = 0;
+	client_send(c, part);
+	run(4);
+	CHECK(no_response(c));
+	client_send(c, post_msg + n);
+	run(4);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && strcmp(r.body, msg_cgi) == 0);
+	CHECK(!c->closing);
+	client_reset();
+}
+
+/// @brief When the server closes the connection
+void test_close(void)
+{
+	client_t *c;
+	resp_t r;
+	int i;
+
+	// Connection: close
+	c = client_connect(5004);
+	client_send(c, "GET / HTTP/1.1\r\nConnection: close\r\n\r\n");
+	run(4);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && r.close && strcmp(r.body, index_html) == 0);
+	CHECK(c->closing);
+	client_reset();
+
+	// HTTP/1.0 without keep-alive
+	c = client_connect(5005);
+	client_send(c, "GET / HTTP/1.0\r\n\r\n");
+	run(4);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && r.close && c->closing);
+	client_reset();
+
+	// HTTP/1.0 with keep-alive
+	c = client_connect(5006);
+	client_send(c, "GET / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+	run(4);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && !r.close && !c->closing);
+	client_reset();
+
+	// HTTP/1.0 template with tokens, the body ends at the close
+	c = client_connect(5007);
+	client_send(c, "GET /time.htm HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+	run(4);
+	CHECK(response(c, &r));
+	CHECK(r.status == 200 && r.close && !r.chunked && c->closing);
+	CHECK(strncmp(r.body, "<html><body>Date: ", 18) == 0);
+	client_reset();
+
+	// WEB_KEEPALIVE_MAX requests on one connection
+	c = client_connect(5008);
+	for(i = 0; i < WEB_KEEPALIVE_MAX; ++i)
+		client_send(c, get_led);
+	run(WEB_KEEPALIVE_MAX * 4);
+	for(i = 0; i < WEB_KEEPALIVE_MAX; ++i)
+	{
+		CHECK(response(c, &r));
+		CHECK(r.status == 200 && r.close == (i == WEB_KEEPALIVE_MAX - 1));
+	}
+	CHECK(c->closing);
+	client_reset();
+
+	// Idle persistent connections are closed
+	c = client_connect(5009);
+	client_send(c, get_index);
+	run(4);
+	CHECK(response(c, &r));
+	now_us += (WEB_KEEPALIVE_TIMEOUT - 1) * 1000000UL;
+	run(2);
+	CHECK(!c->closing);
+	now_us += 2000000UL;
+	run(2);
+	CHECK(c->closing);
+	CHECK(connections == 0);
+	client_reset();
+}
+
+// ==========================================================
+// Connection pool admission and fairness
+
+/// @brief Large responses to several clients share the link a buffer at a time
+void test_fair(void)
+{
+	client_t *c[3];
+	resp_t r;
+	int i, n, rounds, seen;
+
+	for(i = 0; i < 3; ++i)
+	{
+		c[i] = client_connect(5100 + i);
+		client_send(c[i], "GET /big.css HTTP/1.1\r\n\r\n");
+	}
+	run(100);
+	for(i = 0; i < 3; ++i)
+	{
+		CHECK(response(c[i], &r));
+		CHECK(r.status == 200 && r.bodylen == BIG_SIZE);
+		CHECK(memcmp(r.body, pattern(BIG_SIZE, 1), BIG_SIZE) == 0);
+		CHECK(!c[i]->busy);
+	}
+	CHECK(connections == 3);
+
+	// Every client gets one buffer per web_task() pass, in turn
+	rounds = sends / 3;
+	CHECK(rounds * 3 == sends && rounds >= BIG_SIZE / 1000);
+	for(n = 0; n < rounds; ++n)
+	{
+		seen = 0;
+		for(i = 0; i < 3; ++i)
+			seen |= 1 << (send_log[n * 3 + i] - (c[0] - clients));
+		CHECK(seen == 7);
+	}
+	client_reset();
+}
+
+/// @brief Admission control when the pool is full
+void test_admission(void)
+{
+	client_t *c[MAX_CONNECTIONS];
+	client_t *extra;
+	resp_t r;
+	int i;
+
+	for(i = 0; i < MAX_CONNECTIONS; ++i)
+	{
+		c[i] = client_connect(5200 + i);
+		CHECK(c[i]->conn.recv_callback != NULL);
+	}
+	run(2);
+	CHECK(connections == MAX_CONNECTIONS);
+
+	// No room, the client is told to retry and disconnected
+	// The SDK must accept it for the server to send the 503
+	CHECK(max_con > MAX_CONNECTIONS);
+	extra = client_connect(5300);
+	CHECK(extra->conn.recv_callback == NULL);
+	run(2);
+	CHECK(response(extra, &r));
+	CHECK(r.status == 503 && r.close && r.bodylen == 0);
+	CHECK(extra->closing && extra->closed);
+	CHECK(connections == MAX_CONNECTIONS);
+	extra->used = 0;
+
+	// The pool entries still work
+	for(i = 0; i < MAX_CONNECTIONS; ++i)
+		client_send(c[i], get_index);
+	run(4);
+	for(i = 0; i < MAX_CONNECTIONS; ++i)
+	{
+		CHECK(response(c[i], &r));
+		CHECK(r.status == 200 && strcmp(r.body, index_html) == 0);
+	}
+
+	// A closed connection returns its entry to the pool
+	client_close(c[1]);
+	run(1);
+	CHECK(connections == MAX_CONNECTIONS - 1);
+	c[1]->used = 0;
+	c[1] = client_connect(5400);
+	CHECK(c[1]->conn.recv_callback != NULL);
+	client_send(c[1], get_index);
+	run(4);
+	CHECK(response(c[1], &r));
+	CHECK(r.status == 200 && strcmp(r.body, index_html) == 0);
+	client_reset();
+
+	// Not enough memory, the connection is ignored
+	heap_free = 11000;
+	extra = client_connect(5500);
+	CHECK(extra->conn.recv_callback == NULL && extra->sends == 0);
+	heap_free = 30000;
+	client_reset();
+}
+
+/// @brief A client that goes away part way through a response
+void test_abort(void)
+{
+	client_t *a, *b;
+	resp_t r;
+	int sent;
+
+	a = client_connect(5600);
+	b = client_connect(5601);
+	client_send(a, "GET /big.css HTTP/1.1\r\n\r\n");
+	client_send(b, "GET /big.css HTTP/1.1\r\n\r\n");
+	run(5);
+	CHECK(a->sends > 1 && a->sends < BIG_SIZE / 1000);
+
+	// The file is closed and the entry returned, the other client carries on
+	client_close(a);
+	sent = a->sends;
+	run(100);
+	CHECK(a->sends == sent);
+	CHECK(response(b, &r));
+	CHECK(r.status == 200 && r.bodylen == BIG_SIZE && !b->closing);
+	CHECK(connections == 1);
+
+	a->used = 0;
+	a = client_connect(5602);
+	client_send(a, get_index);
+	run(4);
+	CHECK(response(a, &r));
+	CHECK(r.status == 200 && strcmp(r.body, index_html) == 0);
+	CHECK(connections == 2);
+	client_reset();
+	run(1);
+	CHECK(connections == 0);
+}
+
+// ==========================================================
+// WebSocket upgrade and frames
+
+char get_ws[] =
+	"GET /ws HTTP/1.1\r\n"
+	"Host: 192.168.200.116\r\n"
+	"Upgrade: websocket\r\n"
+	"Connection: Upgrade\r\n"
+	"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+	"Sec-WebSocket-Version: 13\r\n"
+	"\r\n";
+
+/// @brief Messages given to the receive handler
+int ws_msgs, ws_opcode;
+char ws_data[256];
+
+void ws_recv_test(rwbuf_t *p, int opcode, char *data, int len)
+{
+	++ws_msgs;
+	ws_opcode = opcode;
+	snprintf(ws_data, sizeof(ws_data), "%s", data);
+}
+
+/**
+  @brief Queue one masked client frame
+  @param[in] *c: client
+  @param[in] b0: FIN, RSV and opcode byte
+  @param[in] *data: payload
+  @param[in] len: payload length, 126 and more use the 16 bit length
+*/
+void ws_frame(client_t *c, int b0, char *data, int len)
+{
+	static const uint8_t mask[4] = { 0x37, 0xfa, 0x21, 0x3d };
+	char buf[1024];
+	int n = 0, i;
+
+	buf[n++] = b0;
+	if(len < 126)
+		buf[n++] = 0x80 | len;
+	else
+	{
+		buf[n++] = 0x80 | 126;
+		buf[n++] = len >> 8;
+		buf[n++] = len & 0xff;
+	}
+	memcpy(buf + n, mask, 4);
+	n += 4;
+	for(i = 0; i < len; ++i)
+		buf[n++] = data[i] ^ mask[i & 3];
+	client_send_len(c, buf, n);
+}
+
+/// @brief Connect a client and upgrade it to a WebSocket
+client_t *ws_connect(int port)
+{
+	client_t *c = client_connect(port);
+	char *end;
+
+	client_send(c, get_ws);
+	run(4);
+	c->out[c->outlen] = 0;
+	CHECK(strncmp(c->out, "HTTP/1.1 101 ", 13) == 0);
+	CHECK(strstr(c->out, "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != NULL);
+	end = strstr(c->out, "\r\n\r\n");
+	CHECK(end != NULL);
+	if(end)
+		c->outoff = end + 4 - c->out;
+	CHECK(ws_clients() == 1);
+	return(c);
+}
+
+/// @brief The server sent a close frame with WS_CLOSE_PROTOCOL and disconnected
+int ws_protocol_close(client_t *c)
+{
+	static const char frame[] = { (char) 0x88, 2, WS_CLOSE_PROTOCOL >> 8, WS_CLOSE_PROTOCOL & 0xff };
+
+	return(c->outlen - c->outoff == 4 && memcmp(c->out + c->outoff, frame, 4) == 0 &&
+		c->closing && ws_clients() == 0);
+}
+
+/**
+  @brief Send an upgrade request and return the status the server answered
+  @param[in] port: client port
+  @param[in] *req: request
+  @param[out] **cp: the client, left for more checks
+  @return status or 0 if there was no complete response
+*/
+int ws_handshake(int port, char *req, client_t **cp)
+{
+	client_t *c = client_connect(port);
+
+	*cp = c;
+	client_send(c, req);
+	run(4);
+	c->out[c->outlen] = 0;
+	// html_msg() ends header lines with LF, the handshake with CRLF
+	if(strncmp(c->out, "HTTP/1.1 ", 9) ||
+		(!strstr(c->out, "\n\n") && !strstr(c->out, "\r\n\r\n")))
+		return(0);
+	return(atoi(c->out + 9));
+}
+
+/// @brief The upgrade needs "Connection: Upgrade" and version 13
+void test_ws_handshake(void)
+{
+	client_t *c;
+
+	// Connection lists more than one token
+	CHECK(ws_handshake(5710,
+		"GET /ws HTTP/1.1\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: keep-alive, Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+		"Sec-WebSocket-Version: 13\r\n"
+		"\r\n", &c) == 101);
+	CHECK(strstr(c->out, "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != NULL);
+	CHECK(ws_clients() == 1);
+	client_reset();
+
+	// No Connection: Upgrade
+	CHECK(ws_handshake(5711,
+		"GET /ws HTTP/1.1\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: keep-alive\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+		"Sec-WebSocket-Version: 13\r\n"
+		"\r\n", &c) == 400);
+	CHECK(c->closing && ws_clients() == 0);
+	client_reset();
+
+	// No version
+	CHECK(ws_handshake(5712,
+		"GET /ws HTTP/1.1\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+		"\r\n", &c) == 400);
+	CHECK(c->closing && ws_clients() == 0);
+	client_reset();
+
+	// An older draft version, we say which one we speak
+	CHECK(ws_handshake(5713,
+		"GET /ws HTTP/1.1\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+		"Sec-WebSocket-Version: 8\r\n"
+		"\r\n", &c) == 426);
+	CHECK(strstr(c->out, "\r\nSec-WebSocket-Version: 13\r\n") != NULL);
+	CHECK(c->closing && ws_clients() == 0);
+	client_reset();
+
+	CHECK(connections == 0);
+}
+
+/**
+  @brief Whole messages reach the handler, fragments and malformed control
+  frames close the connection
+*/
+void test_websocket(void)
+{
+	client_t *c;
+	char big[200];
+
+	ws_recv_handler(ws_recv_test);
+	memset(big, 'p', sizeof(big));
+
+	// One frame messages, a ping is answered with a pong
+	c = ws_connect(5700);
+	ws_msgs = 0;
+	ws_frame(c, 0x80 | WS_TEXT, "hello", 5);
+	ws_frame(c, 0x80 | WS_BINARY, big, sizeof(big));
+	ws_frame(c, 0x80 | WS_PING, "x", 1);
+	run(4);
+	CHECK(ws_msgs == 2 && ws_opcode == WS_BINARY && strlen(ws_data) == sizeof(big));
+	CHECK(c->outlen - c->outoff == 3 && memcmp(c->out + c->outoff, "\x8a\x01x", 3) == 0);
+	c->outoff = c->outlen;
+	CHECK(!c->closing && ws_clients() == 1);
+	client_reset();
+
+	// The first fragment of a message, FIN is 0
+	c = ws_connect(5701);
+	ws_msgs = 0;
+	ws_frame(c, WS_TEXT, "hel", 3);
+	ws_frame(c, 0x80 | WS_CONT, "lo", 2);
+	run(4);
+	CHECK(ws_msgs == 0 && ws_protocol_close(c));
+	client_reset();
+
+	// A continuation with no message to continue
+	c = ws_connect(5702);
+	ws_msgs = 0;
+	ws_frame(c, 0x80 | WS_CONT, "lo", 2);
+	run(4);
+	CHECK(ws_msgs == 0 && ws_protocol_close(c));
+	client_reset();
+
+	// A fragmented ping
+	c = ws_connect(5703);
+	ws_frame(c, WS_PING, "x", 1);
+	run(4);
+	CHECK(ws_protocol_close(c));
+	client_reset();
+
+	// A ping over 125 bytes
+	c = ws_connect(5704);
+	ws_frame(c, 0x80 | WS_PING, big, sizeof(big));
+	run(4);
+	CHECK(ws_protocol_close(c));
+	client_reset();
+
+	// RSV1 set without an extension, and a reserved opcode
+	c = ws_connect(5705);
+	ws_frame(c, 0xc0 | WS_TEXT, "hello", 5);
+	run(4);
+	CHECK(ws_protocol_close(c));
+	client_reset();
+	c = ws_connect(5706);
+	ws_frame(c, 0x80 | 0x3, "hello", 5);
+	run(4);
+	CHECK(ws_protocol_close(c));
+	client_reset();
+
+	ws_recv_handler(NULL);
+	CHECK(connections == 0);
+}
+
+int main(int argc, char *argv[])
+{
+	make_files();
+	web_init(80);
+	web_route_add("hello.cgi", web_route_hello);
+	CHECK(web_accept != NULL);
+
+	test_session();
+	test_pipeline();
+	test_head();
+	test_lost();
+	test_accept_gzip();
+	test_if_modified_since();
+	test_template_edit();
+	test_split();
+	test_close();
+	test_fair();
+	test_admission();
+	test_abort();
+	test_websocket();
+	test_ws_handshake();
+
+	remove_files();
+	return(test_result());
+}
+
+#endif	// WEB_TEST
@@ -29,15 +29,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <math.h>
 
 #include "display/ili9341.h"
+#include "printf/printf_desc.h"
 #include "web/web.h"
+#include "web/template.h"
+#include "web/route.h"
+#include "web/websocket.h"
 
 
 // References: http://www.w3.org/Protocols/rfc2616/rfc2616.html
 
 /// @brief max size of  ERROR/REDIRECT/STATUS Message buffer
 #define MAX_MSG 1024 
-/// @brief max size of  CGI token
-#define CGI_TOKEN_SIZE 128
 /// @brief max size of read/write socket buffers
 /// Note: reducing this size below 1500 will slow down transfer a great deal
 #define BUFFER_SIZE 1000
@@ -49,6 +51,10 @@ extern window *winmsg,*wintop;
 ///@brief socket buffers for this connection
 rwbuf_t *web_connections[MAX_CONNECTIONS];
 
+///@brief connection pool, allocated once by web_init_connections()
+/// web_connections[i] points at web_pool[i] while the connection is open
+static rwbuf_t *web_pool = NULL;
+
 /// @brief Master espconn structure of the web server
 espconn_t WebConn;
 /// @brief Master network configuration for the web server
@@ -57,29 +63,6 @@ static esp_tcp WebTcp;
 // =======================================================
 // http://www.w3.org/Protocols/rfc2616/rfc2616-sec4.html#sec4.4
 
-///@brief HTTP headers we understand 
-header_t msg_headers[] = {
-	{ "GET", 				TOKEN_GET },
-	{ "PUT", 				TOKEN_PUT },
-	{ "POST", 				TOKEN_POST },
-	{ "HEAD", 				TOKEN_HEAD },
-	{ "Host:", 				TOKEN_HOST },
-	{ "User-Agent:", 		TOKEN_USER_AGENT },
-	{ "HTTPS:", 			TOKEN_HTTPS},
-	{ "DNT:", 				TOKEN_DNT},
-	{ "Accept:", 			TOKEN_ACCEPT },
-	{ "Accept-Language:", 	TOKEN_ACCEPT_LANGUAGE },
-	{ "Accept-Encoding:", 	TOKEN_ACCEPT_ENCODING },
-	{ "Connection:", 		TOKEN_CONNECTION },
-	{ "Referer:", 			TOKEN_REFERER },
-	{ "Content-Length:", 	TOKEN_CONTENT_LENGTH },
-	{ "Content-Type:", 		TOKEN_CONTENT_TYPE },
-	{ "Cache-Control:", 	TOKEN_CACHE_CONTROL },
-	{ NULL,                 -1}
-};
-
-
-
 // =============================================================
 
 ///@brief HTTP status code messages
@@ -135,6 +118,12 @@ char *http_status[] = {
 	// The best known of them all, the 404 status code indicates that 
 	// the requested resource was not found at the URL given, and the 
 	// server has no idea how long for.
+	 "405 Method Not Allowed",
+	// 405 status code indicates that the resource does not support the
+	// request method, the Allow header lists the methods it does support.
+	 "426 Upgrade Required",
+	// 426 status code indicates that the client must switch to another
+	// protocol, or protocol version, listed in the response headers.
 
 	// Server Error
 
@@ -158,19 +147,19 @@ char *http_status[] = {
 
 ///@brief MIME types 
 mime_t mimes[] = {
-	{ PTYPE_TEXT,	"text/plain", ".text", ".txt" },
-	{ PTYPE_HTML,	"text/html", ".htm", ".html" },
-	{ PTYPE_PDF, 	"application/pdf", ".pdf",NULL},
-	{ PTYPE_CSS, 	"text/css", ".css", NULL },
-	{ PTYPE_CGI,	"text/html", ".cgi", NULL },
-	{ PTYPE_JS,		"text/plain", ".js", NULL },
-	{ PTYPE_XML,	"text/plain", ".xml", NULL },
-	{ PTYPE_ICO, 	"mage/vnd.microsoft.icon", ".ico", NULL },
-	{ PTYPE_GIF, 	"image/gif", ".gif", NULL },
-	{ PTYPE_JPEG, 	"image/jpeg", ".jpg", ".jpeg" },
-	{ PTYPE_MPEG, 	"video/mpeg", ".mpg", ".mpeg" },
-	{ PTYPE_FLASH,	"application/x-shockwave-flash", ".swf", NULL },
-	{ PTYPE_ERR, 	"text/html", NULL , NULL }
+	{ PTYPE_TEXT,	"text/plain", ".text", ".txt", CACHE_AGE_PAGE },
+	{ PTYPE_HTML,	"text/html", ".htm", ".html", CACHE_AGE_PAGE },
+	{ PTYPE_PDF, 	"application/pdf", ".pdf",NULL, CACHE_AGE_STATIC },
+	{ PTYPE_CSS, 	"text/css", ".css", NULL, CACHE_AGE_STATIC },
+	{ PTYPE_CGI,	"text/html", ".cgi", NULL, 0 },
+	{ PTYPE_JS,		"text/plain", ".js", NULL, CACHE_AGE_STATIC },
+	{ PTYPE_XML,	"text/plain", ".xml", NULL, CACHE_AGE_STATIC },
+	{ PTYPE_ICO, 	"mage/vnd.microsoft.icon", ".ico", NULL, CACHE_AGE_IMAGE },
+	{ PTYPE_GIF, 	"image/gif", ".gif", NULL, CACHE_AGE_IMAGE },
+	{ PTYPE_JPEG, 	"image/jpeg", ".jpg", ".jpeg", CACHE_AGE_IMAGE },
+	{ PTYPE_MPEG, 	"video/mpeg", ".mpg", ".mpeg", CACHE_AGE_IMAGE },
+	{ PTYPE_FLASH,	"application/x-shockwave-flash", ".swf", NULL, CACHE_AGE_STATIC },
+	{ PTYPE_ERR, 	"text/html", NULL , NULL, 0 }
 };
 
 // =======================================================
@@ -235,7 +224,8 @@ int wait_send(rwbuf_t *p)
     len = p->send;
     while(p && p->send )
     {
-        optimistic_yield(1000);
+        // the send callback calls esp_schedule() when it is done
+        sched_wait(SCHED_EV_POST, 10000);
     }
 
     if(!p)
@@ -277,7 +267,14 @@ int write_buffer(rwbuf_t *p)
         return(0);
 
     // wait for existing buffers to send before filling new one
- 	if(!p->wind )
+	if(p->chunked)
+	{
+		// Never send an empty chunk, a zero length chunk ends the body
+		if(p->wind <= p->chunk + CHUNK_HEAD)
+			return(0);
+		write_chunk_head(p);
+	}
+ 	else if(!p->wind )
         return(0);
 
     len = p->wind;
@@ -314,6 +311,73 @@ int write_buffer(rwbuf_t *p)
     return(-1);
 }
 
+/**
+  @brief Fill in the chunk header and trailer of the current chunk
+  The header is a fixed width, so its space is reserved when the chunk starts
+  The trailing CRLF uses the extra bytes allocated after wsize
+  @param[in] *p: rwbuf_t pointer for this socket buffer
+  @return void
+*/
+MEMSPACE
+void write_chunk_head(rwbuf_t *p)
+{
+	int i,len;
+	char *ptr = p->wbuf + p->chunk;
+	static const char hex[] = "0123456789abcdef";
+
+	len = p->wind - p->chunk - CHUNK_HEAD;
+	for(i=CHUNK_HEAD-3;i>=0;--i)
+	{
+		ptr[i] = hex[len & 15];
+		len >>= 4;
+	}
+	ptr[CHUNK_HEAD-2] = '\r';
+	ptr[CHUNK_HEAD-1] = '\n';
+	p->wbuf[p->wind++] = '\r';
+	p->wbuf[p->wind++] = '\n';
+}
+
+/**
+  @brief Start a chunked transfer-encoding message body
+  Each buffer sent by write_buffer() becomes one chunk
+  The response headers must be written first
+  @param[in] *p: rwbuf_t pointer for this socket buffer
+  @return void
+*/
+MEMSPACE
+void write_chunked_start(rwbuf_t *p)
+{
+	// The response to HEAD has no body to chunk
+	if(!p || !p->wbuf || p->chunked || p->head)
+		return;
+	// Make room for the chunk header
+	if(p->wind + CHUNK_HEAD >= p->wsize)
+		write_flush(p);
+	p->chunk = p->wind;
+	p->wind += CHUNK_HEAD;
+	p->chunked = 1;
+}
+
+/**
+  @brief Send the last chunk and end a chunked message body
+  @param[in] *p: rwbuf_t pointer for this socket buffer
+  @return size of last send or -1 on error
+*/
+MEMSPACE
+int write_chunked_end(rwbuf_t *p)
+{
+	if(!p || !p->wbuf || !p->chunked)
+		return(write_flush(p));
+
+	if(write_flush(p) == -1)
+		return(-1);
+	// Drop the unused chunk header space
+	p->wind = p->chunk;
+	p->chunked = 0;
+	write_str(p, "0\r\n\r\n");
+	return(write_flush(p));
+}
+
 /**
   @brief Write all outstanding data and wait for it to send
   @param[in] *p: rwbuf_t pointer for this socket buffer
@@ -329,6 +393,39 @@ int write_flush(rwbuf_t *p)
     return( wait_send(p) );
 }
 
+/**
+  @brief Limit a write to the headers of a response to HEAD
+  The response to HEAD has no body, anything after the blank line
+  that ends the headers is dropped, including CGI output
+  @param[in] *p: rwbuf_t pointer for this socket buffer
+  @param[in] *str: data to write
+  @param[in] len: number of bytes to write
+  @return number of bytes of str to write
+*/
+MEMSPACE
+static int write_head(rwbuf_t *p, char *str, int len)
+{
+	int i;
+
+	if(p->head == 3)
+		return(0);
+	for(i=0;i<len;++i)
+	{
+		if(str[i] == '\n')
+		{
+			if(p->head == 2)
+			{
+				p->head = 3;
+				return(i+1);
+			}
+			p->head = 2;
+		}
+		else if(str[i] != '\r')
+			p->head = 1;
+	}
+	return(len);
+}
+
 /**
   @brief Write a byte (buffered) using the rwbuf_t socket buffers for this connection
   If the buffers are full the socket is written using write_flush
@@ -352,6 +449,13 @@ int write_byte(rwbuf_t *p, int c)
         return(0);
     }
 
+	if(p->head)
+	{
+		char ch = c;
+		if(!write_head(p, &ch, 1))
+			return(1);
+	}
+
     p->wbuf[p->wind++] = c;
  	if(p->wind >= p->wsize)
 	{
@@ -419,10 +523,12 @@ static void tcp_accept(espconn_t *esp_config, esp_tcp *esp_tcp_config,
 	esp_config->proto.tcp = esp_tcp_config;
 	espconn_regist_connectcb(esp_config, (espconn_connect_callback)connect_callback);
 	espconn_accept(esp_config);
-	ret = espconn_tcp_set_max_con_allow(esp_config, MAX_CONNECTIONS);
+	// The SDK refuses connections over its limit before connect_callback
+	// runs, so allow more than the pool holds to be able to send a 503
+	ret = espconn_tcp_set_max_con_allow(esp_config, MAX_CONNECTIONS + WEB_BUSY_CONNECTIONS);
 	if(ret)
 		printf("espconn_tcp_set_max_con_allow(%d) != (%d) failed\n", 
-			MAX_CONNECTIONS, espconn_tcp_get_max_con_allow(esp_config));
+			MAX_CONNECTIONS + WEB_BUSY_CONNECTIONS, espconn_tcp_get_max_con_allow(esp_config));
 #if WEB_DEBUG & 2
 	printf("espconn_tcp_get_max_con_allow:(%d)\n", (int)  espconn_tcp_get_max_con_allow(esp_config));
 #endif
@@ -444,6 +550,65 @@ void rwbuf_rinit(rwbuf_t *p)
 	p->rind = 0;
 }
 
+/**
+  @brief Remove a processed request from the front of the read buffer
+  Any pipelined requests that follow are moved to the start of rbuf
+  @param[in] p: rwbuf_t pointer
+  @param[in] len: bytes to remove
+  @return bytes left in rbuf
+*/
+MEMSPACE
+int rwbuf_consume(rwbuf_t *p, int len)
+{
+	if(!p || !p->rbuf)
+		return(0);
+	if(len > p->received)
+		len = p->received;
+	p->received -= len;
+	if(p->received)
+		memmove(p->rbuf, p->rbuf + len, p->received);
+	p->rbuf[p->received] = 0;
+	p->rind = 0;
+	return(p->received);
+}
+
+/**
+  @brief Move pending received data into the read buffer
+  Receive is resumed when all of it has been moved
+  @param[in] p: rwbuf_t pointer
+  @return void
+*/
+MEMSPACE
+void rwbuf_pull(rwbuf_t *p)
+{
+	int len;
+
+	if(!p || !p->pend)
+		return;
+
+	len = p->rsize - p->received;
+	if(len > p->pend_len - p->pend_off)
+		len = p->pend_len - p->pend_off;
+	if(len > 0)
+	{
+		memcpy(p->rbuf + p->received, p->pend + p->pend_off, len);
+		p->received += len;
+		p->rbuf[p->received] = 0;
+		p->pend_off += len;
+	}
+
+	if(p->pend_off >= p->pend_len)
+	{
+		safefree(p->pend);
+		p->pend = NULL;
+		p->pend_len = 0;
+		p->pend_off = 0;
+		if(p->held && p->conn)
+			espconn_recv_unhold(p->conn);
+		p->held = 0;
+	}
+}
+
 /**
   @brief Initialize socket send status and write index
   @param[in] p: rwbuf_t pointer
@@ -456,6 +621,10 @@ void rwbuf_winit(rwbuf_t *p)
 		return;
 	p->send = 0;
 	p->wind = 0;
+	p->chunk = 0;
+	// Room for the next chunk header
+	if(p->chunked)
+		p->wind = CHUNK_HEAD;
 }
 
 /**
@@ -479,8 +648,32 @@ void display_ipv4(char *msg, uint8_t *ip, int port)
 }
 
 /**
-  @brief Delete socket read/write buffers
-  @param[in] p: rwbuf_t pointer to buffer to delete
+  @brief Close any files a response is still sending
+  @param[in] p: rwbuf_t pointer
+  @return void
+*/
+MEMSPACE
+void rwbuf_close_files(rwbuf_t *p)
+{
+	if(!p) 
+		return;
+	if(p->fi)
+		fclose(p->fi);
+	p->fi = NULL;
+	if(p->ft)
+		fclose(p->ft);
+	p->ft = NULL;
+	if(p->fo)
+		fclose(p->fo);
+	p->fo = NULL;
+	p->tpl_segs = 0;
+	p->tpl_left = 0;
+}
+
+/**
+  @brief Release socket read/write buffers back to the connection pool
+  The buffers are not freed, they belong to the pool
+  @param[in] p: rwbuf_t pointer to buffer to release
   @return void
 */
 MEMSPACE
@@ -489,90 +682,58 @@ void rwbuf_delete(rwbuf_t *p)
 	if(!p) 
 		return;
 
+	rwbuf_close_files(p);
+
 	p->delete = 0;
-	// Free receive buffer
-	p->rsize = 0;
-	if(p->rbuf)
-		safefree(p->rbuf);
-	p->rbuf = NULL;
-	rwbuf_rinit(p);
+	p->closed = 0;
+	p->state = WEB_IDLE;
+	p->request = 0;
+	p->requests = 0;
+	p->keepalive = 0;
+	p->head = 0;
 
-	// Free write buffer
-	p->wsize = 0;
-	if(p->wbuf)
-		safefree(p->wbuf);
-	p->wbuf = NULL;
+	rwbuf_rinit(p);
+	if(p->rbuf)
+		p->rbuf[0] = 0;
+	if(p->pend)
+		safefree(p->pend);
+	p->pend = NULL;
+	p->pend_len = 0;
+	p->pend_off = 0;
+	p->held = 0;
+	p->body_left = 0;
+	p->chunked = 0;
+	p->ws_drop = 0;
 	rwbuf_winit(p);
 
 	p->remote_ip[0] = 0; p->remote_ip[1] = 0; p->remote_ip[2] = 0; p->remote_ip[3] = 0;
 	p->remote_port = 0;
 	p->local_ip[0] = 0; p->local_ip[1] = 0; p->local_ip[2] = 0; p->local_ip[3] = 0;
 	p->local_port = 0;
-
-	// FIXME
-	if( p->conn != &WebConn)
-	{
-		p->conn = NULL;
-        safefree(p);
-	}
+	p->conn = NULL;
 }
 
 
 /**
-  @brief Create socket read/write buffer for a connection
-  @return void
+  @brief Get socket read/write buffers for a connection from the pool
+  @param[in] index: connection pool index
+  @return rwbuf_t pointer or NULL if there is no pool
 */
 MEMSPACE
-rwbuf_t *rwbuf_create()
+rwbuf_t *rwbuf_create(int index)
 {
-	char *buf;
-
-	// connect struction for this connection
-	// Always over allocate to allow an extra EOS or TWO
-	rwbuf_t *p = safecalloc(sizeof(rwbuf_t)+4,1);
-	if(!p) 
-	{
-#if WEB_DEBUG & 1
-		printf("rwbuf_create:calloc failed\n");
-#endif
-		return(NULL);
-	}
-	p->conn = NULL;
+	rwbuf_t *p;
 
-	// read buffer for this connection
-	rwbuf_rinit(p);
-	// Always over allocate to allow an extra EOS or TWO
-	buf = safecalloc(BUFFER_SIZE+4,1);
-	if(!buf) 
+	if(!web_pool || index < 0 || index >= MAX_CONNECTIONS)
 	{
 #if WEB_DEBUG & 1
-		printf("rwbuf_create rbuf: calloc failed\n");
+		printf("rwbuf_create: no pool entry:%d\n", index);
 #endif
-		rwbuf_delete(p);
 		return(NULL);
 	}
-	p->rbuf = buf;
-	p->rsize = BUFFER_SIZE;
 
-	// write buffer for this connection
-	rwbuf_winit(p);
-	// Always over allocate to allow an extra EOS or TWO
-	buf = safecalloc(BUFFER_SIZE+4,1);
-	if(!buf) 
-	{
-#if WEB_DEBUG & 1
-		printf("rwbuf_create wbuf: calloc failed\n");
-#endif
-		rwbuf_delete(p);
-		return(NULL);
-	}
-	p->wbuf = buf;
-	p->wsize = BUFFER_SIZE;
-	p->delete = 0;
-	p->remote_ip[0] = 0; p->remote_ip[1] = 0; p->remote_ip[2] = 0; p->remote_ip[3] = 0;
-	p->remote_port = 0;
-	p->local_ip[0] = 0; p->local_ip[1] = 0; p->local_ip[2] = 0; p->local_ip[3] = 0;
-	p->local_port = 0;
+	p = &web_pool[index];
+	rwbuf_delete(p);
 	return(p);
 }
 
@@ -676,7 +837,7 @@ rwbuf_t *create_connection(espconn_t *conn)
 	{
 		if(web_connections[i] == NULL)
 		{
-			p = rwbuf_create();
+			p = rwbuf_create(i);
 			if(!p)
 			{
 #if WEB_DEBUG & 1
@@ -709,6 +870,7 @@ rwbuf_t *create_connection(espconn_t *conn)
 
 /**
   @brief Delete our main connection structure and connection buffers
+  Only called from web_task, the disconnect callback just marks p->closed
   @param[in] p: rwbuf_t pointer
 */
 MEMSPACE
@@ -748,7 +910,8 @@ int delete_connection(rwbuf_t *p)
 // =======================================================
 
 /**
-  @brief Write data using buffered write_byte function
+  @brief Write data to the rwbuf_t socket buffer, copied a buffer at a time
+  If the buffer fills it is sent using write_flush
   @param[in] *p: rwbuf_t pointer for this socket buffer
   @param[in] *str: data buffer to write
   @param[in] len: number of bytes to write
@@ -757,15 +920,32 @@ int delete_connection(rwbuf_t *p)
 MEMSPACE
 void write_len(rwbuf_t *p, char *str, int len)
 {
-	while(len--) 
-    {
-		if( write_byte(p,*str++) == -1)
-            return;
-    }
+	int size;
+
+ 	if(!p || !p->conn || !p->wbuf)
+		return;
+
+	if(p->head)
+		len = write_head(p, str, len);
+
+	while(len > 0 && !p->delete)
+	{
+		size = p->wsize - p->wind;
+		if(size <= 0)
+			return;
+		if(size > len)
+			size = len;
+		memcpy(p->wbuf + p->wind, str, size);
+		p->wind += size;
+		str += size;
+		len -= size;
+		if(p->wind >= p->wsize && write_flush(p) == -1)
+			return;
+	}
 }
 
 /**
-  @brief Write string using buffered write_byte function
+  @brief Write string using buffered write_len function
   @param[in] *p: rwbuf_t pointer for this socket buffer
   @param[in] *str: 0 terminated string to write
   @return void
@@ -773,11 +953,7 @@ void write_len(rwbuf_t *p, char *str, int len)
 MEMSPACE
 void write_str(rwbuf_t *p, char *str)
 {
-	while(*str) 
-    {
-		if( write_byte(p,*str++) == -1)
-            return;
-    }
+	write_len(p, str, strlen(str));
 }
 
 /**
@@ -796,6 +972,23 @@ static void _write_byte_fn(struct _printf_t *pr, char c)
         pr->sent++;
 }
 
+/**
+   @brief low level vsock_printf function that writes a block to the socket buffer
+   @param[in] *pr: printf structure and user buffer for this socket
+   @param[in] *s: characters to write
+   @param[in] count: number of characters
+   @return void
+*/
+MEMSPACE
+static void _write_block_fn(struct _printf_t *pr, const char *s, int count)
+{
+		rwbuf_t *p = (rwbuf_t *) pr->buffer;
+
+        // if errors happen they will not get sent
+        write_len(p, (char *) s, count);
+        pr->sent += count;
+}
+
 
 /** 
 	@brief vsock_printf function
@@ -810,6 +1003,7 @@ int vsock_printf(rwbuf_t *p, const char *fmt, va_list va)
 	printf_t fn;
 
     fn.put = _write_byte_fn;
+    fn.write = _write_block_fn;
     fn.sent= 0;
 	fn.buffer = (void *) p;
 
@@ -839,6 +1033,32 @@ int sock_printf(rwbuf_t *p, const char *fmt, ...)
     return len;
 }
 
+
+/** 
+	@brief sock_printf using a pre-parsed format
+	@param[in] p: socket buffer structure
+	@param[in] desc: printf_desc_t list, see PF() and printf_compile()
+	@param[in] ...: list of arguments
+	@return bytes written
+*/
+MEMSPACE
+int sock_printf_desc(rwbuf_t *p, const printf_desc_t *desc, ...)
+{
+	printf_t fn;
+    va_list va;
+
+    fn.put = _write_byte_fn;
+    fn.write = _write_block_fn;
+    fn.sent= 0;
+	fn.buffer = (void *) p;
+
+    va_start(va, desc);
+    _printf_desc_fn(&fn, desc, va);
+    va_end(va);
+
+	return(fn.sent);
+}
+
 // =================================================================
 /** 
 	@brief Send an HTML status message to socket
@@ -881,8 +1101,8 @@ int html_msg(rwbuf_t *p, int status, char type, char *fmt, ...)
 
 	// HTTP/1.1 200 OK\n
 	snprintf(header,MAX_MSG,
-		"HTTP/1.1 %s\nContent-Type: %s\nContent-Length: #    \n\n",
-		statp, mimep);
+		"HTTP/1.1 %s\nContent-Type: %s\nConnection: %s\nContent-Length: #    \n\n",
+		statp, mimep, html_connection(p));
 
 	// Make body point to message after header
 	body = header;
@@ -1046,186 +1266,6 @@ char *html_status(int status)
 }
 
 
-/** 
-	Initilize hinfo_t structure
-	@param[in] *hi: hinfo_t structure pointer to initialize
-	@return hinfo_t structure pointer to initialize
-*/
-MEMSPACE
-void init_hinfo(hinfo_t *hi)
-{
-	hi->type = -1;	// GET,PUT,HEADER
-	hi->filename = NULL;
-	hi->connection = NULL;
-	hi->args = NULL;
-	hi->arg_ptr = NULL;
-	hi->args_length = 0;
-	hi->html_encoding= NULL;
-	hi->content_type = NULL;
-	hi->content_length = 0;
-	hi->msg = NULL;
-}
-
-
-/** 
-	@brief Match GET/POST message headers
-	@param[in] *str: string to patch
-	@param[in] **p: points past matched string on sucess
-	@return header index or -1 on no match
-*/
-MEMSPACE
-int match_headers(char *str, char **p)
-{
-	int len, i,ind;
-	char *ptr;
-
-	if(!str)
-		return(-1);
-	
-	str = skipspaces(str);
-	trim_tail(str);
-
-	len = strlen(str);
-	if(!len)
-		return(-1);
-	
-	for(i=0;msg_headers[i].type != -1; ++i) {
-		if( (ind = MATCHI_LEN(str, msg_headers[i].pattern)) ) {
-			ptr = str + ind;
-			ptr = skipspaces(ptr);
-			// Instead of reallocating we now assume we can replace the EOL with EOS in ram
-			// msg_headers[i].value = ptr; // stralloc(ptr);
-			*p = ptr;
-			return(i);
-		}
-	}
-	return(-1);
-}
-
-/** 
-	@brief Process GET argments or POST message name/value data.
-	HTML encoding is done in place often reducting the size of the result.
-	Convert name=value pairs into null terminated strings.
- 	Names and values are each terminated with an EOS by replaceing
-    '?', '&', '=' characters seen while scaning.
-	@param[in] *hi: hinfo_t structure to fill
-	@param[in] *ptr: GET arguments or PUT message body.
-	@return *ptr pointer that points to just past the header area.
-*/
-MEMSPACE
-char *process_args(hinfo_t *hi, char *ptr)
-{
-	char	*out;
-	int h,l,num;
-	char *end;
-	int len;
-	int size = 0;
-	
-	len = strlen(ptr);
-#if WEB_DEBUG & 8
-	printf("process_args:(%d)[%s]\n",len,ptr);
-#endif
-
-	// find next space or EOS - after arguments
-	// HTTP/Versions follows space
-	end = nextspace(ptr);
-	if(*end)
-		*end++ = 0;	// EOS after arguments
-
-	hi->args = ptr;
-	hi->arg_ptr = ptr;
-	hi->args_length = len; // initial undecoded length
-
-#if WEB_DEBUG & 8
-	printf("process_args:[%s]\n",hi->args);
-	printf("process_args_length:[%d]\n",hi->args_length);
-#endif
-
-	if(!hi->args_length)
-	{
-#if WEB_DEBUG & 8
-		// this is not an error - just a notice
-		printf("process_args: zero length\n");
-#endif
-		return(end);
-	}
-	len = hi->args_length;
-
-	// We are overwriting the input buffer
-	// The output will always be <= in size - so this works
-	out = ptr;
-	while(len > 0) {
-		// Name = Value
-		if(*ptr == '=') {	// Name =
-			ptr++;
-			--len;
-			*out++ = 0;		// EOS break
-			++size;
-			continue;
-		}
-		if( *ptr == '&' ) {	// New Argument
-			ptr++;
-			--len;
-			*out++ = 0;		// EOS break
-			++size;
-			continue;
-		}
-		if(*ptr == '+') {	// Space
-			ptr++;
-			--len;
-			*out++ = ' ';
-			++size;
-			continue;
-		}
-		if ( *ptr == '%') {
-			// skip %
-			++ptr;
-			--len;
-			// Make sure we do not go past the end of the string
-			if(!ptr[0] || !ptr[1])
-			{
-#if WEB_DEBUG & 1+8
-	printf("process_args: HTML %HEX decode short string\n");
-#endif
-				break;
-			}
-
-			// Is the data HEX ?
-			h = atodigit( *ptr++, 16);
-			l = atodigit( *ptr++, 16);
-			len -=2;
-
-			if(h < 0 || l < 0) 	// The data was not HEX
-			{
-				num = ' ';
-#if WEB_DEBUG & 1+8
-	printf("process_args: HTML %HEX bad value\n");
-#endif
-			}
-			else
-			{	
-				// The data was HEX
-				num = (h << 4) | l;
-			}
-
-			*out++ = num;
-			++size;
-			continue;
-		} // '%'
-
-		// Default is to copy
-		*out++ = *ptr++;								// Character
-		++size;
-		--len;
-	}
-	// EOS at very end of buffer
-	*out = 0;
-	// Compute new length of arguments string space after decoding
-	hi->args_length = size;
-
-	return(end);
-}
-
 /** 
 	@brief Find first POST/GET argument
 	@param[in] *hi: hinfo_t structure with arguments
@@ -1413,97 +1453,418 @@ char *arg_value(hinfo_t *hi)
 }
 
 /** 
-	@brief Lookup and argument name and return its value
-	@param[in] *hi: hinfo_t structure with arguments
-	@param[in] *str: string to lookup
-	@return argument value
+	@brief Find next space or ? character
+	@param[in] *ptr: string to search
+	@return first space or ? character
 */
 MEMSPACE
-char *http_value(hinfo_t *hi, char *str)
+char *nextbreak(char *ptr)
 {
-	char *name,*value;
+   if(!ptr)
+        return(ptr);
 
-	first_arg(hi);
-	while( (name = arg_name(hi)) ) {
-		if(strcasecmp(name,str) == 0) {
-			value = arg_value(hi);
-			if(!value)
-				return(NULL);
-#if WEB_DEBUG & 8
-		    printf("http_value:%s=%s\n",str,value);
-#endif
-			return(value);
-		}
-		if(!next_arg(hi))
+    while(*ptr) {
+		if(*ptr == ' ' || *ptr == '\t' || *ptr == '?')
 			break;
+        ++ptr;
 	}
-	return(NULL);
+    return(ptr);
 }
 
 
 /** 
-	@brief Does the string look like a header token with a ':' ?
-	@param[in] *str: string to test
-	@param[in] **p: string pointer to set on match
-	@return 1 if it looks like a header, otherwise 0
+	@brief Print a decimal number into a string without an EOS
+	@param[in] *ptr: buffer to write number to
+	@param[in] num: number to convet
+	@return void
 */
 MEMSPACE
-int is_header(char *str, char **p)
+void u5toa(char *ptr, uint16_t num)
 {
+	char buf[10];
+	// The size includes the EOS, 5 would drop the last digit
+	snprintf(buf,sizeof(buf),"%5u",num);
+	memcpy(ptr,buf,5);
+}
+
+
+
+// =================================================================
+
+
+/**
+	@brief Does an Accept-Encoding header value allow gzip ?
+	Example: "gzip, deflate" or "gzip;q=0.5" - "gzip;q=0" refuses gzip
+	An explicit gzip entry wins over "*", so "*;q=1, gzip;q=0" refuses gzip
+	@param[in] *str: Accept-Encoding header value
+	@return 1 if gzip is accepted, otherwise 0
+*/
+MEMSPACE
+int accept_gzip(char *str)
+{
+	int len;
+	int ok;
+	int gzip = -1;	// gzip entry, -1 if there is none, 0 refused, 1 accepted
+	int star = -1;	// "*" entry, used only without a gzip entry
+	char *name;
+
 	if(!str)
+		return(0);
+
+	while(*str)
 	{
-		return (0);
+		str = skipspaces(str);
+		// Coding name ends at ',' ';' or space
+		name = str;
+		len = 0;
+		while(str[len] && str[len] != ',' && str[len] != ';' && str[len] != ' ')
+			++len;
+		str = skipspaces(str+len);
+
+		// Quality value q=0 means not acceptable
+		ok = 1;
+		while(*str == ';')
+		{
+			str = skipspaces(str+1);
+			if((*str == 'q' || *str == 'Q') && str[1] == '=')
+			{
+				str += 2;
+				if(*str == '0')
+				{
+					++str;
+					if(*str == '.')
+						++str;
+					while(*str == '0')
+						++str;
+					if(*str < '1' || *str > '9')
+						ok = 0;
+				}
+			}
+			while(*str && *str != ',' && *str != ';')
+				++str;
+		}
+
+		if(len == 4 && strncasecmp(name,"gzip",4) == 0)
+			gzip = ok;
+		else if(len == 1 && *name == '*')
+			star = ok;
+
+		// Next coding
+		while(*str && *str != ',')
+			++str;
+		if(*str == ',')
+			++str;
 	}
-	while(*str && *str != ':') {
-		if(*str <= ' ' || *str > 'z')
-			break;
-		++str;
+	if(gzip != -1)
+		return(gzip);
+	return(star == 1);
+}
+
+
+/**
+	@brief Find a usable pre-compressed copy of a file, name.gz
+	The client must accept gzip and name.gz must not be older than name
+	@param[in] *hi: hinfo_t header structure with Accept-Encoding
+	@param[in] *name: file name
+	@param[in|out] *sp: stat of name, replaced with the stat of name.gz on success
+	@param[out] *buf: name.gz result
+	@param[in] max: size of buf
+	@return buf or NULL if there is no usable name.gz
+*/
+MEMSPACE
+char *gzip_name(hinfo_t *hi, char *name, struct stat *sp, char *buf, int max)
+{
+	struct stat gp;
+	int len;
+
+	if(!accept_gzip(hi->accept_encoding))
+		return(NULL);
+
+	len = strlen(name);
+	if(len + (int) sizeof(GZIP_EXT) > max)
+		return(NULL);
+	strcpy(buf, name);
+	strcpy(buf+len, GZIP_EXT);
+
+	if(stat(buf, &gp) == -1)
+		return(NULL);
+	// A stale copy must not hide an updated file
+	if(gp.st_mtime < sp->st_mtime)
+		return(NULL);
+
+	*sp = gp;
+	return(buf);
+}
+
+
+/**
+	@brief Format an HTTP date, "Sun, 06 Nov 1994 08:49:37 GMT"
+	@param[in] t: time in seconds
+	@param[out] *buf: result, at least HTTP_DATE_SIZE bytes
+	@return buf
+*/
+MEMSPACE
+char *http_date(time_t t, char *buf)
+{
+	tm_t tm;
+
+	gmtime_r(&t, &tm);
+	snprintf(buf, HTTP_DATE_SIZE, "%s, %02d %s %04d %02d:%02d:%02d GMT",
+		tm_wday_to_ascii(tm.tm_wday),
+		tm.tm_mday,
+		tm_mon_to_ascii(tm.tm_mon),
+		tm.tm_year + 1900,
+		tm.tm_hour, tm.tm_min, tm.tm_sec);
+	return(buf);
+}
+
+
+/**
+	@brief Make an ETag from the file size and modification time
+	@param[in] *sp: stat of the file sent
+	@param[out] *buf: result, at least HTTP_DATE_SIZE bytes
+	@return buf
+*/
+MEMSPACE
+char *http_etag(struct stat *sp, char *buf)
+{
+	snprintf(buf, HTTP_DATE_SIZE, "\"%lx-%lx\"",
+		(long) sp->st_size, (long) sp->st_mtime);
+	return(buf);
+}
+
+
+/**
+	@brief Read a decimal number of up to 4 digits
+	@param[in] *ptr: string
+	@param[out] *val: result
+	@return pointer after the number or NULL if there are no digits
+*/
+MEMSPACE
+static char *http_date_num(char *ptr, int *val)
+{
+	int i;
+
+	*val = 0;
+	for(i=0;i<4 && isdigit(*ptr);++i)
+		*val = *val * 10 + (*ptr++ - '0');
+	return(i ? ptr : NULL);
+}
+
+/**
+	@brief Read a three letter month name
+	@param[in] *ptr: string
+	@param[out] *mon: month 0 .. 11
+	@return pointer after the name or NULL if it is not a month
+*/
+MEMSPACE
+static char *http_date_mon(char *ptr, int *mon)
+{
+	int i;
+
+	for(i=0;i<12;++i)
+	{
+		if(strncasecmp(ptr, tm_mon_to_ascii(i), 3) == 0)
+		{
+			*mon = i;
+			return(ptr + 3);
+		}
+	}
+	return(NULL);
+}
+
+/**
+	@brief Parse an HTTP date in any of the three formats of RFC 9110 5.6.7
+	 "Sun, 06 Nov 1994 08:49:37 GMT"  IMF-fixdate, what http_date() writes
+	 "Sunday, 06-Nov-94 08:49:37 GMT" RFC 850, two digit years before 70 are 20xx
+	 "Sun Nov  6 08:49:37 1994"       C asctime()
+	@param[in] *str: date string
+	@param[out] *t: time in seconds
+	@return 1 on success, 0 if the date is not understood
+*/
+MEMSPACE
+int http_date_parse(char *str, time_t *t)
+{
+	tm_t tm;
+	char *ptr;
+	int asc;
+
+	memset(&tm, 0, sizeof(tm));
+	ptr = skipspaces(str);
+	// The day name is not needed, a ',' follows it except in asctime
+	while(*ptr && *ptr != ',' && *ptr != ' ')
+		++ptr;
+	asc = (*ptr == ' ');
+	if(*ptr == ',')
+		++ptr;
+	ptr = skipspaces(ptr);
+
+	if(asc)
+	{
+		ptr = http_date_mon(ptr, &tm.tm_mon);
+		if(!ptr)
+			return(0);
+		ptr = http_date_num(skipspaces(ptr), &tm.tm_mday);
 	}
-	if(*str == ':')
+	else
 	{
-		*p = str+1;
-		return(1);
+		ptr = http_date_num(ptr, &tm.tm_mday);
+		if(!ptr || (*ptr != ' ' && *ptr != '-'))
+			return(0);
+		ptr = http_date_mon(ptr + 1, &tm.tm_mon);
+		if(!ptr || (*ptr != ' ' && *ptr != '-'))
+			return(0);
+		ptr = http_date_num(ptr + 1, &tm.tm_year);
 	}
-	return(0);
+	if(!ptr || *ptr != ' ')
+		return(0);
+
+	ptr = http_date_num(ptr + 1, &tm.tm_hour);
+	if(!ptr || *ptr != ':')
+		return(0);
+	ptr = http_date_num(ptr + 1, &tm.tm_min);
+	if(!ptr || *ptr != ':')
+		return(0);
+	ptr = http_date_num(ptr + 1, &tm.tm_sec);
+	if(!ptr)
+		return(0);
+
+	if(asc)
+	{
+		ptr = http_date_num(skipspaces(ptr), &tm.tm_year);
+		if(!ptr)
+			return(0);
+	}
+	else if(!MATCHI_LEN(skipspaces(ptr), "GMT"))
+		return(0);
+
+	if(tm.tm_year < 70)
+		tm.tm_year += 2000;
+	else if(tm.tm_year < 100)
+		tm.tm_year += 1900;
+	if(tm.tm_year < 1970 || tm.tm_mday < 1 || tm.tm_mday > 31 ||
+		tm.tm_hour > 23 || tm.tm_min > 59 || tm.tm_sec > 60)
+		return(0);
+	tm.tm_year -= 1900;
+
+	*t = timegm(&tm);
+	return(1);
 }
 
-/** 
-	@brief Find next space or ? character
-	@param[in] *ptr: string to search
-	@return first space or ? character
+
+/**
+	@brief Does the client already have this version of the file ?
+	If-None-Match is used in preference to If-Modified-Since
+	ETags are compared as strings, If-Modified-Since is parsed and the
+	file is not modified if its mtime is not after that date
+	@param[in] *hi: hinfo_t header structure
+	@param[in] *sp: stat of the file we would send
+	@return 1 if a 304 Not Modified can be sent, otherwise 0
 */
 MEMSPACE
-char *nextbreak(char *ptr)
+int not_modified(hinfo_t *hi, struct stat *sp)
 {
-   if(!ptr)
-        return(ptr);
+	char buf[HTTP_DATE_SIZE];
+	time_t t;
 
-    while(*ptr) {
-		if(*ptr == ' ' || *ptr == '\t' || *ptr == '?')
-			break;
-        ++ptr;
+	if(hi->if_none_match)
+	{
+		if(*hi->if_none_match == '*')
+			return(1);
+		// May be a list of tags
+		return( strstr(hi->if_none_match, http_etag(sp, buf)) != NULL );
 	}
-    return(ptr);
+	// A date that can not be parsed is ignored
+	if(hi->if_modified_since && http_date_parse(hi->if_modified_since, &t))
+		return( sp->st_mtime <= t );
+	return(0);
 }
 
 
-/** 
-	@brief Print a decimal number into a string without an EOS
-	@param[in] *ptr: buffer to write number to
-	@param[in] num: number to convet
+/**
+	@brief Write Last-Modified, ETag and Cache-Control headers
+	@param[in] *p: rwbuf_t pointer to socket buffer
+	@param[in] type: mimetype index, selects max-age
+	@param[in] *sp: stat of the file sent
 	@return void
 */
 MEMSPACE
-void u5toa(char *ptr, uint16_t num)
+void html_validators(rwbuf_t *p, int type, struct stat *sp)
 {
-	char buf[10];
-	snprintf(buf,5,"%5u",num);
-	memcpy(ptr,buf,5);
+	char buf[HTTP_DATE_SIZE];
+	uint32_t age;
+
+	if(type >= PTYPE_ERR)
+		type = PTYPE_ERR;
+	age = mimes[type].max_age;
+
+	sock_printf(p,"Last-Modified: %s\n", http_date(sp->st_mtime, buf));
+	sock_printf(p,"ETag: %s\n", http_etag(sp, buf));
+	// no-cache still lets the client use the validators
+	if(age)
+		sock_printf(p,"Cache-Control: max-age=%lu\n", (unsigned long) age);
+	else
+		sock_printf(p,"Cache-Control: no-cache\n");
 }
 
 
+// Response headers are sent for every request, they are parsed at compile time
+// See printf/printf_desc.h for the format strings, test_printf checks them
+static const printf_desc_t head_not_modified[] = HEAD_NOT_MODIFIED_DESC;
+static const printf_desc_t head_length[] = HEAD_LENGTH_DESC;
+static const printf_desc_t head_chunked[] = HEAD_CHUNKED_DESC;
 
-// =================================================================
+/**
+	@brief Send 304 Not Modified
+	@param[in] *p: rwbuf_t pointer to socket buffer
+	@param[in] type: mimetype index
+	@param[in] *sp: stat of the file we would send
+	@return void
+*/
+MEMSPACE
+void html_not_modified(rwbuf_t *p, int type, struct stat *sp)
+{
+	sock_printf_desc(p, head_not_modified,
+		html_status(STATUS_NOT_MODIF),
+		html_connection(p));
+	html_validators(p, type, sp);
+	sock_printf(p,"Vary: Accept-Encoding\n\n");
+}
+
+
+/**
+	@brief Does the client want a persistent connection ?
+	HTTP/1.1 is persistent unless "Connection: close" is sent
+	HTTP/1.0 must ask with "Connection: keep-alive"
+	@param[in] *hi: hinfo_t header structure
+	@return 1 if the connection may be kept open, otherwise 0
+*/
+MEMSPACE
+int http_keepalive(hinfo_t *hi)
+{
+	if(hi->connection)
+	{
+		if(MATCHI_LEN(hi->connection,"close"))
+			return(0);
+		if(MATCHI_LEN(hi->connection,"keep-alive"))
+			return(1);
+	}
+	if(hi->html_encoding && MATCH_LEN(hi->html_encoding,"HTTP/1.1"))
+		return(1);
+	return(0);
+}
+
+
+/**
+	@brief Connection header value for this response
+	@param[in] *p: rwbuf_t pointer to socket buffer
+	@return "keep-alive" or "close"
+*/
+MEMSPACE
+char *html_connection(rwbuf_t *p)
+{
+	return(p->keepalive ? "keep-alive" : "close");
+}
 
 
 /**
@@ -1512,15 +1873,24 @@ void u5toa(char *ptr, uint16_t num)
     @param[in] status: html status message index
     @param[in] type: mimetype index
     @param[in] len: length of message
+    @param[in] *encoding: Content-Encoding, NULL if none
+    @param[in] *sp: stat of the file sent for cache validators, NULL if none
     @return void
 */
 MEMSPACE
-void html_head(rwbuf_t *p, int status, char type, int len	)
+void html_head(rwbuf_t *p, int status, char type, int len, char *encoding, struct stat *sp)
 {
-	sock_printf(p,"HTTP/1.1 %s\nContent-Type: %s\nContent-Length: %lu\n\n", 
+	sock_printf_desc(p, head_length,
 		html_status(status),
 		mime_type(type), 
-		len );
+		html_connection(p),
+		(unsigned long) len );
+	if(encoding)
+		sock_printf(p,"Content-Encoding: %s\n", encoding);
+	if(sp)
+		html_validators(p, type, sp);
+	// Caches must key on Accept-Encoding, we may send either form
+	sock_printf(p,"Vary: Accept-Encoding\n\n");
 }
 
                                                       
@@ -1534,171 +1904,35 @@ void html_head(rwbuf_t *p, int status, char type, int len	)
 MEMSPACE
 int parse_http_request(rwbuf_t *p, hinfo_t *hi)
 {
-	int ret,len;
-	int c,type,header;
-	
-	char *ptr;
-	char *value;
-	char *name;
-	char *save;
-	mem_t memp;
-
-    init_hinfo(hi);        // Init Headers
-
-	type = -1;
-
 #if WEB_DEBUG & 8
+	char *name,*value;
 	printf("\nparse_http_request\n");
 #endif
-	if(!p || !p->rbuf || !p->received)
+
+	if(!p || !p->rbuf || !p->request)
 	{
+		init_hinfo(hi);
 #if WEB_DEBUG & 1
 		printf("EMPTY\n");
 #endif
 		return(0);
 	}
 
-	ptr = meminit(&memp, p->rbuf, p->received);
-
-	// memgets converts '\n' to EOS, then points to next string
-	while( (ptr = memgets(&memp)) ) 
+	// Only the current request, pipelined requests may follow it
+	if(!http_parse(hi, p->rbuf, p->request))
 	{
-		save = ptr;
-		// check against known headers
-		header = match_headers(save,&ptr);
-
-		if(header == -1)
-		{
-			// Does it at least look like a header ?
-			if( !is_header(save, &ptr))
-			{
-#if WEB_DEBUG & 8
-		printf("Header break ==== \n");
-#endif
-				break;
-			}
 #if WEB_DEBUG & 8
-		printf("header skip:[%s]\n",save);
+		printf("Unknown type\n");
 #endif
-			// skip the unknown header
-			continue;
-		}
-
-#if WEB_DEBUG & 8
-		printf("header: %s %s\n",msg_headers[header].pattern,ptr);
-#endif
-		// ptr now points just after the matched header  pattern
-
-		type = msg_headers[header].type;
-
-		if(type == TOKEN_CONTENT_LENGTH)
-		{
-			hi->content_length = atoi(ptr);
-			continue;
-		}
-
-		if(type == TOKEN_CONTENT_TYPE )
-		{
-			hi->content_type = ptr;
-			continue;
-		}
-
-		// Process CONNECTION directive
-		if(type == TOKEN_CONNECTION)
-		{
-			hi->connection = (char *)ptr;
-			ptr = nextbreak(ptr);
-			if(*ptr)
-				*ptr++ = 0;	// Filename EOS
-/// We must respond with Connection: keep-alive now
-#if WEB_DEBUG & 8
-			printf("connection: %s\n", hi->connection);
-#endif
-		}
-
-		// Process GET,POST or HEAD directive
-		// These methods put EOS characters withing the current string
-		if(type == TOKEN_GET)
-		{
-			hi->type = type;
-			hi->filename = ptr;
-			ptr = nextbreak(ptr);
-			c = *ptr;
-			if(*ptr)
-				*ptr++ = 0;	// Filename EOS
-#if WEB_DEBUG & 8
-			printf("filename: [%s]\n",hi->filename);
-#endif
-			// ? implies Arguments
-			if(c == '?') 
-				ptr = process_args(hi,ptr);
-
-			// HTTP Encoding
-			ptr = skipspaces(ptr);
-			hi->html_encoding = ptr;
-		} // GET
-
-		else if(type == TOKEN_POST || type == TOKEN_HEAD )
-		{
-			hi->type = type;
-			hi->filename = ptr;
-			// find next space - after arguments
-			ptr = nextbreak(ptr);
-			c = *ptr;
-			if(*ptr)
-				*ptr++ = 0;	// Filename EOS
-#if WEB_DEBUG & 8
-			printf("filename: [%s]\n",hi->filename);
-#endif
-			// ? implies Arguments
-			if(c == '?') {	
-#if WEB_DEBUG & 8
-				printf("Warning arguments not expected for %d\n", type);
-#endif
-				ptr = process_args(hi,ptr);
-			}
-			// HTTP Encoding
-			ptr = skipspaces(ptr);
-			hi->html_encoding = ptr;
-		} // POST or HEAD
-		else if( type == -1) {
-#if WEB_DEBUG & 8
-			printf("Unknown type: %d\n", hi->type);
-#endif
-			return(0);
-		}
-	}
-
-	// POST has arguments after all headers
-	if(hi->type == TOKEN_POST ) {
-		// Get first non blank line
-		while( (ptr = memgets(&memp)) ) {
-#if WEB_DEBUG & 8
-		printf("process_args:[%s]\n",ptr);
-#endif
-			if(strlen(ptr) > 1)
-				break;
-		}
-		if(strlen(ptr) != hi->content_length)
-		{
-#if WEB_DEBUG & 8
-		printf("strlen:[%d] != hi->content_length:[%d]\n",
-			strlen(ptr) , hi->content_length);
-#endif
-
-		}
-		if(ptr)
-			ptr = process_args(hi,ptr);
+		return(0);
 	}
 
 #if WEB_DEBUG & 8
 	if(hi->type == TOKEN_POST && hi->content_length)
 	{
-		int len;
 		printf("ARGS\n");
 		first_arg(hi);
 		while( (name = arg_name(hi)) ) {
-			len = strlen(name);
 			value = arg_value(hi);
 			printf("\t%s=%s\n",name,value);
 			if(!next_arg(hi))
@@ -1724,6 +1958,27 @@ int parse_http_request(rwbuf_t *p, hinfo_t *hi)
 
 
 // =================================================================
+/**
+  @brief Close a connection that lost received data
+  The rest of the stream can not be parsed and a message body
+  would be saved with a hole in it
+  @param[in] *p: rwbuf_t pointer for this socket buffer
+  @param[in] *msg: reason
+  @param[in] lost: bytes lost
+  @return void
+*/
+MEMSPACE
+static void web_receive_lost(rwbuf_t *p, char *msg, int lost)
+{
+#if WEB_DEBUG & 1
+	printf("web_data_receive_callback: %s, lost:%d, closing\n", msg, lost);
+#endif
+	p->keepalive = 0;
+	p->state = WEB_FINISH;
+	p->delete = 1;
+	espconn_disconnect(p->conn);
+}
+
 /**
   @brief Network receive callback function
   @param[in] *arg: connection pointer
@@ -1736,6 +1991,7 @@ static void web_data_receive_callback(void *arg, char *data, unsigned short leng
 {
 	espconn_t *conn = (espconn_t *) arg;
     int index;
+	int room;
     rwbuf_t *p = find_connection(conn, &index, "web_data_receive_callback");
 
 #if WEB_DEBUG & 2
@@ -1753,44 +2009,48 @@ static void web_data_receive_callback(void *arg, char *data, unsigned short leng
 		return;
 	}
 
-	// The main task has not yet read the data - we must discard it
-	if(p->received)
+	// We hold receive while there is pending data, so this should not happen
+	if(p->pend)
 	{
-#if WEB_DEBUG & 1
-		printf("web_data_receive_callback: receive buffer busy rejecting:%d\n",length);
-#endif
-		// FIXME flag overrun
+		web_receive_lost(p, "receive buffer busy", length);
 		esp_schedule();
 		return;
 	}
 
-	// TRIM buffer size if needed
-	if(length > p->rsize)
-	{
-		// FIXME we may want to permit multi packet receive
-		// FIXME flag overrun
-#if WEB_DEBUG & 1
-		printf("web_data_receive_callback: receive too big:%d, trim to:%d\n",length,p->rsize);
-#endif
-		length = p->rsize;
-	}
-
-	// reset read pointers
-	rwbuf_rinit(p);
 	if(p->rbuf)
 	{
-		memset(p->rbuf,0, p->rsize);
-		memcpy(p->rbuf,data,length);
-		p->received = length;
+		// New data is added after data the main task has not read yet
+		room = p->rsize - p->received;
+		if(room > length)
+			room = length;
+		memcpy(p->rbuf + p->received,data,room);
+		p->received += room;
+		p->rbuf[p->received] = 0;
+
+		// Keep the rest and stop receiving until web_task has room for it
+		// TCP flow control then slows the sender down
+		if(room < length)
+		{
+			p->pend = safemalloc(length - room);
+			if(p->pend)
+			{
+				memcpy(p->pend, data + room, length - room);
+				p->pend_len = length - room;
+				p->pend_off = 0;
+				espconn_recv_hold(conn);
+				p->held = 1;
+			}
+			else
+				web_receive_lost(p, "no memory", length - room);
+		}
 #if WEB_DEBUG & 2
-		printf("web_data_receive_callback: conn=%p, received:%d\n",conn,length);
+		printf("web_data_receive_callback: conn=%p, received:%d, pending:%d\n",
+			conn,length,p->pend_len);
 #endif
 	}
 	else
 	{
-#if WEB_DEBUG & 1
-		printf("web_data_receive_callback: buffer NULL\n");
-#endif
+		web_receive_lost(p, "buffer NULL", length);
 	}
 #if WEB_DEBUG & 2
     display_ipv4("local  ", conn->proto.tcp->local_ip, conn->proto.tcp->local_port);
@@ -1845,7 +2105,23 @@ static void web_data_sent_callback(void *arg)
 	esp_schedule();
 }
 
-// FIXME we still have issues with deleting connection
+/**
+  @brief Mark a connection closed by the network
+  web_task may be part way through a response on this connection
+  so it returns the buffers to the pool on its next pass
+  Clearing send ends any wait_send() on this connection
+  @param[in] *p: rwbuf_t pointer
+  @return void
+*/
+MEMSPACE
+static void rwbuf_closed(rwbuf_t *p)
+{
+	p->conn = NULL;
+	p->delete = 1;
+	p->closed = 1;
+	rwbuf_winit(p);
+}
+
 /**
   @brief Network disconnect callback function
   @param[in] *arg: connection pointer
@@ -1869,8 +2145,9 @@ static void web_data_disconnect_callback(void *arg)
 #if WEB_DEBUG & 2
 		printf("web_data_disconnect_callback: disconnect %p\n", conn);
 #endif
-        delete_connection(p);
+		rwbuf_closed(p);
         esp_schedule();
+		return;
     }
 
 #if WEB_DEBUG & 2
@@ -1914,11 +2191,29 @@ static void web_data_error_callback(void *arg, int8_t err)
     printf("************************************************\n");
     printf("\n");
 #endif
+    // The connection is gone, there may be no disconnect callback
+	if(p)
+		rwbuf_closed(p);
     // delete the bad connection
     espconn_disconnect(conn);
 	esp_schedule();
 }
 
+///@brief Sent when the connection pool is full
+static char web_busy_msg[] =
+	"HTTP/1.1 503 Service Unavailable\nConnection: close\nRetry-After: 1\nContent-Length: 0\n\n";
+
+/**
+  @brief Network sent callback for a connection we had no room for
+  @param[in] *arg: connection pointer
+  @return void
+*/
+MEMSPACE
+static void web_busy_sent_callback(void *arg)
+{
+	espconn_disconnect((espconn_t *) arg);
+}
+
 /**
   @brief incomming connection setup callbacks
   @param[in] *conn: espconn structure pointer
@@ -1959,6 +2254,9 @@ static void web_data_connect_callback(espconn_t *conn)
 #if WEB_DEBUG & 1
 		printf("Can not create connection\n");
 #endif
+		// Admission control - the pool is full so tell the client to retry
+		espconn_regist_sentcb(conn, web_busy_sent_callback);
+		espconn_send(conn, (uint8_t *) web_busy_msg, strlen(web_busy_msg));
 		esp_schedule();
 		return;
 	}
@@ -2052,105 +2350,400 @@ int is_cgitoken(char *str)
 {
 	int len = 0;
 
-	if( str[0] == '@' && str[1] == '_' )
+	if( str[0] == '@' && str[1] == '_' )
+	{
+		// token body is after @_, 2 bytes long
+		len += 2;
+		str += 2;
+
+		while(*str) 
+		{
+			// End of Token
+			if( str[0] == '_' && str[1] == '@')
+			{
+				len += 2;
+#if WEB_DEBUG & 8
+				printf("is_cgi_token:%d\n",len);
+#endif
+				return(len);
+			}
+			if(is_cgitoken_char(0xff & *str) == 0)
+				break;
+			++str;
+			++len;
+		}
+	}
+	return(-1);
+}
+
+
+/**
+    @brief CGI token @_TIMER_@ - time of day and time zone
+    @param[in] *p: socket stream
+    @return length of replaced text
+*/
+MEMSPACE
+static int web_token_timer(rwbuf_t *p)
+{
+	tz_t tz;
+	tv_t tv;
+	time_t secs;
+	char *utc;
+
+	gettimeofday( &tv, &tz );
+
+	secs = tv.tv_sec;
+	if( is_dst(secs) )
+		tz.tz_dsttime = 1;
+
+	utc = ctime(&secs);
+
+	return( sock_printf(p, "Time: %s seconds: %lu.%06lu, minuteswest:%d, dsttime:%d",
+		utc, 
+		(uint32_t) tv.tv_sec,
+		(uint32_t) tv.tv_usec,
+		(int)tz.tz_minuteswest,
+		(int)tz.tz_dsttime) );
+}
+
+/**
+    @brief CGI token @_DATE_@ - date
+    @param[in] *p: socket stream
+    @return length of replaced text
+*/
+MEMSPACE
+static int web_token_date(rwbuf_t *p)
+{
+	time_t sec;
+	time(&sec);
+	return( sock_printf(p, "Date: %s", ctime(&sec)) );
+}
+
+/**
+    @brief Replace CGI token with CGI result
+	CGI tokens have the following syntax @_example123_@
+	They start with "@_" and end with "_@"
+    "@_" must be first two characters of string
+	May have upper and lower case letters, numbers and '-'
+    @param[in] *p: socket stream
+    @param[in] *str: string with token, example @_A_@
+    @return length of replaced text or 0 if no CGI handler was matched
+*/
+MEMSPACE
+int rewrite_cgi_token(rwbuf_t *p, char *src)
+{
+	return( cgi_token_write(p, cgi_token_id(src)) );
+}
+
+
+/**
+    @brief CGI route timer.cgi - sends time.htm
+    @param[in] *p: rwbuf_t pointer to socket buffer
+    @param[in] *hi: hinfo_t header structure with arguments
+    @return file name to send
+*/
+MEMSPACE
+static char *web_route_timer(rwbuf_t *p, hinfo_t *hi)
+{
+	return("time.htm");
+}
+
+/**
+    @brief Send the header of a text response of unknown length
+	HTTP/1.1 clients get chunks, HTTP/1.0 clients need the connection closed
+	Finish the response with html_text_end()
+    @param[in] *p: rwbuf_t pointer to socket buffer
+    @param[in] *hi: hinfo_t header structure
+    @return void
+*/
+MEMSPACE
+void html_text_start(rwbuf_t *p, hinfo_t *hi)
+{
+	if(hi->html_encoding && MATCH_LEN(hi->html_encoding,"HTTP/1.1"))
+	{
+		sock_printf_desc(p, head_chunked,
+			html_status(200),
+			mime_type(PTYPE_TEXT),
+			html_connection(p));
+		write_chunked_start(p);
+	}
+	else
+	{
+		p->keepalive = 0;
+		sock_printf(p,"HTTP/1.1 %s\nContent-Type: %s\nConnection: close\n\n",
+			html_status(200),
+			mime_type(PTYPE_TEXT));
+	}
+}
+
+/**
+    @brief Finish a response started with html_text_start()
+    @param[in] *p: rwbuf_t pointer to socket buffer
+    @return void
+*/
+MEMSPACE
+void html_text_end(rwbuf_t *p)
+{
+	if(p->chunked)
+		write_chunked_end(p);
+}
+
+/**
+    @brief Text output to a socket, for report functions
+    @param[in] *ctx: rwbuf_t pointer to socket buffer
+    @param[in] *line: report line
+    @return void
+*/
+MEMSPACE
+void web_text_put(void *ctx, char *line)
+{
+	write_len((rwbuf_t *) ctx, line, strlen(line));
+}
+
+#ifdef HEAP_TRACE
+
+/**
+    @brief CGI route heap.cgi - sends the heap report as text
+	Argument: mark=1 remembers bytes outstanding for the growth column
+    @param[in] *p: rwbuf_t pointer to socket buffer
+    @param[in] *hi: hinfo_t header structure with arguments
+    @return NULL, the response is sent here
+*/
+MEMSPACE
+static char *web_route_heap(rwbuf_t *p, hinfo_t *hi)
+{
+	if(http_value(hi,"mark"))
+		heap_mark();
+
+	html_text_start(p, hi);
+	heap_report(web_text_put, p);
+	html_text_end(p);
+	return(NULL);
+}
+#endif
+
+#ifdef PROFILE
+/**
+    @brief CGI route prof.cgi - sends the profiler trace or statistics
+	Trace Event JSON by default, save it and open it in chrome://tracing
+	Arguments: stats=1 sends zone statistics, clear=1 clears afterwards
+    @param[in] *p: rwbuf_t pointer to socket buffer
+    @param[in] *hi: hinfo_t header structure with arguments
+    @return NULL, the response is sent here
+*/
+MEMSPACE
+static char *web_route_prof(rwbuf_t *p, hinfo_t *hi)
+{
+	html_text_start(p, hi);
+	if(http_value(hi,"stats"))
+		prof_stats(web_text_put, p);
+	else
+		prof_trace(web_text_put, p);
+	html_text_end(p);
+	if(http_value(hi,"clear"))
+		prof_clear();
+	return(NULL);
+}
+#endif
+
+/**
+    @brief CGI route led.cgi - set virtual LED, sends dout.htm
+	Argument: led0=on
+    @param[in] *p: rwbuf_t pointer to socket buffer
+    @param[in] *hi: hinfo_t header structure with arguments
+    @return file name to send
+*/
+MEMSPACE
+static char *web_route_led(rwbuf_t *p, hinfo_t *hi)
+{
+	char *param;
+
+	if( (param = http_value(hi,"led0")) )
+	{
+		if(!strcmp(param,"on")) led_on(0);
+		else			led_off(0);
+	}
+	else led_off(0);
+	return("dout.htm");
+}
+
+/**
+    @brief CGI route msg.cgi - show a message on the display, sends msg.cgi
+	Arguments: title, contact, location, location_other, return, return_other
+    @param[in] *p: rwbuf_t pointer to socket buffer
+    @param[in] *hi: hinfo_t header structure with arguments
+    @return file name to send
+*/
+MEMSPACE
+static char *web_route_msg(rwbuf_t *p, hinfo_t *hi)
+{
+	char *param;
+	int away = 0;
+
+	// send output to display
+#if WEB_DEBUG & 8
+	printf("found msg.cgi\n");
+#endif
+
+#ifdef DEBUG_STATS
+	tft_fillWin(winmsg, winmsg->bg);
+	tft_set_textpos(winmsg, 0,0);
+	tft_set_font(winmsg,1);
+#else
+	tft_fillWin(wintop, wintop->bg);
+	tft_set_textpos(wintop, 0,0);
+	tft_set_font(wintop,2);
+
+	tft_fillWin(winmsg, winmsg->bg);
+	tft_set_textpos(winmsg, 0,0);
+	tft_set_font(winmsg,2);
+#endif
+
+#if WEB_DEBUG & 8
+	printf("msg.cgi: winmsg(%d,%d)\n",winmsg->h,winmsg->w);
+#endif
+
+	// TOP
+	if( (param = http_value(hi,"title")) && strlen(param))
+	{
+#if WEB_DEBUG & 8
+		printf("msg.cgi: %s\n",param);
+#endif
+
+#ifdef DEBUG_STATS
+		tft_printf(winmsg, "%s\n", param);
+#else
+		tft_set_textpos(wintop,1,0);
+		tft_printf(wintop, "%s", param);
+#endif
+	}
+	if( (param = http_value(hi,"contact")) && strlen(param))
+	{
+#if WEB_DEBUG & 8
+		printf("msg.cgi: %s\n",param);
+#endif
+#ifdef DEBUG_STATS
+		tft_printf(winmsg, "%s\n", param);
+#else
+		tft_set_textpos(wintop,1,1);
+		tft_printf(wintop, "%s", param);
+#endif
+	}
+	// MESSAGE
+	if( (param = http_value(hi,"location")) && strlen(param))
+	{
+#if WEB_DEBUG & 8
+		printf("msg.cgi: %s\n",param);
+#endif
+		tft_printf(winmsg, "-> %s\n", param);
+		++away;
+	}
+	else if( (param = http_value(hi,"location_other")) && strlen(param) )
+	{
+#if WEB_DEBUG & 8
+		printf("msg.cgi: %s\n",param);
+#endif
+		tft_printf(winmsg, "-> %s\n", param);
+		++away;
+	}
+
+	if( (param = http_value(hi,"return")) && strlen(param))
 	{
-		// token body is after @_, 2 bytes long
-		len += 2;
-		str += 2;
-
-		while(*str) 
-		{
-			// End of Token
-			if( str[0] == '_' && str[1] == '@')
-			{
-				len += 2;
 #if WEB_DEBUG & 8
-				printf("is_cgi_token:%d\n",len);
+		printf("msg.cgi: %s\n",param);
 #endif
-				return(len);
-			}
-			if(is_cgitoken_char(0xff & *str) == 0)
-				break;
-			++str;
-			++len;
-		}
+		tft_printf(winmsg, "Return by\n");
+		tft_printf(winmsg, "-> %s", param);
+		++away;
 	}
-	return(-1);
+	else if( (param = http_value(hi,"return_other")) && strlen(param) )
+	{
+#if WEB_DEBUG & 8
+		printf("msg.cgi: %s\n",param);
+#endif
+		tft_printf(winmsg, "Return by\n");
+		tft_printf(winmsg, "-> %s", param);
+		++away;
+	}
+	if(!away)
+		tft_printf(winmsg, "-> Is Here");
+	return("msg.cgi");
 }
 
 
 /**
-    @brief Replace CGI token with CGI result
-	CGI tokens have the following syntax @_example123_@
-	They start with "@_" and end with "_@"
-    "@_" must be first two characters of string
-	May have upper and lower case letters, numbers and '-'
-    @param[in] *p: socket stream
-    @param[in] *str: string with token, example @_A_@
-    @return length of replaced text or 0 if no CGI handler was matched
+    @brief Start a PUT request - the message body is saved to a file
+	web_task writes the body to the file as it is received
+	Any compiled template or .gz copy of the file is rebuilt or ignored
+	because it no longer matches the file size and time
+    @param[in] *p: rwbuf_t pointer to socket buffer
+    @param[in] *hi: hinfo_t header structure
+    @return 1 if the connection may be kept open, otherwise 0
 */
 MEMSPACE
-int rewrite_cgi_token(rwbuf_t *p, char *src)
+static int web_put(rwbuf_t *p, hinfo_t *hi)
 {
-	int len = 0;
-	int ind;
+#ifdef WEB_UPLOAD
+	char *name = hi->filename;
 
-	if((ind = MATCH_LEN(src,"@_TIMER_@")))
+	if(!name || !*name || MATCH(name,"/"))
 	{
-		tz_t tz;
-		tv_t tv;
-		time_t secs;
-		char *utc;
-
-		gettimeofday( &tv, &tz );
-
-		secs = tv.tv_sec;
-		if( is_dst(secs) )
-			tz.tz_dsttime = 1;
-
-		utc = ctime(&secs);
-	
-		len = sock_printf(p, "Time: %s seconds: %lu.%06lu, minuteswest:%d, dsttime:%d",
-			utc, 
-			(uint32_t) tv.tv_sec,
-			(uint32_t) tv.tv_usec,
-			(int)tz.tz_minuteswest,
-			(int)tz.tz_dsttime);
+		html_msg(p, STATUS_BAD_REQ, PTYPE_HTML, "PUT needs a file name\n");
+		return(p->keepalive = 0);
 	}
-	if((ind = MATCH_LEN(src,"@_DATE_@")))
+	p->fo = fopen(name,"w");
+	if(!p->fo)
 	{
-		time_t sec;
-		time(&sec);
-		len = sock_printf(p, "Date: %s", ctime(&sec));
+		html_msg(p, STATUS_FORBIDDEN, PTYPE_HTML, "File: %s can not be written\n", name);
+		return(p->keepalive = 0);
 	}
-
-	return ( len );
+#if WEB_DEBUG & 8
+	printf("PUT: %s, length:%ld\n", name, p->body_left);
+#endif
+	p->body_len = 0;
+	if(!p->body_left)
+	{
+		rwbuf_close_files(p);
+		html_msg(p, STATUS_CREATED, PTYPE_HTML, "Saved 0 bytes\n");
+		return(p->keepalive);
+	}
+	p->state = WEB_RECV_BODY;
+	return(p->keepalive);
+#else
+	html_msg(p, STATUS_NOT_IMPL, PTYPE_HTML, "PUT not enabled\n");
+	return(p->keepalive = 0);
+#endif
 }
 
 
 /**
     @brief Process an incoming HTTP request
     @param[in] *p: rwbuf_t pointer to socket buffer
-    @return void
+    @return 1 if the connection may be kept open, otherwise 0
 */
 MEMSPACE
-static void process_requests(rwbuf_t *p)
+static int process_requests(rwbuf_t *p)
 {
 	int len,ind,size;
 	long pos;
     uint8_t byte;
 	int8_t type;
 	char *name;
-	char *param;
 	char *value,*ptr;
+	web_route_fn route;
 	FILE *fi;
+	FILE *ft;
+	tpl_head_t head;
+	int dynamic;
+	char *encoding;
+	char gzname[MAX_NAME_LEN+4];
 	hinfo_t hibuff;
 	hinfo_t *hi;
     struct stat sp;
+	PROF_ZONE(PROF_WEB_REQUEST);
 
 	hi = &hibuff;
 	// a token like; $i_am_a_token_name$, must be less then this in length
-#define READBUFFSIZE 512
 	char buff[READBUFFSIZE+4];
 
 	if(!p->conn )
@@ -2158,14 +2751,14 @@ static void process_requests(rwbuf_t *p)
 #if WEB_DEBUG & 1
 		printf("Process Requests: NULL conn\n");
 #endif
-		return;
+		return(0);
 	}
 	if(!p->received)
 	{
 #if WEB_DEBUG & 1
 		printf("Process Requests: NULL ARG\n");
 #endif
-		return;
+		return(0);
 	}
 #if WEB_DEBUG & 2+8
 	web_sep();
@@ -2176,12 +2769,29 @@ static void process_requests(rwbuf_t *p)
 	printf("conn=%p\n", p->conn);
 #endif
 
+	// Decided before any response header is written
+	p->keepalive = 0;
+	p->head = 0;
+
 	if(!parse_http_request(p,hi))
 	{
 		html_msg(p, STATUS_BAD_REQ, PTYPE_HTML, "Not Understood Type:%d",type );
-		return;
+		return(0);
 	}
 
+	if(http_keepalive(hi) && p->requests + 1 < WEB_KEEPALIVE_MAX)
+		p->keepalive = 1;
+
+	// Headers only, the same ones GET would send
+	if(hi->type == TOKEN_HEAD)
+		p->head = 1;
+
+	if(hi->type == TOKEN_PUT)
+		return(web_put(p, hi));
+
+	if(hi->upgrade && hi->ws_key)
+		return(ws_upgrade(p, hi));
+
 	type = hi->type;
 	name = hi->filename;
 
@@ -2200,112 +2810,23 @@ static void process_requests(rwbuf_t *p)
 // CGI
 	if(type == PTYPE_CGI)
 	{
-		if(strstr(name,"timer.cgi")) 
+		route = web_route_find(name);
+		if(route)
 		{
-			name = hi->filename = "time.htm";
-		}
-		else if(strstr(name,"led.cgi"))
-		{			
-			name = hi->filename = "dout.htm";
-			if( (param = http_value(hi,"led0")) )
-			{
-				if(!strcmp(param,"on")) led_on(0);
-				else			led_off(0);
-			}
-			else led_off(0);
-		}
-		else if(strstr(name,"msg.cgi"))
-		{			
-			name = hi->filename = "msg.cgi";
-			int away = 0;
-
-			// send output to display
-#if WEB_DEBUG & 8
-			printf("found msg.cgi\n");
-#endif
-
-#ifdef DEBUG_STATS
-			tft_fillWin(winmsg, winmsg->bg);
-			tft_set_textpos(winmsg, 0,0);
-			tft_set_font(winmsg,1);
-#else
-			tft_fillWin(wintop, wintop->bg);
-			tft_set_textpos(wintop, 0,0);
-			tft_set_font(wintop,2);
-
-			tft_fillWin(winmsg, winmsg->bg);
-			tft_set_textpos(winmsg, 0,0);
-			tft_set_font(winmsg,2);
-#endif
-
-#if WEB_DEBUG & 8
-			printf("msg.cgi: winmsg(%d,%d)\n",winmsg->h,winmsg->w);
-#endif
-
-			// TOP
-			if( (param = http_value(hi,"title")) && strlen(param))
-			{
-#if WEB_DEBUG & 8
-				printf("msg.cgi: %s\n",param);
-#endif
-
-#ifdef DEBUG_STATS
-				tft_printf(winmsg, "%s\n", param);
-#else
-				tft_set_textpos(wintop,1,0);
-				tft_printf(wintop, "%s", param);
-#endif
-			}
-			if( (param = http_value(hi,"contact")) && strlen(param))
-			{
-#if WEB_DEBUG & 8
-				printf("msg.cgi: %s\n",param);
-#endif
-#ifdef DEBUG_STATS
-				tft_printf(winmsg, "%s\n", param);
-#else
-				tft_set_textpos(wintop,1,1);
-				tft_printf(wintop, "%s", param);
-#endif
-			}
-			// MESSAGE
-			if( (param = http_value(hi,"location")) && strlen(param))
-			{
-#if WEB_DEBUG & 8
-				printf("msg.cgi: %s\n",param);
-#endif
-				tft_printf(winmsg, "-> %s\n", param);
-				++away;
-			}
-			else if( (param = http_value(hi,"location_other")) && strlen(param) )
-			{
-#if WEB_DEBUG & 8
-				printf("msg.cgi: %s\n",param);
-#endif
-				tft_printf(winmsg, "-> %s\n", param);
-				++away;
-			}
-
-			if( (param = http_value(hi,"return")) && strlen(param))
-			{
-#if WEB_DEBUG & 8
-				printf("msg.cgi: %s\n",param);
-#endif
-				tft_printf(winmsg, "Return by\n");
-				tft_printf(winmsg, "-> %s", param);
-				++away;
-			}
-			else if( (param = http_value(hi,"return_other")) && strlen(param) )
+			// Handlers change state, such as the LED or the display,
+			// so HEAD, which must be safe, does not run them
+			if(p->head)
 			{
-#if WEB_DEBUG & 8
-				printf("msg.cgi: %s\n",param);
-#endif
-				tft_printf(winmsg, "Return by\n");
-				tft_printf(winmsg, "-> %s", param);
-				++away;
+				sock_printf(p,"HTTP/1.1 %s\nAllow: GET, POST\nConnection: %s\nContent-Length: 0\n\n",
+					html_status(STATUS_NOT_ALLOWED),
+					html_connection(p));
+				return(p->keepalive);
 			}
-			if(!away)
-				tft_printf(winmsg, "-> Is Here");
+			name = route(p, hi);
+			// The handler sent the response
+			if(!name)
+				return(p->keepalive);
+			hi->filename = name;
 		}
 	}
 	// END OF CGI
@@ -2318,30 +2839,107 @@ static void process_requests(rwbuf_t *p)
     if(stat(name, &sp) == -1)
     {
 		html_msg(p, STATUS_NOT_FOUND, PTYPE_HTML, "File: %s not found\n", name);
-		return;
+		return(p->keepalive);
     }
     len = (long) sp.st_size;
 
-	fi = fopen(name,"r");
+	// Compiled template for pages that may have CGI tokens
+	// Built on first access, must be opened before the page
+	ft = NULL;
+	if(type == PTYPE_HTML || type == PTYPE_CGI || type == PTYPE_TEXT)
+		ft = tpl_open(name, &sp, &head);
+
+	// CGI results and pages with CGI tokens change every time they are sent
+	dynamic = (type == PTYPE_CGI)
+		|| ((type == PTYPE_HTML || type == PTYPE_TEXT) && !(ft && head.tokens == 0));
+
+	// Pre-compressed copy, name.gz, if the client accepts gzip
+	// Pages with CGI tokens must be rewritten so are always sent as is
+	encoding = NULL;
+	if(!dynamic && gzip_name(hi, name, &sp, gzname, sizeof(gzname)))
+	{
+		if(ft)
+			fclose(ft);
+		ft = NULL;
+		encoding = "gzip";
+		len = (long) sp.st_size;
+#if WEB_DEBUG & 8
+		printf("gzip: %s, len:%d\n", gzname, len);
+#endif
+	}
+
+	// Conditional GET - the client has this version cached
+	if(!dynamic && not_modified(hi, &sp))
+	{
+#if WEB_DEBUG & 8
+		printf("Not modified: %s\n", name);
+#endif
+		if(ft)
+			fclose(ft);
+		html_not_modified(p, type, &sp);
+		return(p->keepalive);
+	}
+
+	fi = fopen(encoding ? gzname : name,"r");
 	/* Search the specified file in stored binaray html image */
 	if(!fi)
 	{
+		if(ft)
+			fclose(ft);
 		html_msg(p, STATUS_NOT_FOUND, PTYPE_HTML, "File: %s not found\n", name);
-		return;
+		return(p->keepalive);
 	}
 
 
 #if WEB_DEBUG & 8
 	printf("Found name: %s, type:%d\n",name,type);
 #endif
-	if(type == PTYPE_HTML || type == PTYPE_CGI || type == PTYPE_TEXT)
+	if(!encoding && (type == PTYPE_HTML || type == PTYPE_CGI || type == PTYPE_TEXT))
 	{
-        // Content length is not required for text and HTML files
+        // Without CGI tokens the page length is the file length
+		// Otherwise the length is not known, HTTP/1.1 clients get chunks
+		// and HTTP/1.0 clients need the connection closed
+		if(!dynamic)
+		{
+			html_head(p, 200, type, len, NULL, &sp);
+		}
+		else if(hi->html_encoding && MATCH_LEN(hi->html_encoding,"HTTP/1.1"))
+		{
+			sock_printf_desc(p, head_chunked,
+				html_status(200),
+				mime_type(type),
+				html_connection(p));
+			write_chunked_start(p);
+		}
+		else
+		{
+			p->keepalive = 0;
+			sock_printf(p,"HTTP/1.1 %s\nContent-Type: %s\nConnection: close\n\n",
+				html_status(200),
+				mime_type(type));
+		}
+
+		if(p->head)
+		{
+			if(ft)
+				fclose(ft);
+			fclose(fi);
+			return(p->keepalive);
+		}
 
-        sock_printf(p,"HTTP/1.1 %s\nContent-Type: %s\n\n\n",
-            html_status(200),
-            mime_type(type));
-		// socket write buffering
+		if(ft)
+		{
+			// web_task streams literal ranges and calls token handlers
+			p->fi = fi;
+			p->ft = ft;
+			p->tpl_segs = head.count;
+			p->tpl_left = 0;
+			p->sd_read += sizeof(tpl_head_t);
+			p->state = WEB_SEND_TPL;
+			return(p->keepalive);
+		}
+		// No template, the sidecar could not be written
+		// This is sent all at once, blocking other connections
 		while( 1 )
 		{
             optimistic_yield(1000);
@@ -2354,6 +2952,7 @@ static void process_requests(rwbuf_t *p)
 			len = fread(buff, 1, READBUFFSIZE,fi);
 			if(len == 0)
 				break;
+			p->sd_read += len;
 
 
 			// make sure that string operations stop at end of read data
@@ -2405,36 +3004,247 @@ static void process_requests(rwbuf_t *p)
 	else 
 	{	// NON CGI read and echo
         // Content length is required for all other files
-        html_head(p, 200, type, len   );
+        html_head(p, 200, type, len, encoding, &sp);
 
-		while(1)
+		if(p->head)
 		{
-            optimistic_yield(1000);
-            // Yeild happens when sending
-			// FIXME
-			len = fread(buff, 1, READBUFFSIZE,fi);
-			if(!len)
-				break;
-			write_len(p, buff, len);
+			fclose(fi);
+			return(p->keepalive);
 		}
+
+		// web_task reads the file directly into the socket buffer
+		p->fi = fi;
+		p->state = WEB_SEND_FILE;
+		return(p->keepalive);
 	}
-    write_flush(p);
 #if WEB_DEBUG & 2+8
 	web_sep();
 	printf("\nDone: ftell:%ld, len:%ld, feof%d\n",ftell(fi),len,feof(fi));
 	web_sep();
 #endif
 	fclose(fi);
+	return(p->keepalive);
+}
+
+
+/**
+    @brief Read the next part of a file into the socket write buffer
+    @param[in] *p: rwbuf_t pointer to socket buffer
+    @return 1 if there is more to send, 0 at end of file
+*/
+MEMSPACE
+static int file_send_chunk(rwbuf_t *p)
+{
+	int len;
 
-///FIXME if we want to support keep-alive we have to change this
+	len = fread(p->wbuf + p->wind, 1, p->wsize - p->wind, p->fi);
+	if(len <= 0)
+		return(0);
+	p->wind += len;
+	p->sd_read += len;
+	return(1);
 }
 
 // =======================================================
 
 
+/**
+    @brief Advance the response on one connection by one socket buffer
+	Nothing is done while the last buffer is still sending
+	WEB_IDLE:	process the next complete request in rbuf
+			discard any message body the request did not use
+	WEB_RECV_BODY:	write the received part of a message body to a file
+	WEB_SEND_*:	fill and send one buffer from the file or template
+	WEB_FINISH:	send the rest of wbuf and the last chunk
+	WEB_DONE:	keep the connection open or close it
+    @param[in] *p: rwbuf_t pointer to socket buffer
+    @return void
+*/
+MEMSPACE
+static void web_connection_task(rwbuf_t *p)
+{
+	int len,save,ret;
+	long body;
+
+	// Data that did not fit when it was received
+	rwbuf_pull(p);
+
+	// The last buffer is still sending
+	if(p->send)
+		return;
+
+	switch(p->state)
+	{
+	case WEB_IDLE:
+		// Discard the rest of a message body nobody wanted
+		if(p->body_left)
+		{
+			len = p->received;
+			if(len > p->body_left)
+				len = p->body_left;
+			rwbuf_consume(p, len);
+			p->body_left -= len;
+			if(p->body_left)
+				break;
+		}
+
+		// Skip blank lines between pipelined requests
+		while(p->received && (p->rbuf[0] == '\r' || p->rbuf[0] == '\n'))
+			rwbuf_consume(p, 1);
+
+		if(p->received)
+		{
+			len = http_header_len(p->rbuf, p->received, &body);
+			if(!len)
+			{
+				// Wait for the rest of the headers
+				if(p->received < p->rsize)
+					return;
+				// Too big, use what we have
+				len = p->received;
+				body = 0;
+			}
+
+			// Small bodies are parsed with the headers, POST form arguments
+			// PUT and bodies too big for rbuf are streamed by WEB_RECV_BODY
+			if(body > 0 && (MATCH_LEN(p->rbuf,"PUT ") || len + body > p->rsize))
+			{
+				p->body_left = body;
+			}
+			else if(body > 0)
+			{
+				// Wait for the rest of the body
+				if(len + body > p->received)
+					return;
+				len += body;
+			}
+
+#if WEB_DEBUG & 2
+            web_sep();
+			printf("web_task: received:%d, request:%d, requests:%d\n",
+				p->received, len, p->requests);
+#endif
+			// http_parse puts an EOS after the request
+			// restore the first byte of a following pipelined request
+			p->request = len;
+			save = (len < p->received) ? (0xff & p->rbuf[len]) : -1;
+			p->sd_read = 0;
+			p->start = system_get_time();
+			// Short responses are sent by WEB_FINISH
+			p->state = WEB_FINISH;
+			(void) process_requests(p);
+			if(save != -1)
+				p->rbuf[len] = save;
+			p->request = 0;
+			// The response no longer needs the request
+			rwbuf_consume(p, len);
+
+		}
+		// Close idle persistent connections
+		else if(p->requests &&
+			(system_get_time() - p->idle) > WEB_KEEPALIVE_TIMEOUT * 1000000UL)
+		{
+#if WEB_DEBUG & 2
+			printf("web_task: idle close, requests:%d\n", p->requests);
+#endif
+			p->delete = 1;
+			espconn_disconnect(p->conn);
+		}
+		break;
+
+	case WEB_RECV_BODY:
+		// Stream the message body to the file, one read buffer at a time
+		len = p->received;
+		if(len > p->body_left)
+			len = p->body_left;
+		if(len && p->fo && fwrite(p->rbuf, 1, len, p->fo) != len)
+		{
+#if WEB_DEBUG & 1
+			printf("web_task: write error\n");
+#endif
+			rwbuf_close_files(p);
+			p->keepalive = 0;
+			html_msg(p, STATUS_INT_SERR, PTYPE_HTML, "Write failed\n");
+			p->state = WEB_FINISH;
+			break;
+		}
+		rwbuf_consume(p, len);
+		p->body_left -= len;
+		p->body_len += len;
+		if(!p->body_left)
+		{
+			rwbuf_close_files(p);
+			html_msg(p, STATUS_CREATED, PTYPE_HTML, "Saved %ld bytes\n", p->body_len);
+			p->state = WEB_FINISH;
+		}
+		break;
+
+	case WEB_SEND_FILE:
+	case WEB_SEND_TPL:
+		if(p->state == WEB_SEND_FILE)
+			ret = file_send_chunk(p);
+		else
+			ret = tpl_send_chunk(p);
+		if(ret <= 0)
+		{
+#if WEB_DEBUG & 1
+			if(ret < 0)
+				printf("web_task: template read error\n");
+#endif
+			rwbuf_close_files(p);
+			p->state = WEB_FINISH;
+		}
+		if(ret > 0)
+			write_buffer(p);
+		break;
+
+	case WEB_WEBSOCKET:
+		ws_task(p);
+		break;
+
+	case WEB_FINISH:
+		if(p->chunked)
+		{
+			// Data left in the last chunk is sent first
+			if(p->wind > p->chunk + CHUNK_HEAD)
+			{
+				write_buffer(p);
+				break;
+			}
+			// Drop the unused chunk header space
+			p->wind = p->chunk;
+			p->chunked = 0;
+			write_str(p, "0\r\n\r\n");
+		}
+		write_buffer(p);
+		p->state = WEB_DONE;
+		break;
+
+	case WEB_DONE:
+		p->requests++;
+#if WEB_DEBUG & 32
+		printf("web_task: SD read:%ld, time:%lu us\n",
+			p->sd_read, (unsigned long) (system_get_time() - p->start));
+#endif
+		if(!p->keepalive)
+		{
+			p->received = 0;
+			p->delete = 1;
+			espconn_disconnect(p->conn);
+			break;
+		}
+		p->idle = system_get_time();
+		p->state = WEB_IDLE;
+		break;
+	}
+}
+
+
 /**
     @brief Process ALL incoming HTTP requests
-	@see process_requests()
+	Each call advances every open connection by at most one socket
+	buffer so clients share the link fairly
+	@see web_connection_task()
     @return void
 */
 MEMSPACE
@@ -2442,7 +3252,6 @@ void web_task()
 {
 	int i;
 	rwbuf_t *p;
-	// loop through all connections and process read actions
 
 	connections = 0;
 	for(i=0;i< MAX_CONNECTIONS;++i)
@@ -2452,33 +3261,89 @@ void web_task()
 		if(!p)
 			continue;
 
+		// Return closed connections to the pool
+		if(p->closed)
+		{
+			delete_connection(p);
+			continue;
+		}
+
 		++connections;
 
-		if(p->received)
+		if(p->delete)
 		{
-
-#if WEB_DEBUG & 2
-            web_sep();
-			printf("web_task: received:%d\n",p->received);
-#endif
-			process_requests(p);
-			p->received = 0;
-            espconn_disconnect(p->conn);
-			optimistic_yield(1000);
+			rwbuf_close_files(p);
+			continue;
 		}
+
+		web_connection_task(p);
+		optimistic_yield(1000);
 	}
 	esp_schedule();
 }
 
 // only called at main initialization time
+/**
+    @brief Allocate the connection pool
+	All socket buffers are allocated once, in one block, so
+	connections never fragment the heap
+    @return void
+*/
 MEMSPACE
 void web_init_connections()
 {
 	int i;
+	char *buf;
+
 	for(i=0;i<MAX_CONNECTIONS;++i)
 	{
 		web_connections[i] = NULL;
 	}
+
+	if(web_pool)
+		return;
+
+	web_pool = safecalloc(sizeof(rwbuf_t) * MAX_CONNECTIONS, 1);
+	// Always over allocate to allow an extra EOS or TWO
+	buf = safecalloc((BUFFER_SIZE+4) * 2 * MAX_CONNECTIONS, 1);
+	if(!web_pool || !buf)
+	{
+#if WEB_DEBUG & 1
+		printf("web_init_connections: calloc failed\n");
+#endif
+		if(web_pool)
+			safefree(web_pool);
+		if(buf)
+			safefree(buf);
+		web_pool = NULL;
+		return;
+	}
+
+	for(i=0;i<MAX_CONNECTIONS;++i)
+	{
+		web_pool[i].rbuf = buf;
+		web_pool[i].rsize = BUFFER_SIZE;
+		buf += BUFFER_SIZE+4;
+		web_pool[i].wbuf = buf;
+		web_pool[i].wsize = BUFFER_SIZE;
+		buf += BUFFER_SIZE+4;
+		rwbuf_delete(&web_pool[i]);
+	}
+#if WEB_DEBUG & 2
+	printf("web_init_connections: %d connections, %d bytes\n",
+		MAX_CONNECTIONS, (int) ((BUFFER_SIZE+4) * 2 + sizeof(rwbuf_t)) * MAX_CONNECTIONS);
+#endif
+}
+
+/**
+    @brief Display connection pool usage
+    @return void
+*/
+MEMSPACE
+void web_mem_stats()
+{
+	printf("connection pool: %d x %d bytes\n",
+		MAX_CONNECTIONS, (int) ((BUFFER_SIZE+4) * 2 + sizeof(rwbuf_t)));
 }
 
 /**
@@ -2490,6 +3355,20 @@ MEMSPACE
 void web_init(int port)
 {
 	web_init_connections();
+
+	// Register tokens before any template is compiled
+	web_token_add("@_TIMER_@", web_token_timer);
+	web_token_add("@_DATE_@", web_token_date);
+	web_route_add("timer.cgi", web_route_timer);
+	web_route_add("led.cgi", web_route_led);
+	web_route_add("msg.cgi", web_route_msg);
+#ifdef HEAP_TRACE
+	web_route_add("heap.cgi", web_route_heap);
+#endif
+#ifdef PROFILE
+	web_route_add("prof.cgi", web_route_prof);
+#endif
+
     wifi_set_sleep_type(NONE_SLEEP_T);
     tcp_accept(&WebConn, &WebTcp, port, web_data_connect_callback);
     espconn_regist_time(&WebConn, 10, 0);
@@ -30,27 +30,24 @@ typedef struct espconn espconn_t;
 #ifndef MAX_CONNECTIONS
 	#define MAX_CONNECTIONS 1
 #endif
+/// @brief connections the SDK accepts beyond MAX_CONNECTIONS
+/// They are only sent the 503 busy reply, see web_data_connect_callback()
+#ifndef WEB_BUSY_CONNECTIONS
+	#define WEB_BUSY_CONNECTIONS 1
+#endif
 
-// =======================================================
-// HTML HEADER information
-typedef struct {
-// GET /LEDCTL.CGI?led2=on&led3=on HTTP/1.1
-// TOKEN_GET,TOKEN_POST,TOKEN_HEAD
-    int type;
-    char *filename;
-    char *arg_ptr;
-    char *args;
-    uint16_t args_length;
-    char *html_encoding;
-	char *connection;
-// POST msg_pointers
-// Content-Type: application/x-www-form-urlencoded
-// Content-Length: 165
-    char *content_type;
-    uint16_t content_length;
-// Follows msg headers
-    char *msg;
-} hinfo_t;
+// HTTP/1.1 persistent connections
+/// @brief requests served on one connection before we close it
+#ifndef WEB_KEEPALIVE_MAX
+	#define WEB_KEEPALIVE_MAX 16
+#endif
+/// @brief seconds an idle persistent connection is kept open
+/// Must be less then the espconn_regist_time() server timeout
+#ifndef WEB_KEEPALIVE_TIMEOUT
+	#define WEB_KEEPALIVE_TIMEOUT 5
+#endif
+
+#include "web/http_parse.h"
 
 // =======================================================
 // Memory buffering for socket reads
@@ -64,31 +61,31 @@ typedef struct {
 // Memory buffering for socket writes
 #define IO_MAX 512  // buffered IO
 
-// HTTP headers from the client
-enum {
-    TOKEN_GET,
-    TOKEN_PUT,
-    TOKEN_POST,
-    TOKEN_HEAD,
-    TOKEN_HOST,
-    TOKEN_USER_AGENT,
-    TOKEN_HTTPS,
-    TOKEN_DNT,
-    TOKEN_ACCEPT,
-    TOKEN_ACCEPT_LANGUAGE,
-    TOKEN_ACCEPT_ENCODING,
-    TOKEN_CONNECTION,
-    TOKEN_REFERER,
-    TOKEN_CONTENT_LENGTH,
-    TOKEN_CONTENT_TYPE,
-    TOKEN_CACHE_CONTROL,
-};
+/// @brief reserved space for a chunk header, 4 hex digits and CRLF
+/// Four digits covers any wbuf size up to 64K
+#define CHUNK_HEAD 6
 
+/// @brief max size of  CGI token
+#define CGI_TOKEN_SIZE 128
+/// @brief file read buffer size used when sending files
+#define READBUFFSIZE 512
+/// @brief pre-compressed file name extension, index.html -> index.html.gz
+#define GZIP_EXT ".gz"
 
-typedef struct {
-    char *pattern;
-    int type;
-} header_t;
+/// @brief size of an HTTP date or ETag string
+#define HTTP_DATE_SIZE 32
+
+// Cache-Control max-age in seconds, by mime type, see mimes[]
+// 0 sends no-cache, the client checks with If-None-Match each time
+#ifndef CACHE_AGE_PAGE
+	#define CACHE_AGE_PAGE 0
+#endif
+#ifndef CACHE_AGE_STATIC
+	#define CACHE_AGE_STATIC 3600
+#endif
+#ifndef CACHE_AGE_IMAGE
+	#define CACHE_AGE_IMAGE 86400
+#endif
 
 //HTTP code descriptions from
 //  HTTP Status Codes for Beginners
@@ -108,6 +105,8 @@ enum {
     STATUS_UNAUTH=401,
     STATUS_FORBIDDEN=403,
     STATUS_NOT_FOUND=404,
+    STATUS_NOT_ALLOWED=405,
+    STATUS_UPGRADE_REQ=426,
     STATUS_INT_SERR=500,
     STATUS_NOT_IMPL=501,
     STATUS_BAD_GATEWAY=502,
@@ -135,9 +134,22 @@ typedef struct {
     char *mime;
     char *ext1;
     char *ext2;
+    uint32_t max_age;	// Cache-Control max-age seconds
 } mime_t;
 
 
+// =======================================================
+// Connection states, see web_connection_task()
+enum {
+    WEB_IDLE,       // waiting for a request
+    WEB_RECV_BODY,  // saving a message body
+    WEB_SEND_FILE,  // sending a file
+    WEB_SEND_TPL,   // sending a compiled template
+    WEB_WEBSOCKET,  // WebSocket frames, see ws_task()
+    WEB_FINISH,     // sending the end of the response
+    WEB_DONE        // response sent
+};
+
 // =======================================================
 typedef struct {
     espconn_t *conn;
@@ -151,6 +163,8 @@ typedef struct {
     int send;       // bytes to send
     int wind;       // index into wbuf
     int wsize;      // bytes allocated
+    int chunked;    // chunked transfer-encoding, each wbuf send is a chunk
+    int chunk;      // index of the reserved chunk header in wbuf
 
 	uint8_t remote_ip[4];
 	uint8_t local_ip[4];
@@ -158,6 +172,30 @@ typedef struct {
 	int local_port;
 
 	int delete;		// close connection
+
+	int request;	// length of the request being processed in rbuf
+	int requests;	// requests served on this connection
+	int keepalive;	// keep connection open after this response
+	int head;		// HEAD response, see write_head(): 0 no, 1 headers, 2 end of line, 3 body
+	uint32_t idle;	// system_get_time() of the last response
+
+	int state;		// WEB_IDLE .. WEB_DONE
+	int closed;		// disconnected, web_task returns it to the pool
+	FILE *fi;		// file being sent
+	FILE *ft;		// compiled template being sent
+	int tpl_segs;	// template segments left to send
+	int tpl_left;	// bytes left in the current literal segment
+	long sd_read;	// SD card bytes read for this response
+
+	char *pend;		// received data that did not fit in rbuf
+	int pend_len;	// bytes in pend
+	int pend_off;	// bytes of pend moved to rbuf
+	int held;		// espconn_recv_hold() is in effect
+	FILE *fo;		// file a message body is saved to
+	long body_left;	// message body bytes still to receive
+	long body_len;	// message body bytes saved
+	uint32_t start;	// system_get_time() at the start of the request
+	int ws_drop;	// WebSocket messages dropped in a row, see ws_send()
 } rwbuf_t;
 
 
@@ -166,6 +204,9 @@ typedef struct {
 MEMSPACE void web_sep ( void );
 MEMSPACE int wait_send ( rwbuf_t *p );
 MEMSPACE int write_buffer ( rwbuf_t *p );
+MEMSPACE void write_chunk_head ( rwbuf_t *p );
+MEMSPACE void write_chunked_start ( rwbuf_t *p );
+MEMSPACE int write_chunked_end ( rwbuf_t *p );
 MEMSPACE int write_flush ( rwbuf_t *p );
 MEMSPACE int write_byte ( rwbuf_t *p , int c );
 MEMSPACE void led_on ( int led );
@@ -173,40 +214,53 @@ MEMSPACE void led_off ( int led );
 MEMSPACE void rwbuf_rinit ( rwbuf_t *p );
 MEMSPACE void rwbuf_winit ( rwbuf_t *p );
 MEMSPACE void display_ipv4 ( char *msg , uint8_t *ip , int port );
+MEMSPACE void rwbuf_close_files ( rwbuf_t *p );
 MEMSPACE void rwbuf_delete ( rwbuf_t *p );
-MEMSPACE rwbuf_t *rwbuf_create ( void );
+MEMSPACE rwbuf_t *rwbuf_create ( int index );
 MEMSPACE rwbuf_t *find_connection ( espconn_t *conn , int *index , char *msg );
 MEMSPACE rwbuf_t *create_connection ( espconn_t *conn );
 MEMSPACE int delete_connection ( rwbuf_t *p );
+MEMSPACE int rwbuf_consume ( rwbuf_t *p , int len );
+MEMSPACE void rwbuf_pull ( rwbuf_t *p );
 MEMSPACE void write_len ( rwbuf_t *p , char *str , int len );
 MEMSPACE void write_str ( rwbuf_t *p , char *str );
 MEMSPACE int vsock_printf ( rwbuf_t *p , const char *fmt , va_list va );
 MEMSPACE int sock_printf ( rwbuf_t *p , const char *fmt , ...);
+MEMSPACE int sock_printf_desc ( rwbuf_t *p , const printf_desc_t *desc , ...);
 MEMSPACE int html_msg ( rwbuf_t *p , int status , char type , char *fmt , ...);
 MEMSPACE char *meminit ( mem_t *p , char *ptr , int size );
 MEMSPACE char *memgets ( mem_t *p );
 MEMSPACE char *mime_type ( int type );
 MEMSPACE int file_type ( char *name );
 MEMSPACE char *html_status ( int status );
-MEMSPACE void init_hinfo ( hinfo_t *hi );
-MEMSPACE int match_headers ( char *str , char **p );
-MEMSPACE char *process_args ( hinfo_t *hi , char *ptr );
 MEMSPACE char *first_arg ( hinfo_t *hi );
 MEMSPACE char *next_arg ( hinfo_t *hi );
 MEMSPACE char *arg_name ( hinfo_t *hi );
 MEMSPACE char *arg_value ( hinfo_t *hi );
-MEMSPACE char *http_value ( hinfo_t *hi , char *str );
-MEMSPACE int is_header ( char *str , char **p );
 MEMSPACE char *nextbreak ( char *ptr );
 MEMSPACE void u5toa ( char *ptr , uint16_t num );
-MEMSPACE void html_head ( rwbuf_t *p , int status , char type , int len );
+MEMSPACE int accept_gzip ( char *str );
+MEMSPACE char *gzip_name ( hinfo_t *hi , char *name , struct stat *sp , char *buf , int max );
+MEMSPACE char *http_date ( time_t t , char *buf );
+MEMSPACE char *http_etag ( struct stat *sp , char *buf );
+MEMSPACE int http_date_parse ( char *str , time_t *t );
+MEMSPACE int not_modified ( hinfo_t *hi , struct stat *sp );
+MEMSPACE void html_validators ( rwbuf_t *p , int type , struct stat *sp );
+MEMSPACE void html_not_modified ( rwbuf_t *p , int type , struct stat *sp );
+MEMSPACE int http_keepalive ( hinfo_t *hi );
+MEMSPACE char *html_connection ( rwbuf_t *p );
+MEMSPACE void html_head ( rwbuf_t *p , int status , char type , int len , char *encoding , struct stat *sp );
 MEMSPACE int parse_http_request ( rwbuf_t *p , hinfo_t *hi );
 MEMSPACE int is_cgitoken_char ( int c );
 MEMSPACE int find_cgitoken_start ( char *str );
 MEMSPACE int is_cgitoken ( char *str );
 MEMSPACE int rewrite_cgi_token ( rwbuf_t *p , char *src );
+MEMSPACE void html_text_start ( rwbuf_t *p , hinfo_t *hi );
+MEMSPACE void html_text_end ( rwbuf_t *p );
+MEMSPACE void web_text_put ( void *ctx , char *line );
 MEMSPACE void web_task ( void );
 MEMSPACE void web_init_connections ( void );
+MEMSPACE void web_mem_stats ( void );
 MEMSPACE void web_init ( int port );
 
 
@@ -0,0 +1,509 @@
+/**
+ @file websocket.c
+
+ @brief WebSocket support for the esp8266 web server
+  A GET of WS_PATH with "Upgrade: websocket" switches the connection
+  to RFC 6455 framing. The connection then stays in the pool in state
+  WEB_WEBSOCKET until either side closes it.
+  The application pushes updates to every client with ws_broadcast()
+  or ws_printf(), and receives messages with ws_recv_handler().
+  A client that is still receiving the last frame misses the next one
+  instead of blocking the sender, after WS_DROP_MAX misses in a row
+  it is closed.
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "user_config.h"
+
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "web/web.h"
+#include "web/websocket.h"
+
+extern rwbuf_t *web_connections[];
+
+/// @brief application message handler, see ws_recv_handler()
+static ws_recv_fn ws_recv = NULL;
+
+// =======================================================
+/// @brief rotate left
+#define ROL(x,n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+/**
+  @brief SHA-1 of one 64 byte block
+  @param[in,out] *h: hash state
+  @param[in] *b: block
+  @return void
+*/
+MEMSPACE
+static void ws_sha1_block(uint32_t *h, uint8_t *b)
+{
+	uint32_t w[16];
+	uint32_t a,c,d,e,f,k,t,bb;
+	int i;
+
+	a = h[0]; bb = h[1]; c = h[2]; d = h[3]; e = h[4];
+
+	for(i=0;i<80;++i)
+	{
+		if(i < 16)
+			w[i] = ((uint32_t)b[i*4] << 24) | ((uint32_t)b[i*4+1] << 16)
+				| ((uint32_t)b[i*4+2] << 8) | b[i*4+3];
+		else
+		{
+			t = w[(i+13)&15] ^ w[(i+8)&15] ^ w[(i+2)&15] ^ w[i&15];
+			w[i&15] = ROL(t,1);
+		}
+
+		if(i < 20)
+		{
+			f = (bb & c) | (~bb & d);
+			k = 0x5a827999UL;
+		}
+		else if(i < 40)
+		{
+			f = bb ^ c ^ d;
+			k = 0x6ed9eba1UL;
+		}
+		else if(i < 60)
+		{
+			f = (bb & c) | (bb & d) | (c & d);
+			k = 0x8f1bbcdcUL;
+		}
+		else
+		{
+			f = bb ^ c ^ d;
+			k = 0xca62c1d6UL;
+		}
+
+		t = ROL(a,5) + f + e + k + w[i&15];
+		e = d;
+		d = c;
+		c = ROL(bb,30);
+		bb = a;
+		a = t;
+	}
+	h[0] += a; h[1] += bb; h[2] += c; h[3] += d; h[4] += e;
+}
+
+/**
+  @brief SHA-1 digest, only used for the handshake
+  @param[in] *data: data
+  @param[in] len: length of data
+  @param[out] *digest: 20 byte digest
+  @return void
+*/
+MEMSPACE
+static void ws_sha1(uint8_t *data, int len, uint8_t *digest)
+{
+	uint32_t h[5] = { 0x67452301UL, 0xefcdab89UL, 0x98badcfeUL, 0x10325476UL, 0xc3d2e1f0UL };
+	uint8_t block[64];
+	uint32_t bits = (uint32_t) len * 8;
+	int i;
+
+	for( ; len >= 64; len -= 64, data += 64)
+		ws_sha1_block(h, data);
+
+	memset(block, 0, sizeof(block));
+	memcpy(block, data, len);
+	block[len] = 0x80;
+	if(len >= 56)
+	{
+		ws_sha1_block(h, block);
+		memset(block, 0, sizeof(block));
+	}
+	for(i=0;i<4;++i)
+		block[63-i] = bits >> (i*8);
+	ws_sha1_block(h, block);
+
+	for(i=0;i<20;++i)
+		digest[i] = h[i>>2] >> (24 - (i&3)*8);
+}
+
+/**
+  @brief Compute Sec-WebSocket-Accept for a Sec-WebSocket-Key
+  base64( SHA-1( key WS_GUID ) )
+  @param[in] *key: Sec-WebSocket-Key value
+  @param[out] *buf: result, WS_ACCEPT_SIZE bytes
+  @return 1 on success, 0 if the key is not valid
+*/
+MEMSPACE
+int ws_accept_key(char *key, char *buf)
+{
+	static const char b64[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	uint8_t digest[21];
+	char str[64];
+	int i,len;
+	uint32_t v;
+
+	// The key is a base64 16 byte nonce, always 24 characters
+	len = strlen(key);
+	if(len != 24)
+		return(0);
+	strcpy(str, key);
+	strcpy(str + len, WS_GUID);
+	ws_sha1((uint8_t *) str, len + sizeof(WS_GUID) - 1, digest);
+
+	digest[20] = 0;
+	for(i=0;i<7;++i)
+	{
+		v = ((uint32_t)digest[i*3] << 16) | ((uint32_t)digest[i*3+1] << 8) | digest[i*3+2];
+		*buf++ = b64[(v >> 18) & 63];
+		*buf++ = b64[(v >> 12) & 63];
+		*buf++ = b64[(v >> 6) & 63];
+		*buf++ = b64[v & 63];
+	}
+	// 20 bytes is 27 characters and one pad
+	buf[-1] = '=';
+	*buf = 0;
+	return(1);
+}
+
+// =======================================================
+/**
+  @brief Find a token in a comma separated header value, ignoring case
+  Browsers may send "Connection: keep-alive, Upgrade"
+  @param[in] *list: header value, may be NULL
+  @param[in] *token: token to find
+  @return 1 if found, otherwise 0
+*/
+MEMSPACE
+static int ws_has_token(char *list, char *token)
+{
+	int len;
+
+	while(list && *list)
+	{
+		while(*list == ' ' || *list == '\t' || *list == ',')
+			++list;
+		len = MATCHI_LEN(list, token);
+		if(len && (!list[len] || list[len] == ',' || list[len] == ' ' || list[len] == '\t'))
+			return(1);
+		while(*list && *list != ',')
+			++list;
+	}
+	return(0);
+}
+
+/**
+  @brief Switch a connection to WebSocket framing
+  Called by process_requests() for a request with "Upgrade: websocket"
+  A request without "Connection: Upgrade", or a key, gets 400, any
+  version but 13 gets 426 with the version we do speak
+  @param[in] *p: rwbuf_t pointer to socket buffer
+  @param[in] *hi: hinfo_t header structure
+  @return 1 if the connection stays open, otherwise 0
+*/
+MEMSPACE
+int ws_upgrade(rwbuf_t *p, hinfo_t *hi)
+{
+	char accept[WS_ACCEPT_SIZE];
+
+	if(hi->type != TOKEN_GET || !hi->filename || !MATCH(hi->filename, WS_PATH))
+	{
+		html_msg(p, STATUS_NOT_FOUND, PTYPE_HTML, "No WebSocket at %s\n",
+			hi->filename ? hi->filename : "");
+		return(p->keepalive);
+	}
+	if(!MATCHI_LEN(hi->upgrade, "websocket") || !ws_has_token(hi->connection, "Upgrade") ||
+		!hi->ws_version || !ws_accept_key(hi->ws_key, accept))
+	{
+		// The client is not speaking the protocol, do not wait for more
+		p->keepalive = 0;
+		html_msg(p, STATUS_BAD_REQ, PTYPE_HTML, "Bad WebSocket request\n");
+		return(0);
+	}
+	if(!MATCH(hi->ws_version, WS_VERSION))
+	{
+		p->keepalive = 0;
+		// WebSocket handshake uses CRLF line endings
+		sock_printf(p,"HTTP/1.1 %s\r\n"
+			"Sec-WebSocket-Version: %s\r\n"
+			"Connection: %s\r\n"
+			"Content-Length: 0\r\n\r\n",
+			html_status(STATUS_UPGRADE_REQ), WS_VERSION, html_connection(p));
+		write_buffer(p);
+		return(0);
+	}
+
+#if WEB_DEBUG & 2
+	printf("ws_upgrade: conn=%p\n", (void *) p->conn);
+#endif
+
+	// WebSocket handshake uses CRLF line endings
+	sock_printf(p,"HTTP/1.1 101 Switching Protocols\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+	write_buffer(p);
+
+	p->keepalive = 1;
+	p->ws_drop = 0;
+	p->state = WEB_WEBSOCKET;
+	// Replace the short HTTP timeout
+	espconn_regist_time(p->conn, WS_TIMEOUT, 1);
+	return(1);
+}
+
+/**
+  @brief Send one unmasked frame
+  The frame is dropped if the last one is still sending, so a slow
+  client never blocks the caller
+  @param[in] *p: rwbuf_t pointer to socket buffer
+  @param[in] opcode: WS_TEXT, WS_BINARY ...
+  @param[in] *data: payload
+  @param[in] len: payload length
+  @return 1 if sent, 0 if dropped or closed
+*/
+MEMSPACE
+int ws_send(rwbuf_t *p, int opcode, char *data, int len)
+{
+	int head = (len < 126) ? 2 : 4;
+
+	if(!p || !p->conn || !p->wbuf || p->delete || p->state != WEB_WEBSOCKET)
+		return(0);
+
+	// Never fits
+	if(head + len > p->wsize)
+		return(0);
+
+	// Backpressure - the client has not taken the last frame yet
+	if(p->send || p->wind + head + len > p->wsize)
+	{
+		if(++p->ws_drop >= WS_DROP_MAX)
+		{
+#if WEB_DEBUG & 1
+			printf("ws_send: client too slow, closing conn=%p\n", (void *) p->conn);
+#endif
+			p->delete = 1;
+			espconn_disconnect(p->conn);
+		}
+		return(0);
+	}
+
+	p->wbuf[p->wind++] = 0x80 | opcode;	// FIN, single frame
+	if(head == 2)
+		p->wbuf[p->wind++] = len;
+	else
+	{
+		p->wbuf[p->wind++] = 126;
+		p->wbuf[p->wind++] = len >> 8;
+		p->wbuf[p->wind++] = len & 0xff;
+	}
+	if(len)
+		memcpy(p->wbuf + p->wind, data, len);
+	p->wind += len;
+	p->ws_drop = 0;
+
+	return(write_buffer(p) > 0);
+}
+
+/**
+  @brief Send a close frame and close the connection once it is sent
+  @param[in] *p: rwbuf_t pointer to socket buffer
+  @param[in] status: WS_CLOSE_NORMAL ...
+  @return void
+*/
+MEMSPACE
+void ws_close(rwbuf_t *p, int status)
+{
+	char buf[2];
+
+	buf[0] = status >> 8;
+	buf[1] = status & 0xff;
+	(void) ws_send(p, WS_CLOSE, buf, 2);
+	// WEB_DONE disconnects when the frame has been sent
+	p->keepalive = 0;
+	p->state = WEB_DONE;
+}
+
+/**
+  @brief Process received frames on a WebSocket connection
+  Called by web_task when the connection is not sending
+  Client frames are always masked, they are unmasked in place
+  Messages must fit in one frame, rbuf is too small to reassemble them,
+  so fragments, as well as malformed control frames and unknown opcodes,
+  close the connection with WS_CLOSE_PROTOCOL
+  @param[in] *p: rwbuf_t pointer to socket buffer
+  @return void
+*/
+MEMSPACE
+void ws_task(rwbuf_t *p)
+{
+	uint8_t *buf;
+	char *data;
+	int opcode,head,i,save;
+	long len;
+
+	while(p->received >= 2 && !p->send && !p->delete && p->state == WEB_WEBSOCKET)
+	{
+		buf = (uint8_t *) p->rbuf;
+		opcode = buf[0] & 0x0f;
+		len = buf[1] & 0x7f;
+		head = 2;
+
+		// Only whole TEXT and BINARY messages, control frames are never
+		// fragmented and have at most 125 bytes, RFC 6455 5.4 and 5.5
+		// No extensions are negotiated so the RSV bits must be 0
+		if(!(buf[0] & 0x80) || (buf[0] & 0x70) ||
+			(opcode != WS_TEXT && opcode != WS_BINARY && opcode != WS_CLOSE &&
+				opcode != WS_PING && opcode != WS_PONG) ||
+			((opcode & 0x8) && len > 125))
+		{
+			ws_close(p, WS_CLOSE_PROTOCOL);
+			return;
+		}
+
+		if(len == 126)
+		{
+			if(p->received < 4)
+				return;
+			len = ((long) buf[2] << 8) | buf[3];
+			head = 4;
+		}
+
+		// Frames must be masked and fit in rbuf
+		if(!(buf[1] & 0x80))
+		{
+			ws_close(p, WS_CLOSE_PROTOCOL);
+			return;
+		}
+		head += 4;
+		if(len == 127 || head + len > p->rsize)
+		{
+			ws_close(p, WS_CLOSE_TOO_BIG);
+			return;
+		}
+		// Wait for the rest of the frame
+		if(p->received < head + len)
+			return;
+
+		data = p->rbuf + head;
+		for(i=0;i<len;++i)
+			data[i] ^= buf[head - 4 + (i & 3)];
+
+		switch(opcode)
+		{
+		case WS_TEXT:
+		case WS_BINARY:
+			// rbuf has room for an EOS after rsize
+			save = data[len];
+			data[len] = 0;
+			if(ws_recv)
+				ws_recv(p, opcode, data, len);
+			data[len] = save;
+			break;
+		case WS_PING:
+			(void) ws_send(p, WS_PONG, data, len);
+			break;
+		case WS_CLOSE:
+#if WEB_DEBUG & 2
+			printf("ws_task: close conn=%p\n", (void *) p->conn);
+#endif
+			ws_close(p, WS_CLOSE_NORMAL);
+			break;
+		default:
+			break;
+		}
+		rwbuf_consume(p, head + len);
+	}
+}
+
+/**
+  @brief Set the handler for received text and binary messages
+  @param[in] fn: handler or NULL
+  @return void
+*/
+MEMSPACE
+void ws_recv_handler(ws_recv_fn fn)
+{
+	ws_recv = fn;
+}
+
+/**
+  @brief Count open WebSocket connections
+  @return number of connections
+*/
+MEMSPACE
+int ws_clients(void)
+{
+	int i, count = 0;
+	rwbuf_t *p;
+
+	for(i=0;i<MAX_CONNECTIONS;++i)
+	{
+		p = web_connections[i];
+		if(p && !p->delete && !p->closed && p->state == WEB_WEBSOCKET)
+			++count;
+	}
+	return(count);
+}
+
+/**
+  @brief Send a message to every WebSocket client
+  @param[in] opcode: WS_TEXT or WS_BINARY
+  @param[in] *data: message
+  @param[in] len: message length
+  @return number of clients the message was sent to
+*/
+MEMSPACE
+int ws_broadcast(int opcode, char *data, int len)
+{
+	int i, count = 0;
+	rwbuf_t *p;
+
+	for(i=0;i<MAX_CONNECTIONS;++i)
+	{
+		p = web_connections[i];
+		if(p && !p->closed)
+			count += ws_send(p, opcode, data, len);
+	}
+	return(count);
+}
+
+/**
+  @brief Format a text message and send it to every WebSocket client
+  Nothing is formatted when there are no clients
+  @param[in] *fmt: printf format string
+  @param[in] ...: vararg list or arguments
+  @return number of clients the message was sent to
+*/
+MEMSPACE
+int ws_printf(const char *fmt, ...)
+{
+	char buf[WS_MSG_MAX];
+	va_list va;
+	int len;
+
+	if(!ws_clients())
+		return(0);
+
+	va_start(va, fmt);
+	len = vsnprintf(buf, sizeof(buf), fmt, va);
+	va_end(va);
+
+	if(len < 0)
+		return(0);
+	if(len >= (int) sizeof(buf))
+		len = sizeof(buf) - 1;
+	return(ws_broadcast(WS_TEXT, buf, len));
+}
@@ -0,0 +1,84 @@
+/**
+ @file websocket.h
+
+ @brief WebSocket support for the esp8266 web server
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef	__WEBSOCKET_H__
+#define	__WEBSOCKET_H__
+
+/// @brief WebSocket endpoint, ws://address/ws
+#ifndef WS_PATH
+	#define WS_PATH "/ws"
+#endif
+/// @brief Sec-WebSocket-Version we speak, RFC 6455
+#define WS_VERSION "13"
+/// @brief seconds an idle WebSocket connection is kept open
+#ifndef WS_TIMEOUT
+	#define WS_TIMEOUT 7200
+#endif
+/// @brief messages dropped in a row before a slow client is closed
+#ifndef WS_DROP_MAX
+	#define WS_DROP_MAX 32
+#endif
+/// @brief largest message sent by ws_printf()
+#define WS_MSG_MAX 256
+
+/// @brief RFC 6455 key GUID, see ws_accept_key()
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+/// @brief Sec-WebSocket-Accept size, base64 of a SHA-1 digest plus EOS
+#define WS_ACCEPT_SIZE 29
+
+// WebSocket frame opcodes
+enum {
+	WS_CONT = 0x0,
+	WS_TEXT = 0x1,
+	WS_BINARY = 0x2,
+	WS_CLOSE = 0x8,
+	WS_PING = 0x9,
+	WS_PONG = 0xa
+};
+
+// WebSocket close status codes
+enum {
+	WS_CLOSE_NORMAL = 1000,
+	WS_CLOSE_PROTOCOL = 1002,
+	WS_CLOSE_TOO_BIG = 1009
+};
+
+/// @brief Handler for received text and binary messages
+/// Each call is one whole message, opcode is WS_TEXT or WS_BINARY
+/// data is unmasked and ends with an EOS, it is only valid during the call
+typedef void (*ws_recv_fn)(rwbuf_t *p, int opcode, char *data, int len);
+
+// ============================================================
+/* websocket.c */
+MEMSPACE int ws_accept_key ( char *key , char *buf );
+MEMSPACE int ws_upgrade ( rwbuf_t *p , hinfo_t *hi );
+MEMSPACE int ws_send ( rwbuf_t *p , int opcode , char *data , int len );
+MEMSPACE void ws_close ( rwbuf_t *p , int status );
+MEMSPACE void ws_task ( rwbuf_t *p );
+MEMSPACE void ws_recv_handler ( ws_recv_fn fn );
+MEMSPACE int ws_clients ( void );
+MEMSPACE int ws_broadcast ( int opcode , char *data , int len );
+MEMSPACE int ws_printf ( const char *fmt , ...);
+
+#endif	/* end of __WEBSOCKET_H__ */
@@ -69,6 +69,7 @@ void wire_draw(window *win, const wire_p *wire, const wire_e *edge, point *view,
 	wire_p W;
 	wire_e E;
 	point P,R;
+	PROF_ZONE(PROF_WIRE_DRAW);
 
 	W.x = 0;
 	W.y = 0;
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define CONT_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifndef CONT_STACKSIZE
 #define CONT_STACKSIZE (1024*4)
@@ -39,6 +40,9 @@ typedef struct cont_
     unsigned unused1;
     unsigned unused2;
     unsigned stack_guard1;
+#ifdef SCHED_TEST
+    void* host;     // host ucontext state, see cont_host.c
+#endif
 
     unsigned stack[CONT_STACKSIZE / 4];
 
@@ -46,9 +50,24 @@ typedef struct cont_
     unsigned* struct_start;
 } cont_t;
 
+// The guard and struct pointer that follow the stack. cont_norm finds
+// the cont_t through struct_start when the task function returns, so a
+// cont_t may have a stack of any size as long as this follows it
+typedef struct cont_tail_
+{
+    unsigned stack_guard2;
+    unsigned* struct_start;
+} cont_tail_t;
+
+// Bytes to allocate for a cont_t with a stack of size bytes
+#define CONT_SIZE(size) (offsetof(cont_t, stack) + ((size) & ~3) + sizeof(cont_tail_t))
+
 // Initialize the cont_t structure before calling cont_run
 void cont_init(cont_t*);
 
+// Initialize a cont_t allocated with CONT_SIZE(size)
+void cont_init_size(cont_t*, size_t size);
+
 // Run function pfn in a separate stack, or continue execution
 // at the point where cont_yield was called
 void cont_run(cont_t*, void (*pfn)(void));
@@ -64,4 +83,7 @@ int cont_check(cont_t* cont);
 // Check if yield() may be called. Returns true if we are running inside
 // continuation stack
 bool cont_can_yield(cont_t* cont);
+
+// Return the number of stack bytes that have never been used
+int cont_get_free_stack(cont_t* cont);
 #endif                                            /* CONT_H_ */
@@ -0,0 +1,117 @@
+/**
+ @file cont_host.c
+
+ @brief cont_run and cont_yield for host tests of the task scheduler
+ cont.S does this on the ESP8266, here ucontext switches the stacks
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// only used when testing standalone on linux
+#ifdef SCHED_TEST
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include "cont.h"
+
+/// @brief host context switch state of one cont_t
+typedef struct {
+	ucontext_t ret;		/* caller of cont_run */
+	ucontext_t task;	/* the task on its own stack */
+	void (*pfn)(void);
+} cont_host_t;
+
+/// @brief cont_t being started, makecontext can only pass int arguments
+static cont_t *cont_start;
+
+/**
+  @brief Non zero code address for pc_ret and pc_yield
+  cont_can_yield only tests them against zero
+*/
+static void cont_host_mark(void)
+{
+}
+
+/**
+  @brief Run the task function on its own stack
+  When it returns clear pc_ret, like cont_norm, and uc_link resumes cont_run
+*/
+static void cont_host_start(void)
+{
+	cont_t *cont = cont_start;
+	cont_host_t *h = cont->host;
+
+	h->pfn();
+	cont->pc_ret = 0;
+}
+
+/**
+  @brief Run pfn on the cont_t stack, or resume it after cont_yield
+  @param[in] *cont: continuation
+  @param[in] pfn: function to start when the cont_t is not suspended
+  @return void
+*/
+void cont_run(cont_t *cont, void (*pfn)(void))
+{
+	cont_host_t *h = cont->host;
+
+	if(!h)
+	{
+		h = calloc(1, sizeof(cont_host_t));
+		if(!h)
+		{
+			printf("cont_run: out of memory\n");
+			exit(1);
+		}
+		cont->host = h;
+	}
+
+	cont->pc_ret = cont_host_mark;
+	if(cont->pc_yield == 0)
+	{
+		getcontext(&h->task);
+		h->task.uc_stack.ss_sp = cont->stack;
+		h->task.uc_stack.ss_size = (char *) cont->stack_end - (char *) cont->stack;
+		h->task.uc_link = &h->ret;
+		h->pfn = pfn;
+		cont_start = cont;
+		makecontext(&h->task, cont_host_start, 0);
+	}
+	else
+	{
+		cont->pc_yield = 0;
+	}
+	swapcontext(&h->ret, &h->task);
+}
+
+/**
+  @brief Suspend the running task and return from cont_run
+  @param[in] *cont: continuation of the running task
+  @return void
+*/
+void cont_yield(cont_t *cont)
+{
+	cont_host_t *h = cont->host;
+
+	cont->pc_yield = cont_host_mark;
+	swapcontext(&h->task, &h->ret);
+}
+
+#endif	// SCHED_TEST
@@ -20,22 +20,41 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "cont.h"
 #include <stddef.h>
+#ifdef SCHED_TEST
+#define ETS_INTR_WITHINISR() 0
+#else
 #include "ets_sys.h"
+#endif
 
 #define CONT_STACKGUARD 0xfeefeffe
 
 void cont_init(cont_t* cont)
 {
+    cont_init_size(cont, sizeof(cont->stack));
+}
+
+
+void cont_init_size(cont_t* cont, size_t size)
+{
+    cont_tail_t* tail;
+    unsigned* p;
+
     cont->stack_guard1 = CONT_STACKGUARD;
-    cont->stack_guard2 = CONT_STACKGUARD;
-    cont->stack_end = cont->stack + (sizeof(cont->stack) / 4);
-    cont->struct_start = (unsigned*) cont;
+    cont->stack_end = cont->stack + (size / 4);
+    // Paint the stack so cont_get_free_stack can find the high water mark
+    for(p = cont->stack; p < cont->stack_end; ++p)
+        *p = CONT_STACKGUARD;
+    tail = (cont_tail_t*) cont->stack_end;
+    tail->stack_guard2 = CONT_STACKGUARD;
+    tail->struct_start = (unsigned*) cont;
 }
 
 
 int cont_check(cont_t* cont)
 {
-    if(cont->stack_guard1 != CONT_STACKGUARD || cont->stack_guard2 != CONT_STACKGUARD) return 1;
+    cont_tail_t* tail = (cont_tail_t*) cont->stack_end;
+
+    if(cont->stack_guard1 != CONT_STACKGUARD || tail->stack_guard2 != CONT_STACKGUARD) return 1;
 
     return 0;
 }
@@ -46,3 +65,14 @@ bool cont_can_yield(cont_t* cont)
     return !ETS_INTR_WITHINISR() &&
         cont->pc_ret != 0 && cont->pc_yield == 0;
 }
+
+
+int cont_get_free_stack(cont_t* cont)
+{
+    unsigned* p = cont->stack;
+
+    // The stack grows down from stack_end, the unused part is still painted
+    while(p < cont->stack_end && *p == CONT_STACKGUARD)
+        ++p;
+    return (p - cont->stack) * 4;
+}
@@ -0,0 +1,373 @@
+/**
+ @file sched.c
+
+ @brief Cooperative task scheduler using cont_t coroutines
+ Each task has its own stack, the ready queue is run round robin from
+ loop_task. A task gives up the CPU with yield(), sched_wait() or sched_sleep()
+ so blocking I/O in one task lets the others run.
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef USER_CONFIG
+#include "user_config.h"
+#else
+// only used when testing standalone on linux
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#define MEMSPACE
+#define safecalloc(n,s) calloc(n,s)
+extern uint32_t system_get_time(void);
+#include "cont.h"
+#endif
+
+#include "sched.h"
+
+/// @brief Start time of the running task, used by optimistic_yield()
+extern uint32_t g_micros_at_task_start;
+
+/// @brief Task table
+static sched_task_t sched_tasks[SCHED_TASKS];
+static int sched_count = 0;
+
+/// @brief Ready queue
+static sched_task_t *sched_head = NULL;
+static sched_task_t *sched_tail = NULL;
+static int sched_queued = 0;
+
+/// @brief The running task, NULL outside of sched_run()
+static sched_task_t *sched_current = NULL;
+
+/// @brief Task that yielded while holding a shared bus
+static sched_task_t *sched_owner = NULL;
+static int (*sched_busy_fn)(void) = NULL;
+
+/**
+  @brief Add a task to the end of the ready queue
+  @param[in] *t: task
+  @return void
+*/
+MEMSPACE
+static void sched_push(sched_task_t *t)
+{
+	t->state = SCHED_READY;
+	t->next = NULL;
+	if(sched_tail)
+		sched_tail->next = t;
+	else
+		sched_head = t;
+	sched_tail = t;
+	++sched_queued;
+}
+
+/**
+  @brief Remove the task at the head of the ready queue
+  @return task or NULL if the queue is empty
+*/
+MEMSPACE
+static sched_task_t *sched_pop(void)
+{
+	sched_task_t *t = sched_head;
+
+	if(t)
+	{
+		sched_head = t->next;
+		if(!sched_head)
+			sched_tail = NULL;
+		t->next = NULL;
+		--sched_queued;
+	}
+	return(t);
+}
+
+/**
+  @brief Create a task with its own stack and make it ready
+  @param[in] *name: task name for sched_stats()
+  @param[in] fn: task function, started again each time it returns
+  @param[in] stack: stack size in bytes
+  @return task or NULL on error
+*/
+MEMSPACE
+sched_task_t *sched_add(char *name, void (*fn)(void), uint32_t stack)
+{
+	sched_task_t *t;
+	cont_t *cont;
+
+	if(sched_count >= SCHED_TASKS)
+	{
+		printf("sched_add: %s: task table full\n", name);
+		return(NULL);
+	}
+
+	stack &= ~3;
+	cont = safecalloc(1, CONT_SIZE(stack));
+	if(!cont)
+	{
+		printf("sched_add: %s: no memory for %lu byte stack\n", name, (unsigned long) stack);
+		return(NULL);
+	}
+	cont_init_size(cont, stack);
+
+	t = &sched_tasks[sched_count++];
+	t->id = sched_count;
+	t->name = name;
+	t->fn = fn;
+	t->cont = cont;
+	t->stack = stack;
+	t->free = stack;
+	sched_push(t);
+	return(t);
+}
+
+/**
+  @brief Set the function that tells if a shared bus is in use
+  While it returns non zero after a task yields only that task is run,
+  so a task can not start an SPI transfer while another has a chip select
+  @param[in] busy: function, or NULL
+  @return void
+*/
+MEMSPACE
+void sched_busy(int (*busy)(void))
+{
+	sched_busy_fn = busy;
+}
+
+/**
+  @brief The running task
+  @return task or NULL outside of a task
+*/
+MEMSPACE
+sched_task_t *sched_self(void)
+{
+	return(sched_current);
+}
+
+/**
+  @brief Continuation of the running task
+  @return cont_t pointer or NULL outside of a task
+*/
+MEMSPACE
+cont_t *sched_cont(void)
+{
+	return(sched_current ? sched_current->cont : NULL);
+}
+
+/**
+  @brief Update the stack high water mark of a task
+  @param[in] *t: task
+  @return free stack in bytes
+*/
+MEMSPACE
+uint32_t sched_stack_free(sched_task_t *t)
+{
+	uint32_t free = cont_get_free_stack(t->cont);
+
+	if(free < t->free)
+		t->free = free;
+	if(t->free < SCHED_STACK_LOW && !t->low)
+	{
+		t->low = 1;
+		printf("task %s: low stack, %lu of %lu bytes free\n",
+			t->name, (unsigned long) t->free, (unsigned long) t->stack);
+	}
+	return(t->free);
+}
+
+/**
+  @brief Run every ready task once
+  Called from loop_task
+  @return 1 if a task is ready or waiting with a timeout, 0 if all wait for events
+*/
+MEMSPACE
+int sched_run(void)
+{
+	sched_task_t *t;
+	uint32_t now;
+	int i, n;
+
+	// End waits that have timed out
+	now = system_get_time();
+	for(i = 0; i < sched_count; ++i)
+	{
+		t = &sched_tasks[i];
+		if(t->state == SCHED_WAIT && t->timeout && (now - t->start) >= t->timeout)
+			sched_push(t);
+	}
+
+	// Tasks made ready while this pass runs wait for the next one
+	n = sched_queued;
+	while(n-- > 0 && (t = sched_pop()) != NULL)
+	{
+		if(sched_owner && t != sched_owner)
+		{
+			sched_push(t);
+			continue;
+		}
+
+		sched_current = t;
+#ifdef PROFILE
+		prof_switch(t->id);
+#endif
+		g_micros_at_task_start = now = system_get_time();
+		cont_run(t->cont, t->fn);
+		now = system_get_time() - now;
+#ifdef PROFILE
+		prof_switch(0);
+#endif
+		sched_current = NULL;
+
+		t->runs++;
+		t->us += now;
+		if(now > t->max)
+			t->max = now;
+
+		if(cont_check(t->cont) != 0)
+		{
+			printf("\ntask %s stack overflow detected\n", t->name);
+			abort();
+		}
+		if((t->runs & SCHED_STACK_CHECK) == 0)
+			sched_stack_free(t);
+
+		if(sched_busy_fn && t->cont->pc_yield && sched_busy_fn())
+			sched_owner = t;
+		else if(sched_owner == t)
+			sched_owner = NULL;
+
+		if(t->state == SCHED_READY)
+			sched_push(t);
+	}
+
+	if(sched_queued)
+		return(1);
+	for(i = 0; i < sched_count; ++i)
+	{
+		if(sched_tasks[i].state == SCHED_WAIT && sched_tasks[i].timeout)
+			return(1);
+	}
+	return(0);
+}
+
+/**
+  @brief Let the other ready tasks run
+  Does nothing outside of a task
+  @return void
+*/
+MEMSPACE
+void sched_yield(void)
+{
+	sched_task_t *t = sched_current;
+
+	if(t && cont_can_yield(t->cont))
+		cont_yield(t->cont);
+}
+
+/**
+  @brief Suspend the running task until one of the events is signaled or the timeout ends
+  Events are not remembered, test the condition being waited for again after this returns
+  Outside of a task this returns 0 at once
+  @param[in] events: event mask, 0 to only wait for the timeout
+  @param[in] timeout: microseconds, 0 to wait without a timeout
+  @return events that ended the wait, 0 on timeout
+*/
+MEMSPACE
+uint32_t sched_wait(uint32_t events, uint32_t timeout)
+{
+	sched_task_t *t = sched_current;
+
+	if(!t || !cont_can_yield(t->cont))
+		return(0);
+
+	if(!events && !timeout)
+	{
+		cont_yield(t->cont);
+		return(0);
+	}
+
+	t->events = events;
+	t->woken = 0;
+	t->timeout = timeout;
+	t->start = system_get_time();
+	t->state = SCHED_WAIT;
+	cont_yield(t->cont);
+	t->events = 0;
+	return(t->woken);
+}
+
+/**
+  @brief Suspend the running task for a time
+  @param[in] us: microseconds
+  @return void
+*/
+MEMSPACE
+void sched_sleep(uint32_t us)
+{
+	if(!us)
+		us = 1;
+	sched_wait(0, us);
+}
+
+/**
+  @brief Wake the tasks waiting for any of the events
+  May be called from callbacks, but not from an interrupt
+  @param[in] events: event mask
+  @return void
+*/
+MEMSPACE
+void sched_signal(uint32_t events)
+{
+	sched_task_t *t;
+	int i;
+
+	for(i = 0; i < sched_count; ++i)
+	{
+		t = &sched_tasks[i];
+		if(t->state == SCHED_WAIT && (t->events & events))
+		{
+			t->woken = t->events & events;
+			sched_push(t);
+		}
+	}
+}
+
+/**
+  @brief Display task statistics
+  @return void
+*/
+MEMSPACE
+void sched_stats(void)
+{
+	sched_task_t *t;
+	int i;
+
+	printf("task      state runs       avg(us) max(us)  stack  free\n");
+	for(i = 0; i < sched_count; ++i)
+	{
+		t = &sched_tasks[i];
+		sched_stack_free(t);
+		printf("%-9s %-5s %-10lu %-7lu %-8lu %-6lu %lu\n",
+			t->name,
+			t->state == SCHED_WAIT ? "wait" : "ready",
+			(unsigned long) t->runs,
+			(unsigned long) (t->runs ? t->us / t->runs : 0),
+			(unsigned long) t->max,
+			(unsigned long) t->stack,
+			(unsigned long) t->free);
+	}
+}
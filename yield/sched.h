@@ -0,0 +1,84 @@
+/**
+ @file sched.h
+
+ @brief Cooperative task scheduler using cont_t coroutines
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+  Please retain a copy of this notice in any code you use it in.
+
+  This is free software: you can redistribute it and/or modify it under the
+  terms of the GNU General Public License as published by the Free Software
+  Foundation, either version 3 of the License, or (at your option)
+  any later version.
+
+  This software is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+// Named address space
+#ifndef MEMSPACE
+#define MEMSPACE /**/
+#endif
+
+/// @brief Maximum number of tasks
+#ifndef SCHED_TASKS
+#define SCHED_TASKS 8
+#endif
+
+/// @brief Check the stack high water mark every SCHED_STACK_CHECK+1 runs
+#define SCHED_STACK_CHECK 0xff
+/// @brief Warn when a task has less free stack than this in bytes
+#define SCHED_STACK_LOW 256
+
+/// @brief Task states
+#define SCHED_READY 0	/* in the ready queue or running */
+#define SCHED_WAIT  1	/* waiting for events or a timeout */
+
+/// @brief Events for sched_wait() and sched_signal()
+#define SCHED_EV_POST 1		/* esp_schedule() was called, usually by a network callback */
+#define SCHED_EV_USER 0x100	/* first event free for application use */
+
+/// @brief A task is a function run on its own stack
+/// When the function returns it is started again on its next turn
+typedef struct sched_task_ {
+	char *name;
+	void (*fn)(void);
+	cont_t *cont;
+	struct sched_task_ *next;	/* ready queue link */
+	uint32_t stack;		/* stack size in bytes */
+	uint32_t free;		/* lowest free stack seen in bytes */
+	uint32_t events;	/* events the waiting task wants */
+	uint32_t woken;		/* events that ended the wait */
+	uint32_t start;		/* system_get_time() when the wait started */
+	uint32_t timeout;	/* wait timeout in microseconds, 0 for none */
+	uint32_t runs;		/* times the task was run */
+	uint32_t us;		/* total run time in microseconds */
+	uint32_t max;		/* longest run in microseconds */
+	uint8_t state;
+	uint8_t low;		/* low stack warning given */
+	uint8_t id;		/* 1 for the first task added, 0 is no task */
+} sched_task_t;
+
+/* sched.c */
+MEMSPACE sched_task_t *sched_add ( char *name , void (*fn )(void ), uint32_t stack );
+MEMSPACE void sched_busy ( int (*busy )(void ));
+MEMSPACE sched_task_t *sched_self ( void );
+MEMSPACE cont_t *sched_cont ( void );
+MEMSPACE int sched_run ( void );
+MEMSPACE void sched_yield ( void );
+MEMSPACE uint32_t sched_wait ( uint32_t events , uint32_t timeout );
+MEMSPACE void sched_sleep ( uint32_t us );
+MEMSPACE void sched_signal ( uint32_t events );
+MEMSPACE uint32_t sched_stack_free ( sched_task_t *t );
+MEMSPACE void sched_stats ( void );
+
+#endif	// _SCHED_H_
@@ -0,0 +1,287 @@
+/**
+ @file test_sched.c
+
+ @brief Host tests and benchmark for the task scheduler
+
+ @par Copyright &copy; 2015 Mike Gore, GPL License
+ @par You are free to use this code under the terms of GPL
+   please retain a copy of this notice in any code you use it in.
+
+This is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// only used when testing standalone on linux
+#ifdef SCHED_TEST
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "cont.h"
+#include "sched.h"
+#include "lib/testsup.h"
+
+/// @brief Host stacks need room for printf
+#define TEST_STACK (1024*32)
+
+uint32_t g_micros_at_task_start;
+
+/**
+  @brief Microsecond clock like the ESP8266 system_get_time()
+*/
+uint32_t system_get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return((uint32_t) (ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000));
+}
+
+// ==========================================================
+// A "web" task blocked on a send while a "display" task refreshes
+
+volatile int sent = 0;
+int web_done = 0;
+int refresh = 0;
+int refresh_while_blocked = 0;
+int woken = 0;
+
+void web_fn(void)
+{
+	if(web_done)
+	{
+		sched_wait(SCHED_EV_USER, 0);
+		return;
+	}
+	// Like wait_send(), the network callback clears the busy flag
+	while(!sent)
+	{
+		if(sched_wait(SCHED_EV_POST, 100000) & SCHED_EV_POST)
+			++woken;
+		refresh_while_blocked = refresh;
+	}
+	web_done = 1;
+}
+
+void display_fn(void)
+{
+	for(;;)
+	{
+		++refresh;
+		sched_yield();
+	}
+}
+
+// ==========================================================
+// Round robin
+
+int rr[3];
+
+void rr0(void) { for(;;) { ++rr[0]; sched_yield(); } }
+void rr1(void) { for(;;) { ++rr[1]; sched_yield(); } }
+void rr2(void) { ++rr[2]; }
+
+// ==========================================================
+// Sleep and stack use
+
+uint32_t slept;
+int sleep_done = 0;
+
+void sleep_fn(void)
+{
+	uint32_t t;
+	if(sleep_done)
+	{
+		sched_wait(SCHED_EV_USER << 1, 0);
+		return;
+	}
+	t = system_get_time();
+	sched_sleep(5000);
+	slept = system_get_time() - t;
+	sleep_done = 1;
+}
+
+int deep_sum;
+
+void deep_fn(void)
+{
+	volatile char buf[8192];
+	int i;
+	for(i = 0; i < (int) sizeof(buf); ++i)
+		buf[i] = i;
+	deep_sum = buf[100];
+	sched_wait(SCHED_EV_USER << 2, 0);
+}
+
+// ==========================================================
+// Bus ownership
+
+int bus = 0;
+int bus_order[8];
+int bus_n = 0;
+
+int bus_busy(void)
+{
+	return(bus);
+}
+
+void bus_a(void)
+{
+	if(bus_n >= 6)
+	{
+		sched_wait(SCHED_EV_USER << 3, 0);
+		return;
+	}
+	bus = 1;
+	bus_order[bus_n++] = 'a';
+	sched_yield();
+	bus_order[bus_n++] = 'a';
+	sched_yield();
+	bus = 0;
+	sched_yield();
+}
+
+void bus_b(void)
+{
+	if(bus_n >= 6)
+	{
+		sched_wait(SCHED_EV_USER << 3, 0);
+		return;
+	}
+	bus_order[bus_n++] = 'b';
+	sched_yield();
+}
+
+// ==========================================================
+// Context switch benchmark
+
+sched_task_t *tasks[SCHED_TASKS];
+int ntasks = 0;
+
+/**
+  @brief sched_add() that remembers the task for the benchmark
+*/
+sched_task_t *add(char *name, void (*fn)(void))
+{
+	sched_task_t *t = sched_add(name, fn, TEST_STACK);
+	if(t)
+		tasks[ntasks++] = t;
+	return(t);
+}
+
+/**
+  @brief Total runs of all tasks
+*/
+long runs(void)
+{
+	long n = 0;
+	int i;
+	for(i = 0; i < ntasks; ++i)
+		n += tasks[i]->runs;
+	return(n);
+}
+
+void bench_fn(void)
+{
+	for(;;)
+		sched_yield();
+}
+
+int main(int argc, char *argv[])
+{
+	sched_task_t *web, *display, *t;
+	long n;
+	int i;
+	uint32_t start, elapsed;
+
+	// Blocking wait in one task does not stop the other
+	web = add("web", web_fn);
+	display = add("display", display_fn);
+	CHECK(web && display);
+	for(i = 0; i < 100; ++i)
+	{
+		sched_run();
+		if(i == 10)
+			sched_signal(SCHED_EV_POST);
+		if(i == 50)
+		{
+			sent = 1;
+			sched_signal(SCHED_EV_POST);
+		}
+	}
+	CHECK(web_done);
+	CHECK(woken == 2);
+	CHECK(refresh_while_blocked >= 50);
+	CHECK(refresh >= 99);
+	CHECK(web->state == SCHED_WAIT);
+	CHECK(display->state == SCHED_READY);
+
+	// Round robin, tasks that loop and tasks that return
+	add("rr0", rr0);
+	add("rr1", rr1);
+	add("rr2", rr2);
+	for(i = 0; i < 1000; ++i)
+		sched_run();
+	CHECK(rr[0] == 1000 && rr[1] == 1000 && rr[2] == 1000);
+
+	// Sleep and timeouts
+	add("sleep", sleep_fn);
+	start = system_get_time();
+	while(!sleep_done && system_get_time() - start < 1000000)
+		sched_run();
+	CHECK(sleep_done);
+	CHECK(slept >= 5000 && slept < 100000);
+
+	// Stack high water mark
+	t = add("deep", deep_fn);
+	sched_run();
+	CHECK(deep_sum == 100);
+	CHECK(sched_stack_free(t) <= TEST_STACK - 8192);
+	CHECK(sched_stack_free(t) > 1024);
+	CHECK(cont_check(t->cont) == 0);
+	t->cont->stack_guard1 = 0;
+	CHECK(cont_check(t->cont) == 1);
+	t->cont->stack_guard1 = 0xfeefeffe;
+
+	// Task that yields with the bus busy keeps it
+	sched_busy(bus_busy);
+	add("bus_a", bus_a);
+	add("bus_b", bus_b);
+	for(i = 0; i < 10 && bus_n < 6; ++i)
+		sched_run();
+	bus_order[bus_n] = 0;
+	CHECK(bus_n == 6);
+	CHECK(bus_order[0] == 'a' && bus_order[1] == 'a');
+	sched_busy(NULL);
+
+	sched_stats();
+
+	if(argc > 1 && strcmp(argv[1], "bench") == 0)
+	{
+		add("bench", bench_fn);
+		n = runs();
+		start = system_get_time();
+		for(i = 0; i < 1000000; ++i)
+			sched_run();
+		elapsed = system_get_time() - start;
+		n = runs() - n;
+		printf("%ld task runs in %lu uS, %.1f nS per switch in and out\n",
+			n, (unsigned long) elapsed, elapsed * 1000.0 / n);
+	}
+
+	return(test_result());
+}
+
+#endif	// SCHED_TEST
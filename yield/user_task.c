@@ -38,6 +38,13 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #define OPTIMISTIC_YIELD_TIME_US 16000
 
+// Task stacks, sched_stats() shows how much of each is used
+#define LOOP_STACKSIZE CONT_STACKSIZE
+#define WEB_STACKSIZE  CONT_STACKSIZE
+
+// web_task polls for timeouts at least this often without network events
+#define WEB_POLL_US 10000
+
 struct rst_info resetInfo;
 
 int atexit(void (*func)())
@@ -49,7 +56,6 @@ int atexit(void (*func)())
 extern void loop();
 extern void setup();
 
-cont_t g_cont __attribute__ ((aligned (16)));
 static os_event_t g_loop_queue[LOOP_QUEUE_SIZE];
 
 uint32_t g_micros_at_task_start;
@@ -64,30 +70,37 @@ void abort()
 }
 
 
+static void loop_post()
+{
+    system_os_post(LOOP_TASK_PRIORITY, 0, 0);
+}
+
+
 void esp_yield()
 {
 // FIXME DEBUG
 	hspi_waitReady();
 
-    if (cont_can_yield(&g_cont))
-    {
-        cont_yield(&g_cont);
-    }
+    sched_yield();
 }
 
 
+// Wake tasks waiting in sched_wait(SCHED_EV_POST) and run the scheduler
 void esp_schedule()
 {
-    system_os_post(LOOP_TASK_PRIORITY, 0, 0);
+    sched_signal(SCHED_EV_POST);
+    loop_post();
 }
 
 
 //void __yield()
 void yield()
 {
-    if (cont_can_yield(&g_cont))
+    cont_t *cont = sched_cont();
+
+    if (cont && cont_can_yield(cont))
     {
-        esp_schedule();
+        loop_post();
         esp_yield();
     }
     else
@@ -101,7 +114,9 @@ void yield()
 
 void optimistic_yield(uint32_t interval_us)
 {
-    if (cont_can_yield(&g_cont) &&
+    cont_t *cont = sched_cont();
+
+    if (cont && cont_can_yield(cont) &&
         (system_get_time() - g_micros_at_task_start) > interval_us)
     {
         yield();
@@ -109,11 +124,17 @@ void optimistic_yield(uint32_t interval_us)
 }
 
 
+// Keep the SPI bus with a task that yields with a chip select active
+static int spi_busy()
+{
+    return(spi_chip_select_status() != 0xff);
+}
+
+
 bool setup_done = false;
 void loop_wrapper()
 {
 	extern void loop(void);
-	extern void web_task();
 
     if(!setup_done)
     {
@@ -124,25 +145,27 @@ void loop_wrapper()
 	REG_SET_BIT(0x3ff00014, BIT(0));
 	hspi_waitReady();
 
-#ifdef WEBSERVER
-	web_task();
-#endif
-
 // USER TASK
     loop();
-    esp_schedule();
 }
 
 
+#ifdef WEBSERVER
+void web_wrapper()
+{
+	extern void web_task();
+
+	web_task();
+	// Sleep until a network callback calls esp_schedule()
+	sched_wait(SCHED_EV_POST, WEB_POLL_US);
+}
+#endif
+
+
 static void loop_task(os_event_t *events)
 {
-    g_micros_at_task_start = system_get_time();
-    cont_run(&g_cont, &loop_wrapper);
-    if(cont_check(&g_cont) != 0)
-    {
-        printf("\nsketch stack overflow detected\n");
-        abort();
-    }
+    if(sched_run())
+        loop_post();
 }
 
 
@@ -166,7 +189,13 @@ void user_init(void)
         setup_done = true;
     }
 
-    cont_init(&g_cont);
+    sched_busy(spi_busy);
+#ifdef WEBSERVER
+    if(!sched_add("web", web_wrapper, WEB_STACKSIZE))
+        abort();
+#endif
+    if(!sched_add("loop", loop_wrapper, LOOP_STACKSIZE))
+        abort();
 
     system_os_task(loop_task,
         LOOP_TASK_PRIORITY, g_loop_queue,
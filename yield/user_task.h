@@ -9,6 +9,7 @@ void esp_schedule ( void );
 //void __yield ( void );
 void yield ( void );
 void loop_wrapper ( void );
+void web_wrapper ( void );
 void init_done ( void );
 void user_init ( void );
 